@@ -28,10 +28,20 @@
 #include "Framework.h"
 #include <locale>
 #include <codecvt>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
 
 namespace
 {
     HWND gWinHandle = nullptr;
+    bool gHeadless = false;
+    typedef std::chrono::high_resolution_clock Clock;
+
+    float secondsBetween(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<float>(end - start).count();
+    }
 
     static LRESULT CALLBACK msgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     {
@@ -94,6 +104,8 @@ namespace
     void msgLoop(Tutorial& tutorial)
     {
         MSG msg;
+        Clock::time_point lastFrame = Clock::now();
+        float elapsedTime = 0;
         while (1)
         {
             if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
@@ -104,10 +116,27 @@ namespace
             }
             else
             {
-                tutorial.onFrameRender();
+                tutorial.onFrameRender(elapsedTime);
+                Clock::time_point now = Clock::now();
+                elapsedTime = secondsBetween(lastFrame, now);
+                lastFrame = now;
             }
         }
     }
+
+    // frameTimes is in seconds and gets sorted
+    void printFrameStats(std::vector<float>& frameTimes, float loadTime)
+    {
+        if (frameTimes.empty()) return;
+        double total = 0;
+        for (float t : frameTimes) total += t;
+        std::sort(frameTimes.begin(), frameTimes.end());
+        auto percentile = [&](double p) { return 1000.0 * frameTimes[std::min(frameTimes.size() - 1, size_t(p * frameTimes.size()))]; };
+
+        printf("Load %.3f sec. %zu frames in %.3f sec, %.1f frames/sec\n", loadTime, frameTimes.size(), total, double(frameTimes.size()) / total);
+        printf("Frame time in ms: average %.3f, min %.3f, median %.3f, 95%% %.3f, 99%% %.3f, max %.3f\n", 1000.0 * total / double(frameTimes.size()),
+            1000.0 * frameTimes.front(), percentile(0.5), percentile(0.95), percentile(0.99), 1000.0 * frameTimes.back());
+    }
 };
 
 std::wstring string_2_wstring(const std::string& s)
@@ -126,6 +155,12 @@ std::string wstring_2_string(const std::wstring& ws)
 
 void msgBox(const std::string& msg)
 {
+    if (gHeadless)
+    {
+        // Nobody is there to close the message-box
+        fprintf(stderr, "Error: %s\n", msg.c_str());
+        return;
+    }
     MessageBoxA(gWinHandle, msg.c_str(), "Error", MB_OK);
 }
 
@@ -149,7 +184,11 @@ void Framework::run(Tutorial& tutorial, const std::string& winTitle, uint32_t wi
     height = r.bottom - r.top;
 
     // Call onLoad()
-    tutorial.onLoad(gWinHandle, width, height);
+    Surface surface;
+    surface.winHandle = gWinHandle;
+    surface.width = width;
+    surface.height = height;
+    tutorial.onLoad(surface);
     
     // Show the window
     ShowWindow(gWinHandle, SW_SHOWNORMAL);
@@ -160,4 +199,36 @@ void Framework::run(Tutorial& tutorial, const std::string& winTitle, uint32_t wi
     // Cleanup
     tutorial.onShutdown();
     DestroyWindow(gWinHandle);
-}
\ No newline at end of file
+}
+
+void Framework::runHeadless(Tutorial& tutorial, const HeadlessOptions& options, uint32_t width, uint32_t height)
+{
+    gHeadless = true;
+    Surface surface;
+    surface.width = width;
+    surface.height = height;
+
+    Clock::time_point start = Clock::now();
+    tutorial.onLoad(surface);
+    float loadTime = secondsBetween(start, Clock::now());
+
+    // The frame time is the time between the starts of two frames, same as in the windowed loop
+    std::vector<float> frameTimes;
+    frameTimes.reserve(options.frameCount);
+    float elapsedTime = 0;
+    Clock::time_point lastFrame = Clock::now();
+    for (uint32_t frame = 0; frame < options.frameCount; frame++)
+    {
+        tutorial.onFrameRender(elapsedTime);
+        Clock::time_point now = Clock::now();
+        frameTimes.push_back(secondsBetween(lastFrame, now));
+        elapsedTime = (options.timestep > 0) ? options.timestep : frameTimes.back();
+        lastFrame = now;
+    }
+
+    // onShutdown() waits for the GPU, the last frame isn't done before that
+    tutorial.onShutdown();
+    if (frameTimes.empty() == false) frameTimes.back() += secondsBetween(lastFrame, Clock::now());
+
+    printFrameStats(frameTimes, loadTime);
+}
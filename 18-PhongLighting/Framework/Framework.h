@@ -45,6 +45,7 @@
 #include "Externals/DXCAPI/dxcapi.use.h"
 #include <vector>
 #include <array>
+#include "JobSystem.h"
 
 using namespace glm;
 
@@ -59,6 +60,7 @@ MAKE_SMART_COM_PTR(IDXGIAdapter1);
 MAKE_SMART_COM_PTR(ID3D12Fence);
 MAKE_SMART_COM_PTR(ID3D12CommandAllocator);
 MAKE_SMART_COM_PTR(ID3D12Resource);
+MAKE_SMART_COM_PTR(ID3D12Heap);
 MAKE_SMART_COM_PTR(ID3D12DescriptorHeap);
 MAKE_SMART_COM_PTR(ID3D12Debug);
 MAKE_SMART_COM_PTR(ID3D12StateObject);
@@ -66,20 +68,38 @@ MAKE_SMART_COM_PTR(ID3D12RootSignature);
 MAKE_SMART_COM_PTR(ID3DBlob);
 MAKE_SMART_COM_PTR(IDxcBlobEncoding);
 
+// What the tutorial renders to. Headless runs don't have a window, so the tutorial has to render to offscreen buffers instead of a swap-chain
+struct Surface
+{
+    HWND winHandle = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool isHeadless() const { return winHandle == nullptr; }
+};
+
 // Interface for the tutorials
 class Tutorial
 {
 public:
     virtual ~Tutorial() {}
-    virtual void onLoad(HWND winHandle, uint32_t winWidth, uint32_t winHeight) = 0;  // Called when the tutorial loads
-    virtual void onFrameRender() = 0;         // Called each frame
-    virtual void onShutdown() = 0;            // Called when the application shutsdown, before the window is closing
+    virtual void onLoad(const Surface& surface) = 0;    // Called when the tutorial loads
+    virtual void onFrameRender(float elapsedTime) = 0;  // Called each frame. elapsedTime is the time in seconds since the previous frame
+    virtual void onShutdown() = 0;                      // Called when the application shutsdown, before the window is closing
+};
+
+struct HeadlessOptions
+{
+    uint32_t frameCount = 1000;
+    float timestep = 0;         // The elapsedTime of every frame. 0 uses the wall-clock time. The frames are rendered as fast as possible either way
 };
 
 class Framework
 {
 public:
     static void run(Tutorial& tutorial, const std::string& winTitle, uint32_t width = 1920, uint32_t height = 1200);
+
+    // Render a fixed number of frames without a window, then print the frame-time statistics. Errors are printed instead of showing a message-box
+    static void runHeadless(Tutorial& tutorial, const HeadlessOptions& options, uint32_t width = 1920, uint32_t height = 1200);
 };
 
 static const uint32_t kDefaultSwapChainBuffers = 3;
@@ -0,0 +1,275 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "JobSystem.h"
+#include <algorithm>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    // The system the calling thread is a worker thread of, and its index. Worker 0 is recognized by JobSystem::mOwner instead
+    thread_local const JobSystem* tlpSystem = nullptr;
+    thread_local uint32_t tlWorker = 0;
+
+    // Rounds of stealing before an idle worker goes to sleep
+    const uint32_t kSpinCount = 64;
+
+    void pinCurrentThread(uint32_t core)
+    {
+        const uint32_t coreCount = std::max(1u, std::thread::hardware_concurrency());
+#ifdef _WIN32
+        SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (core % std::min(coreCount, 64u)));
+#else
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core % coreCount, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+    }
+}
+
+void JobSystem::Deque::write(int64_t index, const Job& job)
+{
+    Slot& slot = mSlots[index & (kDequeCapacity - 1)];
+    slot.function.store((uintptr_t)job.pFunction, std::memory_order_relaxed);
+    slot.data.store((uintptr_t)job.pData, std::memory_order_relaxed);
+    slot.counter.store((uintptr_t)job.pCounter, std::memory_order_relaxed);
+    slot.range.store(job.begin | (uint64_t(job.end) << 32), std::memory_order_relaxed);
+    slot.grainSize.store(job.grainSize, std::memory_order_relaxed);
+}
+
+JobSystem::Job JobSystem::Deque::read(int64_t index) const
+{
+    const Slot& slot = mSlots[index & (kDequeCapacity - 1)];
+    Job job;
+    job.pFunction = (void (*)(const void*, uint32_t, uint32_t))slot.function.load(std::memory_order_relaxed);
+    job.pData = (const void*)slot.data.load(std::memory_order_relaxed);
+    job.pCounter = (JobCounter*)slot.counter.load(std::memory_order_relaxed);
+    const uint64_t range = slot.range.load(std::memory_order_relaxed);
+    job.begin = (uint32_t)range;
+    job.end = (uint32_t)(range >> 32);
+    job.grainSize = slot.grainSize.load(std::memory_order_relaxed);
+    return job;
+}
+
+// Owner only
+bool JobSystem::Deque::push(const Job& job)
+{
+    const int64_t bottom = mBottom.load(std::memory_order_relaxed);
+    const int64_t top = mTop.load(std::memory_order_acquire);
+    if (bottom - top >= (int64_t)kDequeCapacity) return false;
+    write(bottom, job);
+    // Publishes the slot, and what the job reads, to the thieves
+    mBottom.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+// Owner only
+bool JobSystem::Deque::pop(Job& job)
+{
+    const int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+    mBottom.store(bottom, std::memory_order_seq_cst);
+    int64_t top = mTop.load(std::memory_order_seq_cst);
+    if (top > bottom)
+    {
+        // Empty
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+    job = read(bottom);
+    if (top < bottom) return true;
+
+    // The last job. The thieves may be after it too, whoever moves top gets it
+    const bool won = mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    mBottom.store(bottom + 1, std::memory_order_relaxed);
+    return won;
+}
+
+bool JobSystem::Deque::steal(Job& job)
+{
+    int64_t top = mTop.load(std::memory_order_seq_cst);
+    const int64_t bottom = mBottom.load(std::memory_order_seq_cst);
+    if (top >= bottom) return false;
+    job = read(top);
+    return mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+JobSystem::JobSystem(uint32_t threadCount, bool pinThreads) : mOwner(std::this_thread::get_id())
+{
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t i = 0; i < threadCount; i++) mWorkers.push_back(std::unique_ptr<Deque>(new Deque));
+    for (uint32_t i = 1; i < threadCount; i++) mThreads.push_back(std::thread(&JobSystem::workerLoop, this, i, pinThreads));
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mQuit = true;
+    }
+    mWake.notify_all();
+    for (std::thread& thread : mThreads) thread.join();
+}
+
+uint32_t JobSystem::getWorkerIndex() const
+{
+    if (tlpSystem == this) return tlWorker;
+    return (std::this_thread::get_id() == mOwner) ? 0 : getThreadCount();
+}
+
+void JobSystem::push(const Job& job)
+{
+    job.pCounter->mCount.fetch_add(1, std::memory_order_relaxed);
+    const uint32_t worker = getWorkerIndex();
+    if (worker == getThreadCount() || mWorkers[worker]->push(job) == false)
+    {
+        // Not a worker, or its deque is full
+        execute(job, worker);
+        return;
+    }
+    wakeWorkers();
+}
+
+void JobSystem::wakeWorkers()
+{
+    // The epoch goes up before the sleepers are counted, and a worker counts itself before it checks the epoch, so either the worker sees
+    // the new epoch or this sees the worker
+    mWakeEpoch.fetch_add(1, std::memory_order_seq_cst);
+    if (mSleeping.load(std::memory_order_seq_cst))
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mWake.notify_all();
+    }
+}
+
+void JobSystem::execute(Job job, uint32_t worker)
+{
+    // Split off the upper halves for the other workers until the job is a single grain
+    if (worker < getThreadCount())
+    {
+        bool pushed = false;
+        while (job.end - job.begin > job.grainSize)
+        {
+            Job upper = job;
+            upper.begin = job.begin + (job.end - job.begin) / 2;
+            job.end = upper.begin;
+            upper.pCounter->mCount.fetch_add(1, std::memory_order_relaxed);
+            if (mWorkers[worker]->push(upper))
+            {
+                pushed = true;
+            }
+            else
+            {
+                execute(upper, worker);
+            }
+        }
+        if (pushed) wakeWorkers();
+        job.pFunction(job.pData, job.begin, job.end);
+    }
+    else
+    {
+        for (uint32_t begin = job.begin; begin < job.end; begin += std::min(job.grainSize, job.end - begin))
+        {
+            job.pFunction(job.pData, begin, begin + std::min(job.grainSize, job.end - begin));
+        }
+    }
+    // Releases what the job wrote to the thread that waits for the counter
+    job.pCounter->mCount.fetch_sub(1, std::memory_order_release);
+}
+
+bool JobSystem::findJob(uint32_t worker, Job& job)
+{
+    if (mWorkers[worker]->pop(job)) return true;
+
+    // Try the others, starting after this one so the thieves spread out
+    const uint32_t count = getThreadCount();
+    for (uint32_t i = 1; i < count; i++)
+    {
+        if (mWorkers[(worker + i) % count]->steal(job)) return true;
+    }
+    return false;
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    const uint32_t worker = getWorkerIndex();
+    while (counter.isDone() == false)
+    {
+        // Jobs run on the worker they were pushed from. A thread that isn't a worker ran them in push()
+        Job job;
+        if (worker < getThreadCount() && findJob(worker, job)) execute(job, worker);
+        else std::this_thread::yield();
+    }
+}
+
+bool JobSystem::runPendingJob()
+{
+    const uint32_t worker = getWorkerIndex();
+    Job job;
+    if (worker == getThreadCount() || findJob(worker, job) == false) return false;
+    execute(job, worker);
+    return true;
+}
+
+void JobSystem::workerLoop(uint32_t worker, bool pin)
+{
+    tlpSystem = this;
+    tlWorker = worker;
+    if (pin) pinCurrentThread(worker);
+
+    uint32_t idleRounds = 0;
+    while (mQuit.load(std::memory_order_relaxed) == false)
+    {
+        const uint32_t epoch = mWakeEpoch.load(std::memory_order_seq_cst);
+        Job job;
+        if (findJob(worker, job))
+        {
+            execute(job, worker);
+            idleRounds = 0;
+            continue;
+        }
+        if (++idleRounds < kSpinCount)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Nothing to steal for a while. Sleep until a push changes the epoch
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleeping.fetch_add(1, std::memory_order_seq_cst);
+        if (mWakeEpoch.load(std::memory_order_seq_cst) == epoch && mQuit == false) mWake.wait_for(lock, std::chrono::milliseconds(1));
+        mSleeping.fetch_sub(1, std::memory_order_seq_cst);
+        idleRounds = 0;
+    }
+}
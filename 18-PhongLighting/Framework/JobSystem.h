@@ -0,0 +1,150 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the unfinished jobs of a fork/join. JobSystem::wait() returns once it's zero
+class JobCounter
+{
+public:
+    JobCounter() : mCount(0) {}
+    bool isDone() const { return mCount.load(std::memory_order_acquire) == 0; }
+private:
+    friend class JobSystem;
+    std::atomic<uint32_t> mCount;
+};
+
+/** A work-stealing job system.
+    Every worker owns a Chase-Lev deque. It pushes and pops jobs at the bottom without locks, and idle workers steal from the top of the deques
+    of the others. The thread that creates the system is worker 0 and only runs jobs while it waits for a counter, the others are threads of
+    their own. A thread can be worker 0 of several systems. A job that covers more than its grain size pushes its upper half before it runs, so a parallelFor() spreads over the workers
+    in log(count / grainSize) steps, and the stolen halves are the large ones.
+    Jobs can be run from any worker, including from inside a job. Other threads run them right away, on the calling thread.
+*/
+class JobSystem
+{
+public:
+    static const uint32_t kDequeCapacity = 4096;    // Per worker, a power of 2. When the deque is full the job runs right away
+
+    // threadCount includes the calling thread, 0 uses all the cores. pinThreads binds worker i to core i, the calling thread isn't moved
+    explicit JobSystem(uint32_t threadCount = 0, bool pinThreads = true);
+    // Waits for the workers to exit. The jobs must be done
+    ~JobSystem();
+
+    uint32_t getThreadCount() const { return (uint32_t)mWorkers.size(); }
+    // The worker the calling thread is, or getThreadCount() if it isn't one of them
+    uint32_t getWorkerIndex() const;
+
+    // Forks job. job must live until wait(counter) returns
+    template<typename Function>
+    void run(JobCounter& counter, const Function& job)
+    {
+        push({ &callJob<Function>, (const void*)&job, &counter, 0, 1, 1 });
+    }
+
+    // Runs jobs, the ones of the counter or any other, until the counter is zero
+    void wait(JobCounter& counter);
+
+    // Runs one job of any counter on the calling worker. Returns false if there wasn't one, or the calling thread isn't a worker
+    bool runPendingJob();
+
+    // Calls body(begin, end) for ranges of at most grainSize elements that cover [0, count) once, and waits for them
+    template<typename Body>
+    void parallelFor(uint32_t count, uint32_t grainSize, const Body& body)
+    {
+        if (count == 0) return;
+        JobCounter counter;
+        push({ &callRange<Body>, (const void*)&body, &counter, 0, count, grainSize ? grainSize : 1 });
+        wait(counter);
+    }
+
+private:
+    struct Job
+    {
+        void (*pFunction)(const void* pData, uint32_t begin, uint32_t end);
+        const void* pData;
+        JobCounter* pCounter;
+        uint32_t begin;
+        uint32_t end;
+        uint32_t grainSize;
+    };
+
+    // Chase-Lev deque with a fixed capacity. The slots are atomics, so a thief can read a slot the owner overwrites, its CAS on top fails then
+    class Deque
+    {
+    public:
+        bool push(const Job& job);
+        bool pop(Job& job);
+        bool steal(Job& job);
+    private:
+        struct Slot
+        {
+            std::atomic<uintptr_t> function;
+            std::atomic<uintptr_t> data;
+            std::atomic<uintptr_t> counter;
+            std::atomic<uint64_t> range;       // begin | end << 32
+            std::atomic<uint32_t> grainSize;
+        };
+        void write(int64_t index, const Job& job);
+        Job read(int64_t index) const;
+
+        // top and bottom on cache lines of their own. The thieves write top, the owner bottom
+        std::atomic<int64_t> mTop{ 0 };
+        uint8_t mPadding0[64];
+        std::atomic<int64_t> mBottom{ 0 };
+        uint8_t mPadding1[64];
+        Slot mSlots[kDequeCapacity];
+    };
+
+    template<typename Function>
+    static void callJob(const void* pData, uint32_t, uint32_t) { (*(const Function*)pData)(); }
+    template<typename Body>
+    static void callRange(const void* pData, uint32_t begin, uint32_t end) { (*(const Body*)pData)(begin, end); }
+
+    void push(const Job& job);
+    void wakeWorkers();
+    void execute(Job job, uint32_t worker);
+    bool findJob(uint32_t worker, Job& job);
+    void workerLoop(uint32_t worker, bool pin);
+
+    std::vector<std::unique_ptr<Deque>> mWorkers;
+    std::vector<std::thread> mThreads;
+    std::thread::id mOwner;                 // Worker 0. Kept per system, the same thread can create several
+    std::atomic<bool> mQuit{ false };
+    // Idle workers sleep until a push changes the epoch
+    std::atomic<uint32_t> mWakeEpoch{ 0 };
+    std::atomic<uint32_t> mSleeping{ 0 };
+    std::mutex mSleepMutex;
+    std::condition_variable mWake;
+};
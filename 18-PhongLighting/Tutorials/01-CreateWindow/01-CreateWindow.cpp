@@ -26,34 +26,16 @@
 # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 ***************************************************************************/
 #include "01-CreateWindow.h"
-
-// 2.1 createDxgiSwapChain
-IDXGISwapChain3Ptr createDxgiSwapChain(IDXGIFactory4Ptr pFactory, HWND hwnd, uint32_t width, uint32_t height, DXGI_FORMAT format, ID3D12CommandQueuePtr pCommandQueue)
-{
-    DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-    swapChainDesc.BufferCount = kDefaultSwapChainBuffers;
-    swapChainDesc.Width = width;
-    swapChainDesc.Height = height;
-    swapChainDesc.Format = format;
-    swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-    swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    swapChainDesc.SampleDesc.Count = 1;
-
-    // CreateSwapChainForHwnd() doesn't accept IDXGISwapChain3 (Why MS? Why?)
-    MAKE_SMART_COM_PTR(IDXGISwapChain1);
-    IDXGISwapChain1Ptr pSwapChain;
-
-    HRESULT hr = pFactory->CreateSwapChainForHwnd(pCommandQueue, hwnd, &swapChainDesc, nullptr, nullptr, &pSwapChain);
-    if (FAILED(hr))
-    {
-        d3dTraceHR("Failed to create the swap-chain", hr);
-        return false;
-    }
-
-    IDXGISwapChain3Ptr pSwapChain3;
-    d3d_call(pSwapChain->QueryInterface(IID_PPV_ARGS(&pSwapChain3)));
-    return pSwapChain3;
-}
+#include "CpuRaytracer.h"
+#include "Benchmarks.h"
+#include "ShaderCache.h"
+#include "PackedVertex.h"
+#include "TaskGraph.h"
+#include <algorithm>
+#include <deque>
+#include <float.h>
+#include <map>
+#include <mutex>
 
 // 2.2 createDevice
 ID3D12Device5Ptr createDevice(IDXGIFactory4Ptr pDxgiFactory)
@@ -93,53 +75,72 @@ ID3D12Device5Ptr createDevice(IDXGIFactory4Ptr pDxgiFactory)
 }
 
 // 2.3 createCommandQueue
-ID3D12CommandQueuePtr createCommandQueue(ID3D12Device5Ptr pDevice)
+ID3D12CommandQueuePtr createCommandQueue(ID3D12Device5Ptr pDevice, D3D12_COMMAND_LIST_TYPE type = D3D12_COMMAND_LIST_TYPE_DIRECT)
 {
     ID3D12CommandQueuePtr pQueue;
     D3D12_COMMAND_QUEUE_DESC cqDesc = {};
     cqDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
-    cqDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+    cqDesc.Type = type;
     d3d_call(pDevice->CreateCommandQueue(&cqDesc, IID_PPV_ARGS(&pQueue)));
     return pQueue;
 }
 
-// 2.4 createDescriptorHeap
-ID3D12DescriptorHeapPtr createDescriptorHeap(ID3D12Device5Ptr pDevice, uint32_t count, D3D12_DESCRIPTOR_HEAP_TYPE type, bool shaderVisible)
-{
-    D3D12_DESCRIPTOR_HEAP_DESC desc = {};
-    desc.NumDescriptors = count;
-    desc.Type = type;
-    desc.Flags = shaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-
-    ID3D12DescriptorHeapPtr pHeap;
-    d3d_call(pDevice->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&pHeap)));
-    return pHeap;
-}
-
 // 2.5 createRTV
-D3D12_CPU_DESCRIPTOR_HANDLE createRTV(ID3D12Device5Ptr pDevice, ID3D12ResourcePtr pResource, ID3D12DescriptorHeapPtr pHeap, uint32_t& usedHeapEntries, DXGI_FORMAT format)
+D3D12_CPU_DESCRIPTOR_HANDLE createRTV(ID3D12Device5Ptr pDevice, ID3D12ResourcePtr pResource, D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle, DXGI_FORMAT format)
 {
     D3D12_RENDER_TARGET_VIEW_DESC desc = {};
     desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
     desc.Format = format;
     desc.Texture2D.MipSlice = 0;
-    D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = pHeap->GetCPUDescriptorHandleForHeapStart();
-    rtvHandle.ptr += usedHeapEntries * pDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-    usedHeapEntries++;
     pDevice->CreateRenderTargetView(pResource, &desc, rtvHandle);
     return rtvHandle;
 }
 
-// 2.6 resourceBarrier
-void resourceBarrier(ID3D12GraphicsCommandList4Ptr pCmdList, ID3D12ResourcePtr pResource, D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter)
+// 2.6 The ResourceStateTracker knows a resource by its pointer
+uint64_t getResourceHandle(ID3D12ResourcePtr pResource)
+{
+    return (uint64_t)(uintptr_t)pResource.GetInterfacePtr();
+}
+
+// 2.6.a Records the barriers of a ResourceStateTracker in a single ResourceBarrier() call
+void recordBarriers(ID3D12GraphicsCommandList4Ptr pCmdList, const std::vector<ResourceBarrier>& barriers)
 {
-    D3D12_RESOURCE_BARRIER barrier = {};
-    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barrier.Transition.pResource = pResource;
-    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-    barrier.Transition.StateBefore = stateBefore;
-    barrier.Transition.StateAfter = stateAfter;
-    pCmdList->ResourceBarrier(1, &barrier);
+    if (barriers.empty()) return;
+    std::vector<D3D12_RESOURCE_BARRIER> d3dBarriers(barriers.size());
+    for (size_t i = 0; i < barriers.size(); i++)
+    {
+        const ResourceBarrier& b = barriers[i];
+        ID3D12Resource* pResource = reinterpret_cast<ID3D12Resource*>((uintptr_t)b.resource);
+        D3D12_RESOURCE_BARRIER& barrier = d3dBarriers[i];
+        if (b.type == ResourceBarrier::Type::Uav)
+        {
+            barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+            barrier.UAV.pResource = pResource;
+        }
+        else if (b.type == ResourceBarrier::Type::Aliasing)
+        {
+            barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+            barrier.Aliasing.pResourceBefore = nullptr;
+            barrier.Aliasing.pResourceAfter = pResource;
+        }
+        else
+        {
+            barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+            barrier.Transition.pResource = pResource;
+            barrier.Transition.Subresource = b.subresource;
+            barrier.Transition.StateBefore = (D3D12_RESOURCE_STATES)b.stateBefore;
+            barrier.Transition.StateAfter = (D3D12_RESOURCE_STATES)b.stateAfter;
+        }
+    }
+    pCmdList->ResourceBarrier((uint32_t)d3dBarriers.size(), d3dBarriers.data());
+}
+
+// 2.6.b The barriers the states required since the last flush need, before the commands that use them
+void flushBarriers(ID3D12GraphicsCommandList4Ptr pCmdList, CommandListStates& states)
+{
+    std::vector<ResourceBarrier> barriers;
+    states.flush(barriers);
+    recordBarriers(pCmdList, barriers);
 }
 
 // 2.7 submitCommandList
@@ -153,11 +154,124 @@ uint64_t submitCommandList(ID3D12GraphicsCommandList4Ptr pCmdList, ID3D12Command
     return fenceValue;
 }
 
+/** 2.7.a CommandListPool on D3D12, for the lists of one queue.
+    Every list has a command allocator of its own. The pool creates them under its lock while other threads look up the lists they acquired,
+    so the lookup takes a lock too.
+    Every list has the CommandListStates of the resources it uses. The states the lists expect are resolved in execution order when they're
+    submitted, and the barriers a list needs before it starts go to the end of the list before it. The first list of a batch gets a second
+    list on its allocator for them, recorded after it's closed.
+*/
+class D3D12CommandListBackend : public CommandListBackend
+{
+public:
+    D3D12CommandListBackend(ID3D12Device5Ptr pDevice, ID3D12CommandQueuePtr pQueue, D3D12_COMMAND_LIST_TYPE type, ResourceStateTracker& tracker)
+        : mpDevice(pDevice), mpQueue(pQueue), mType(type), mTracker(tracker) {}
+
+    uint32_t createList() override
+    {
+        Entry entry;
+        d3d_call(mpDevice->CreateCommandAllocator(mType, IID_PPV_ARGS(&entry.pAllocator)));
+        d3d_call(mpDevice->CreateCommandList(0, mType, entry.pAllocator, nullptr, IID_PPV_ARGS(&entry.pList)));
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStates.emplace_back(mTracker);
+        entry.pStates = &mStates.back();
+        mEntries.push_back(entry);
+        return (uint32_t)mEntries.size() - 1;
+    }
+
+    void resetList(uint32_t list) override
+    {
+        Entry entry = getEntry(list);
+        d3d_call(entry.pAllocator->Reset());
+        d3d_call(entry.pList->Reset(entry.pAllocator, nullptr));
+        entry.pStates->reset();
+    }
+
+    void prepareLists(const uint32_t* pLists, uint32_t count) override
+    {
+        mFirstBarriers.clear();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            std::vector<ResourceBarrier> barriers;
+            mTracker.resolve(*getEntry(pLists[i]).pStates, barriers);
+            if (i == 0) mFirstBarriers = barriers;
+            else recordBarriers(getEntry(pLists[i - 1]).pList, barriers);
+        }
+    }
+
+    void closeList(uint32_t list) override
+    {
+        d3d_call(getEntry(list).pList->Close());
+    }
+
+    void executeLists(const uint32_t* pLists, uint32_t count) override
+    {
+        // mEntries holds a reference to every list
+        std::vector<ID3D12CommandList*> lists;
+        if (mFirstBarriers.size())
+        {
+            // The first list is closed, so its allocator can record the barriers
+            Entry first = getEntry(pLists[0]);
+            if (first.pBarrierList)
+            {
+                d3d_call(first.pBarrierList->Reset(first.pAllocator, nullptr));
+            }
+            else
+            {
+                d3d_call(mpDevice->CreateCommandList(0, mType, first.pAllocator, nullptr, IID_PPV_ARGS(&first.pBarrierList)));
+                std::lock_guard<std::mutex> lock(mMutex);
+                mEntries[pLists[0]].pBarrierList = first.pBarrierList;
+            }
+            recordBarriers(first.pBarrierList, mFirstBarriers);
+            d3d_call(first.pBarrierList->Close());
+            lists.push_back(first.pBarrierList.GetInterfacePtr());
+        }
+        for (uint32_t i = 0; i < count; i++) lists.push_back(getEntry(pLists[i]).pList.GetInterfacePtr());
+        mpQueue->ExecuteCommandLists((uint32_t)lists.size(), lists.data());
+    }
+
+    TrackedCommandList getList(uint32_t list)
+    {
+        Entry entry = getEntry(list);
+        return { entry.pList, entry.pStates };
+    }
+
+private:
+    struct Entry
+    {
+        ID3D12CommandAllocatorPtr pAllocator;
+        ID3D12GraphicsCommandList4Ptr pList;
+        ID3D12GraphicsCommandList4Ptr pBarrierList;    // Created the first time the list is the first of a batch and needs barriers
+        CommandListStates* pStates = nullptr;
+    };
+
+    Entry getEntry(uint32_t list)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mEntries[list];
+    }
+
+    ID3D12Device5Ptr mpDevice;
+    ID3D12CommandQueuePtr mpQueue;
+    D3D12_COMMAND_LIST_TYPE mType;
+    ResourceStateTracker& mTracker;
+    std::mutex mMutex;
+    std::vector<Entry> mEntries;
+    std::deque<CommandListStates> mStates;          // A deque, the entries point to them
+    std::vector<ResourceBarrier> mFirstBarriers;    // prepareLists() to executeLists(), on the thread that submits
+};
+
+// 2.7.b The order of the lists in a submission. The BLAS builds and the TLAS update go to the compute queue, the BLAS builds in chunks,
+// kBlasBuildListOrder + the chunk index. The others go to the direct queue, the passes of the frame graph kGraphListOrder + their position
+static const uint32_t kBlasBuildListOrder = 0;
+static const uint32_t kTlasListOrder = 0x10000000;
+static const uint32_t kGraphListOrder = 0;
+static const uint32_t kPresentListOrder = 0x10000000;
+
 // 2.8 initDXR
-void Tutorial01::initDXR(HWND winHandle, uint32_t winWidth, uint32_t winHeight)
+void Tutorial01::initDXR(const Surface& surface)
 {
-    mHwnd = winHandle;
-    mSwapChainSize = uvec2(winWidth, winHeight);
+    mSwapChainSize = uvec2(surface.width, surface.height);
 
     // Initialize the debug layer for debug builds
 #ifdef _DEBUG
@@ -172,58 +286,119 @@ void Tutorial01::initDXR(HWND winHandle, uint32_t winWidth, uint32_t winHeight)
     d3d_call(CreateDXGIFactory1(IID_PPV_ARGS(&pDxgiFactory)));
     mpDevice = createDevice(pDxgiFactory);
     mpCmdQueue = createCommandQueue(mpDevice);
-    mpSwapChain = createDxgiSwapChain(pDxgiFactory, mHwnd, winWidth, winHeight, DXGI_FORMAT_R8G8B8A8_UNORM, mpCmdQueue);
+    // 2.3.a The acceleration-structure builds run on a compute queue, so the next frame's TLAS update overlaps the trace of this one
+    mpComputeQueue = createCommandQueue(mpDevice, D3D12_COMMAND_LIST_TYPE_COMPUTE);
+    // 2.1 Without a window we render to offscreen buffers, everything else is the same
+    mHeadless = surface.isHeadless();
+    if (mHeadless)
+    {
+        mpPresenter.reset(new OffscreenPresenter(mpDevice, surface.width, surface.height, DXGI_FORMAT_R8G8B8A8_TYPELESS));
+    }
+    else
+    {
+        mpPresenter.reset(new SwapChainPresenter(pDxgiFactory, surface.winHandle, surface.width, surface.height, DXGI_FORMAT_R8G8B8A8_UNORM, mpCmdQueue));
+    }
 
-    // Create a RTV descriptor heap
-    mRtvHeap.pHeap = createDescriptorHeap(mpDevice, kRtvHeapSize, D3D12_DESCRIPTOR_HEAP_TYPE_RTV, false);
+    // 2.4 Create a RTV descriptor heap
+    mRtvHeap.init(mpDevice, D3D12_DESCRIPTOR_HEAP_TYPE_RTV, kDefaultSwapChainBuffers, false);
 
     // Create the per-frame objects
     for (uint32_t i = 0; i < kDefaultSwapChainBuffers; i++)
     {
-        d3d_call(mpDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&mFrameObjects[i].pCmdAllocator)));
-        d3d_call(mpSwapChain->GetBuffer(i, IID_PPV_ARGS(&mFrameObjects[i].pSwapChainBuffer)));
-        mFrameObjects[i].rtvHandle = createRTV(mpDevice, mFrameObjects[i].pSwapChainBuffer, mRtvHeap.pHeap, mRtvHeap.usedEntries, DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+        mFrameObjects[i].pSwapChainBuffer = mpPresenter->getBuffer(i);
+        mFrameObjects[i].rtvHandle = createRTV(mpDevice, mFrameObjects[i].pSwapChainBuffer, mRtvHeap.allocatePersistent(1).cpuHandle, DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+        mResourceStates.addResource(getResourceHandle(mFrameObjects[i].pSwapChainBuffer), 1, D3D12_RESOURCE_STATE_PRESENT);
     }
 
-    // Create the command-list
-    d3d_call(mpDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, mFrameObjects[0].pCmdAllocator, nullptr, IID_PPV_ARGS(&mpCmdList)));
-
-    // Create a fence and the event
+    // Create the command-list of onLoad(), and the pool the frames record from. The pool creates a list and an allocator per thread that records
+    d3d_call(mpDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&mpCmdAllocator)));
+    d3d_call(mpDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, mpCmdAllocator, nullptr, IID_PPV_ARGS(&mpCmdList)));
+    mpLoadStates.reset(new CommandListStates(mResourceStates));
+    mpCommandListBackend.reset(new D3D12CommandListBackend(mpDevice, mpCmdQueue, D3D12_COMMAND_LIST_TYPE_DIRECT, mResourceStates));
+    mpCommandLists.reset(new CommandListPool(*mpCommandListBackend, kDefaultSwapChainBuffers));
+    // The compute lists only use the resources of the acceleration-structure builds, the direct queue waits for them before it uses those
+    mpComputeListBackend.reset(new D3D12CommandListBackend(mpDevice, mpComputeQueue, D3D12_COMMAND_LIST_TYPE_COMPUTE, mResourceStates));
+    mpComputeLists.reset(new CommandListPool(*mpComputeListBackend, kDefaultSwapChainBuffers));
+
+    // Create a fence and the event. The compute queue has a fence of its own, the direct queue waits for it
     d3d_call(mpDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mpFence)));
+    d3d_call(mpDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mpComputeFence)));
     mFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+
+    // The upload heap pages are created on demand
+    mUploadHeap.init(mpDevice);
+    mFramePacer.reset(kDefaultSwapChainBuffers);
+    mGpuProfiler.init(mpDevice, mpCmdQueue, &mProfiler);
+    mComputeProfilerQueue = mGpuProfiler.addQueue(mpComputeQueue);
 }
 
 // 2.9 beginFrame
 uint32_t Tutorial01::beginFrame()
 {
-    // 6.5 Bind the descriptor heaps
-    ID3D12DescriptorHeap* heaps[] = { mpSrvUavHeap };
-    mpCmdList->SetDescriptorHeaps(arraysize(heaps), heaps);
-    return mpSwapChain->GetCurrentBackBufferIndex();
+    // Reuse the upload blocks and descriptors the GPU is done with
+    uint64_t completedFenceValue = mpFence->GetCompletedValue();
+    mUploadHeap.retire(completedFenceValue);
+    mSrvUavHeap.retire(completedFenceValue);
+    return mpPresenter->getCurrentBufferIndex();
 }
 
 // 2.10 endFrame
 void Tutorial01::endFrame(uint32_t rtvIndex)
 {
-    // 6.6 update before state D3D12_RESOURCE_STATE_COPY_DEST
-    resourceBarrier(mpCmdList, mFrameObjects[rtvIndex].pSwapChainBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT);
-    mFenceValue = submitCommandList(mpCmdList, mpCmdQueue, mpFence, mFenceValue);
-    mpSwapChain->Present(0, 0);
-
-    // Prepare the command list for the next frame
-    uint32_t bufferIndex = mpSwapChain->GetCurrentBackBufferIndex();
+    // 6.6 The back-buffer goes back to present. The other lists of the frame are recorded, so the timestamps can be resolved
+    TrackedCommandList list = acquireCommandList(kPresentListOrder);
+    list.pStates->require(getResourceHandle(mFrameObjects[rtvIndex].pSwapChainBuffer), D3D12_RESOURCE_STATE_PRESENT);
+    flushBarriers(list.pCmdList, *list.pStates);
+    mGpuProfiler.resolve(list.pCmdList, mFramePacer.getFrameIndex());
+
+    // 2.7.c All the lists of the frame in a single ExecuteCommandLists(), in order, once the TLAS update of the frame is done
+    mpCmdQueue->Wait(mpComputeFence, mComputeFenceValue);
+    mpCommandLists->submit();
+    mFenceValue++;
+    mpCmdQueue->Signal(mpFence, mFenceValue);
+    mUploadHeap.endFrame(mFenceValue);
+    mSrvUavHeap.endFrame(mFenceValue);
+    {
+        Profiler::Scope scope(mProfiler, "Present");
+        mpPresenter->present();
+    }
 
-    // 14.3.d Sync. We need to do this because the TLAS resources are not double-buffered and we are going to update them
-    // Make sure we have the new back-buffer is ready
-    //if (mFenceValue > kDefaultSwapChainBuffers)
+    // 14.3.d Sync. The TLAS, the output and the shader table are per-frame, so we only wait for the frame that last used the next slot. That's
+    // mFenceValue - kDefaultSwapChainBuffers + 1, which lets the CPU record while the GPU is still working on the previous frames
+    uint64_t waitValue = mFramePacer.endFrame(mFenceValue);
+    if (mpFence->GetCompletedValue() < waitValue)
     {
-        //mpFence->SetEventOnCompletion(mFenceValue - kDefaultSwapChainBuffers + 1, mFenceEvent);
-        mpFence->SetEventOnCompletion(mFenceValue, mFenceEvent);
+        Profiler::Scope scope(mProfiler, "Fence wait");
+        mpFence->SetEventOnCompletion(waitValue, mFenceEvent);
         WaitForSingleObject(mFenceEvent, INFINITE);
     }
 
-    mFrameObjects[bufferIndex].pCmdAllocator->Reset();
-    mpCmdList->Reset(mFrameObjects[bufferIndex].pCmdAllocator, nullptr);
+    // The GPU is done with the frame that used the next slot, so its timestamps are ready
+    uint32_t frameIndex = mFramePacer.getFrameIndex();
+    mGpuProfiler.collect(frameIndex);
+
+    // The lists and allocators of the slot can be reset for the next frame. The direct queue waited for the compute lists of the slot
+    mpCommandLists->beginFrame(frameIndex);
+    mpComputeLists->beginFrame(frameIndex);
+}
+
+// A list of its own for the calling thread, open until the next submit. Lists with a lower order execute first
+TrackedCommandList Tutorial01::acquireCommandList(uint32_t order)
+{
+    return static_cast<D3D12CommandListBackend*>(mpCommandListBackend.get())->getList(mpCommandLists->acquire(order));
+}
+
+TrackedCommandList Tutorial01::acquireComputeList(uint32_t order)
+{
+    return static_cast<D3D12CommandListBackend*>(mpComputeListBackend.get())->getList(mpComputeLists->acquire(order));
+}
+
+// 2.7.d Starts the compute lists right away. The direct queue waits for mComputeFenceValue before it uses their results
+void Tutorial01::submitComputeLists()
+{
+    if (mpComputeLists->submit() == 0) return;
+    mComputeFenceValue++;
+    mpComputeQueue->Signal(mpComputeFence, mComputeFenceValue);
 }
 
 // 3.1 createBuffer
@@ -247,16 +422,6 @@ ID3D12ResourcePtr createBuffer(ID3D12Device5Ptr pDevice, uint64_t size, D3D12_RE
     return pBuffer;
 }
 
-// 3.2 TriangleVB upload heap props
-static const D3D12_HEAP_PROPERTIES kUploadHeapProps =
-{
-    D3D12_HEAP_TYPE_UPLOAD,
-    D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
-    D3D12_MEMORY_POOL_UNKNOWN,
-    0,
-    0,
-};
-
 // 15.5.a
 //struct TriVertex
 //{
@@ -265,29 +430,13 @@ static const D3D12_HEAP_PROPERTIES kUploadHeapProps =
 //    vec3 normal;
 //};
 
-// 3.3 createTriangleVB
-ID3D12ResourcePtr createTriangleVB(ID3D12Device5Ptr pDevice)
+// 3.3 createSceneBuffer. The scene blobs are already laid out the way the GPU expects them, so each one is a single copy straight from the mapped file
+UploadAllocation createSceneBuffer(UploadHeap& uploadHeap, const void* pSrc, uint64_t size, uint64_t alignment)
 {
-    // 18.1
-    const Tutorial01::VertexPositionNormalTangentTexture vertices[] =
-    {
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(0,          1,  0), vec3(0, 0, -1), vec3(), vec2()),
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(0.866f,  -0.5f, 0), vec3(0, 0, -1), vec3(), vec2()),
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(-0.866f, -0.5f, 0), vec3(0, 0, -1), vec3(), vec2()),
-
-        // Note: 16 also increase vertex count passed to const uint32_t vertexCount[] = { 6, 6 }
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(0,          1,  0), vec3(1, 0, 0), vec3(), vec2()),
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(0,  -0.5f, 0.866f), vec3(1, 0, 0), vec3(), vec2()),
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(0, -0.5f, -0.866f), vec3(1, 0, 0), vec3(), vec2()),
-    };
-
-    // For simplicity, we create the vertex buffer on the upload heap, but that's not required
-    ID3D12ResourcePtr pBuffer = createBuffer(pDevice, sizeof(vertices), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, kUploadHeapProps);
-    uint8_t* pData;
-    pBuffer->Map(0, nullptr, (void**)&pData);
-    memcpy(pData, vertices, sizeof(vertices));
-    pBuffer->Unmap(0, nullptr);
-    return pBuffer;
+    // For simplicity, we keep the buffer on the upload heap, but that's not required
+    UploadAllocation buffer = uploadHeap.allocatePersistent(size, alignment);
+    memcpy(buffer.pData, pSrc, (size_t)size);
+    return buffer;
 }
 
 // 3.4.a bottom-level acceleration structure
@@ -301,226 +450,393 @@ static const D3D12_HEAP_PROPERTIES kDefaultHeapProps =
 };
 
 //11.2.a bottom-level acceleration structure
-Tutorial01::AccelerationStructureBuffers createBottomLevelAS(ID3D12Device5Ptr pDevice, ID3D12GraphicsCommandList4Ptr pCmdList, ID3D12ResourcePtr pVB[], const uint32_t vertexCount[], uint32_t geometryCount)
+std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> createBlasGeometryDescs(const Scene& scene, const SceneBlas& blas, D3D12_GPU_VIRTUAL_ADDRESS vbAddress, uint32_t vertexStride, D3D12_GPU_VIRTUAL_ADDRESS ibAddress)
 {
-    // 11.2.b
+    // 11.2.b One geometry per mesh. The meshes are ranges of the scene vertex and index buffers
+    const uint32_t geometryCount = blas.meshCount;
     std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDesc;
     geomDesc.resize(geometryCount);
 
     for (uint32_t i = 0; i < geometryCount; i++)
     {
+        const SceneMesh& mesh = scene.getMesh(blas.firstMesh + i);
         geomDesc[i].Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-        geomDesc[i].Triangles.VertexBuffer.StartAddress = pVB[i]->GetGPUVirtualAddress();
-        // 18.0
-        geomDesc[i].Triangles.VertexBuffer.StrideInBytes = sizeof(Tutorial01::VertexPositionNormalTangentTexture);
-        geomDesc[i].Triangles.VertexCount = vertexCount[i];
+        // 18.0 Both vertex formats start with the float3 position
+        geomDesc[i].Triangles.VertexBuffer.StrideInBytes = vertexStride;
+        geomDesc[i].Triangles.VertexBuffer.StartAddress = vbAddress + mesh.firstVertex * geomDesc[i].Triangles.VertexBuffer.StrideInBytes;
+        geomDesc[i].Triangles.VertexCount = mesh.vertexCount;
         geomDesc[i].Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+        if (mesh.indexFormat != SceneIndexFormat::None)
+        {
+            geomDesc[i].Triangles.IndexBuffer = ibAddress + mesh.indexOffset;
+            geomDesc[i].Triangles.IndexCount = mesh.indexCount;
+            geomDesc[i].Triangles.IndexFormat = (mesh.indexFormat == SceneIndexFormat::Uint16) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+        }
         geomDesc[i].Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
     }
+    return geomDesc;
+}
 
-    // Get the size requirements for the scratch and AS buffers
-    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
-    inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-    inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
-    // 11.2.c
-    inputs.NumDescs = geometryCount;
-    inputs.pGeometryDescs = geomDesc.data();
-    inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+/** 11.2.c BlasManager on D3D12.
+    The buffers are committed resources, looked up by their GPU address. BlasManager suballocates them, a build() creates one for all its results. Every build writes its compacted size to its own slot of a UAV buffer,
+    and endBuilds() copies the slots to a readback buffer so readCompactedSizes() can map it once the builds ran.
+    recordBuilds() records kBuildsPerList builds to a list of the compute pool, the lists on the job system. The direct queue waits for them
+    before pCmdList, which gets everything else. The states of the size buffer are tracked, loadStates are the states of pCmdList.
+*/
+class D3D12BlasBackend : public BlasBackend
+{
+public:
+    static const uint32_t kBuildsPerList = 256;
 
-    D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
-    pDevice->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+    D3D12BlasBackend(ID3D12Device5Ptr pDevice, ID3D12GraphicsCommandList4Ptr pCmdList, CommandListStates& loadStates, ResourceStateTracker& tracker,
+        D3D12CommandListBackend& lists, CommandListPool& pool, JobSystem& jobs)
+        : mpDevice(pDevice), mpCmdList(pCmdList), mLoadStates(loadStates), mTracker(tracker), mLists(lists), mPool(pool), mJobs(jobs) {}
 
-    // Create the buffers. They need to support UAV, and since we are going to immediately use them, we create them with an unordered-access state
-    Tutorial01::AccelerationStructureBuffers buffers;
-    buffers.pScratch = createBuffer(pDevice, info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, kDefaultHeapProps);
-    buffers.pResult = createBuffer(pDevice, info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, kDefaultHeapProps);
+    // Returns the blasIndex, and the sizes BlasManager::addBlas() needs in info
+    uint32_t addBlas(std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO& info)
+    {
+        mGeomDescs.push_back(std::move(geomDescs));
+        const uint32_t blasIndex = (uint32_t)mGeomDescs.size() - 1;
+        D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = getInputs(blasIndex);
+        mpDevice->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+        return blasIndex;
+    }
 
-    // Create the bottom-level AS
-    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
-    asDesc.Inputs = inputs;
-    asDesc.DestAccelerationStructureData = buffers.pResult->GetGPUVirtualAddress();
-    asDesc.ScratchAccelerationStructureData = buffers.pScratch->GetGPUVirtualAddress();
+    uint64_t createBuffer(uint64_t size, bool scratch) override
+    {
+        ID3D12ResourcePtr pBuffer = ::createBuffer(mpDevice, size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+            scratch ? D3D12_RESOURCE_STATE_UNORDERED_ACCESS : D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, kDefaultHeapProps);
+        const uint64_t address = pBuffer->GetGPUVirtualAddress();
+        mBuffers[address] = pBuffer;
+        return address;
+    }
 
-    pCmdList->BuildRaytracingAccelerationStructure(&asDesc, 0, nullptr);
+    void releaseBuffer(uint64_t address) override
+    {
+        mBuffers.erase(address);
+    }
 
-    // We need to insert a UAV barrier before using the acceleration structures in a raytracing operation
-    D3D12_RESOURCE_BARRIER uavBarrier = {};
-    uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-    uavBarrier.UAV.pResource = buffers.pResult;
-    pCmdList->ResourceBarrier(1, &uavBarrier);
+    void build(uint32_t blasIndex, uint64_t resultAddress, uint64_t scratchAddress) override
+    {
+        if (mSizeSlotCount < mGeomDescs.size()) createSizeBuffers();
+        recordBuild(mpCmdList, blasIndex, resultAddress, scratchAddress);
+    }
 
-    return buffers;
-}
+    void recordBuilds(const BuildCommand* pBuilds, uint32_t count) override
+    {
+        if (mSizeSlotCount < mGeomDescs.size()) createSizeBuffers();
 
-// 14.1.a
-void buildTopLevelAS(ID3D12Device5Ptr pDevice, ID3D12GraphicsCommandList4Ptr pCmdList, ID3D12ResourcePtr pBottomLevelAS[2], uint64_t& tlasSize, float rotation, bool update, Tutorial01::AccelerationStructureBuffers& buffers)
+        // 11.2.e The chunks are recorded in any order, the pool submits their lists in chunk order
+        const uint32_t listCount = (count + kBuildsPerList - 1) / kBuildsPerList;
+        mJobs.parallelFor(listCount, 1, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t list = begin; list < end; list++)
+            {
+                TrackedCommandList tracked = mLists.getList(mPool.acquire(kBlasBuildListOrder + list));
+                tracked.pStates->require(getResourceHandle(mpSizes), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+                flushBarriers(tracked.pCmdList, *tracked.pStates);
+                const uint32_t last = std::min(count, (list + 1) * kBuildsPerList);
+                for (uint32_t i = list * kBuildsPerList; i < last; i++)
+                {
+                    if (pBuilds[i].barrierBefore)
+                    {
+                        // Without a resource it covers every UAV access, the builds and the copies included, also those of the lists submitted before
+                        tracked.pStates->uavBarrier();
+                        flushBarriers(tracked.pCmdList, *tracked.pStates);
+                    }
+                    recordBuild(tracked.pCmdList, pBuilds[i].blasIndex, pBuilds[i].resultAddress, pBuilds[i].scratchAddress);
+                }
+            }
+        });
+    }
+
+    void copyCompacted(uint64_t destAddress, uint64_t sourceAddress) override
+    {
+        mpCmdList->CopyRaytracingAccelerationStructure(destAddress, sourceAddress, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
+    }
+
+    void uavBarrier() override
+    {
+        mLoadStates.uavBarrier();
+        flushBarriers(mpCmdList, mLoadStates);
+    }
+
+    void endBuilds() override
+    {
+        // The size buffer stays a copy source, the lists of the next builds require it as a UAV again
+        mLoadStates.uavBarrier();
+        mLoadStates.require(getResourceHandle(mpSizes), D3D12_RESOURCE_STATE_COPY_SOURCE);
+        flushBarriers(mpCmdList, mLoadStates);
+        mpCmdList->CopyBufferRegion(mpSizesReadback, 0, mpSizes, 0, mSizeSlotCount * sizeof(uint64_t));
+    }
+
+    void readCompactedSizes(std::vector<uint64_t>& sizes) override
+    {
+        sizes.resize(mSizeSlotCount);
+        D3D12_RANGE readRange = { 0, mSizeSlotCount * sizeof(uint64_t) };
+        D3D12_RANGE writeRange = { 0, 0 };
+        void* pData = nullptr;
+        d3d_call(mpSizesReadback->Map(0, &readRange, &pData));
+        memcpy(sizes.data(), pData, (size_t)readRange.End);
+        mpSizesReadback->Unmap(0, &writeRange);
+    }
+
+private:
+    // The size buffers must exist. The recording threads only read the backend
+    void recordBuild(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t blasIndex, uint64_t resultAddress, uint64_t scratchAddress) const
+    {
+        D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
+        asDesc.Inputs = getInputs(blasIndex);
+        asDesc.DestAccelerationStructureData = resultAddress;
+        asDesc.ScratchAccelerationStructureData = scratchAddress;
+
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postbuildInfo = {};
+        postbuildInfo.InfoType = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE;
+        postbuildInfo.DestBuffer = mpSizes->GetGPUVirtualAddress() + blasIndex * sizeof(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC);
+        pCmdList->BuildRaytracingAccelerationStructure(&asDesc, 1, &postbuildInfo);
+    }
+
+    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS getInputs(uint32_t blasIndex) const
+    {
+        D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+        inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+        inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
+        inputs.NumDescs = (uint32_t)mGeomDescs[blasIndex].size();
+        inputs.pGeometryDescs = mGeomDescs[blasIndex].data();
+        inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+        return inputs;
+    }
+
+    // One 8-byte slot per BLAS. The steps of BlasManager don't overlap, so the sizes of earlier builds were already read
+    void createSizeBuffers()
+    {
+        mSizeSlotCount = (uint32_t)mGeomDescs.size();
+        const uint64_t size = mSizeSlotCount * sizeof(uint64_t);
+        if (mpSizes) mTracker.removeResource(getResourceHandle(mpSizes));
+        mpSizes = ::createBuffer(mpDevice, size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, kDefaultHeapProps);
+        mTracker.addResource(getResourceHandle(mpSizes), 1, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        D3D12_HEAP_PROPERTIES readbackHeapProps = {};
+        readbackHeapProps.Type = D3D12_HEAP_TYPE_READBACK;
+        mpSizesReadback = ::createBuffer(mpDevice, size, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, readbackHeapProps);
+    }
+
+    ID3D12Device5Ptr mpDevice;
+    ID3D12GraphicsCommandList4Ptr mpCmdList;
+    CommandListStates& mLoadStates;
+    ResourceStateTracker& mTracker;
+    D3D12CommandListBackend& mLists;
+    CommandListPool& mPool;
+    JobSystem& mJobs;
+    std::vector<std::vector<D3D12_RAYTRACING_GEOMETRY_DESC>> mGeomDescs;
+    std::map<uint64_t, ID3D12ResourcePtr> mBuffers;
+    ID3D12ResourcePtr mpSizes;
+    ID3D12ResourcePtr mpSizesReadback;
+    uint32_t mSizeSlotCount = 0;
+};
+
+// 14.1.a buffers is the TLAS of the frame being recorded, pLatest the TLAS of the previous frame. The per-frame TLAS can be up to
+// kDefaultSwapChainBuffers - 1 frames behind, so it's brought up to date even when nothing changed since the last frame. Returns true if
+// the TLAS buffers were created again, the views of the old ones point at freed memory
+bool buildTopLevelAS(ID3D12Device5Ptr pDevice, ID3D12GraphicsCommandList4Ptr pCmdList, CommandListStates& states, UploadHeap& uploadHeap, InstanceTable& instances, uint64_t& tlasSize, Tutorial01::AccelerationStructureBuffers& buffers, const Tutorial01::AccelerationStructureBuffers* pLatest)
 {
+    // Decide between refit and rebuild before flushing the dirty instances, the TLAS model needs to know which ones moved
+    TlasBuildMode mode = instances.chooseBuildMode();
+    const uint32_t instanceCount = instances.getInstanceCount();
+    const bool allocate = (buffers.pResult == nullptr) || (buffers.instanceCount != instanceCount);
+
     // First, get the size of the TLAS buffers and create them
     D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
     inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
     // 14.1.b
     inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
     // 8.0.a 
-    inputs.NumDescs = 3;
+    inputs.NumDescs = instanceCount;
     inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
 
-    D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info;
-    pDevice->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
-
     // 14.1.c
-    if (update)
-    {
-        // If this a request for an update, then the TLAS was already used in a DispatchRay() call. We need a UAV barrier to make sure the read operation ends before updating the buffer
-        D3D12_RESOURCE_BARRIER uavBarrier = {};
-        uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-        uavBarrier.UAV.pResource = buffers.pResult;
-        pCmdList->ResourceBarrier(1, &uavBarrier);
-    }
-    else
+    if (allocate)
     {
-        // Create the buffers
-        buffers.pScratch = createBuffer(pDevice, info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, kDefaultHeapProps);
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info;
+        pDevice->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+
+        // Create the buffers. The same scratch buffer is used for builds and updates
+        uint64_t scratchSize = std::max(info.ScratchDataSizeInBytes, info.UpdateScratchDataSizeInBytes);
+        buffers.pScratch = createBuffer(pDevice, scratchSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, kDefaultHeapProps);
         buffers.pResult = createBuffer(pDevice, info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, kDefaultHeapProps);
-        // The instance desc should be inside a buffer, create and map the buffer
-        // 8.0.b
-        buffers.pInstanceDesc = createBuffer(pDevice, sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * 3, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, kUploadHeapProps);
+        // The instance desc should be inside a buffer. Upload pages stay mapped, the frame's fence was waited on so the GPU isn't reading it
+        // 8.0.b The range of the old instance count is reused once this frame retires
+        uploadHeap.freePersistent(buffers.instanceDesc);
+        buffers.instanceDesc = uploadHeap.allocatePersistent(sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * instanceCount, UploadHeap::kInstanceDescAlignment);
+        buffers.instanceCount = instanceCount;
+        buffers.instanceVersion = 0;
         tlasSize = info.ResultDataMaxSizeInBytes;
+        mode = TlasBuildMode::Build;
+    }
+
+    // 8.0.c 14.1.d Only the instances that changed since this frame's buffer was last written
+    static_assert(sizeof(RaytracingInstanceDesc) == sizeof(D3D12_RAYTRACING_INSTANCE_DESC), "RaytracingInstanceDesc doesn't match D3D12_RAYTRACING_INSTANCE_DESC");
+    const uint64_t version = buffers.instanceVersion;
+    instances.flush((RaytracingInstanceDesc*)buffers.instanceDesc.pData, buffers.instanceVersion);
+    if (mode == TlasBuildMode::None)
+    {
+        // Nothing changed since the last frame. If this TLAS missed the changes of an earlier frame, refit it from the latest one
+        if (version == buffers.instanceVersion) return false;
+        mode = TlasBuildMode::Refit;
     }
 
-    D3D12_RAYTRACING_INSTANCE_DESC* pInstanceDesc;
-    buffers.pInstanceDesc->Map(0, nullptr, (void**)&pInstanceDesc);
-    ZeroMemory(pInstanceDesc, sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * 3);
-
-    // Initialize the instance desc. We only have a single instance
-    pInstanceDesc->InstanceID = 0;                            // This value will be exposed to the shader via InstanceID()
-    pInstanceDesc->InstanceContributionToHitGroupIndex = 0;   // This is the offset inside the shader-table. We only have a single geometry, so the offset 0
-    pInstanceDesc->Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-
-    // 8.0.c
-    mat4 transformation[3];
-    transformation[0] = mat4(); // Identity
-    // 14.1.d
-    mat4 rotationMat = eulerAngleY(rotation);
-    transformation[1] = translate(mat4(), vec3(-2, 0, 0)) * rotationMat;
-    transformation[2] = translate(mat4(), vec3(2, 0, 0)) * rotationMat;
-
-    // 11.3.b Create the desc for the triangle/plane instance
-    pInstanceDesc[0].InstanceID = 0;
-    pInstanceDesc[0].InstanceContributionToHitGroupIndex = 0;
-    pInstanceDesc[0].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-    memcpy(pInstanceDesc[0].Transform, &transformation[0], sizeof(pInstanceDesc[0].Transform));
-    pInstanceDesc[0].AccelerationStructure = pBottomLevelAS[0]->GetGPUVirtualAddress();
-    pInstanceDesc[0].InstanceMask = 0xFF;
-
-    // 8.0.d
-    for (uint32_t i = 1 /*11.3.c*/; i < 3; i++)
-    {
-        pInstanceDesc[i].InstanceID = i; // This value will be exposed to the shader via InstanceID()
-        // 13.3.a
-        pInstanceDesc[i].InstanceContributionToHitGroupIndex = (i * 2) + 2;  // The indices are relative to to the start of the hit-table entries specified in Raytrace(), so we need 4 and 6
-        pInstanceDesc[i].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-        mat4 m = transpose(transformation[i]); // GLM is column major, the INSTANCE_DESC is row major
-        memcpy(pInstanceDesc[i].Transform, &m, sizeof(pInstanceDesc[i].Transform));
-        pInstanceDesc[i].AccelerationStructure = pBottomLevelAS[1]->GetGPUVirtualAddress();
-        pInstanceDesc[i].InstanceMask = 0xFF;
-    }
-
-    // Unmap
-    buffers.pInstanceDesc->Unmap(0, nullptr);
-
-    // Create the TLAS
+    // A refit needs a source built from the same number of instances
+    const bool canRefit = pLatest && (pLatest != &buffers) && pLatest->pResult && (pLatest->instanceCount == instanceCount);
+    if (mode == TlasBuildMode::Refit && canRefit == false) mode = TlasBuildMode::Build;
+
+    // Create the TLAS. This frame's fence was waited on before recording, so the GPU is done with the destination and no barrier is needed
     D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
     asDesc.Inputs = inputs;
-    asDesc.Inputs.InstanceDescs = buffers.pInstanceDesc->GetGPUVirtualAddress();
+    asDesc.Inputs.InstanceDescs = buffers.instanceDesc.gpuAddress;
     asDesc.DestAccelerationStructureData = buffers.pResult->GetGPUVirtualAddress();
     asDesc.ScratchAccelerationStructureData = buffers.pScratch->GetGPUVirtualAddress();
 
-    // 14.1.e If this is an update operation, set the source buffer and the perform_update flag
-    if (update)
+    // 14.1.e If this is an update operation, set the source buffer and the perform_update flag. The source is the previous frame's TLAS
+    if (mode == TlasBuildMode::Refit)
     {
         asDesc.Inputs.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
-        asDesc.SourceAccelerationStructureData = buffers.pResult->GetGPUVirtualAddress();
+        asDesc.SourceAccelerationStructureData = pLatest->pResult->GetGPUVirtualAddress();
     }
 
     pCmdList->BuildRaytracingAccelerationStructure(&asDesc, 0, nullptr);
 
     // We need to insert a UAV barrier before using the acceleration structures in a raytracing operation
-    D3D12_RESOURCE_BARRIER uavBarrier = {};
-    uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-    uavBarrier.UAV.pResource = buffers.pResult;
-    pCmdList->ResourceBarrier(1, &uavBarrier);
+    states.uavBarrier(getResourceHandle(buffers.pResult));
+    flushBarriers(pCmdList, states);
+    return allocate;
 }
 
-// 11.1.c
-ID3D12ResourcePtr createPlaneVB(ID3D12Device5Ptr pDevice)
+// 3.6 createAccelerationStructures()
+// The CPU side of createAccelerationStructures(). It doesn't touch the device, so it runs while initDXR() creates it
+void Tutorial01::prepareScene()
 {
-    // 18.1.b
-    const Tutorial01::VertexPositionNormalTangentTexture vertices[] =
+    // 11.1.d The scene drives everything below. The hit shaders fetch the vertices through the views, so they are validated with the scene
+    std::string error;
+    if (loadScene(mScene, mSceneFile, error) == false || validateSceneGeometry(mScene, getSceneGeometryViews(mScene), error) == false)
     {
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(-100, -1,  -2), vec3(0, 1, 0), vec3(), vec2()),
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(100, -1,  100), vec3(0, 1, 0), vec3(), vec2()),
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(-100, -1,  100), vec3(0, 1, 0), vec3(), vec2()),
-
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(-100, -1,  -2), vec3(0, 1, 0), vec3(), vec2()),
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(100, -1,  -2), vec3(0, 1, 0), vec3(), vec2()),
-        Tutorial01::VertexPositionNormalTangentTexture(vec3(100, -1,  100), vec3(0, 1, 0), vec3(), vec2()),
-    };
+        msgBox(error + "\nUsing the built-in scene instead");
+        loadScene(mScene, std::string(), error);
+    }
+    mGeometryViews = getSceneGeometryViews(mScene);
+    if (mPackedVertices)
+    {
+        mPackedVertexData.resize(mScene.getVertexCount());
+        packVertices(mScene.getVertices(), mScene.getVertexCount(), mPackedVertexData.data());
+    }
 
-    // For simplicity, we create the vertex buffer on the upload heap, but that's not required
-    ID3D12ResourcePtr pBuffer = createBuffer(pDevice, sizeof(vertices), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, kUploadHeapProps);
-    uint8_t* pData;
-    pBuffer->Map(0, nullptr, (void**)&pData);
-    memcpy(pData, vertices, sizeof(vertices));
-    pBuffer->Unmap(0, nullptr);
-    return pBuffer;
+    // The bounds of every BLAS, for the instance culling of the TLAS builds
+    mBlasBounds.resize(mScene.getBlasCount());
+    for (uint32_t i = 0; i < mScene.getBlasCount(); i++)
+    {
+        const SceneBlas& blas = mScene.getBlas(i);
+        mBlasBounds[i].boundsMin = glm::vec3(FLT_MAX);
+        mBlasBounds[i].boundsMax = glm::vec3(-FLT_MAX);
+        for (uint32_t m = blas.firstMesh; m < blas.firstMesh + blas.meshCount; m++)
+        {
+            glm::vec3 meshMin, meshMax;
+            computeBounds(mScene.getVertices() + mScene.getMesh(m).firstVertex, mScene.getMesh(m).vertexCount, meshMin, meshMax);
+            mBlasBounds[i].boundsMin = glm::min(mBlasBounds[i].boundsMin, meshMin);
+            mBlasBounds[i].boundsMax = glm::max(mBlasBounds[i].boundsMax, meshMax);
+        }
+    }
 }
 
-// 3.6 createAccelerationStructures()
 void Tutorial01::createAccelerationStructures()
 {
-    // 11.1.d
-    mpVertexBuffer[0] = createTriangleVB(mpDevice);
-    
-    // 18.1.a
-    //Shape shape = createSphere(2.0f, 32);
-    //const uint32_t sVertexCount = shape.vertexData.size();
-    //UINT size = static_cast<unsigned int>(sizeof(VertexPositionNormalTangentTexture) * sVertexCount);
-    //// For simplicity, we create the vertex buffer on the upload heap, but that's not required
-    //mpVertexBuffer[0] = createBuffer(
-    //    mpDevice, 
-    //    size,
-    //    D3D12_RESOURCE_FLAG_NONE, 
-    //    D3D12_RESOURCE_STATE_GENERIC_READ, 
-    //    kUploadHeapProps);
-    //uint8_t* pData;
-    //mpVertexBuffer[0]->Map(0, nullptr, (void**)&pData);
-    //memcpy(pData, shape.vertexData.data(), size);
-    //mpVertexBuffer[0]->Unmap(0, nullptr);
-
-    // 11.2.d
-    mpVertexBuffer[1] = createPlaneVB(mpDevice);
-    AccelerationStructureBuffers bottomLevelBuffers[2];
-
-    // 16.1.b
-    // The first bottom-level buffer is for the plane and the triangle
-    const uint32_t vertexCount[] = { 6, 6 }; // Triangle has 3 vertices, plane has 6
-    bottomLevelBuffers[0] = createBottomLevelAS(mpDevice, mpCmdList, mpVertexBuffer, vertexCount, 2);
-    mpBottomLevelAS[0] = bottomLevelBuffers[0].pResult;
-
-    // The second bottom-level buffer is for the triangle only
-    bottomLevelBuffers[1] = createBottomLevelAS(mpDevice, mpCmdList, mpVertexBuffer, vertexCount, 1);
-    mpBottomLevelAS[1] = bottomLevelBuffers[1].pResult;
-
-    // 14.3.a Refit the top-level acceleration structure and set update to false
-    buildTopLevelAS(mpDevice, mpCmdList, mpBottomLevelAS, mTlasSize, mRotation, false, mpTopLevelAS);
-    mRotation += 0.005f;
-
-    // The tutorial doesn't have any resource lifetime management, so we flush and sync here. This is not required by the DXR spec - you can submit the list whenever you like as long as you take care of the resources lifetime.
+    // The vertex buffer offset must be a whole number of vertices, the SRV in createShaderResources() addresses it by element
+    if (mPackedVertices)
+    {
+        mVertexStride = sizeof(PackedVertex);
+        mVertexBuffer = createSceneBuffer(mUploadHeap, mPackedVertexData.data(), sizeof(PackedVertex) * mPackedVertexData.size(), sizeof(PackedVertex));
+        mPackedVertexData = std::vector<PackedVertex>();
+    }
+    else
+    {
+        mVertexStride = sizeof(VertexPositionNormalTangentTexture);
+        mVertexBuffer = createSceneBuffer(mUploadHeap, mScene.getVertices(), sizeof(VertexPositionNormalTangentTexture) * mScene.getVertexCount(), sizeof(VertexPositionNormalTangentTexture));
+    }
+    // 17.1.c The index SRV is raw, so it starts at a 16-byte boundary and covers whole words. It needs a buffer even when no mesh is indexed
+    mSceneIndexBuffer = mUploadHeap.allocatePersistent(mGeometryViews.indexElements * sizeof(uint32_t), D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT);
+    memset(mSceneIndexBuffer.pData, 0, mGeometryViews.indexElements * sizeof(uint32_t));
+    if (mScene.getIndexDataSize()) memcpy(mSceneIndexBuffer.pData, mScene.getIndexData(), (size_t)mScene.getIndexDataSize());
+
+    // 16.1.b One BLAS per scene BLAS. The tutorial scene has the triangle and the plane in the first one, and the triangle only in the second one
+    D3D12BlasBackend* pBlasBackend = new D3D12BlasBackend(mpDevice, mpCmdList, *mpLoadStates, mResourceStates, *static_cast<D3D12CommandListBackend*>(mpComputeListBackend.get()),
+        *mpComputeLists, mJobs);
+    mpBlasBackend.reset(pBlasBackend);
+    mpBlasManager.reset(new BlasManager(*pBlasBackend));
+    for (uint32_t i = 0; i < mScene.getBlasCount(); i++)
+    {
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
+        pBlasBackend->addBlas(createBlasGeometryDescs(mScene, mScene.getBlas(i), mVertexBuffer.gpuAddress, mVertexStride, mSceneIndexBuffer.gpuAddress), info);
+        mpBlasManager->addBlas(info.ResultDataMaxSizeInBytes, info.ScratchDataSizeInBytes);
+    }
+    mpBlasManager->build();
+
+    // 11.2.d The compacted sizes are known once the builds ran. The TLAS builds below go after the copies, with the compacted addresses
+    flushCommandList();
+    mpBlasManager->compact();
+    for (uint32_t i = 0; i < mScene.getBlasCount(); i++)
+    {
+        mInstanceTable.setBlas(i, mpBlasManager->getBlas(i).address, mBlasBounds[i].boundsMin, mBlasBounds[i].boundsMax);
+    }
+
+    // 11.3.b 13.3.a The hit-group offsets follow the shader-table layout. The scene computes the same values createShaderTable() gets from ShaderTableBuilder
+    for (uint32_t i = 0; i < mScene.getInstanceCount(); i++)
+    {
+        mInstanceTable.addInstance(mScene.getInstance(i).blasIndex, mScene.getInstanceTransform(i, mRotation), i, mScene.getInstanceContributionToHitGroupIndex(i));
+    }
+
+    // 14.3.a Create the buffers of every frame in flight and do a full build into each of them
+    for (uint32_t i = 0; i < kDefaultSwapChainBuffers; i++)
+    {
+        buildTopLevelAS(mpDevice, mpCmdList, *mpLoadStates, mUploadHeap, mInstanceTable, mTlasSize, mpTopLevelAS[i], nullptr);
+    }
+    mRotation += kRotationPerFrame;
+
+    // The copies ran, only the compacted BLASes are left
+    flushCommandList();
+    mpBlasManager->releaseBuildBuffers();
+    for (uint32_t i = 0; i < mpBlasManager->getBlasCount(); i++)
+    {
+        const BlasManager::BlasInfo& blas = mpBlasManager->getBlas(i);
+        printf("BLAS %u: %llu bytes built, %llu bytes compacted (%.0f%%)\n", i, (unsigned long long)blas.buildSize, (unsigned long long)blas.compactedSize,
+            100.0 * double(blas.compactedSize) / double(blas.buildSize));
+    }
+    const BlasManager::MemoryStats& blasMemory = mpBlasManager->getMemoryStats();
+    printf("BLAS memory: %llu bytes built, %llu bytes compacted, %llu bytes of pooled scratch released, %u buffers, %u scratch reuses\n",
+        (unsigned long long)blasMemory.buildBytes, (unsigned long long)blasMemory.compactedBytes, (unsigned long long)blasMemory.scratchPoolBytes,
+        blasMemory.bufferCount, blasMemory.scratchReuseCount);
+}
+
+// The tutorial doesn't have any resource lifetime management, so we flush and sync here. This is not required by the DXR spec - you can submit the list whenever you like as long as you take care of the resources lifetime.
+// The compute lists go first, the BLAS builds are recorded into them. The barriers the list of onLoad() needs before it starts go to a list of
+// the pool
+void Tutorial01::flushCommandList()
+{
+    submitComputeLists();
+    mpCmdQueue->Wait(mpComputeFence, mComputeFenceValue);
+    mpCommandLists->submit();
+    std::vector<ResourceBarrier> barriers;
+    mResourceStates.resolve(*mpLoadStates, barriers);
+    mpLoadStates->reset();
+    if (barriers.size())
+    {
+        recordBarriers(acquireCommandList(kGraphListOrder).pCmdList, barriers);
+        mpCommandLists->submit();
+    }
     mFenceValue = submitCommandList(mpCmdList, mpCmdQueue, mpFence, mFenceValue);
+    mUploadHeap.endFrame(mFenceValue);
     mpFence->SetEventOnCompletion(mFenceValue, mFenceEvent);
     WaitForSingleObject(mFenceEvent, INFINITE);
-    uint32_t bufferIndex = mpSwapChain->GetCurrentBackBufferIndex();
-    mpCmdList->Reset(mFrameObjects[0].pCmdAllocator, nullptr);
+    mpCmdAllocator->Reset();
+    mpCmdList->Reset(mpCmdAllocator, nullptr);
+    mpCommandLists->beginFrame(mFramePacer.getFrameIndex());
+    mpComputeLists->beginFrame(mFramePacer.getFrameIndex());
 }
 
 // 4.1 Shader-Libraries
@@ -531,57 +847,93 @@ MAKE_SMART_COM_PTR(IDxcLibrary);
 MAKE_SMART_COM_PTR(IDxcBlobEncoding);
 MAKE_SMART_COM_PTR(IDxcOperationResult);
 
-ID3DBlobPtr compileLibrary(const WCHAR* filename, const WCHAR* targetString)
+// dxcompiler behind the ShaderCache. The DLL is only loaded when the cache misses
+class DxcShaderCompiler : public ShaderCompiler
 {
-    // Initialize the helper
-    d3d_call(gDxcDllHelper.Initialize());
-    IDxcCompilerPtr pCompiler;
-    IDxcLibraryPtr pLibrary;
-    d3d_call(gDxcDllHelper.CreateInstance(CLSID_DxcCompiler, &pCompiler));
-    d3d_call(gDxcDllHelper.CreateInstance(CLSID_DxcLibrary, &pLibrary));
-
-    // Open and read the file
-    std::ifstream shaderFile(filename);
-    if (shaderFile.good() == false)
-    {
-        msgBox("Can't open file " + wstring_2_string(std::wstring(filename)));
-        return nullptr;
+public:
+    std::string getVersion() override
+    {
+        // Framework.props copies Externals/dxcompiler/version.txt next to the DLL. Without it, fall back to the size and the timestamp of the DLL
+        std::ifstream versionFile("dxcompiler-version.txt");
+        std::string version;
+        std::getline(versionFile, version);
+        if (version.empty() == false) return version;
+
+        WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+        GetFileAttributesExA("dxcompiler.dll", GetFileExInfoStandard, &attributes);
+        return "dxcompiler.dll " + std::to_string(attributes.nFileSizeLow) + " " + std::to_string(attributes.ftLastWriteTime.dwLowDateTime) + " " + std::to_string(attributes.ftLastWriteTime.dwHighDateTime);
     }
-    std::stringstream strStream;
-    strStream << shaderFile.rdbuf();
-    std::string shader = strStream.str();
 
-    // Create blob from the string
-    IDxcBlobEncodingPtr pTextBlob;
-    d3d_call(pLibrary->CreateBlobWithEncodingFromPinned((LPBYTE)shader.c_str(), (uint32_t)shader.size(), 0, &pTextBlob));
+    bool compile(const std::string& filename, const std::string& source, const std::string& target, const std::vector<std::string>& defines, std::vector<uint8_t>& dxil, std::string& error) override
+    {
+        // Initialize the helper
+        d3d_call(gDxcDllHelper.Initialize());
+        IDxcCompilerPtr pCompiler;
+        IDxcLibraryPtr pLibrary;
+        d3d_call(gDxcDllHelper.CreateInstance(CLSID_DxcCompiler, &pCompiler));
+        d3d_call(gDxcDllHelper.CreateInstance(CLSID_DxcLibrary, &pLibrary));
+
+        // Create blob from the string
+        IDxcBlobEncodingPtr pTextBlob;
+        d3d_call(pLibrary->CreateBlobWithEncodingFromPinned((LPBYTE)source.c_str(), (uint32_t)source.size(), 0, &pTextBlob));
+
+        // "NAME=VALUE" to a DxcDefine. The strings have to live until Compile() returns
+        std::vector<std::wstring> defineNames(defines.size());
+        std::vector<std::wstring> defineValues(defines.size());
+        std::vector<DxcDefine> dxcDefines(defines.size());
+        for (size_t i = 0; i < defines.size(); i++)
+        {
+            size_t equals = defines[i].find('=');
+            defineNames[i] = string_2_wstring(defines[i].substr(0, equals));
+            defineValues[i] = (equals == std::string::npos) ? std::wstring() : string_2_wstring(defines[i].substr(equals + 1));
+            dxcDefines[i].Name = defineNames[i].c_str();
+            dxcDefines[i].Value = defineValues[i].empty() ? nullptr : defineValues[i].c_str();
+        }
+
+        // Compile
+        IDxcOperationResultPtr pResult;
+        d3d_call(pCompiler->Compile(pTextBlob, string_2_wstring(filename).c_str(), L"", string_2_wstring(target).c_str(), nullptr, 0, dxcDefines.data(), (UINT32)dxcDefines.size(), nullptr, &pResult));
 
-    // Compile
-    IDxcOperationResultPtr pResult;
-    d3d_call(pCompiler->Compile(pTextBlob, filename, L"", targetString, nullptr, 0, nullptr, 0, nullptr, &pResult));
+        // Verify the result
+        HRESULT resultCode;
+        d3d_call(pResult->GetStatus(&resultCode));
+        if (FAILED(resultCode))
+        {
+            IDxcBlobEncodingPtr pError;
+            d3d_call(pResult->GetErrorBuffer(&pError));
+            error = "Compiler error:\n" + convertBlobToString(pError.GetInterfacePtr());
+            return false;
+        }
 
-    // Verify the result
-    HRESULT resultCode;
-    d3d_call(pResult->GetStatus(&resultCode));
-    if (FAILED(resultCode))
-    {
-        IDxcBlobEncodingPtr pError;
-        d3d_call(pResult->GetErrorBuffer(&pError));
-        std::string log = convertBlobToString(pError.GetInterfacePtr());
-        msgBox("Compiler error:\n" + log);
-        return nullptr;
+        MAKE_SMART_COM_PTR(IDxcBlob);
+        IDxcBlobPtr pBlob;
+        d3d_call(pResult->GetResult(&pBlob));
+        const uint8_t* pData = (const uint8_t*)pBlob->GetBufferPointer();
+        dxil.assign(pData, pData + pBlob->GetBufferSize());
+        return true;
     }
+};
 
-    MAKE_SMART_COM_PTR(IDxcBlob);
-    IDxcBlobPtr pBlob;
-    d3d_call(pResult->GetResult(&pBlob));
-    return pBlob;
+// Returns an empty library if the file can't be compiled
+std::vector<uint8_t> compileLibrary(const std::string& filename, const std::string& target, const std::vector<std::string>& defines)
+{
+    DxcShaderCompiler compiler;
+    ShaderCache cache(compiler, "ShaderCache");
+    std::vector<uint8_t> dxil;
+    std::string error;
+    if (cache.getLibrary(filename, target, defines, dxil, error) == false)
+    {
+        msgBox(error);
+        dxil.clear();
+    }
+    return dxil;
 }
 
 // 4.6.b DxilLibrary
 struct DxilLibrary
 {
     // 4.6.d
-    DxilLibrary(ID3DBlobPtr pBlob, const WCHAR* entryPoint[], uint32_t entryPointCount) : pShaderBlob(pBlob)
+    DxilLibrary(std::vector<uint8_t> dxil, const WCHAR* entryPoint[], uint32_t entryPointCount) : shaderBytecode(std::move(dxil))
     {
         // 4.6.e
         stateSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY;
@@ -591,11 +943,11 @@ struct DxilLibrary
         dxilLibDesc = {};
         exportDesc.resize(entryPointCount);
         exportName.resize(entryPointCount);
-        if (pBlob)
+        if (shaderBytecode.empty() == false)
         {
             // 4.6.g
-            dxilLibDesc.DXILLibrary.pShaderBytecode = pBlob->GetBufferPointer();
-            dxilLibDesc.DXILLibrary.BytecodeLength = pBlob->GetBufferSize();
+            dxilLibDesc.DXILLibrary.pShaderBytecode = shaderBytecode.data();
+            dxilLibDesc.DXILLibrary.BytecodeLength = shaderBytecode.size();
             dxilLibDesc.NumExports = entryPointCount;
             dxilLibDesc.pExports = exportDesc.data();
 
@@ -610,12 +962,12 @@ struct DxilLibrary
         }
     };
 
-    DxilLibrary() : DxilLibrary(nullptr, nullptr, 0) {}
+    DxilLibrary() : DxilLibrary(std::vector<uint8_t>(), nullptr, 0) {}
 
     // 4.6.c
     D3D12_DXIL_LIBRARY_DESC dxilLibDesc = {};
     D3D12_STATE_SUBOBJECT stateSubobject{};
-    ID3DBlobPtr pShaderBlob;
+    std::vector<uint8_t> shaderBytecode;
     std::vector<D3D12_EXPORT_DESC> exportDesc;
     std::vector<std::wstring> exportName;
 };
@@ -633,13 +985,19 @@ static const WCHAR* kShadowChs = L"shadowChs";
 static const WCHAR* kShadowMiss = L"shadowMiss";
 static const WCHAR* kShadowHitGroup = L"ShadowHitGroup";
 
-// 4.6.j
-DxilLibrary createDxilLibrary()
+// Compile the shader, or load it from the cache. The hit shaders decode the vertex format the vertex buffer has
+std::vector<uint8_t> compileShaderLibrary(bool packedVertices)
+{
+    std::vector<std::string> defines;
+    if (packedVertices) defines.push_back("PACKED_VERTICES");
+    return compileLibrary("Data/04-Shaders.hlsl", "lib_6_3", defines);
+}
+
+// 4.6.j dxilLib is the library compileShaderLibrary() returned
+DxilLibrary createDxilLibrary(std::vector<uint8_t> dxilLib)
 {
-    // Compile the shader
-    ID3DBlobPtr pDxilLib = compileLibrary(L"Data/04-Shaders.hlsl", L"lib_6_3");
     const WCHAR* entryPoints[] = { kRayGenShader, kMissShader, kPlaneChs /* 12.3.e */, kClosestHitShader, kShadowMiss /* 12.3.b */, kShadowChs /* 12.3.b */ };
-    return DxilLibrary(pDxilLib, entryPoints, arraysize(entryPoints));
+    return DxilLibrary(std::move(dxilLib), entryPoints, arraysize(entryPoints));
 }
 
 // 4.7.a HitProgram
@@ -802,7 +1160,7 @@ RootSignatureDesc createHitRootDesc()
 {
     RootSignatureDesc desc;
 
-    desc.rootParams.resize(3); // cbv + vertex srv + index srv
+    desc.rootParams.resize(4); // cbv + vertex srv + index srv + geometry constants
     // CBV
     desc.rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
     desc.rootParams[0].Descriptor.RegisterSpace = 0;
@@ -832,7 +1190,13 @@ RootSignatureDesc createHitRootDesc()
     desc.rootParams[2].DescriptorTable.NumDescriptorRanges = 1;
     desc.rootParams[2].DescriptorTable.pDescriptorRanges = &desc.range[1];
 
-    desc.desc.NumParameters = 3; // cbv + vertex srv + index srv
+    // 17.2.a SceneGeometryConstants, they tell the shader where the indices of the geometry are
+    desc.rootParams[3].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    desc.rootParams[3].Constants.ShaderRegister = 1;
+    desc.rootParams[3].Constants.RegisterSpace = 0;
+    desc.rootParams[3].Constants.Num32BitValues = sizeof(SceneGeometryConstants) / sizeof(uint32_t);
+
+    desc.desc.NumParameters = 4; // cbv + vertex srv + index srv + geometry constants
     desc.desc.pParameters = desc.rootParams.data();
     desc.desc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
 
@@ -842,246 +1206,16 @@ RootSignatureDesc createHitRootDesc()
 // 9.3 create constant buffer
 void Tutorial01::createConstantBuffer()
 {
-    // The shader declares the CB with 9 float3. However, due to HLSL packing rules, we create the CB with 9 float4 (each float3 needs to start on a 16-byte boundary)
-    vec4 bufferData[] =
-    {
-        // A
-        vec4(1.0f, 0.0f, 0.0f, 1.0f),
-        vec4(0.0f, 1.0f, 0.0f, 1.0f),
-        vec4(0.0f, 0.0f, 1.0f, 1.0f),
-
-        // B
-        vec4(1.0f, 1.0f, 0.0f, 1.0f),
-        vec4(0.0f, 1.0f, 1.0f, 1.0f),
-        vec4(1.0f, 0.0f, 1.0f, 1.0f),
-
-        // C
-        vec4(1.0f, 0.0f, 1.0f, 1.0f),
-        vec4(1.0f, 1.0f, 0.0f, 1.0f),
-        vec4(0.0f, 1.0f, 1.0f, 1.0f),
-    };
-
-    // 10.2.b
-    for (uint32_t i = 0; i < 3; i++)
-    {
-        const uint32_t bufferSize = sizeof(vec4) * 3;
-        mpConstantBuffer[i] = createBuffer(mpDevice, bufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, kUploadHeapProps);
-        uint8_t* pData;
-        d3d_call(mpConstantBuffer[i]->Map(0, nullptr, (void**)&pData));
-        memcpy(pData, &bufferData[i * 3], sizeof(bufferData));
-        mpConstantBuffer[i]->Unmap(0, nullptr);
-    }
-}
-
-// 18.0.d
-Tutorial01::Shape Tutorial01::createSphere(float diameter, int tessellation, bool uvHorizontalFlip, bool uvVerticalFlip)
-{
-    Shape returnSphereInfo;
-
-    const int verticalSegments = tessellation;
-    const int horizontalSegments = tessellation * 2;
-    float uIncrement = 1.f / horizontalSegments;
-    float vIncrement = 1.f / verticalSegments;
-    const float radius = diameter / 2;
-
-    uIncrement *= uvHorizontalFlip ? 1 : -1;
-    vIncrement *= uvVerticalFlip ? 1 : -1;
-
-    float u = static_cast<float>(uvHorizontalFlip ? 0 : 1);
-    float v = static_cast<float>(uvVerticalFlip ? 0 : 1);
-
-    // Start with a single vertex at the bottom of the sphere.
-    for (int i = 0; i < horizontalSegments; i++)
-    {
-        u += uIncrement;
-
-        VertexPositionNormalTangentTexture vertex(
-            glm::vec3(0, -1, 0) * radius,
-            glm::vec3(0, -1, 0),
-            glm::vec3(0),
-            glm::vec2(u, v)
-        );
-
-        //Add it
-        returnSphereInfo.vertexData.push_back(vertex);
-    }
-
-    // Create rings of vertices at progressively higher latitudes.
-    v = static_cast<float>(uvVerticalFlip ? 0 : 1);
-    for (int i = 0; i < verticalSegments - 1; i++)
-    {
-        const float latitude = (((i + 1) * static_cast<float>(M_PI)) / verticalSegments) - static_cast<float>(M_PI) / 2;
-        u = static_cast<float>(uvHorizontalFlip ? 0 : 1);
-        v += vIncrement;
-        const float dy = static_cast<float>(sin(latitude));
-        const float dxz = static_cast<float>(cos(latitude));
-
-        // Create a single ring of vertices at this latitude.
-        for (int j = 0; j <= horizontalSegments; j++)
-        {
-            const float longitude = j * static_cast<float>(M_PI) * 2 / horizontalSegments;
-
-            const float dx = static_cast<float>(cos(longitude)) * dxz;
-            const float dz = static_cast<float>(sin(longitude)) * dxz;
-
-            const glm::vec3 normal(dx, dy, dz);
-
-            const glm::vec2 texCoord(u, v);
-            u += uIncrement;
-
-            VertexPositionNormalTangentTexture vertex(
-                normal * radius,
-                normal,
-                glm::vec3(0),
-                texCoord
-            );
-
-            //Add it
-            returnSphereInfo.vertexData.push_back(vertex);
-        }
-    }
-
-    // Finish with a single vertex at the top of the sphere.
-    v = static_cast<float>(uvVerticalFlip ? 1 : 0);
-    u = static_cast<float>(uvHorizontalFlip ? 0 : 1);
-    for (int i = 0; i < horizontalSegments; i++)
-    {
-        u += uIncrement;
-
-        VertexPositionNormalTangentTexture vertex(
-            glm::vec3(0, 1, 0) * radius,
-            glm::vec3(0, 1, 0),
-            glm::vec3(0),
-            glm::vec2(u, v)
-        );
-
-        //Add it
-        returnSphereInfo.vertexData.push_back(vertex);
-    }
-
-    // Create a fan connecting the bottom vertex to the bottom latitude ring.
-    for (int i = 0; i < horizontalSegments; i++)
-    {
-        returnSphereInfo.indexData.push_back(static_cast<unsigned short>(i));
-
-        returnSphereInfo.indexData.push_back(static_cast<unsigned short>(1 + i + horizontalSegments));
-
-        returnSphereInfo.indexData.push_back(static_cast<unsigned short>(i + horizontalSegments));
-    }
-
-    // Fill the sphere body with triangles joining each pair of latitude rings.
-    for (int i = 0; i < verticalSegments - 2; i++)
-    {
-        for (int j = 0; j < horizontalSegments; j++)
-        {
-            const int nextI = i + 1;
-            const int nextJ = j + 1;
-            const int num = horizontalSegments + 1;
-
-            const int i1 = horizontalSegments + (i * num) + j;
-            const int i2 = horizontalSegments + (i * num) + nextJ;
-            const int i3 = horizontalSegments + (nextI * num) + j;
-            const int i4 = i3 + 1;
-
-            returnSphereInfo.indexData.push_back(static_cast<unsigned short>(i1));
-
-            returnSphereInfo.indexData.push_back(static_cast<unsigned short>(i2));
-
-            returnSphereInfo.indexData.push_back(static_cast<unsigned short>(i3));
-
-            returnSphereInfo.indexData.push_back(static_cast<unsigned short>(i2));
-
-            returnSphereInfo.indexData.push_back(static_cast<unsigned short>(i4));
-
-            returnSphereInfo.indexData.push_back(static_cast<unsigned short>(i3));
-        }
-    }
-
-    // Create a fan connecting the top vertex to the top latitude ring.
-    for (int i = 0; i < horizontalSegments; i++)
-    {
-        returnSphereInfo.indexData.push_back(static_cast<unsigned short>(returnSphereInfo.vertexData.size() - 1 - i));
-
-        returnSphereInfo.indexData.push_back(
-            static_cast<unsigned short>(returnSphereInfo.vertexData.size() - horizontalSegments - 2 - i));
-
-        returnSphereInfo.indexData.push_back(
-            static_cast<unsigned short>(returnSphereInfo.vertexData.size() - horizontalSegments - 1 - i));
-    }
-
-    calculateTangentSpace(returnSphereInfo);
-
-    return returnSphereInfo;
-}
-
-// 18.0.f
-void Tutorial01::calculateTangentSpace(Shape& shape)
-{
-    const size_t vertexCount = shape.vertexData.size();
-    const size_t triangleCount = shape.indexData.size() / 3;
-
-    glm::vec3* tan1 = new glm::vec3[vertexCount * 2];
-    glm::vec3* tan2 = tan1 + vertexCount;
-
-    VertexPositionNormalTangentTexture a1, a2, a3;
-    glm::vec3 v1, v2, v3;
-    glm::vec2 w1, w2, w3;
-
-    for (int a = 0; a < triangleCount; a++)
+    // 10.2.b One constant buffer per chs material. The shader declares the CB with 3 float3. However, due to HLSL packing rules, we create the CB with 3 float4 (each float3 needs to start on a 16-byte boundary)
+    mConstantBuffer.resize(mScene.getMaterialCount());
+    for (uint32_t i = 0; i < mScene.getMaterialCount(); i++)
     {
-        const unsigned short i1 = shape.indexData[(a * 3) + 0];
-        const unsigned short i2 = shape.indexData[(a * 3) + 1];
-        const unsigned short i3 = shape.indexData[(a * 3) + 2];
-
-        a1 = shape.vertexData[i1];
-        a2 = shape.vertexData[i2];
-        a3 = shape.vertexData[i3];
-
-        v1 = a1.position;
-        v2 = a2.position;
-        v3 = a3.position;
-
-        w1 = a1.texCoord;
-        w2 = a2.texCoord;
-        w3 = a3.texCoord;
+        const SceneMaterial& material = mScene.getMaterial(i);
+        if (material.hitProgram != SceneHitProgram::Triangle) continue;
 
-        float x1 = v2.x - v1.x;
-        float x2 = v3.x - v1.x;
-        float y1 = v2.y - v1.y;
-        float y2 = v3.y - v1.y;
-        float z1 = v2.z - v1.z;
-        float z2 = v3.z - v1.z;
-
-        float s1 = w2.x - w1.x;
-        float s2 = w3.x - w1.x;
-        float t1 = w2.y - w1.y;
-        float t2 = w3.y - w1.y;
-
-        const float r = 1.0F / ((s1 * t2) - (s2 * t1));
-        glm::vec3 sdir(((t2 * x1) - (t1 * x2)) * r, ((t2 * y1) - (t1 * y2)) * r, ((t2 * z1) - (t1 * z2)) * r);
-        glm::vec3 tdir(((s1 * x2) - (s2 * x1)) * r, ((s1 * y2) - (s2 * y1)) * r, ((s1 * z2) - (s2 * z1)) * r);
-
-        tan1[i1] += sdir;
-        tan1[i2] += sdir;
-        tan1[i3] += sdir;
-
-        tan2[i1] += tdir;
-        tan2[i2] += tdir;
-        tan2[i3] += tdir;
-    }
-
-    for (int a = 0; a < vertexCount; a++)
-    {
-        VertexPositionNormalTangentTexture vertex = shape.vertexData[a];
-
-        const glm::vec3 n = vertex.normal;
-        const glm::vec3 t = tan1[a];
-
-        // Gram-Schmidt orthogonalize
-        vertex.tangent = t - (n * glm::dot(n, t));
-        vertex.tangent = glm::normalize(vertex.tangent);
-
-        shape.vertexData[a] = vertex;
+        const uint32_t bufferSize = sizeof(material.constants);
+        mConstantBuffer[i] = mUploadHeap.allocatePersistent(bufferSize, UploadHeap::kConstantBufferAlignment);
+        memcpy(mConstantBuffer[i].pData, material.constants, bufferSize);
     }
 }
 
@@ -1089,7 +1223,7 @@ void Tutorial01::calculateTangentSpace(Shape& shape)
 RootSignatureDesc createPlaneHitRootDesc()
 {
     RootSignatureDesc desc;
-    desc.range.resize(2);
+    desc.range.resize(3);
     desc.range[0].BaseShaderRegister = 0;
     desc.range[0].NumDescriptors = 1;
     desc.range[0].RegisterSpace = 0;
@@ -1103,12 +1237,24 @@ RootSignatureDesc createPlaneHitRootDesc()
     desc.range[1].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
     desc.range[1].OffsetInDescriptorsFromTableStart = 1;
 
-    desc.rootParams.resize(1);
+    // 17.2.b The index SRV follows the vertex SRV
+    desc.range[2].BaseShaderRegister = 2;
+    desc.range[2].NumDescriptors = 1;
+    desc.range[2].RegisterSpace = 0;
+    desc.range[2].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+    desc.range[2].OffsetInDescriptorsFromTableStart = 2;
+
+    desc.rootParams.resize(2);
     desc.rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    desc.rootParams[0].DescriptorTable.NumDescriptorRanges = 2;
+    desc.rootParams[0].DescriptorTable.NumDescriptorRanges = 3;
     desc.rootParams[0].DescriptorTable.pDescriptorRanges = desc.range.data();
 
-    desc.desc.NumParameters = 1;
+    desc.rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    desc.rootParams[1].Constants.ShaderRegister = 1;
+    desc.rootParams[1].Constants.RegisterSpace = 0;
+    desc.rootParams[1].Constants.Num32BitValues = sizeof(SceneGeometryConstants) / sizeof(uint32_t);
+
+    desc.desc.NumParameters = 2;
     desc.desc.pParameters = desc.rootParams.data();
     desc.desc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
 
@@ -1133,7 +1279,7 @@ void Tutorial01::createRtPipelineState()
     uint32_t index = 0;
 
     // 4.6.k Create the DXIL library
-    DxilLibrary dxilLib = createDxilLibrary();
+    DxilLibrary dxilLib = createDxilLibrary(std::move(mShaderLibrary));
     subobjects[index++] = dxilLib.stateSubobject; // 0 Library
     // 4.7.b createRtPipelineState
     HitProgram hitProgram(nullptr, kClosestHitShader, kHitGroup);
@@ -1215,107 +1361,79 @@ void Tutorial01::createRtPipelineState()
 void Tutorial01::createShaderTable()
 {
     /** The shader-table layout is as follows:
-        Entry 0 - Ray-gen program
-        Entry 1 - Miss program for the primary ray
-        Entry 2 - Miss program for the shadow ray
-        Entries 3,4 - Hit programs for triangle 0 (primary followed by shadow)
-        Entries 5,6 - Hit programs for the plane (primary followed by shadow)
-        Entries 7,8 - Hit programs for triangle 1 (primary followed by shadow)
-        Entries 9,10 - Hit programs for triangle 2 (primary followed by shadow)
-        All entries in the shader-table must have the same size, so we will choose it base on the largest required entry.
-        The triangle primary-ray hit program requires the largest entry - sizeof(program identifier) + 8 bytes for the constant-buffer root descriptor.
-        The entry size must be aligned up to D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT
+        Ray-gen region - Ray-gen program
+        Miss region - Miss program for the primary ray, then the miss program for the shadow ray
+        Hit-group region - Hit programs for each geometry of each scene instance (primary followed by shadow). With the tutorial scene:
+            Records 0,1 - Hit programs for triangle 0
+            Records 2,3 - Hit programs for the plane
+            Records 4,5 - Hit programs for triangle 1
+            Records 6,7 - Hit programs for triangle 2
+        The records of a region must have the same size. ShaderTableBuilder chooses it per region based on its largest record, so the miss records
+        don't pay for the root arguments of the hit programs. The triangle primary-ray hit program requires the largest record - sizeof(program identifier)
+        + 8 bytes for the constant-buffer root descriptor + 2 descriptor tables + 12 bytes of geometry constants.
     */
+    MAKE_SMART_COM_PTR(ID3D12StateObjectProperties);
+    ID3D12StateObjectPropertiesPtr pRtsoProps;
+    mpPipelineState->QueryInterface(IID_PPV_ARGS(&pRtsoProps));
 
-    // Calculate the size and create the buffer
-    mShaderTableEntrySize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-    mShaderTableEntrySize += 8; // The hit shader constant-buffer descriptor
-    mShaderTableEntrySize = align_to(D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT, mShaderTableEntrySize);
-    uint32_t shaderTableSize = mShaderTableEntrySize * 11;
+    // One table per frame in flight. They only differ in the descriptors they point at
+    for (uint32_t frame = 0; frame < kDefaultSwapChainBuffers; frame++)
+    {
+        ShaderTableBuilder builder;
+        const DescriptorRange& descriptors = mFrameDescriptors[frame];
 
-    // For simplicity, we create the shader-table on the upload heap. You can also create it on the default heap
-    mpShaderTable = createBuffer(mpDevice, shaderTableSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, kUploadHeapProps);
+        // Ray-gen program ID and descriptor data
+        builder.addRayGen(pRtsoProps->GetShaderIdentifier(kRayGenShader)).addDescriptor(descriptors.getGpuHandle(0).ptr);
 
-    // Map the buffer
-    uint8_t* pData;
-    d3d_call(mpShaderTable->Map(0, nullptr, (void**)&pData));
+        // Primary ray miss, then shadow-ray miss
+        builder.addMiss(pRtsoProps->GetShaderIdentifier(kMissShader));
+        builder.addMiss(pRtsoProps->GetShaderIdentifier(kShadowMiss));
 
-    MAKE_SMART_COM_PTR(ID3D12StateObjectProperties);
-    ID3D12StateObjectPropertiesPtr pRtsoProps;
-    mpPipelineState->QueryInterface(IID_PPV_ARGS(&pRtsoProps));
+        // A primary and a shadow record for each geometry of each instance
+        for (uint32_t i = 0; i < mScene.getInstanceCount(); i++)
+        {
+            // 11.3.b 13.3.a The builder knows where the records of the instance start. A different value than the one the TLAS was built with forces a rebuild
+            mInstanceTable.setInstanceContributionToHitGroupIndex(i, builder.beginInstance());
+
+            const SceneInstance& instance = mScene.getInstance(i);
+            const SceneBlas& blas = mScene.getBlas(instance.blasIndex);
+            for (uint32_t g = 0; g < blas.meshCount; g++)
+            {
+                uint32_t materialIndex = instance.firstMaterial + g;
+                const SceneGeometryConstants geometry = getGeometryConstants(mScene.getMesh(blas.firstMesh + g));
+                if (mScene.getMaterial(materialIndex).hitProgram == SceneHitProgram::Triangle)
+                {
+                    // Triangle, primary ray. ProgramID and constant-buffer data
+                    builder.addHitGroup(pRtsoProps->GetShaderIdentifier(kHitGroup))
+                        .addDescriptor(mConstantBuffer[materialIndex].gpuAddress)
+                        .addDescriptor(descriptors.getGpuHandle(2).ptr)    // 15.3.a The vertex SRV is the third descriptor of the frame
+                        .addDescriptor(descriptors.getGpuHandle(3).ptr)    // 17.3.a The index SRV is the fourth
+                        .addConstants(&geometry, sizeof(geometry));
+                }
+                else
+                {
+                    // Plane, primary ray. ProgramID, and the TLAS, vertex and index SRVs in one table
+                    builder.addHitGroup(pRtsoProps->GetShaderIdentifier(kPlaneHitGroup))
+                        .addDescriptor(descriptors.getGpuHandle(1).ptr)    // 16.1.f The TLAS SRV comes directly after the UAV
+                        .addConstants(&geometry, sizeof(geometry));
+                }
+
+                // Shadow ray. ProgramID only
+                builder.addHitGroup(pRtsoProps->GetShaderIdentifier(kShadowHitGroup));
+            }
+        }
 
-    // Entry 0 - ray-gen program ID and descriptor data
-    memcpy(pData, pRtsoProps->GetShaderIdentifier(kRayGenShader), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    uint64_t heapStart = mpSrvUavHeap->GetGPUDescriptorHandleForHeapStart().ptr;
-    *(uint64_t*)(pData + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES) = heapStart;
-
-    // Entry 1 - primary ray miss
-    memcpy(pData + mShaderTableEntrySize, pRtsoProps->GetShaderIdentifier(kMissShader), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-
-    // Entry 2 - shadow-ray miss
-    memcpy(pData + mShaderTableEntrySize * 2, pRtsoProps->GetShaderIdentifier(kShadowMiss), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-
-    // Entry 3 - Triangle 0, primary ray. ProgramID and constant-buffer data
-    uint8_t* pEntry3 = pData + mShaderTableEntrySize * 3;
-    memcpy(pEntry3, pRtsoProps->GetShaderIdentifier(kHitGroup), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    assert(((uint64_t)(pEntry3 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES) % 8) == 0); // Root descriptor must be stored at an 8-byte aligned address
-    *(D3D12_GPU_VIRTUAL_ADDRESS*)(pEntry3 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES) = mpConstantBuffer[0]->GetGPUVirtualAddress();
-    // 15.3.a
-    *(uint64_t*)(pEntry3 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + sizeof(D3D12_GPU_VIRTUAL_ADDRESS)) = heapStart + mpDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * 2; // The SRV comes 2 after the program id
-    // 17.3.a
-    *(uint64_t*)(pEntry3 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + sizeof(D3D12_GPU_VIRTUAL_ADDRESS) * 2) = heapStart + mpDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * 3; //  index SRV comes 3 after the program id
-
-    // Entry 4 - Triangle 0, shadow ray. ProgramID only
-    uint8_t* pEntry4 = pData + mShaderTableEntrySize * 4;
-    memcpy(pEntry4, pRtsoProps->GetShaderIdentifier(kShadowHitGroup), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-
-    // Entry 5 - Plane, primary ray. ProgramID only and the TLAS SRV
-    uint8_t* pEntry5 = pData + mShaderTableEntrySize * 5;
-    memcpy(pEntry5, pRtsoProps->GetShaderIdentifier(kPlaneHitGroup), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    *(uint64_t*)(pEntry5 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES) = heapStart + mpDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV); // The SRV comes directly after the program id
-    // 16.1.f
-    *(uint64_t*)(pEntry5 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + sizeof(uint64_t)) = heapStart + mpDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * 2; // The SRV comes 2 after the program id
-
-    // Entry 6 - Plane, shadow ray
-    uint8_t* pEntry6 = pData + mShaderTableEntrySize * 6;
-    memcpy(pEntry6, pRtsoProps->GetShaderIdentifier(kShadowHitGroup), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-
-    // Entry 7 - Triangle 1, primary ray. ProgramID and constant-buffer data
-    uint8_t* pEntry7 = pData + mShaderTableEntrySize * 7;
-    memcpy(pEntry7, pRtsoProps->GetShaderIdentifier(kHitGroup), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    assert(((uint64_t)(pEntry7 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES) % 8) == 0); // Root descriptor must be stored at an 8-byte aligned address
-    *(D3D12_GPU_VIRTUAL_ADDRESS*)(pEntry7 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES) = mpConstantBuffer[1]->GetGPUVirtualAddress();
-    // 15.3.b
-    *(uint64_t*)(pEntry7 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + sizeof(D3D12_GPU_VIRTUAL_ADDRESS)) = heapStart + mpDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * 2; // The SRV comes 2 after the program id\
-    // 17.3.b
-    *(uint64_t*)(pEntry7 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + sizeof(D3D12_GPU_VIRTUAL_ADDRESS) * 2) = heapStart + mpDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * 3; // The index SRV comes 3 after the program id
-
-    // Entry 8 - Triangle 1, shadow ray. ProgramID only
-    uint8_t* pEntry8 = pData + mShaderTableEntrySize * 8;
-    memcpy(pEntry8, pRtsoProps->GetShaderIdentifier(kShadowHitGroup), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-
-    // Entry 9 - Triangle 2, primary ray. ProgramID and constant-buffer data
-    uint8_t* pEntry9 = pData + mShaderTableEntrySize * 9;
-    memcpy(pEntry9, pRtsoProps->GetShaderIdentifier(kHitGroup), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    assert(((uint64_t)(pEntry9 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES) % 8) == 0); // Root descriptor must be stored at an 8-byte aligned address
-    *(D3D12_GPU_VIRTUAL_ADDRESS*)(pEntry9 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES) = mpConstantBuffer[2]->GetGPUVirtualAddress();
-    // 15.3.c
-    *(uint64_t*)(pEntry9 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + sizeof(D3D12_GPU_VIRTUAL_ADDRESS)) = heapStart + mpDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * 2; // The SRV comes 2 after the program id
-    // 17.3.c
-    *(uint64_t*)(pEntry9 + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + sizeof(D3D12_GPU_VIRTUAL_ADDRESS) * 2) = heapStart + mpDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * 3; // The index SRV comes 3 after the program id
-
-    // Entry 10 - Triangle 2, shadow ray. ProgramID only
-    uint8_t* pEntry10 = pData + mShaderTableEntrySize * 10;
-    memcpy(pEntry10, pRtsoProps->GetShaderIdentifier(kShadowHitGroup), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-
-    // Unmap
-    mpShaderTable->Unmap(0, nullptr);
+        // For simplicity, we keep the shader-table on the upload heap. You can also create it on the default heap
+        mShaderTable[frame] = mUploadHeap.allocatePersistent(builder.getSize(), UploadHeap::kShaderTableAlignment);
+        builder.write(mShaderTable[frame].pData);
+        for (uint32_t r = 0; r < (uint32_t)ShaderTableBuilder::Region::Count; r++) mShaderTableRegions[r] = builder.getLayout((ShaderTableBuilder::Region)r);
+    }
 }
 
 // 6.0 01-CreateWindow.cpp
 void Tutorial01::createShaderResources()
 {
-    // Create the output resource. The dimensions and format should match the swap-chain
+    // Create the output resources. The dimensions and format should match the swap-chain
     D3D12_RESOURCE_DESC resDesc = {};
     resDesc.DepthOrArraySize = 1;
     resDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
@@ -1326,130 +1444,298 @@ void Tutorial01::createShaderResources()
     resDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
     resDesc.MipLevels = 1;
     resDesc.SampleDesc.Count = 1;
-    d3d_call(mpDevice->CreateCommittedResource(&kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr, IID_PPV_ARGS(&mpOutputResource))); // Starting as copy-source to simplify onFrameRender()
-
-    // 17.1.a Create an SRV/UAV descriptor heap. Need 4 entries - 1 SRV for the scene and 1 UAV for the output, 1 for the vertex information, and now one for the Index buffer
-    mpSrvUavHeap = createDescriptorHeap(mpDevice, 4, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true);
 
-    // Create the UAV. Based on the root signature we created it should be the first entry
-    D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-    uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
-    mpDevice->CreateUnorderedAccessView(mpOutputResource, nullptr, &uavDesc, mpSrvUavHeap->GetCPUDescriptorHandleForHeapStart());
+    // 17.1.a Create the SRV/UAV descriptor heaps. Need 4 entries per frame - 1 SRV for the scene and 1 UAV for the output, 1 for the vertex information, and now one for the Index buffer
+    mSrvUavHeap.init(mpDevice, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, kSrvUavDescriptors, true);
+    mStagingHeap.init(mpDevice, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, kSrvUavDescriptors, false);
 
-    // 6.1 Create the TLAS SRV right after the UAV. Note that we are using a different SRV desc here
+    // 15.1.b The vertex and index SRVs are the same for every frame, so they are only created once
+    DescriptorRange sceneViews = mStagingHeap.allocatePersistent(2);
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
-    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    // 14.3.d
-    srvDesc.RaytracingAccelerationStructure.Location = mpTopLevelAS.pResult->GetGPUVirtualAddress();
-    D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = mpSrvUavHeap->GetCPUDescriptorHandleForHeapStart();
-    srvHandle.ptr += mpDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    mpDevice->CreateShaderResourceView(nullptr, &srvDesc, srvHandle);
-
-    // 15.1.b
-    srvDesc = {};
     srvDesc.ViewDimension = D3D12_SRV_DIMENSION::D3D12_SRV_DIMENSION_BUFFER;
     srvDesc.Format = DXGI_FORMAT::DXGI_FORMAT_UNKNOWN;
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
     srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
     // 18.0
-    srvDesc.Buffer.StructureByteStride = sizeof(Tutorial01::VertexPositionNormalTangentTexture); // your vertex struct size goes here
-    srvDesc.Buffer.NumElements = 3; // number of vertices go here
-    srvHandle.ptr += mpDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    mpDevice->CreateShaderResourceView(mpVertexBuffer[0], &srvDesc, srvHandle);
-    mpVertexBuffer[0]->SetName(L"SRV VB");
+    srvDesc.Buffer.StructureByteStride = mVertexStride; // your vertex struct size goes here
+    srvDesc.Buffer.FirstElement = mVertexBuffer.offset / srvDesc.Buffer.StructureByteStride;
+    srvDesc.Buffer.NumElements = mGeometryViews.vertexElements; // number of vertices go here
+    mpDevice->CreateShaderResourceView(mVertexBuffer.pResource, &srvDesc, sceneViews.getCpuHandle(0));
 
-    // 17.1.b mpVertexBuffer[0] is triangle, mpVertexBuffer[1] is plane, for this excercise we are only doing indices for the triangle
-    const int indices[] =
+    // 17.1.b The index SRV is a raw view of the whole scene index buffer, the hit shaders find the indices of their geometry in it
+    srvDesc = {};
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION::D3D12_SRV_DIMENSION_BUFFER;
+    srvDesc.Format = DXGI_FORMAT::DXGI_FORMAT_R32_TYPELESS;
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
+    srvDesc.Buffer.FirstElement = mSceneIndexBuffer.offset / sizeof(uint32_t);
+    srvDesc.Buffer.NumElements = mGeometryViews.indexElements;
+    mpDevice->CreateShaderResourceView(mSceneIndexBuffer.pResource, &srvDesc, sceneViews.getCpuHandle(1));
+
+    // 6.2 The output resources are transients of the frame graph
+    createFrameGraph(resDesc);
+    for (uint32_t frame = 0; frame < kDefaultSwapChainBuffers; frame++)
     {
-        0, 1, 2
-    };
+        mFrameViews[frame] = mStagingHeap.allocatePersistent(2);
 
-    // For simplicity, we create the vertex buffer on the upload heap, but that's not required
-    mpIndexBuffer = createBuffer(mpDevice, sizeof(indices), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, kUploadHeapProps);
-    uint8_t* pData;
-    mpIndexBuffer->Map(0, nullptr, (void**)&pData);
-    memcpy(pData, indices, sizeof(indices));
-    mpIndexBuffer->Unmap(0, nullptr);
+        // Create the UAV. Based on the root signature we created it should be the first entry of the frame
+        D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+        uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+        mpDevice->CreateUnorderedAccessView(mpOutputResource[frame], nullptr, &uavDesc, mFrameViews[frame].getCpuHandle(0));
 
-    srvDesc = {};
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION::D3D12_SRV_DIMENSION_BUFFER;
-    srvDesc.Format = DXGI_FORMAT::DXGI_FORMAT_UNKNOWN;
+        // The frame's table is the UAV and the TLAS SRV of the frame, followed by the shared vertex and index SRVs
+        mFrameDescriptors[frame] = mSrvUavHeap.allocatePersistent(kSrvUavDescriptorsPerFrame);
+        createTlasView(frame);
+        mSrvUavHeap.copy(mFrameDescriptors[frame], 2, sceneViews);
+    }
+
+    // A single CopyDescriptors() call for all the frames
+    mSrvUavHeap.flushCopies();
+}
+
+void Tutorial01::createTlasView(uint32_t frame)
+{
+    // 6.1 Create the TLAS SRV right after the UAV. Note that we are using a different SRV desc here
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-    srvDesc.Buffer.StructureByteStride = sizeof(int); // your index struct size goes here
-    srvDesc.Buffer.NumElements = 3; // number of indices go here
-    srvHandle.ptr += mpDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    mpDevice->CreateShaderResourceView(mpIndexBuffer, &srvDesc, srvHandle);
-    mpIndexBuffer->SetName(L"SRV IB");
+    // 14.3.d
+    srvDesc.RaytracingAccelerationStructure.Location = mpTopLevelAS[frame].pResult->GetGPUVirtualAddress();
+    mpDevice->CreateShaderResourceView(nullptr, &srvDesc, mFrameViews[frame].getCpuHandle(1));
+
+    // The UAV and the SRV are next to each other in both heaps. The caller flushes the copy
+    mSrvUavHeap.copy(mFrameDescriptors[frame], 0, mFrameViews[frame]);
 }
 
-//////////////////////////////////////////////////////////////////////////
-// Callbacks
-//////////////////////////////////////////////////////////////////////////
-void Tutorial01::onLoad(HWND winHandle, uint32_t winWidth, uint32_t winHeight)
+// 6.2.a The frame graph. The dispatch writes the output, the copy reads it and writes the back-buffer. Passes between them add their
+// transients with addGraphTransient()
+void Tutorial01::createFrameGraph(const D3D12_RESOURCE_DESC& outputDesc)
 {
-    // 2.11 onLoad
-    initDXR(winHandle, winWidth, winHeight); // Tutorial 02
-    createAccelerationStructures(); // Tutorial 03
-    createRtPipelineState(); // Tutorial 04
-    createShaderResources(); // Tutorial 06. Need to do this before initializing the shader-table
-    createConstantBuffer(); // Tutorial 09. Yes, we need to do it before creating the shader-table
-    createShaderTable(); // Tutorial 05
+    mOutputId = addGraphTransient("Output", outputDesc);
+    mBackBufferId = mFrameGraph.addImported("Back-buffer");
+    mFrameGraph.markOutput(mBackBufferId);
+
+    RenderGraph::PassId dispatch = mFrameGraph.addPass("DispatchRays");
+    mFrameGraph.write(dispatch, mOutputId, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    RenderGraph::PassId copy = mFrameGraph.addPass("Copy to back-buffer");
+    mFrameGraph.read(copy, mOutputId, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    mFrameGraph.write(copy, mBackBufferId, D3D12_RESOURCE_STATE_COPY_DEST);
+    mGraphPasses.resize(mFrameGraph.getPassCount());
+    mGraphPasses[dispatch] = [this](ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex, uint32_t rtvIndex) { recordDispatchRays(pCmdList, frameIndex); };
+    mGraphPasses[copy] = [this](ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex, uint32_t rtvIndex) { recordCopyToBackBuffer(pCmdList, frameIndex, rtvIndex); };
+    mFrameGraph.compile();
+
+    // 6.2.b A heap per graph heap and frame in flight, the transients are placed where the graph says. They start every frame in the state
+    // the last pass leaves them in, so they're created in it
+    static const D3D12_HEAP_FLAGS kHeapFlags[] = { D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS };
+    for (uint32_t frame = 0; frame < kDefaultSwapChainBuffers; frame++)
+    {
+        mTransientHeaps[frame].resize(mFrameGraph.getHeapCount());
+        for (uint32_t heap = 0; heap < mFrameGraph.getHeapCount(); heap++)
+        {
+            if (mFrameGraph.getHeapSize(heap) == 0) continue;
+            D3D12_HEAP_DESC heapDesc = {};
+            heapDesc.SizeInBytes = mFrameGraph.getHeapSize(heap);
+            heapDesc.Properties = kDefaultHeapProps;
+            heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+            for (RenderGraph::ResourceId r = 0; r < mFrameGraph.getResourceCount(); r++)
+            {
+                const RenderGraph::Placement& placement = mFrameGraph.getPlacement(r);
+                if (mFrameGraph.isTransient(r) && placement.heap == heap) heapDesc.Alignment = std::max(heapDesc.Alignment, placement.alignment);
+            }
+            heapDesc.Flags = kHeapFlags[heap];
+            d3d_call(mpDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&mTransientHeaps[frame][heap])));
+        }
+
+        mTransientResources[frame].resize(mFrameGraph.getResourceCount());
+        for (RenderGraph::ResourceId r = 0; r < mFrameGraph.getResourceCount(); r++)
+        {
+            if (mFrameGraph.isTransient(r) == false || mFrameGraph.isUsed(r) == false) continue;
+            const RenderGraph::Placement& placement = mFrameGraph.getPlacement(r);
+            const D3D12_RESOURCE_DESC& desc = mTransientDescs[r];
+            const D3D12_RESOURCE_STATES state = (D3D12_RESOURCE_STATES)mFrameGraph.getFinalState(r);
+            d3d_call(mpDevice->CreatePlacedResource(mTransientHeaps[frame][placement.heap], placement.offset, &desc, state, nullptr, IID_PPV_ARGS(&mTransientResources[frame][r])));
+            uint32_t subresourceCount = 1;
+            if (desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D) subresourceCount = desc.MipLevels;
+            else if (desc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER) subresourceCount = desc.MipLevels * desc.DepthOrArraySize;
+            mResourceStates.addResource(getResourceHandle(mTransientResources[frame][r]), subresourceCount, state);
+        }
+        mpOutputResource[frame] = mTransientResources[frame][mOutputId];
+    }
+
+    uint64_t heapSize = 0;
+    for (uint32_t heap = 0; heap < mFrameGraph.getHeapCount(); heap++) heapSize += mFrameGraph.getHeapSize(heap);
+    printf("Frame graph: %u of %u passes, %llu bytes of transients in %llu bytes of heaps per frame in flight\n", (uint32_t)mFrameGraph.getPassOrder().size(),
+        mFrameGraph.getPassCount(), (unsigned long long)mFrameGraph.getUnaliasedSize(), (unsigned long long)heapSize);
 }
 
-void Tutorial01::onFrameRender()
+// A transient of the frame graph, buffers and textures go to different heaps
+RenderGraph::ResourceId Tutorial01::addGraphTransient(const char* name, const D3D12_RESOURCE_DESC& desc)
 {
-    // 2.12 onFrameRender
-    uint32_t rtvIndex = beginFrame();
+    D3D12_RESOURCE_ALLOCATION_INFO info = mpDevice->GetResourceAllocationInfo(0, 1, &desc);
+    const uint32_t heap = (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER) ? kBufferHeap : kTextureHeap;
+    RenderGraph::ResourceId resource = mFrameGraph.addTransient(name, info.SizeInBytes, info.Alignment, heap);
+    mTransientDescs.resize(mFrameGraph.getResourceCount());
+    mTransientDescs[resource] = desc;
+    return resource;
+}
 
-    // Refit the top-level acceleration structure
-    buildTopLevelAS(mpDevice, mpCmdList, mpBottomLevelAS, mTlasSize, mRotation, true, mpTopLevelAS);
-    mRotation += 0.005f;
+ID3D12ResourcePtr Tutorial01::getGraphResource(RenderGraph::ResourceId resource, uint32_t frameIndex, uint32_t rtvIndex)
+{
+    // The back-buffer is the only imported resource
+    return (resource == mBackBufferId) ? mFrameObjects[rtvIndex].pSwapChainBuffer : mTransientResources[frameIndex][resource];
+}
 
-    // 6.4 this is rasterization and no longer needed
-    //const float clearColor[4] = { 0.4f, 0.6f, 0.2f, 1.0f };
-    //resourceBarrier(mpCmdList, mFrameObjects[rtvIndex].pSwapChainBuffer, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    //mpCmdList->ClearRenderTargetView(mFrameObjects[rtvIndex].rtvHandle, clearColor, 0, nullptr);
+// 6.4.i The barriers of a pass go in a single call at the start of its list. The transients it starts using get an aliasing barrier if
+// they share their memory, and it expects them in the state the previous frame of the slot left them in, so their transitions are in the
+// list rather than in a list before it
+void Tutorial01::recordGraphPass(RenderGraph::PassId pass, const TrackedCommandList& list, uint32_t frameIndex, uint32_t rtvIndex)
+{
+    std::vector<ResourceBarrier> barriers;
+    for (RenderGraph::ResourceId resource : mFrameGraph.getFirstUses(pass))
+    {
+        const uint64_t handle = getResourceHandle(getGraphResource(resource, frameIndex, rtvIndex));
+        if (mFrameGraph.isAliased(resource)) barriers.push_back({ ResourceBarrier::Type::Aliasing, handle, ResourceStateTracker::kAllSubresources, 0, 0 });
+        list.pStates->expect(handle, mFrameGraph.getFinalState(resource));
+    }
+    for (const RenderGraph::Access& access : mFrameGraph.getAccesses(pass))
+    {
+        list.pStates->require(getResourceHandle(getGraphResource(access.resource, frameIndex, rtvIndex)), access.state);
+    }
+    list.pStates->flush(barriers);
+    recordBarriers(list.pCmdList, barriers);
+    mGraphPasses[pass](list.pCmdList, frameIndex, rtvIndex);
+}
+
+// 6.4.a Let's raytrace
+void Tutorial01::recordDispatchRays(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex)
+{
+    // 6.5 Bind the descriptor heaps
+    ID3D12DescriptorHeap* heaps[] = { mSrvUavHeap.getHeap() };
+    pCmdList->SetDescriptorHeaps(arraysize(heaps), heaps);
 
-    // 6.4.a Let's raytrace
-    resourceBarrier(mpCmdList, mpOutputResource, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    mGpuProfiler.begin(pCmdList, frameIndex, "DispatchRays");
     D3D12_DISPATCH_RAYS_DESC raytraceDesc = {};
     raytraceDesc.Width = mSwapChainSize.x;
     raytraceDesc.Height = mSwapChainSize.y;
     raytraceDesc.Depth = 1;
 
-    // 6.4.b RayGen is the first entry in the shader-table
-    raytraceDesc.RayGenerationShaderRecord.StartAddress = mpShaderTable->GetGPUVirtualAddress() + 0 * mShaderTableEntrySize;
-    raytraceDesc.RayGenerationShaderRecord.SizeInBytes = mShaderTableEntrySize;
+    // 6.4.b RayGen is the first region of the shader-table
+    const ShaderTableBuilder::RegionLayout& rayGen = mShaderTableRegions[(uint32_t)ShaderTableBuilder::Region::RayGen];
+    raytraceDesc.RayGenerationShaderRecord.StartAddress = mShaderTable[frameIndex].gpuAddress + rayGen.offset;
+    raytraceDesc.RayGenerationShaderRecord.SizeInBytes = rayGen.stride;
 
-    // 6.4.c Miss is the second entry in the shader-table
-    size_t missOffset = 1 * mShaderTableEntrySize;
-    raytraceDesc.MissShaderTable.StartAddress = mpShaderTable->GetGPUVirtualAddress() + missOffset;
-    raytraceDesc.MissShaderTable.StrideInBytes = mShaderTableEntrySize;
-    raytraceDesc.MissShaderTable.SizeInBytes = mShaderTableEntrySize * 2;   // 13.3.b 2 miss-entries
+    // 6.4.c Miss is the second region
+    const ShaderTableBuilder::RegionLayout& miss = mShaderTableRegions[(uint32_t)ShaderTableBuilder::Region::Miss];
+    raytraceDesc.MissShaderTable.StartAddress = mShaderTable[frameIndex].gpuAddress + miss.offset;
+    raytraceDesc.MissShaderTable.StrideInBytes = miss.stride;
+    raytraceDesc.MissShaderTable.SizeInBytes = miss.size;   // 13.3.b 2 miss-entries
 
-    // 6.4.d Hit is the third entry in the shader-table
-    size_t hitOffset = 3 * mShaderTableEntrySize; // 13.3.c
-    raytraceDesc.HitGroupTable.StartAddress = mpShaderTable->GetGPUVirtualAddress() + hitOffset;
-    raytraceDesc.HitGroupTable.StrideInBytes = mShaderTableEntrySize;
-    raytraceDesc.HitGroupTable.SizeInBytes = mShaderTableEntrySize * 8;    // 13.3.d 8 hit-entries
+    // 6.4.d Hit is the third region. 13.3.c
+    const ShaderTableBuilder::RegionLayout& hit = mShaderTableRegions[(uint32_t)ShaderTableBuilder::Region::HitGroup];
+    raytraceDesc.HitGroupTable.StartAddress = mShaderTable[frameIndex].gpuAddress + hit.offset;
+    raytraceDesc.HitGroupTable.StrideInBytes = hit.stride;
+    raytraceDesc.HitGroupTable.SizeInBytes = hit.size;    // 13.3.d 8 hit-entries with the tutorial scene
 
     // 6.4.e Bind the empty root signature
-    mpCmdList->SetComputeRootSignature(mpEmptyRootSig);
+    pCmdList->SetComputeRootSignature(mpEmptyRootSig);
 
     // 6.4.f Set Pipeline
-    mpCmdList->SetPipelineState1(mpPipelineState.GetInterfacePtr());
+    pCmdList->SetPipelineState1(mpPipelineState.GetInterfacePtr());
 
     // 6.4.g Dispatch
-    mpCmdList->DispatchRays(&raytraceDesc);
+    pCmdList->DispatchRays(&raytraceDesc);
+    mGpuProfiler.end(pCmdList, frameIndex);
+}
 
-    // 6.4.h Copy the results to the back-buffer
-    resourceBarrier(mpCmdList, mpOutputResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
-    resourceBarrier(mpCmdList, mFrameObjects[rtvIndex].pSwapChainBuffer, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_COPY_DEST);
-    mpCmdList->CopyResource(mFrameObjects[rtvIndex].pSwapChainBuffer, mpOutputResource);
+// 6.4.h Copy the results to the back-buffer
+void Tutorial01::recordCopyToBackBuffer(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex, uint32_t rtvIndex)
+{
+    // 6.4 this is rasterization and no longer needed
+    //const float clearColor[4] = { 0.4f, 0.6f, 0.2f, 1.0f };
+    //resourceBarrier(pCmdList, mFrameObjects[rtvIndex].pSwapChainBuffer, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    //pCmdList->ClearRenderTargetView(mFrameObjects[rtvIndex].rtvHandle, clearColor, 0, nullptr);
 
-    endFrame(rtvIndex);
+    mGpuProfiler.begin(pCmdList, frameIndex, "Copy to back-buffer");
+    pCmdList->CopyResource(mFrameObjects[rtvIndex].pSwapChainBuffer, mpOutputResource[frameIndex]);
+    mGpuProfiler.end(pCmdList, frameIndex);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Callbacks
+//////////////////////////////////////////////////////////////////////////
+void Tutorial01::onLoad(const Surface& surface)
+{
+    // 2.11 onLoad. The shader compile and the scene preparation don't need the device, so they run while initDXR() creates it, and the
+    // pipeline state is created while the acceleration structures build. The stages that record into the command list or allocate from
+    // the upload heap depend on each other, neither is thread-safe. The acceleration structures are built on this thread, it's worker 0 of
+    // mJobs and the BLAS builds are recorded on the job system
+    TaskGraph graph(&mProfiler);
+    TaskGraph::TaskId dxr = graph.addTask("initDXR", [&]() { initDXR(surface); }, {}, TaskGraph::Affinity::MainThread); // Tutorial 02. The swap-chain belongs to the window thread
+    TaskGraph::TaskId scene = graph.addTask("prepareScene", [&]() { prepareScene(); });
+    TaskGraph::TaskId shaders = graph.addTask("compileShaders", [&]() { mShaderLibrary = compileShaderLibrary(mPackedVertices); });
+    TaskGraph::TaskId as = graph.addTask("createAccelerationStructures", [&]() { createAccelerationStructures(); }, { dxr, scene }, TaskGraph::Affinity::MainThread); // Tutorial 03
+    TaskGraph::TaskId pipeline = graph.addTask("createRtPipelineState", [&]() { createRtPipelineState(); }, { dxr, shaders }); // Tutorial 04
+    TaskGraph::TaskId resources = graph.addTask("createShaderResources", [&]() { createShaderResources(); }, { as }); // Tutorial 06. Need to do this before initializing the shader-table
+    TaskGraph::TaskId constants = graph.addTask("createConstantBuffer", [&]() { createConstantBuffer(); }, { as }); // Tutorial 09. Yes, we need to do it before creating the shader-table
+    graph.addTask("createShaderTable", [&]() { createShaderTable(); }, { pipeline, resources, constants }); // Tutorial 05
+    graph.run(mJobs);
+    graph.printTimings();
+}
+
+void Tutorial01::onFrameRender(float elapsedTime)
+{
+    // 2.12 onFrameRender
+    uint32_t rtvIndex;
+    {
+        Profiler::Scope scope(mProfiler, "beginFrame");
+        rtvIndex = beginFrame();
+    }
+    uint32_t frameIndex = mFramePacer.getFrameIndex();
+
+    // 2.12.a The passes of the frame graph don't depend on the CPU side of the TLAS update, so they are recorded on the job system while
+    // this thread updates the TLAS. Every pass has a list of its own, the lists of a queue execute in order. The jobs live until the wait
+    JobCounter recording;
+    const std::vector<RenderGraph::PassId>& passes = mFrameGraph.getPassOrder();
+    auto recordPass = [&](uint32_t position)
+    {
+        Profiler::Scope scope(mProfiler, mFrameGraph.getPassName(passes[position]));
+        recordGraphPass(passes[position], acquireCommandList(kGraphListOrder + position), frameIndex, rtvIndex);
+    };
+    std::vector<std::function<void()>> passJobs;
+    for (uint32_t position = 0; position < (uint32_t)passes.size(); position++) passJobs.push_back([&recordPass, position]() { recordPass(position); });
+    for (const std::function<void()>& job : passJobs) mJobs.run(recording, job);
+
+    // Refit this frame's top-level acceleration structure on the compute queue. Only the rotating instances are dirty. The trace of the
+    // previous frame reads its own TLAS, so the refit can start while it runs
+    {
+        Profiler::Scope scope(mProfiler, "buildTopLevelAS");
+        TrackedCommandList list = acquireComputeList(kTlasListOrder);
+        mGpuProfiler.begin(list.pCmdList, frameIndex, "buildTopLevelAS", mComputeProfilerQueue);
+        // The table tracks the dirty instances, so only the transforms are computed in parallel
+        mInstanceTransforms.resize(mScene.getInstanceCount());
+        mJobs.parallelFor(mScene.getInstanceCount(), 256, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; i++) mInstanceTransforms[i] = mScene.getInstanceTransform(i, mRotation);
+        });
+        for (uint32_t i = 0; i < mScene.getInstanceCount(); i++) mInstanceTable.setTransform(i, mInstanceTransforms[i]);
+        if (buildTopLevelAS(mpDevice, list.pCmdList, *list.pStates, mUploadHeap, mInstanceTable, mTlasSize, mpTopLevelAS[frameIndex], &mpTopLevelAS[mFramePacer.getPreviousFrameIndex()]))
+        {
+            // The instance count changed. The GPU is done with this frame's descriptors, so the new TLAS SRV can replace the old one
+            createTlasView(frameIndex);
+            mSrvUavHeap.flushCopies();
+        }
+        mGpuProfiler.end(list.pCmdList, frameIndex);
+        submitComputeLists();
+    }
+    mRotation += mHeadless ? kRotationSpeed * elapsedTime : kRotationPerFrame;
+    mJobs.wait(recording);
+
+    {
+        Profiler::Scope scope(mProfiler, "endFrame");
+        endFrame(rtvIndex);
+    }
+    mProfiler.endFrame();
 }
 
 void Tutorial01::onShutdown()
@@ -1460,9 +1746,85 @@ void Tutorial01::onShutdown()
     mpCmdQueue->Signal(mpFence, mFenceValue);
     mpFence->SetEventOnCompletion(mFenceValue, mFenceEvent);
     WaitForSingleObject(mFenceEvent, INFINITE);
+
+    // The frames in flight are done, collect their GPU events too
+    for (uint32_t i = 0; i < kDefaultSwapChainBuffers; i++) mGpuProfiler.collect(i);
+    mProfiler.endFrame();
+    mProfiler.printStats();
+    if (mTraceFile.size() && mProfiler.writeChromeTrace(mTraceFile) == false)
+    {
+        msgBox("Can't write the trace to " + mTraceFile);
+    }
+}
+
+// Print to the console we were started from, if any
+void attachParentConsole()
+{
+    if (AttachConsole(ATTACH_PARENT_PROCESS))
+    {
+        freopen("CONOUT$", "w", stdout);
+        freopen("CONOUT$", "w", stderr);
+    }
 }
 
 int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd)
 {
-    Framework::run(Tutorial01(), "Tutorial 01 - Create Window");
+    /** Command line:
+        -scene <file>           Load a scene file instead of the built-in tutorial scene
+        -cpuref [file]          Render the CPU reference image instead of opening the window
+        -bench                  Run the CPU benchmarks
+        -writescene <file>      Write the built-in tutorial scene to a file, as a starting point for custom scenes
+        -headless <frames>      Render the frames without a window and print the frame times
+        -timestep <seconds>     Advance the animation by a fixed time every frame of a headless run, instead of the time the frame took
+        -trace <file>           Write the CPU and GPU events to a Chrome trace when the application exits
+        -packed-vertices        Upload the vertices in the 20-byte PackedVertex format instead of the 44-byte one. -cpuref always
+                                uses the 44-byte vertices, so its image isn't a reference for this format
+    */
+    std::istringstream args(lpCmdLine);
+    std::vector<std::string> argv;
+    for (std::string arg; args >> arg;) argv.push_back(arg);
+
+    std::string sceneFile;
+    std::string traceFile;
+    bool packedVertices = false;
+    HeadlessOptions headless;
+    for (size_t i = 0; i < argv.size(); i++)
+    {
+        if (argv[i] == "-scene" && i + 1 < argv.size()) sceneFile = argv[++i];
+        if (argv[i] == "-timestep" && i + 1 < argv.size()) headless.timestep = (float)atof(argv[++i].c_str());
+        if (argv[i] == "-trace" && i + 1 < argv.size()) traceFile = argv[++i];
+        if (argv[i] == "-packed-vertices") packedVertices = true;
+    }
+
+    for (size_t i = 0; i < argv.size(); i++)
+    {
+        if (argv[i] == "-cpuref")
+        {
+            attachParentConsole();
+            std::string filename = (i + 1 < argv.size() && argv[i + 1][0] != '-') ? argv[i + 1] : "CpuReference.ppm";
+            return renderCpuReference(sceneFile, filename, 1920, 1200);
+        }
+        if (argv[i] == "-bench")
+        {
+            attachParentConsole();
+            return runBenchmarks();
+        }
+        if (argv[i] == "-writescene" && i + 1 < argv.size())
+        {
+            attachParentConsole();
+            std::vector<uint8_t> data = createTutorialScene();
+            std::ofstream file(argv[i + 1], std::ios::binary);
+            file.write((const char*)data.data(), data.size());
+            return file.good() ? 0 : 1;
+        }
+        if (argv[i] == "-headless" && i + 1 < argv.size())
+        {
+            attachParentConsole();
+            headless.frameCount = (uint32_t)atoi(argv[i + 1].c_str());
+            Framework::runHeadless(Tutorial01(sceneFile, traceFile, packedVertices), headless);
+            return 0;
+        }
+    }
+
+    Framework::run(Tutorial01(sceneFile, traceFile, packedVertices), "Tutorial 01 - Create Window");
 }
@@ -27,121 +27,187 @@
 ***************************************************************************/
 #pragma once
 #include "Framework.h"
+#include "Geometry.h"
+#include "BlasManager.h"
+#include "CommandListPool.h"
+#include "DescriptorHeap.h"
+#include "FramePacer.h"
+#include "GpuProfiler.h"
+#include "InstanceTable.h"
+#include "PackedVertex.h"
+#include "Presenter.h"
+#include "Profiler.h"
+#include "RenderGraph.h"
+#include "ResourceStateTracker.h"
+#include "Scene.h"
+#include "ShaderTableBuilder.h"
+#include "UploadHeap.h"
+#include <functional>
+#include <memory>
+
+// A list of a CommandListPool and the resource states it requires. The barriers before its first commands are added when it's submitted
+struct TrackedCommandList
+{
+    ID3D12GraphicsCommandList4Ptr pCmdList;
+    CommandListStates* pStates;
+};
 
 class Tutorial01 : public Tutorial
 {
 public:
+    // An empty sceneFile uses the built-in tutorial scene. If traceFile isn't empty, the profiler events are written to it on shutdown.
+    // packedVertices uploads the vertices as PackedVertex and compiles the hit shaders for it
+    explicit Tutorial01(const std::string& sceneFile = std::string(), const std::string& traceFile = std::string(), bool packedVertices = false)
+        : mTraceFile(traceFile), mSceneFile(sceneFile), mPackedVertices(packedVertices) {}
+
     // 14.3.b bottom-level acceleration structure
     struct AccelerationStructureBuffers
     {
         ID3D12ResourcePtr pScratch;
         ID3D12ResourcePtr pResult;
-        ID3D12ResourcePtr pInstanceDesc;    // Used only for top-level AS
+        UploadAllocation instanceDesc;      // Used only for top-level AS
+        uint32_t instanceCount = 0;
+        uint64_t instanceVersion = 0;       // The InstanceTable version of the records in instanceDesc
     };
 
     // Tutorial 1 code
-    void onLoad(HWND winHandle, uint32_t winWidth, uint32_t winHeight) override;
-    void onFrameRender() override;
+    void onLoad(const Surface& surface) override;
+    void onFrameRender(float elapsedTime) override;
     void onShutdown() override;
 private:
     // Tutorial 2 code
-    void initDXR(HWND winHandle, uint32_t winWidth, uint32_t winHeight);
+    void initDXR(const Surface& surface);
     uint32_t beginFrame();
     void endFrame(uint32_t rtvIndex);
-    HWND mHwnd = nullptr;
+    TrackedCommandList acquireCommandList(uint32_t order);
+    TrackedCommandList acquireComputeList(uint32_t order);
+    void submitComputeLists();
     ID3D12Device5Ptr mpDevice;
     ID3D12CommandQueuePtr mpCmdQueue;
-    IDXGISwapChain3Ptr mpSwapChain;
+    ID3D12CommandQueuePtr mpComputeQueue;
+    std::unique_ptr<Presenter> mpPresenter;
     uvec2 mSwapChainSize;
+    // 2.6 The state of every resource that changes state, as the submitted lists leave it. Every list requires the states it needs
+    ResourceStateTracker mResourceStates;
+    // The list of onLoad(). The frames record into lists of mpCommandLists, on several threads
+    ID3D12CommandAllocatorPtr mpCmdAllocator;
     ID3D12GraphicsCommandList4Ptr mpCmdList;
+    std::unique_ptr<CommandListStates> mpLoadStates;
+    // 2.7.a The backends are D3D12CommandListBackends, one for the direct queue and one for the compute queue
+    std::unique_ptr<CommandListBackend> mpCommandListBackend;
+    std::unique_ptr<CommandListPool> mpCommandLists;
+    std::unique_ptr<CommandListBackend> mpComputeListBackend;
+    std::unique_ptr<CommandListPool> mpComputeLists;
     ID3D12FencePtr mpFence;
     HANDLE mFenceEvent;
     uint64_t mFenceValue = 0;
+    ID3D12FencePtr mpComputeFence;
+    uint64_t mComputeFenceValue = 0;
+    // Every upload-heap buffer is a range of one of its pages. Frame allocations are released by fence
+    UploadHeap mUploadHeap;
 
+    // The swap-chain buffers are indexed by the back-buffer index
     struct
     {
-        ID3D12CommandAllocatorPtr pCmdAllocator;
         ID3D12ResourcePtr pSwapChainBuffer;
         D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle;
     } mFrameObjects[kDefaultSwapChainBuffers];
-
-    // Heap data
-    struct HeapData
-    {
-        ID3D12DescriptorHeapPtr pHeap;
-        uint32_t usedEntries = 0;
-    };
-    HeapData mRtvHeap;
-    static const uint32_t kRtvHeapSize = 3;
+    FramePacer mFramePacer;
+    // CPU scopes and GPU timestamps of the frame. The stats are printed on shutdown
+    Profiler mProfiler;
+    GpuProfiler mGpuProfiler;
+    uint32_t mComputeProfilerQueue = 0;     // The GpuProfiler queue of the lists on mpComputeQueue
+    std::string mTraceFile;
+    // The per-frame CPU work and the command-list recording. This thread is worker 0
+    JobSystem mJobs;
+
+    // One RTV per swap-chain buffer
+    DescriptorHeap mRtvHeap;
 
     // Tutorial 03
+    void prepareScene();
     void createAccelerationStructures();
-    // 11.1.a
-    ID3D12ResourcePtr mpVertexBuffer[2];
-    // 14.3.c
-    AccelerationStructureBuffers mpTopLevelAS;
-    // 11.1.b
-    ID3D12ResourcePtr mpBottomLevelAS[2];
+    void flushCommandList();
+    std::string mSceneFile;
+    Scene mScene;
+    bool mPackedVertices = false;
+    uint32_t mVertexStride = sizeof(VertexPositionNormalTangentTexture);   // sizeof(PackedVertex) with mPackedVertices
+    // 11.1.a The vertex and index blobs of the scene. Every mesh is a range in them
+    UploadAllocation mVertexBuffer;
+    UploadAllocation mSceneIndexBuffer;
+    // The NumElements of the vertex and index SRVs, checked against the meshes by validateSceneGeometry()
+    SceneGeometryViews mGeometryViews;
+    // From prepareScene() to createAccelerationStructures(). The packed vertices are freed once they are uploaded
+    std::vector<PackedVertex> mPackedVertexData;
+    std::vector<InstanceBounds> mBlasBounds;
+    // 14.3.c One TLAS per frame in flight, so the CPU can update one while the GPU traces the others
+    AccelerationStructureBuffers mpTopLevelAS[kDefaultSwapChainBuffers];
+    InstanceTable mInstanceTable;
+    std::vector<glm::mat4> mInstanceTransforms;     // The transforms of the frame, computed on every core
+    // 11.1.b The BLASes, compacted into buffers the manager owns. The backend is a D3D12BlasBackend
+    std::unique_ptr<BlasBackend> mpBlasBackend;
+    std::unique_ptr<BlasManager> mpBlasManager;
     uint64_t mTlasSize = 0;
 
     // Tutorial 04
     void createRtPipelineState();
+    std::vector<uint8_t> mShaderLibrary;    // The DXIL, compiled while the device is created
     ID3D12StateObjectPtr mpPipelineState;
     ID3D12RootSignaturePtr mpEmptyRootSig;
 
     // Tutorial 05
     void createShaderTable();
-    ID3D12ResourcePtr mpShaderTable;
-    uint32_t mShaderTableEntrySize = 0;
+    // The ray-gen and plane records point at the descriptors of their frame, so there is one table per frame in flight
+    UploadAllocation mShaderTable[kDefaultSwapChainBuffers];
+    ShaderTableBuilder::RegionLayout mShaderTableRegions[(uint32_t)ShaderTableBuilder::Region::Count];
 
     // tutorial 06
     void createShaderResources();
-    ID3D12ResourcePtr mpOutputResource;
-    ID3D12DescriptorHeapPtr mpSrvUavHeap;
-    static const uint32_t kSrvUavHeapSize = 2;
+    // Write the TLAS SRV of the frame and copy the frame's views to its table. Done again whenever the TLAS of the frame is reallocated
+    void createTlasView(uint32_t frame);
+    ID3D12ResourcePtr mpOutputResource[kDefaultSwapChainBuffers];
+    // The views are created in the staging heap and copied to the shader-visible heap. The heaps are sized for scenes with thousands of meshes
+    DescriptorHeap mSrvUavHeap;
+    DescriptorHeap mStagingHeap;
+    static const uint32_t kSrvUavDescriptors = 16384;
+    // Every frame in flight has its own UAV, TLAS SRV, vertex SRV and index SRV, in that order
+    static const uint32_t kSrvUavDescriptorsPerFrame = 4;
+    DescriptorRange mFrameDescriptors[kDefaultSwapChainBuffers];
+    DescriptorRange mFrameViews[kDefaultSwapChainBuffers];     // The UAV and the TLAS SRV of each frame, in the staging heap
+    // 6.2 The passes of a frame and the resources they use. The transients of every frame in flight are placed in heaps of their own, the
+    // output is one of them. A pass records its commands with its function, the graph adds the barriers
+    typedef std::function<void(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex, uint32_t rtvIndex)> GraphPassFunc;
+    static const uint32_t kTextureHeap = 0;
+    static const uint32_t kBufferHeap = 1;
+    void createFrameGraph(const D3D12_RESOURCE_DESC& outputDesc);
+    RenderGraph::ResourceId addGraphTransient(const char* name, const D3D12_RESOURCE_DESC& desc);
+    ID3D12ResourcePtr getGraphResource(RenderGraph::ResourceId resource, uint32_t frameIndex, uint32_t rtvIndex);
+    void recordGraphPass(RenderGraph::PassId pass, const TrackedCommandList& list, uint32_t frameIndex, uint32_t rtvIndex);
+    RenderGraph mFrameGraph;
+    std::vector<GraphPassFunc> mGraphPasses;                // Indexed by PassId
+    std::vector<D3D12_RESOURCE_DESC> mTransientDescs;       // Indexed by ResourceId
+    RenderGraph::ResourceId mOutputId = RenderGraph::kInvalid;
+    RenderGraph::ResourceId mBackBufferId = RenderGraph::kInvalid;
+    std::vector<ID3D12HeapPtr> mTransientHeaps[kDefaultSwapChainBuffers];
+    std::vector<ID3D12ResourcePtr> mTransientResources[kDefaultSwapChainBuffers];
+    // 6.4 The passes of the frame graph, recorded in parallel
+    void recordDispatchRays(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex);
+    void recordCopyToBackBuffer(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex, uint32_t rtvIndex);
 
     // 9.0 
     void createConstantBuffer();
-    // 10.2.a 01-CreateWindow.h
-    ID3D12ResourcePtr mpConstantBuffer[3];
+    // 10.2.a 01-CreateWindow.h One per scene material, empty for materials that don't use one
+    std::vector<UploadAllocation> mConstantBuffer;
 
-    // 14.2.b
+    // 14.2.b The window turns the instances by the same angle every frame. Headless runs turn them by the elapsed time, the fixed timestep
+    // if there is one, so batch renders don't depend on the frame rate. The speed is the per-frame angle at 60 Hz
     float mRotation = 0;
+    static constexpr float kRotationPerFrame = 0.005f;
+    static constexpr float kRotationSpeed = 0.3f;  // Radians per second
+    bool mHeadless = false;
 
-    // 17.1.c
-    ID3D12ResourcePtr mpIndexBuffer;
-
-    // 18.0.a
+    // 18.0.a The vertex and shape definitions live in Geometry.h so the CPU reference path can share them
 public:
-    struct VertexPositionNormalTangentTexture
-    {
-        glm::vec3 position;
-        glm::vec3 normal;
-        glm::vec3 tangent;
-        glm::vec2 texCoord;
-
-        VertexPositionNormalTangentTexture(const glm::vec3 pos, const glm::vec3 norm,
-            const glm::vec3 tan, const glm::vec2 texCor)
-        {
-            position = pos;
-            normal = norm;
-            tangent = tan;
-            texCoord = texCor;
-        }
-
-        VertexPositionNormalTangentTexture() = default;
-    };
-
-    // 18.0.b
-    struct Shape
-    {
-        std::vector<VertexPositionNormalTangentTexture> vertexData;
-        std::vector<unsigned short> indexData;
-    };
-
-    // 18.0.e
-    static void calculateTangentSpace(Shape& shape);
-    
-    // 18.0.c
-    static Shape createSphere(float diameter, int tessellation, bool uvHorizontalFlip = false, bool uvVerticalFlip = false);
+    using VertexPositionNormalTangentTexture = ::VertexPositionNormalTangentTexture;
+    using Shape = ::Shape;
 };
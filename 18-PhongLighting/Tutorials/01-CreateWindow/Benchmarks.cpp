@@ -0,0 +1,2781 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <float.h>
+#include "Benchmarks.h"
+#include "WideBvh.h"
+#include "BlasManager.h"
+#include "CommandListPool.h"
+#include "CpuRaytracer.h"
+#include "DescriptorAllocator.h"
+#include "RingAllocator.h"
+#include "FramePacer.h"
+#include "InstanceTable.h"
+#include "JobSystem.h"
+#include "MeshOptimizer.h"
+#include "PackedVertex.h"
+#include "Profiler.h"
+#include "QueueTimeline.h"
+#include "RenderGraph.h"
+#include "ResourceStateTracker.h"
+#include "Scene.h"
+#include "ShaderCache.h"
+#include "ShaderTableBuilder.h"
+#include "TaskGraph.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+namespace
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Run func() until at least minSeconds have passed and return the best time of a single run, which is the least noisy number we can get
+    template<typename Func>
+    double bestTime(Func func, double minSeconds = 0.5)
+    {
+        double best = 1e30;
+        Clock::time_point start = Clock::now();
+        do
+        {
+            Clock::time_point runStart = Clock::now();
+            func();
+            best = std::min(best, secondsSince(runStart));
+        } while (secondsSince(start) < minSeconds);
+        return best;
+    }
+
+    // rayGen() looking at the sphere, with a shadow ray towards the planeChs() light for every primary hit
+    struct RayBatch
+    {
+        std::vector<RayDesc> primary;
+        std::vector<RayDesc> shadow;
+    };
+
+    RayBatch generateRays(const WideBvh& bvh, uint32_t width, uint32_t height)
+    {
+        RayBatch batch;
+        batch.primary.reserve(size_t(width) * height);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                glm::vec2 d = (glm::vec2(float(x), float(y)) / glm::vec2(float(width), float(height))) * 2.f - 1.f;
+                RayDesc ray;
+                ray.origin = glm::vec3(0, 0, -2);
+                ray.direction = glm::normalize(glm::vec3(d.x * float(width) / float(height), -d.y, 1));
+                ray.tMin = 0;
+                ray.tMax = 100000;
+                batch.primary.push_back(ray);
+
+                WideBvh::Hit hit;
+                if (bvh.intersect(ray, false, hit))
+                {
+                    RayDesc shadowRay;
+                    shadowRay.origin = ray.origin + hit.t * ray.direction;
+                    shadowRay.direction = glm::normalize(glm::vec3(0.5f, 0.5f, -0.5f));
+                    shadowRay.tMin = 0.01f;
+                    shadowRay.tMax = 100000;
+                    batch.shadow.push_back(shadowRay);
+                }
+            }
+        }
+        return batch;
+    }
+
+    // Returns the number of hits, so the work can't be optimized away and the kernels can be checked against each other
+    uint32_t traceBatch(const WideBvh& traversal, const std::vector<RayDesc>& rays, bool acceptFirstHit)
+    {
+        uint32_t hitCount = 0;
+        for (const RayDesc& ray : rays)
+        {
+            WideBvh::Hit hit;
+            if (traversal.intersect(ray, acceptFirstHit, hit)) hitCount++;
+        }
+        return hitCount;
+    }
+
+    void reportTraversal(const char* name, const WideBvh& traversal, const RayBatch& batch)
+    {
+        uint32_t primaryHits = 0;
+        uint32_t shadowHits = 0;
+        double primarySec = bestTime([&]() { primaryHits = traceBatch(traversal, batch.primary, false); });
+        double shadowSec = bestTime([&]() { shadowHits = traceBatch(traversal, batch.shadow, true); });
+        printf("    %-7s primary %7.2f Mrays/s (%u hits), shadow %7.2f Mrays/s (%u hits)\n", name,
+            double(batch.primary.size()) / primarySec / 1e6, primaryHits, double(batch.shadow.size()) / shadowSec / 1e6, shadowHits);
+    }
+
+    // The frame loop of the tutorial, with kDefaultSwapChainBuffers frames in flight. The fence of frame N completes when frame N + kFramesInFlight starts
+    static const uint32_t kFramesInFlight = 3;
+
+    struct UploadRequest
+    {
+        uint64_t size;
+        uint64_t alignment;
+    };
+
+    // Constant buffers, shader-table records, instance descs and structured-buffer elements of the tutorial vertex
+    std::vector<UploadRequest> generateUploadRequests(uint32_t count, uint64_t maxSize, uint32_t seed)
+    {
+        const uint64_t kAlignments[] = { 256, 64, 16, 4, 44 };
+        std::mt19937 rng(seed);
+        std::vector<UploadRequest> requests(count);
+        for (UploadRequest& request : requests)
+        {
+            request.size = 1 + rng() % maxSize;
+            request.alignment = kAlignments[rng() % (sizeof(kAlignments) / sizeof(kAlignments[0]))];
+        }
+        return requests;
+    }
+
+    struct UploadStats
+    {
+        uint32_t outOfSpace = 0;
+        uint32_t invalid = 0;
+        uint64_t peakUsage = 0;
+    };
+
+    // When validating, every allocation is checked for alignment and against the ranges still in flight
+    UploadStats runUploadFrames(RingAllocator& ring, const std::vector<UploadRequest>& requests, uint32_t frameCount, uint32_t allocationsPerFrame, bool validate)
+    {
+        UploadStats stats;
+        std::map<uint64_t, uint64_t> liveRanges;    // begin -> end
+        std::deque<std::vector<uint64_t>> frameRanges;
+        size_t next = 0;
+        for (uint32_t frame = 1; frame <= frameCount; frame++)
+        {
+            if (frame > kFramesInFlight)
+            {
+                ring.retire(frame - kFramesInFlight);
+                if (validate)
+                {
+                    for (uint64_t begin : frameRanges.front()) liveRanges.erase(begin);
+                    frameRanges.pop_front();
+                }
+            }
+            if (validate) frameRanges.push_back(std::vector<uint64_t>());
+
+            for (uint32_t i = 0; i < allocationsPerFrame; i++)
+            {
+                const UploadRequest& request = requests[next];
+                next = (next + 1) % requests.size();
+                uint64_t offset = ring.allocate(request.size, request.alignment);
+                if (offset == RingAllocator::kInvalidOffset)
+                {
+                    stats.outOfSpace++;
+                    continue;
+                }
+                if (validate)
+                {
+                    uint64_t end = offset + request.size;
+                    std::map<uint64_t, uint64_t>::iterator it = liveRanges.lower_bound(offset);
+                    bool invalid = (offset % request.alignment) != 0 || end > ring.getCapacity();
+                    if (it != liveRanges.end() && it->first < end) invalid = true;
+                    if (it != liveRanges.begin() && std::prev(it)->second > offset) invalid = true;
+                    if (invalid)
+                    {
+                        printf("    Invalid allocation at frame %u: offset %llu, size %llu, alignment %llu\n", frame, (unsigned long long)offset, (unsigned long long)request.size, (unsigned long long)request.alignment);
+                        stats.invalid++;
+                        continue;
+                    }
+                    liveRanges[offset] = end;
+                    frameRanges.back().push_back(offset);
+                }
+            }
+            stats.peakUsage = std::max(stats.peakUsage, ring.getUsedSize());
+            ring.endFrame(frame);
+        }
+        return stats;
+    }
+
+    struct DescriptorStats
+    {
+        uint64_t allocations = 0;
+        uint32_t outOfSpace = 0;
+        uint32_t invalid = 0;
+        uint32_t peakFreeRanges = 0;
+        bool drained = false;       // Everything was free and merged into a single range after the last frame retired
+    };
+
+    // Meshes come and go every frame, each with a persistent range of 1 to maxRangeSize descriptors, and every frame allocates a few
+    // transient ranges. When validating, every descriptor is tracked, so a range that overlaps a live one, or reuses a freed descriptor
+    // before the frame that freed it retired, is caught
+    DescriptorStats runDescriptorFrames(DescriptorAllocator& allocator, uint32_t liveRangeTarget, uint32_t maxRangeSize, uint32_t frameCount, uint32_t seed, bool validate)
+    {
+        enum State : uint8_t { Free, Live, Freed, Transient };
+        DescriptorStats stats;
+        std::mt19937 rng(seed);
+        const uint32_t persistentCount = allocator.getPersistentCount();
+        std::vector<uint8_t> state(validate ? persistentCount + allocator.getTransientCount() : 0, Free);
+        std::vector<std::pair<uint32_t, uint32_t>> liveRanges;
+        std::deque<std::vector<std::pair<uint32_t, uint32_t>>> frameReleases;   // The freed and the transient ranges of the frames in flight
+
+        auto claim = [&](uint32_t index, uint32_t count, uint32_t begin, uint32_t end, State newState)
+        {
+            bool ok = index >= begin && index + count <= end;
+            for (uint32_t d = index; ok && d < index + count; d++) ok = state[d] == Free;
+            if (ok == false)
+            {
+                stats.invalid++;
+                return false;
+            }
+            for (uint32_t d = index; d < index + count; d++) state[d] = newState;
+            return true;
+        };
+
+        for (uint32_t frame = 1; frame <= frameCount; frame++)
+        {
+            if (frame > kFramesInFlight)
+            {
+                allocator.retire(frame - kFramesInFlight);
+                if (validate)
+                {
+                    for (const std::pair<uint32_t, uint32_t>& range : frameReleases.front())
+                    {
+                        for (uint32_t d = range.first; d < range.first + range.second; d++) state[d] = Free;
+                    }
+                    frameReleases.pop_front();
+                }
+            }
+            if (validate) frameReleases.push_back(std::vector<std::pair<uint32_t, uint32_t>>());
+
+            // Replace about a tenth of the meshes every frame
+            uint32_t changes = liveRangeTarget / 10 + 1;
+            for (uint32_t c = 0; c < changes && liveRanges.empty() == false; c++)
+            {
+                size_t victim = rng() % liveRanges.size();
+                std::pair<uint32_t, uint32_t> range = liveRanges[victim];
+                liveRanges[victim] = liveRanges.back();
+                liveRanges.pop_back();
+                allocator.freePersistent(range.first, range.second);
+                if (validate)
+                {
+                    for (uint32_t d = range.first; d < range.first + range.second; d++) state[d] = Freed;
+                    frameReleases.back().push_back(range);
+                }
+            }
+            while (liveRanges.size() < liveRangeTarget)
+            {
+                uint32_t count = 1 + rng() % maxRangeSize;
+                uint32_t index = allocator.allocatePersistent(count);
+                stats.allocations++;
+                if (index == DescriptorAllocator::kInvalidIndex)
+                {
+                    stats.outOfSpace++;
+                    break;
+                }
+                if (validate && claim(index, count, 0, persistentCount, Live) == false) continue;
+                liveRanges.push_back(std::make_pair(index, count));
+            }
+
+            for (uint32_t t = 0; t < 16; t++)
+            {
+                uint32_t count = 1 + rng() % 8;
+                uint32_t index = allocator.allocateTransient(count);
+                stats.allocations++;
+                if (index == DescriptorAllocator::kInvalidIndex)
+                {
+                    stats.outOfSpace++;
+                    continue;
+                }
+                if (validate && claim(index, count, persistentCount, persistentCount + allocator.getTransientCount(), Transient))
+                {
+                    frameReleases.back().push_back(std::make_pair(index, count));
+                }
+            }
+
+            stats.peakFreeRanges = std::max(stats.peakFreeRanges, allocator.getFreeRangeCount());
+            allocator.endFrame(frame);
+        }
+
+        // Free everything. Once the last frame retires the free list has to be back to a single range
+        for (const std::pair<uint32_t, uint32_t>& range : liveRanges) allocator.freePersistent(range.first, range.second);
+        allocator.endFrame(frameCount + 1);
+        allocator.retire(frameCount + 1);
+        stats.drained = allocator.getFreePersistentCount() == persistentCount && allocator.getFreeRangeCount() == 1 && allocator.getUsedTransientCount() == 0;
+        return stats;
+    }
+
+    // The sphere generator createSphere() replaced. It grows the vectors with push_back() and calls sin() and cos() for every vertex.
+    // The indices are 32-bit here, the original used 16-bit indices and overflowed above tessellation 180
+    Shape createSphereReference(float diameter, int tessellation)
+    {
+        Shape sphere;
+        const int verticalSegments = tessellation;
+        const int horizontalSegments = tessellation * 2;
+        const float uIncrement = -1.f / horizontalSegments;
+        const float vIncrement = -1.f / verticalSegments;
+        const float radius = diameter / 2;
+        float u = 1;
+        float v = 1;
+        for (int i = 0; i < horizontalSegments; i++)
+        {
+            u += uIncrement;
+            sphere.vertexData.push_back(VertexPositionNormalTangentTexture(glm::vec3(0, -1, 0) * radius, glm::vec3(0, -1, 0), glm::vec3(0), glm::vec2(u, v)));
+        }
+        for (int i = 0; i < verticalSegments - 1; i++)
+        {
+            const float latitude = (((i + 1) * static_cast<float>(M_PI)) / verticalSegments) - static_cast<float>(M_PI) / 2;
+            u = 1;
+            v += vIncrement;
+            const float dy = static_cast<float>(sin(latitude));
+            const float dxz = static_cast<float>(cos(latitude));
+            for (int j = 0; j <= horizontalSegments; j++)
+            {
+                const float longitude = j * static_cast<float>(M_PI) * 2 / horizontalSegments;
+                const glm::vec3 normal(static_cast<float>(cos(longitude)) * dxz, dy, static_cast<float>(sin(longitude)) * dxz);
+                sphere.vertexData.push_back(VertexPositionNormalTangentTexture(normal * radius, normal, glm::vec3(0), glm::vec2(u, v)));
+                u += uIncrement;
+            }
+        }
+        u = 1;
+        for (int i = 0; i < horizontalSegments; i++)
+        {
+            u += uIncrement;
+            sphere.vertexData.push_back(VertexPositionNormalTangentTexture(glm::vec3(0, 1, 0) * radius, glm::vec3(0, 1, 0), glm::vec3(0), glm::vec2(u, 0)));
+        }
+
+        for (int i = 0; i < horizontalSegments; i++)
+        {
+            sphere.indexData32.push_back(i);
+            sphere.indexData32.push_back(1 + i + horizontalSegments);
+            sphere.indexData32.push_back(i + horizontalSegments);
+        }
+        for (int i = 0; i < verticalSegments - 2; i++)
+        {
+            for (int j = 0; j < horizontalSegments; j++)
+            {
+                const int num = horizontalSegments + 1;
+                const int i1 = horizontalSegments + (i * num) + j;
+                const int i2 = i1 + 1;
+                const int i3 = i1 + num;
+                const int i4 = i3 + 1;
+                const uint32_t quad[] = { uint32_t(i1), uint32_t(i2), uint32_t(i3), uint32_t(i2), uint32_t(i4), uint32_t(i3) };
+                sphere.indexData32.insert(sphere.indexData32.end(), quad, quad + 6);
+            }
+        }
+        const uint32_t vertexCount = (uint32_t)sphere.vertexData.size();
+        for (int i = 0; i < horizontalSegments; i++)
+        {
+            sphere.indexData32.push_back(vertexCount - 1 - i);
+            sphere.indexData32.push_back(vertexCount - horizontalSegments - 2 - i);
+            sphere.indexData32.push_back(vertexCount - horizontalSegments - 1 - i);
+        }
+        calculateTangentSpace(sphere);
+        return sphere;
+    }
+
+    // Returns the largest difference of the positions, normals and texture coordinates, or FLT_MAX if the topology differs
+    float compareSpheres(const Shape& a, const Shape& b)
+    {
+        if (a.vertexData.size() != b.vertexData.size() || a.getIndexCount() != b.getIndexCount()) return FLT_MAX;
+        for (uint32_t i = 0; i < a.getIndexCount(); i++)
+        {
+            if (a.getIndex(i) != b.getIndex(i)) return FLT_MAX;
+        }
+        float maxError = 0;
+        for (size_t i = 0; i < a.vertexData.size(); i++)
+        {
+            const VertexPositionNormalTangentTexture& va = a.vertexData[i];
+            const VertexPositionNormalTangentTexture& vb = b.vertexData[i];
+            glm::vec3 position = glm::abs(va.position - vb.position);
+            glm::vec3 normal = glm::abs(va.normal - vb.normal);
+            glm::vec2 texCoord = glm::abs(va.texCoord - vb.texCoord);
+            maxError = std::max(maxError, std::max(std::max(position.x, std::max(position.y, position.z)), std::max(normal.x, std::max(normal.y, normal.z))));
+            maxError = std::max(maxError, std::max(texCoord.x, texCoord.y));
+        }
+        return maxError;
+    }
+
+    // The tangent generator calculateTangentSpace() used before generateTangents(). It sums the unnormalized per-triangle tangents, so
+    // corners are weighted by the triangle area over the texture area, and it has no handedness
+    std::vector<glm::vec3> calculateTangentsReference(const Shape& shape)
+    {
+        const size_t vertexCount = shape.vertexData.size();
+        std::vector<glm::vec3> tan1(vertexCount, glm::vec3(0));
+        for (uint32_t a = 0; a < shape.getIndexCount() / 3; a++)
+        {
+            const uint32_t i1 = shape.getIndex((a * 3) + 0);
+            const uint32_t i2 = shape.getIndex((a * 3) + 1);
+            const uint32_t i3 = shape.getIndex((a * 3) + 2);
+            const VertexPositionNormalTangentTexture& a1 = shape.vertexData[i1];
+            const VertexPositionNormalTangentTexture& a2 = shape.vertexData[i2];
+            const VertexPositionNormalTangentTexture& a3 = shape.vertexData[i3];
+
+            const glm::vec3 e1 = a2.position - a1.position;
+            const glm::vec3 e2 = a3.position - a1.position;
+            const float s1 = a2.texCoord.x - a1.texCoord.x;
+            const float s2 = a3.texCoord.x - a1.texCoord.x;
+            const float t1 = a2.texCoord.y - a1.texCoord.y;
+            const float t2 = a3.texCoord.y - a1.texCoord.y;
+
+            const float r = 1.0F / ((s1 * t2) - (s2 * t1));
+            const glm::vec3 sdir = (e1 * t2 - e2 * t1) * r;
+            tan1[i1] += sdir;
+            tan1[i2] += sdir;
+            tan1[i3] += sdir;
+        }
+
+        std::vector<glm::vec3> tangents(vertexCount);
+        for (size_t a = 0; a < vertexCount; a++)
+        {
+            const glm::vec3 n = shape.vertexData[a].normal;
+            tangents[a] = glm::normalize(tan1[a] - (n * glm::dot(n, tan1[a])));
+        }
+        return tangents;
+    }
+
+    // Checks that every tangent is a unit vector orthogonal to the normal with a handedness of +1 or -1, and returns the largest angle in
+    // degrees to the reference tangents. Returns FLT_MAX if a check failed. handedness is set to the common handedness, or 0 if it varies
+    float checkTangents(const Shape& shape, const std::vector<glm::vec4>& tangents, const std::vector<glm::vec3>& reference, float& handedness)
+    {
+        float maxAngle = 0;
+        handedness = tangents.empty() ? 0 : tangents[0].w;
+        for (size_t i = 0; i < tangents.size(); i++)
+        {
+            const glm::vec3 t(tangents[i]);
+            const float w = tangents[i].w;
+            if (fabsf(glm::length(t) - 1) > 1e-4f || fabsf(glm::dot(t, shape.vertexData[i].normal)) > 1e-4f || fabsf(w) != 1) return FLT_MAX;
+            if (w != handedness) handedness = 0;
+            const float cosAngle = std::min(1.0f, glm::dot(t, reference[i]));
+            maxAngle = std::max(maxAngle, acosf(cosAngle) * 180.0f / static_cast<float>(M_PI));
+        }
+        return maxAngle;
+    }
+
+    float angleDegrees(const glm::vec3& a, const glm::vec3& b)
+    {
+        return acosf(std::min(1.0f, glm::dot(glm::normalize(a), glm::normalize(b)))) * 180.0f / static_cast<float>(M_PI);
+    }
+
+    // The 32-byte sectors the hit shader touches when it reads size bytes at offset of the three vertices of every triangle, per triangle
+    double averageSectorsPerHit(const Shape& shape, uint32_t stride, uint32_t offset, uint32_t size)
+    {
+        const uint64_t kSectorSize = 32;
+        uint64_t sectors = 0;
+        for (uint32_t i = 0; i < shape.getIndexCount(); i += 3)
+        {
+            uint64_t touched[6];
+            uint32_t count = 0;
+            for (uint32_t corner = 0; corner < 3; corner++)
+            {
+                uint64_t begin = uint64_t(shape.getIndex(i + corner)) * stride + offset;
+                for (uint64_t sector = begin / kSectorSize; sector <= (begin + size - 1) / kSectorSize; sector++)
+                {
+                    if (std::find(touched, touched + count, sector) == touched + count) touched[count++] = sector;
+                }
+            }
+            sectors += count;
+        }
+        return double(sectors) / (shape.getIndexCount() / 3);
+    }
+
+    // The triangles of a shape by vertex value, each rotated to start at its smallest vertex and then sorted, so two shapes compare equal
+    // when they have the same triangles with the same winding, whatever the index and vertex order. A shape without indices is a triangle list
+    std::vector<std::string> canonicalTriangles(const Shape& shape)
+    {
+        const size_t kVertexSize = sizeof(VertexPositionNormalTangentTexture);
+        const bool indexed = shape.getIndexCount() != 0;
+        std::vector<std::string> triangles((indexed ? shape.getIndexCount() : shape.vertexData.size()) / 3);
+        for (uint32_t t = 0; t < (uint32_t)triangles.size(); t++)
+        {
+            const VertexPositionNormalTangentTexture* corners[3];
+            for (uint32_t c = 0; c < 3; c++) corners[c] = &shape.vertexData[indexed ? shape.getIndex(t * 3 + c) : t * 3 + c];
+            uint32_t first = 0;
+            for (uint32_t c = 1; c < 3; c++)
+            {
+                if (memcmp(corners[c], corners[first], kVertexSize) < 0) first = c;
+            }
+            triangles[t].resize(3 * kVertexSize);
+            for (uint32_t c = 0; c < 3; c++) memcpy(&triangles[t][c * kVertexSize], corners[(first + c) % 3], kVertexSize);
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    glm::mat4 translation(const glm::vec3& offset)
+    {
+        glm::mat4 m(1.0f);
+        m[3] = glm::vec4(offset, 1.0f);
+        return m;
+    }
+
+    struct TimelineStats
+    {
+        double frameTime = 0;       // Average time between two presented frames, once the pipeline is full
+        uint32_t violations = 0;    // The CPU started recording into a slot the GPU was still using
+        uint32_t staleBuffers = 0;  // A per-frame instance buffer didn't match the instance table after flush()
+    };
+
+    // Plays the CPU and the GPU queue of the frame loop against each other. The CPU records a frame, submits it, and waits for the fence
+    // FramePacer returns. The GPU runs the frames in submission order. Every frame also moves a few instances and flushes the instance
+    // buffer of its slot, which has to match the table afterwards
+    TimelineStats simulateFrameTimeline(uint32_t framesInFlight, double cpuTime, double gpuTime, uint32_t frameCount, uint32_t seed)
+    {
+        TimelineStats stats;
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> jitter(0.8f, 1.2f);
+
+        const uint32_t kInstanceCount = 64;
+        InstanceTable table;
+        table.setBlas(0, 0x1000, glm::vec3(-1), glm::vec3(1));
+        for (uint32_t i = 0; i < kInstanceCount; i++) table.addInstance(0, translation(glm::vec3(float(i), 0, 0)), i, 0);
+        std::vector<std::vector<RaytracingInstanceDesc>> slotBuffers(framesInFlight, std::vector<RaytracingInstanceDesc>(kInstanceCount));
+        std::vector<uint64_t> slotVersions(framesInFlight, 0);
+
+        FramePacer pacer(framesInFlight);
+        std::vector<double> fenceCompletion(1, 0.0);        // Indexed by fence value. Fence 0 is signaled from the start
+        std::vector<double> slotCompletion(framesInFlight, 0.0);
+        double cpuClock = 0;
+        double gpuClock = 0;
+        double firstMeasured = 0;
+        const uint32_t warmup = framesInFlight * 2;
+        for (uint32_t frame = 0; frame < frameCount; frame++)
+        {
+            // The slot must be free when recording starts
+            uint32_t slot = pacer.getFrameIndex();
+            if (slotCompletion[slot] > cpuClock) stats.violations++;
+
+            // Some frames don't move anything, the slot buffers still have to catch up with the changes they missed
+            uint32_t moved = rng() % 4;
+            for (uint32_t m = 0; m < moved; m++) table.setTransform(rng() % kInstanceCount, translation(glm::vec3(float(rng() % 1000), float(frame), 0)));
+            table.chooseBuildMode();
+            table.flush(slotBuffers[slot].data(), slotVersions[slot]);
+            for (uint32_t i = 0; i < kInstanceCount; i++)
+            {
+                if (memcmp(&slotBuffers[slot][i], &table.getDesc(i), sizeof(RaytracingInstanceDesc)) != 0)
+                {
+                    stats.staleBuffers++;
+                    break;
+                }
+            }
+
+            cpuClock += cpuTime * jitter(rng);
+
+            // Submit. The GPU starts when both the work arrived and the previous frame is done
+            gpuClock = std::max(gpuClock, cpuClock) + gpuTime * jitter(rng);
+            uint64_t fenceValue = fenceCompletion.size();
+            fenceCompletion.push_back(gpuClock);
+            slotCompletion[slot] = gpuClock;
+            if (frame == warmup) firstMeasured = gpuClock;
+
+            // Wait for the next slot
+            uint64_t waitValue = pacer.endFrame(fenceValue);
+            cpuClock = std::max(cpuClock, fenceCompletion[(size_t)waitValue]);
+        }
+        stats.frameTime = (gpuClock - firstMeasured) / double(frameCount - warmup - 1);
+        return stats;
+    }
+
+    enum class AsQueueMode
+    {
+        Direct,         // The TLAS update and the trace on the direct queue
+        AsyncCompute,   // The TLAS update on the compute queue, the direct queue waits for its fence
+        NoWait,         // The same without the wait. The checks have to catch it
+    };
+
+    struct AsyncComputeStats
+    {
+        double frameTime = 0;           // Average time between two traces, once the pipeline is full
+        uint32_t overlaps = 0;          // TLAS updates that ran while an earlier frame traced
+        uint32_t earlyTraces = 0;       // A trace started before the TLAS update of its frame ended
+        uint32_t slotViolations = 0;    // A TLAS update started before the last trace of its slot ended
+        bool stalled = false;
+    };
+
+    // The frame loop of Tutorial01 on a QueueTimeline. The CPU records the TLAS update and submits it, records the trace and submits it,
+    // then waits for the fence FramePacer returns. With async compute the update signals a fence of the compute queue that the direct
+    // queue waits for before the trace
+    AsyncComputeStats simulateAsyncCompute(AsQueueMode mode, double cpuTime, double tlasTime, double traceTime, uint32_t frameCount, uint32_t seed)
+    {
+        AsyncComputeStats stats;
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> jitter(0.8f, 1.2f);
+
+        QueueTimeline timeline;
+        const uint32_t direct = timeline.addQueue();
+        const uint32_t compute = (mode == AsQueueMode::Direct) ? direct : timeline.addQueue();
+        const uint32_t directFence = timeline.addFence();
+        const uint32_t computeFence = timeline.addFence();
+        FramePacer pacer(kFramesInFlight);
+        std::vector<uint32_t> tlasSpans;
+        std::vector<uint32_t> traceSpans;
+        double cpuClock = 0;
+        for (uint32_t frame = 0; frame < frameCount; frame++)
+        {
+            const uint64_t fenceValue = frame + 1;
+            cpuClock += cpuTime * 0.25 * jitter(rng);
+            tlasSpans.push_back(timeline.execute(compute, cpuClock, tlasTime * jitter(rng), frame));
+            if (mode != AsQueueMode::Direct) timeline.signal(compute, computeFence, fenceValue, cpuClock);
+
+            cpuClock += cpuTime * 0.75 * jitter(rng);
+            if (mode == AsQueueMode::AsyncCompute) timeline.wait(direct, computeFence, fenceValue, cpuClock);
+            traceSpans.push_back(timeline.execute(direct, cpuClock, traceTime * jitter(rng), frame));
+            timeline.signal(direct, directFence, fenceValue, cpuClock);
+
+            const uint64_t waitValue = pacer.endFrame(fenceValue);
+            cpuClock = std::max(cpuClock, timeline.getFenceTime(directFence, waitValue));
+        }
+        stats.stalled = timeline.isStalled();
+
+        for (uint32_t frame = 0; frame < frameCount; frame++)
+        {
+            const QueueTimeline::Span& tlas = timeline.getSpan(tlasSpans[frame]);
+            const QueueTimeline::Span& trace = timeline.getSpan(traceSpans[frame]);
+            if (trace.start < tlas.end) stats.earlyTraces++;
+            // The frames still in flight when the update was submitted
+            for (uint32_t previous = (frame > kFramesInFlight) ? frame - kFramesInFlight + 1 : 0; previous < frame; previous++)
+            {
+                const QueueTimeline::Span& previousTrace = timeline.getSpan(traceSpans[previous]);
+                if (tlas.start < previousTrace.end && previousTrace.start < tlas.end)
+                {
+                    stats.overlaps++;
+                    break;
+                }
+            }
+            // The TLAS of the slot was last traced kFramesInFlight frames ago
+            if (frame >= kFramesInFlight && tlas.start < timeline.getSpan(traceSpans[frame - kFramesInFlight]).end) stats.slotViolations++;
+        }
+        const uint32_t warmup = kFramesInFlight * 2;
+        stats.frameTime = (timeline.getSpan(traceSpans.back()).end - timeline.getSpan(traceSpans[warmup]).end) / double(frameCount - warmup - 1);
+        return stats;
+    }
+
+    // What a command list of the resource-state check did, in recording order. The checker replays it on the "GPU" states
+    struct StateOp
+    {
+        enum class Type
+        {
+            Barriers,   // A flush(), the barriers are in batch
+            Use,        // A command that needs the state
+        };
+        Type type;
+        uint64_t resource;
+        uint32_t subresource;
+        uint32_t state;
+        std::vector<ResourceBarrier> batch;
+    };
+
+    struct StateCheck
+    {
+        uint32_t violations = 0;    // A barrier from the wrong state, or a command that ran in the wrong state or without a UAV barrier
+        uint32_t barriers = 0;
+        uint32_t barrierCalls = 0;  // Non-empty batches, each one ResourceBarrier() call
+    };
+
+    // The states the GPU has the subresources in, and the batch that last used a subresource as a UAV without a barrier since. The
+    // aliasing barriers are collected for the render-graph check
+    struct GpuStates
+    {
+        std::map<uint64_t, std::vector<uint32_t>> states;
+        std::map<uint64_t, std::vector<int64_t>> uavBatch;
+        std::vector<uint64_t> aliased;
+
+        void applyBarriers(const std::vector<ResourceBarrier>& barriers, StateCheck& check)
+        {
+            if (barriers.empty()) return;
+            check.barrierCalls++;
+            for (const ResourceBarrier& b : barriers)
+            {
+                check.barriers++;
+                if (b.type == ResourceBarrier::Type::Aliasing)
+                {
+                    aliased.push_back(b.resource);
+                    continue;
+                }
+                if (b.type == ResourceBarrier::Type::Uav)
+                {
+                    for (auto& it : uavBatch)
+                    {
+                        if (b.resource == 0 || b.resource == it.first) std::fill(it.second.begin(), it.second.end(), -1);
+                    }
+                    continue;
+                }
+                std::vector<uint32_t>& s = states[b.resource];
+                const uint32_t first = (b.subresource == ResourceStateTracker::kAllSubresources) ? 0 : b.subresource;
+                const uint32_t last = (b.subresource == ResourceStateTracker::kAllSubresources) ? (uint32_t)s.size() : b.subresource + 1;
+                for (uint32_t i = first; i < last; i++)
+                {
+                    if (i >= s.size() || s[i] != b.stateBefore) check.violations++;
+                    if (i < s.size()) s[i] = b.stateAfter;
+                    // A transition orders the accesses like a UAV barrier does
+                    if (i < s.size()) uavBatch[b.resource][i] = -1;
+                }
+            }
+        }
+
+        void use(const StateOp& op, int64_t batch, StateCheck& check)
+        {
+            std::vector<uint32_t>& s = states[op.resource];
+            const uint32_t first = (op.subresource == ResourceStateTracker::kAllSubresources) ? 0 : op.subresource;
+            const uint32_t last = (op.subresource == ResourceStateTracker::kAllSubresources) ? (uint32_t)s.size() : op.subresource + 1;
+            for (uint32_t i = first; i < last; i++)
+            {
+                const bool ok = ResourceStateTracker::isReadState(op.state) ? (s[i] & op.state) == op.state : s[i] == op.state;
+                if (ok == false) check.violations++;
+                if (op.state == ResourceStateTracker::kStateUnorderedAccess)
+                {
+                    int64_t& last = uavBatch[op.resource][i];
+                    if (last != -1 && last != batch) check.violations++;
+                    last = batch;
+                }
+            }
+        }
+    };
+
+    // Random passes over random resources, recorded into several lists on the job system and submitted through resolve(). Returns the
+    // replay on the "GPU", and the number of require() calls in requireCount
+    StateCheck runResourceStates(JobSystem& jobs, uint32_t frameCount, uint32_t seed, uint32_t& requireCount)
+    {
+        const uint32_t kStates[] = { ResourceStateTracker::kStateCommon, ResourceStateTracker::kStateUnorderedAccess, 0x800, 0x400, 0x40, 0x80, 0x40 | 0x80, 0x1 };
+        const uint32_t kStateCount = sizeof(kStates) / sizeof(kStates[0]);
+        const uint32_t kResourceCount = 12;
+        std::mt19937 rng(seed);
+        ResourceStateTracker tracker;
+        GpuStates gpu;
+        for (uint64_t r = 1; r <= kResourceCount; r++)
+        {
+            const uint32_t subresources = (r % 3 == 0) ? 6 : 1;
+            const uint32_t state = kStates[rng() % kStateCount];
+            tracker.addResource(r * 0x100, subresources, state);
+            gpu.states[r * 0x100].assign(subresources, state);
+            gpu.uavBatch[r * 0x100].assign(subresources, -1);
+        }
+
+        StateCheck check;
+        std::atomic<uint32_t> requireCalls(0);
+        int64_t batch = 0;
+        for (uint32_t frame = 0; frame < frameCount; frame++)
+        {
+            const uint32_t listCount = 1 + rng() % 6;
+            std::vector<uint32_t> seeds(listCount);
+            for (uint32_t& listSeed : seeds) listSeed = rng();
+            std::vector<std::unique_ptr<CommandListStates>> lists(listCount);
+            std::vector<std::vector<StateOp>> ops(listCount);
+            jobs.parallelFor(listCount, 1, [&](uint32_t begin, uint32_t end)
+            {
+                for (uint32_t l = begin; l < end; l++)
+                {
+                    std::mt19937 listRng(seeds[l]);
+                    lists[l].reset(new CommandListStates(tracker));
+                    // Guess the state of a resource, right or wrong
+                    if (listRng() % 4 == 0)
+                    {
+                        const uint64_t resource = (1 + listRng() % kResourceCount) * 0x100;
+                        const uint32_t subresources = tracker.getSubresourceCount(resource);
+                        const uint32_t subresource = (subresources > 1 && listRng() % 2) ? listRng() % subresources : ResourceStateTracker::kAllSubresources;
+                        lists[l]->expect(resource, kStates[listRng() % kStateCount], subresource);
+                    }
+                    const uint32_t passCount = 1 + listRng() % 12;
+                    for (uint32_t pass = 0; pass < passCount; pass++)
+                    {
+                        // A pass uses a few resources, some of them twice, then the commands run
+                        std::vector<StateOp> uses;
+                        const uint32_t useCount = 1 + listRng() % 4;
+                        for (uint32_t u = 0; u < useCount; u++)
+                        {
+                            const uint64_t resource = (1 + listRng() % kResourceCount) * 0x100;
+                            const uint32_t subresources = tracker.getSubresourceCount(resource);
+                            const uint32_t subresource = (subresources > 1 && listRng() % 2) ? listRng() % subresources : ResourceStateTracker::kAllSubresources;
+                            // A pass can't use a subresource in two states
+                            bool conflict = false;
+                            for (const StateOp& use : uses)
+                            {
+                                const bool overlap = use.resource == resource && (use.subresource == subresource || use.subresource == ResourceStateTracker::kAllSubresources || subresource == ResourceStateTracker::kAllSubresources);
+                                if (overlap) conflict = true;
+                            }
+                            if (conflict) continue;
+                            uint32_t state = kStates[listRng() % kStateCount];
+                            // Change your mind before the flush, the last state counts
+                            if (listRng() % 8 == 0)
+                            {
+                                lists[l]->require(resource, state, subresource);
+                                requireCalls++;
+                                state = kStates[listRng() % kStateCount];
+                            }
+                            lists[l]->require(resource, state, subresource);
+                            requireCalls++;
+                            uses.push_back({ StateOp::Type::Use, resource, subresource, state, {} });
+                        }
+                        if (listRng() % 16 == 0) lists[l]->uavBarrier(listRng() % 2 ? 0 : (1 + listRng() % kResourceCount) * 0x100);
+                        StateOp flush = { StateOp::Type::Barriers, 0, 0, 0, {} };
+                        lists[l]->flush(flush.batch);
+                        ops[l].push_back(flush);
+                        for (const StateOp& use : uses) ops[l].push_back(use);
+                    }
+                }
+            });
+
+            // Submit in order, the barriers resolve() returns go before the list
+            for (uint32_t l = 0; l < listCount; l++)
+            {
+                std::vector<ResourceBarrier> entry;
+                tracker.resolve(*lists[l], entry);
+                gpu.applyBarriers(entry, check);
+                for (const StateOp& op : ops[l])
+                {
+                    if (op.type == StateOp::Type::Barriers)
+                    {
+                        gpu.applyBarriers(op.batch, check);
+                        batch++;
+                    }
+                    else
+                    {
+                        gpu.use(op, batch, check);
+                    }
+                }
+            }
+        }
+
+        // The tracker ends where the GPU does
+        for (const auto& it : gpu.states)
+        {
+            for (uint32_t s = 0; s < (uint32_t)it.second.size(); s++)
+            {
+                if (tracker.getState(it.first, s) != it.second[s]) check.violations++;
+            }
+        }
+        requireCount = requireCalls;
+        return check;
+    }
+
+    struct GraphCheck
+    {
+        uint32_t violations = 0;        // Culling, placement, aliasing or barrier errors
+        uint32_t culledCount = 0;
+        uint32_t firstListBarriers = 0; // Barriers resolve() added before the first pass of a frame, which need a list of their own
+        StateCheck states;
+    };
+
+    // Checks a compiled graph, then records frameCount frames of it the way Tutorial01 does and replays the barriers. The passes left are the
+    // ones the outputs need through the passes that wrote what they read. Transients in use at the same time don't share memory, and a pass
+    // only uses a transient that shares memory after an aliasing barrier for it. The imported resources alternate between importedVersions
+    // resources, like the back-buffers
+    GraphCheck checkRenderGraph(const RenderGraph& graph, uint32_t frameCount, uint32_t importedVersions)
+    {
+        GraphCheck check;
+        const uint32_t passCount = graph.getPassCount();
+        const uint32_t resourceCount = graph.getResourceCount();
+
+        // The passes the outputs need, from the last writer of every resource a needed pass reads
+        std::vector<std::vector<RenderGraph::PassId>> producers(passCount);
+        std::vector<RenderGraph::PassId> lastWriter(resourceCount, RenderGraph::kInvalid);
+        for (RenderGraph::PassId p = 0; p < passCount; p++)
+        {
+            for (const RenderGraph::Access& a : graph.getAccesses(p))
+            {
+                if (a.read && lastWriter[a.resource] != RenderGraph::kInvalid) producers[p].push_back(lastWriter[a.resource]);
+            }
+            for (const RenderGraph::Access& a : graph.getAccesses(p))
+            {
+                if (a.write) lastWriter[a.resource] = p;
+            }
+        }
+        std::vector<bool> needed(passCount);
+        std::vector<RenderGraph::PassId> stack;
+        for (RenderGraph::ResourceId r = 0; r < resourceCount; r++)
+        {
+            // The writers of an output are the last ones, markOutput() doesn't say
+            bool output = false;
+            for (RenderGraph::PassId p : graph.getPassOrder())
+            {
+                for (const RenderGraph::Access& a : graph.getAccesses(p)) output = output || (a.resource == r && a.write && lastWriter[r] == p);
+            }
+            if (output) stack.push_back(lastWriter[r]);
+        }
+        while (stack.size())
+        {
+            RenderGraph::PassId p = stack.back();
+            stack.pop_back();
+            if (needed[p]) continue;
+            needed[p] = true;
+            for (RenderGraph::PassId producer : producers[p]) stack.push_back(producer);
+        }
+        for (RenderGraph::PassId p = 0; p < passCount; p++)
+        {
+            if (graph.isCulled(p)) check.culledCount++;
+            if (graph.isCulled(p) == needed[p]) check.violations++;
+        }
+        // The order is the order they were added in
+        for (size_t i = 1; i < graph.getPassOrder().size(); i++)
+        {
+            if (graph.getPassOrder()[i - 1] >= graph.getPassOrder()[i]) check.violations++;
+        }
+
+        // The placement
+        std::vector<std::vector<RenderGraph::ResourceId>> sharing(resourceCount);
+        for (RenderGraph::ResourceId a = 0; a < resourceCount; a++)
+        {
+            if (graph.isTransient(a) == false || graph.isUsed(a) == false) continue;
+            const RenderGraph::Placement& pa = graph.getPlacement(a);
+            if (pa.offset % pa.alignment || pa.offset + pa.size > graph.getHeapSize(pa.heap)) check.violations++;
+            for (RenderGraph::ResourceId b = 0; b < resourceCount; b++)
+            {
+                if (a == b || graph.isTransient(b) == false || graph.isUsed(b) == false) continue;
+                const RenderGraph::Placement& pb = graph.getPlacement(b);
+                const bool sameMemory = pa.heap == pb.heap && pa.offset < pb.offset + pb.size && pb.offset < pa.offset + pa.size;
+                const bool sameTime = graph.getFirstPosition(a) <= graph.getLastPosition(b) && graph.getFirstPosition(b) <= graph.getLastPosition(a);
+                if (sameMemory && sameTime) check.violations++;
+                if (sameMemory) sharing[a].push_back(b);
+            }
+            if (graph.isAliased(a) != (sharing[a].size() > 0)) check.violations++;
+        }
+
+        // The frames
+        auto getHandle = [&](RenderGraph::ResourceId r, uint32_t frame)
+        {
+            return graph.isTransient(r) ? 0x1000 + (uint64_t)r : 0x100000 + (uint64_t)r * 16 + frame % importedVersions;
+        };
+        ResourceStateTracker tracker;
+        GpuStates gpu;
+        for (RenderGraph::ResourceId r = 0; r < resourceCount; r++)
+        {
+            for (uint32_t v = 0; v < (graph.isTransient(r) ? 1 : importedVersions); v++)
+            {
+                const uint64_t handle = getHandle(r, v);
+                const uint32_t state = graph.isTransient(r) ? graph.getFinalState(r) : ResourceStateTracker::kStateCommon;
+                tracker.addResource(handle, 1, state);
+                gpu.states[handle].assign(1, state);
+                gpu.uavBatch[handle].assign(1, -1);
+            }
+        }
+        std::vector<bool> active(resourceCount);
+        int64_t batch = 0;
+        for (uint32_t frame = 0; frame < frameCount; frame++)
+        {
+            const std::vector<RenderGraph::PassId>& order = graph.getPassOrder();
+            std::vector<std::unique_ptr<CommandListStates>> lists(order.size());
+            std::vector<std::vector<ResourceBarrier>> passBarriers(order.size());
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                const RenderGraph::PassId pass = order[i];
+                lists[i].reset(new CommandListStates(tracker));
+                for (RenderGraph::ResourceId r : graph.getFirstUses(pass))
+                {
+                    if (graph.isAliased(r)) passBarriers[i].push_back({ ResourceBarrier::Type::Aliasing, getHandle(r, frame), ResourceStateTracker::kAllSubresources, 0, 0 });
+                    lists[i]->expect(getHandle(r, frame), graph.getFinalState(r));
+                }
+                for (const RenderGraph::Access& a : graph.getAccesses(pass)) lists[i]->require(getHandle(a.resource, frame), a.state);
+                lists[i]->flush(passBarriers[i]);
+            }
+
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                std::vector<ResourceBarrier> entry;
+                tracker.resolve(*lists[i], entry);
+                if (i == 0) check.firstListBarriers += (uint32_t)entry.size();
+                gpu.applyBarriers(entry, check.states);
+                gpu.applyBarriers(passBarriers[i], check.states);
+                batch++;
+                for (uint64_t handle : gpu.aliased)
+                {
+                    const RenderGraph::ResourceId r = (RenderGraph::ResourceId)(handle - 0x1000);
+                    active[r] = true;
+                    for (RenderGraph::ResourceId other : sharing[r]) active[other] = false;
+                }
+                gpu.aliased.clear();
+                for (const RenderGraph::Access& a : graph.getAccesses(order[i]))
+                {
+                    if (graph.isTransient(a.resource) && graph.isAliased(a.resource) && active[a.resource] == false) check.violations++;
+                    StateOp use = { StateOp::Type::Use, getHandle(a.resource, frame), ResourceStateTracker::kAllSubresources, a.state, {} };
+                    gpu.use(use, batch, check.states);
+                }
+            }
+        }
+        check.violations += check.states.violations;
+        return check;
+    }
+
+    // Random passes that read what the passes before them wrote and write transients or the imported resources, some of them outputs
+    void buildRandomGraph(RenderGraph& graph, uint32_t passCount, uint32_t transientCount, uint32_t seed)
+    {
+        const uint32_t kWriteStates[] = { ResourceStateTracker::kStateUnorderedAccess, 0x4, 0x400 };                // UAV, render target, copy dest
+        const uint32_t kReadStates[] = { 0x40, 0x80, 0x40 | 0x80, 0x800, ResourceStateTracker::kStateUnorderedAccess };  // Shader resources, copy source
+        std::mt19937 rng(seed);
+        std::vector<RenderGraph::ResourceId> resources;
+        for (uint32_t t = 0; t < transientCount; t++)
+        {
+            const uint64_t kPage = 64 * 1024;
+            resources.push_back(graph.addTransient("Transient", (1 + rng() % 64) * kPage, (rng() % 4) ? kPage : 4 * 1024 * 1024, rng() % 2));
+        }
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            resources.push_back(graph.addImported("Imported"));
+            if (i < 2) graph.markOutput(resources.back());
+        }
+        std::vector<RenderGraph::ResourceId> written;
+        for (uint32_t p = 0; p < passCount; p++)
+        {
+            const RenderGraph::PassId pass = graph.addPass("Pass");
+            const uint32_t readCount = written.size() ? rng() % 4 : 0;
+            for (uint32_t i = 0; i < readCount; i++) graph.read(pass, written[rng() % written.size()], kReadStates[rng() % 5]);
+            const uint32_t writeCount = 1 + rng() % 2;
+            for (uint32_t i = 0; i < writeCount; i++)
+            {
+                const RenderGraph::ResourceId r = resources[rng() % resources.size()];
+                graph.write(pass, r, kWriteStates[rng() % 3]);
+                written.push_back(r);
+            }
+        }
+    }
+
+    // Stands in for dxcompiler. The "DXIL" is the source repeated to the requested size, so a stale entry can be told from a fresh one
+    class StubShaderCompiler : public ShaderCompiler
+    {
+    public:
+        std::string version = "stub 1.0";
+        size_t dxilSize = 64 * 1024;
+        uint32_t compileCount = 0;
+
+        std::string getVersion() override { return version; }
+
+        bool compile(const std::string&, const std::string& source, const std::string& target, const std::vector<std::string>& defines, std::vector<uint8_t>& dxil, std::string&) override
+        {
+            compileCount++;
+            std::string seed = target;
+            for (const std::string& define : defines) seed += define;
+            seed += source;
+            dxil.resize(dxilSize);
+            for (size_t i = 0; i < dxilSize; i++) dxil[i] = (uint8_t)seed[i % seed.size()];
+            return true;
+        }
+    };
+
+    void writeTextFile(const std::string& filename, const std::string& text)
+    {
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        file << text;
+    }
+
+    // A fake shader identifier. Every byte is the program index, so a record can be traced back to the program it was written for
+    struct FakeIdentifier
+    {
+        uint8_t bytes[ShaderTableBuilder::kShaderIdentifierSize];
+        explicit FakeIdentifier(uint8_t program) { memset(bytes, program, sizeof(bytes)); }
+    };
+
+    // The record mix of createShaderTable(). Every instance has a triangle and a plane geometry. The descriptors encode the instance and
+    // geometry so they can be checked after the table was written
+    void buildTutorialTable(ShaderTableBuilder& builder, uint32_t instanceCount, std::vector<uint32_t>& contributions)
+    {
+        const FakeIdentifier rayGen(1), miss(2), shadowMiss(3), triangle(4), plane(5), shadow(6);
+        builder.addRayGen(rayGen.bytes).addDescriptor(0x1000);
+        builder.addMiss(miss.bytes);
+        builder.addMiss(shadowMiss.bytes);
+        contributions.resize(instanceCount);
+        for (uint32_t i = 0; i < instanceCount; i++)
+        {
+            contributions[i] = builder.beginInstance();
+            uint64_t base = uint64_t(i) << 8;
+            builder.addHitGroup(triangle.bytes).addDescriptor(base | 1).addDescriptor(base | 2).addDescriptor(base | 3);
+            builder.addHitGroup(shadow.bytes);
+            builder.addHitGroup(plane.bytes).addDescriptor(base | 4).addDescriptor(base | 5);
+            builder.addHitGroup(shadow.bytes);
+        }
+    }
+
+    // Returns the number of records that don't hold what buildTutorialTable() put in them
+    uint32_t verifyTutorialTable(const ShaderTableBuilder& builder, const uint8_t* pTable, const std::vector<uint32_t>& contributions)
+    {
+        uint32_t errors = 0;
+        auto check = [&](const uint8_t* pRecord, uint8_t program, const std::vector<uint64_t>& descriptors, uint64_t stride)
+        {
+            bool ok = ((uintptr_t)pRecord % ShaderTableBuilder::kRecordAlignment) == 0;
+            for (uint32_t b = 0; b < ShaderTableBuilder::kShaderIdentifierSize; b++) ok = ok && pRecord[b] == program;
+            uint32_t offset = ShaderTableBuilder::kShaderIdentifierSize;
+            for (uint64_t descriptor : descriptors)
+            {
+                uint64_t value;
+                memcpy(&value, pRecord + offset, sizeof(value));
+                ok = ok && value == descriptor && ((uintptr_t)(pRecord + offset) % sizeof(uint64_t)) == 0;
+                offset += sizeof(uint64_t);
+            }
+            // The padding up to the stride is zero
+            for (; offset < stride; offset++) ok = ok && pRecord[offset] == 0;
+            if (ok == false) errors++;
+        };
+
+        ShaderTableBuilder::RegionLayout rayGen = builder.getLayout(ShaderTableBuilder::Region::RayGen);
+        ShaderTableBuilder::RegionLayout miss = builder.getLayout(ShaderTableBuilder::Region::Miss);
+        ShaderTableBuilder::RegionLayout hit = builder.getLayout(ShaderTableBuilder::Region::HitGroup);
+        check(pTable + rayGen.offset, 1, { 0x1000 }, rayGen.stride);
+        check(pTable + miss.offset, 2, {}, miss.stride);
+        check(pTable + miss.offset + miss.stride, 3, {}, miss.stride);
+        for (uint32_t i = 0; i < (uint32_t)contributions.size(); i++)
+        {
+            // The hit-group index the shaders compute for geometry g and ray type r: contribution + 2 * g + r
+            const uint8_t* pInstance = pTable + hit.offset + contributions[i] * hit.stride;
+            uint64_t base = uint64_t(i) << 8;
+            check(pInstance, 4, { base | 1, base | 2, base | 3 }, hit.stride);
+            check(pInstance + hit.stride, 6, {}, hit.stride);
+            check(pInstance + hit.stride * 2, 5, { base | 4, base | 5 }, hit.stride);
+            check(pInstance + hit.stride * 3, 6, {}, hit.stride);
+        }
+        return errors;
+    }
+
+    // Stands in for the device in BlasManager. The buffers are address ranges, and every call checks that the manager only uses live buffers,
+    // gives builds that can overlap disjoint scratch, copies BLASes whose build finished, and packs the copies without overlap
+    class MockBlasBackend : public BlasBackend
+    {
+    public:
+        struct Buffer
+        {
+            uint64_t size;
+            bool scratch;
+        };
+
+        std::vector<uint64_t> buildSizes;       // Indexed by blasIndex, what the manager was told
+        std::vector<uint64_t> scratchSizes;
+        std::vector<uint64_t> compactedSizes;   // What the "GPU" writes in the postbuild info
+        std::map<uint64_t, Buffer> liveBuffers;
+        uint32_t errors = 0;
+        uint32_t barrierCount = 0;
+        uint32_t createCount = 0;
+
+        uint64_t createBuffer(uint64_t size, bool scratch) override
+        {
+            createCount++;
+            const uint64_t address = mNextAddress;
+            mNextAddress += (size + 0xffff) / 0x10000 * 0x10000 + 0x10000;
+            liveBuffers[address] = { size, scratch };
+            return address;
+        }
+
+        void releaseBuffer(uint64_t address) override
+        {
+            if (liveBuffers.erase(address) == 0) errors++;
+        }
+
+        void build(uint32_t blasIndex, uint64_t resultAddress, uint64_t scratchAddress) override
+        {
+            if (blasIndex >= scratchSizes.size() || mBuilt.size() != blasIndex) errors++;
+            const uint64_t buildSize = blasIndex < buildSizes.size() ? buildSizes[blasIndex] : 0;
+            const Buffer* pResult = findBuffer(resultAddress, buildSize);
+            if (pResult == nullptr || pResult->scratch || (resultAddress % BlasManager::kAlignment) != 0) errors++;
+            for (const auto& range : mResults)
+            {
+                if (resultAddress < range.second && range.first < resultAddress + buildSize) errors++;
+            }
+            mResults.push_back(std::make_pair(resultAddress, resultAddress + buildSize));
+
+            // The scratch of the builds since the last barrier can't overlap
+            const uint64_t scratchSize = blasIndex < scratchSizes.size() ? scratchSizes[blasIndex] : 0;
+            const Buffer* pScratch = findBuffer(scratchAddress, scratchSize);
+            if (pScratch == nullptr || pScratch->scratch == false || (scratchAddress % BlasManager::kAlignment) != 0) errors++;
+            for (const auto& range : mScratchInFlight)
+            {
+                if (scratchAddress < range.second && range.first < scratchAddress + scratchSize) errors++;
+            }
+            mScratchInFlight.push_back(std::make_pair(scratchAddress, scratchAddress + scratchSize));
+            mBuilt.push_back(std::make_pair(resultAddress, false));
+        }
+
+        void copyCompacted(uint64_t destAddress, uint64_t sourceAddress) override
+        {
+            // The source is a BLAS whose build is behind a barrier
+            auto built = std::find_if(mBuilt.begin(), mBuilt.end(), [&](const std::pair<uint64_t, bool>& b) { return b.first == sourceAddress; });
+            if (built == mBuilt.end() || built->second == false || findBuffer(sourceAddress, 1) == nullptr)
+            {
+                errors++;
+                return;
+            }
+            const uint64_t size = compactedSizes[built - mBuilt.begin()];
+            const Buffer* pDest = findBuffer(destAddress, size);
+            if (pDest == nullptr || pDest->scratch || (destAddress % BlasManager::kAlignment) != 0) errors++;
+            for (const auto& range : mCopies)
+            {
+                if (destAddress < range.second && range.first < destAddress + size) errors++;
+            }
+            mCopies.push_back(std::make_pair(destAddress, destAddress + size));
+        }
+
+        void uavBarrier() override
+        {
+            barrierCount++;
+            mScratchInFlight.clear();
+            for (auto& built : mBuilt) built.second = true;
+        }
+
+        void endBuilds() override
+        {
+            uavBarrier();
+            mSizesWritten = (uint32_t)mBuilt.size();
+        }
+
+        void readCompactedSizes(std::vector<uint64_t>& sizes) override
+        {
+            sizes.assign(compactedSizes.begin(), compactedSizes.begin() + mSizesWritten);
+        }
+
+        uint64_t getLiveBytes() const
+        {
+            uint64_t bytes = 0;
+            for (const auto& buffer : liveBuffers) bytes += buffer.second.size;
+            return bytes;
+        }
+
+    private:
+        // The live buffer that holds [address, address + size)
+        const Buffer* findBuffer(uint64_t address, uint64_t size) const
+        {
+            auto it = liveBuffers.upper_bound(address);
+            if (it == liveBuffers.begin()) return nullptr;
+            --it;
+            return (address + size <= it->first + it->second.size) ? &it->second : nullptr;
+        }
+
+        uint64_t mNextAddress = 0x10000;
+        std::vector<std::pair<uint64_t, uint64_t>> mScratchInFlight;
+        std::vector<std::pair<uint64_t, uint64_t>> mResults;
+        std::vector<std::pair<uint64_t, bool>> mBuilt;      // The result address, and whether a barrier followed the build
+        std::vector<std::pair<uint64_t, uint64_t>> mCopies;
+        uint32_t mSizesWritten = 0;
+    };
+
+    struct BlasCompactionResult
+    {
+        uint64_t peakBytes = 0;     // The live buffers after compact(), before the build buffers are released
+        uint64_t finalBytes = 0;    // The live buffers after releaseBuildBuffers()
+        uint32_t failures = 0;
+    };
+
+    // Adds blasCount BLASes with sizes in the range the driver reports for meshes of 100 to 100k triangles, builds and compacts them in
+    // the given number of rounds, like createAccelerationStructures() does with one
+    BlasCompactionResult runBlasCompaction(uint32_t blasCount, uint32_t rounds, uint64_t scratchPoolSize, BlasManager::BuildMode mode, bool printEach)
+    {
+        BlasCompactionResult result;
+        MockBlasBackend backend;
+        std::mt19937 rng(blasCount);
+        std::uniform_int_distribution<uint64_t> buildSizes(8 * 1024, 8 * 1024 * 1024);
+        std::uniform_real_distribution<double> compaction(0.35, 0.75);
+        {
+            BlasManager manager(backend, scratchPoolSize, mode);
+            for (uint32_t round = 0; round < rounds; round++)
+            {
+                const uint32_t first = manager.getBlasCount();
+                const uint32_t end = blasCount * (round + 1) / rounds;
+                for (uint32_t i = first; i < end; i++)
+                {
+                    const uint64_t buildSize = buildSizes(rng);
+                    const uint64_t scratchSize = buildSize / 2 + 1000;
+                    manager.addBlas(buildSize, scratchSize);
+                    backend.buildSizes.push_back(manager.getBlas(i).buildSize);
+                    backend.scratchSizes.push_back(manager.getBlas(i).scratchSize);
+                    backend.compactedSizes.push_back(uint64_t(manager.getBlas(i).buildSize * compaction(rng)) / 8 * 8);
+                }
+                manager.build();
+                manager.compact();
+                result.peakBytes = std::max(result.peakBytes, backend.getLiveBytes());
+                manager.releaseBuildBuffers();
+            }
+            result.finalBytes = backend.getLiveBytes();
+
+            // Only the compacted buffers are left, and every BLAS is inside one at the size the GPU reported
+            const BlasManager::MemoryStats& stats = manager.getMemoryStats();
+            bool ok = backend.errors == 0 && result.finalBytes == stats.compactedBytes && backend.createCount == stats.bufferCount;
+            // A round creates a scratch pool at most. Two neighbouring result or compacted buffers hold more than kMaxBufferSize, so a round
+            // creates at most one more of them than twice their bytes over kMaxBufferSize
+            ok = ok && backend.createCount <= 3 * rounds + 2 * (stats.buildBytes + stats.compactedBytes) / BlasManager::kMaxBufferSize;
+            if (mode == BlasManager::BuildMode::Serial) ok = ok && stats.scratchPoolBytes == *std::max_element(backend.scratchSizes.begin(), backend.scratchSizes.end());
+            for (uint32_t i = 0; i < manager.getBlasCount(); i++)
+            {
+                const BlasManager::BlasInfo& blas = manager.getBlas(i);
+                ok = ok && blas.compactedSize == backend.compactedSizes[i];
+                if (printEach)
+                {
+                    printf("    BLAS %u: %8llu bytes built, %8llu bytes compacted (%.0f%%)\n", i, (unsigned long long)blas.buildSize,
+                        (unsigned long long)blas.compactedSize, 100.0 * double(blas.compactedSize) / double(blas.buildSize));
+                }
+            }
+            if (ok == false) result.failures++;
+            // createBottomLevelAS() used to create a result and a scratch buffer and insert a barrier per BLAS
+            printf("  %5u BLASes, %u round%s, %-10s %3llu MB scratch budget: %7.1f MB built, %7.1f MB compacted, %5.1f MB scratch pool, "
+                "%7.1f MB peak, %2u buffers and %4u barriers (%u and %u one by one), %s\n", blasCount, rounds, rounds > 1 ? "s" : " ",
+                mode == BlasManager::BuildMode::Serial ? "serial," : "concurrent,", (unsigned long long)(scratchPoolSize >> 20), stats.buildBytes / 1048576.0,
+                stats.compactedBytes / 1048576.0, stats.scratchPoolBytes / 1048576.0, result.peakBytes / 1048576.0, backend.createCount,
+                backend.barrierCount, blasCount * 2, blasCount, ok ? "ok" : "FAILED");
+        }
+        // The manager released everything
+        if (backend.liveBuffers.empty() == false || backend.errors) result.failures++;
+        return result;
+    }
+
+    // Command lists without a device. Checks that a list is only recorded while it's open, that it's only reset once the GPU is done with it,
+    // and that every batch has closed lists, each once, with the orders the lists were recorded with going up
+    class MockCommandListBackend : public CommandListBackend
+    {
+    public:
+        uint32_t errors = 0;
+        uint32_t executedCount = 0;
+
+        uint32_t createList() override
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mLists.push_back(List());
+            return (uint32_t)mLists.size() - 1;
+        }
+
+        void resetList(uint32_t list) override
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            List& l = mLists[list];
+            if (l.state != State::Closed || l.inFlight) errors++;
+            l.state = State::Open;
+            l.order = kNoOrder;
+        }
+
+        void prepareLists(const uint32_t* pLists, uint32_t count) override
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (mLists[pLists[i]].state != State::Open) errors++;
+            }
+        }
+
+        void closeList(uint32_t list) override
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mLists[list].state != State::Open) errors++;
+            mLists[list].state = State::Closed;
+        }
+
+        void executeLists(const uint32_t* pLists, uint32_t count) override
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            uint32_t previousOrder = 0;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                List& l = mLists[pLists[i]];
+                if (l.state != State::Closed || l.inFlight || l.order == kNoOrder || l.order < previousOrder) errors++;
+                previousOrder = l.order;
+                l.inFlight = true;
+                l.slot = mSlot;
+            }
+            executedCount += count;
+        }
+
+        // Records a command into an acquired list, tagged with the order it was acquired with
+        void record(uint32_t list, uint32_t order)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            List& l = mLists[list];
+            if (l.state != State::Open || (l.order != kNoOrder && l.order != order)) errors++;
+            l.order = order;
+        }
+
+        // The fence of the slot completed, which is when the pool gets beginFrame(slot). The next batches belong to the slot
+        void retire(uint32_t slot)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            for (List& l : mLists)
+            {
+                if (l.slot == slot) l.inFlight = false;
+            }
+            mSlot = slot;
+        }
+
+    private:
+        static const uint32_t kNoOrder = ~0u;
+        enum class State
+        {
+            Open,
+            Closed,
+        };
+        struct List
+        {
+            State state = State::Open;
+            bool inFlight = false;
+            uint32_t slot = 0;
+            uint32_t order = kNoOrder;
+        };
+        std::mutex mMutex;
+        std::vector<List> mLists;
+        uint32_t mSlot = 0;
+    };
+
+    // Runs the graph and returns the number of tasks that ran more or less than once, before one of their dependencies finished, or off the
+    // calling thread when they have to run on it. The graph must have been built with addCheckedTask()
+    struct TaskGraphCheck
+    {
+        std::vector<std::atomic<uint32_t>> runs;
+        std::vector<TaskGraph::Affinity> affinity;
+        std::atomic<uint32_t> errors;
+        std::thread::id mainThread;
+
+        explicit TaskGraphCheck(uint32_t taskCount) : runs(taskCount), affinity(taskCount), errors(0) {}
+
+        TaskGraph::TaskId addCheckedTask(TaskGraph& graph, const char* name, std::function<void()> work, const std::vector<TaskGraph::TaskId>& dependencies, TaskGraph::Affinity taskAffinity)
+        {
+            const TaskGraph::TaskId id = graph.getTaskCount();
+            affinity[id] = taskAffinity;
+            return graph.addTask(name, [this, id, dependencies, work]()
+            {
+                for (TaskGraph::TaskId dependency : dependencies)
+                {
+                    if (runs[dependency] != 1) errors++;
+                }
+                if (affinity[id] == TaskGraph::Affinity::MainThread && std::this_thread::get_id() != mainThread) errors++;
+                work();
+                runs[id]++;
+            }, dependencies, taskAffinity);
+        }
+
+        uint32_t run(TaskGraph& graph, JobSystem& jobs)
+        {
+            mainThread = std::this_thread::get_id();
+            for (std::atomic<uint32_t>& r : runs) r = 0;
+            errors = 0;
+            graph.run(jobs);
+            uint32_t failures = errors;
+            for (const std::atomic<uint32_t>& r : runs) failures += (r == 1) ? 0 : 1;
+            return failures;
+        }
+    };
+
+    // Forks both calls, so the job system sees a deep tree of small jobs with a wait in every one
+    uint64_t forkJoinFibonacci(JobSystem& jobs, uint32_t n)
+    {
+        if (n < 12)
+        {
+            uint64_t a = 0, b = 1;
+            for (uint32_t i = 0; i < n; i++)
+            {
+                uint64_t next = a + b;
+                a = b;
+                b = next;
+            }
+            return a;
+        }
+        uint64_t x = 0, y = 0;
+        JobCounter counter;
+        auto left = [&]() { x = forkJoinFibonacci(jobs, n - 1); };
+        auto right = [&]() { y = forkJoinFibonacci(jobs, n - 2); };
+        jobs.run(counter, left);
+        jobs.run(counter, right);
+        jobs.wait(counter);
+        return x + y;
+    }
+
+    // A few hundred cycles of floating-point work per element, about what an instance transform update costs
+    float jobWork(uint32_t i)
+    {
+        float x = float(i & 0xffff) * 1e-4f;
+        for (uint32_t k = 0; k < 8; k++) x = x * 0.999f + sinf(x) * 0.01f;
+        return x;
+    }
+}
+
+void benchmarkBvhTraversal()
+{
+    printf("BVH traversal, single thread, 1024x1024 primary rays%s\n", cpuSupportsAvx2() ? "" : " (no AVX2 on this CPU, the AVX2 row runs SSE)");
+    const int kTessellations[] = { 16, 64, 180 };
+    for (int tessellation : kTessellations)
+    {
+        Shape sphere = createSphere(2, tessellation);
+        BvhGeometryDesc geometry;
+        geometry.pVertices = sphere.vertexData.data();
+        geometry.vertexCount = (uint32_t)sphere.vertexData.size();
+        geometry.pIndices = sphere.getIndices();
+        geometry.indexCount = sphere.getIndexCount();
+        geometry.indices32Bit = sphere.indices32Bit();
+
+        Bvh bvh;
+        bvh.build(&geometry, 1);
+        WideBvh wideBvh;
+        wideBvh.build(bvh);
+        printf("  Sphere tessellation %d: %u triangles, %u binary nodes, %zu BVH8 nodes\n", tessellation, bvh.getStats().triangleCount, bvh.getStats().nodeCount, wideBvh.getNodes().size());
+
+        wideBvh.setKernel(WideBvh::Kernel::Sse);
+        RayBatch batch = generateRays(wideBvh, 1024, 1024);
+        reportTraversal("SSE", wideBvh, batch);
+        wideBvh.setKernel(WideBvh::Kernel::Avx2);
+        reportTraversal("AVX2", wideBvh, batch);
+        wideBvh.setKernel(WideBvh::Kernel::Auto);
+        reportTraversal("Auto", wideBvh, batch);
+    }
+}
+
+void benchmarkCpuReference()
+{
+    // "-cpuref" of the default scene at 320x200 and the first frame's rotation. Only update it when the change to the image is intended
+    const uint64_t kGoldenHash = 0xa18296d69ad0fc03ull;
+    const uint32_t kWidth = 320;
+    const uint32_t kHeight = 200;
+    printf("CPU reference, %ux%u\n", kWidth, kHeight);
+    uint32_t failures = 0;
+
+    Scene scene;
+    std::string error;
+    if (loadScene(scene, "", error) == false)
+    {
+        printf("  Can't load the scene: %s FAILED\n", error.c_str());
+        return;
+    }
+    CpuRaytracer raytracer(scene);
+    raytracer.setRotation(0.005f);
+
+    struct Run
+    {
+        const char* pName;
+        WideBvh::Kernel kernel;
+        uint32_t threadCount;
+    };
+    const Run kRuns[] =
+    {
+        { "AVX2, 1 thread", WideBvh::Kernel::Avx2, 1 },
+        { "AVX2, 3 threads", WideBvh::Kernel::Avx2, 3 },
+        { "AVX2, all threads", WideBvh::Kernel::Avx2, 0 },
+        { "Auto, all threads", WideBvh::Kernel::Auto, 0 },
+        { "SSE, all threads", WideBvh::Kernel::Sse, 0 },
+    };
+    for (const Run& run : kRuns)
+    {
+        raytracer.setKernel(run.kernel);
+        CpuRaytracer::Stats stats = raytracer.render(kWidth, kHeight, run.threadCount);
+        uint64_t hash = raytracer.getFrameHash();
+        bool ok = (hash == kGoldenHash);
+        printf("  %-18s hash %016llx, %.2f Mrays/s %s\n", run.pName, (unsigned long long)hash, stats.raysPerSecond() / 1e6, ok ? "ok" : "FAILED");
+        if (ok == false) failures++;
+    }
+    if (failures) printf("  Expected %016llx. If the build contracts FMAs (GCC and Clang do by default) use -ffp-contract=off\n", (unsigned long long)kGoldenHash);
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkSphereGenerator()
+{
+    printf("Sphere generator, diameter 2, including the tangents. The reference is the push_back() generator with per-vertex sin() and cos()\n");
+    const int kTessellations[] = { 32, 128, 512, 2048 };
+    for (int tessellation : kTessellations)
+    {
+        Shape sphere;
+        Shape reference;
+        double sec = bestTime([&]() { sphere = createSphere(2, tessellation); }, 0.2);
+        double singleSec = bestTime([&]() { sphere = createSphere(2, tessellation, false, false, 1); }, 0.2);
+        double referenceSec = bestTime([&]() { reference = createSphereReference(2, tessellation); }, 0.2);
+
+        bool expected32Bit = sphere.vertexData.size() > 0x10000;
+        bool countsOk = sphere.vertexData.size() == getSphereVertexCount(tessellation) && sphere.getIndexCount() == getSphereIndexCount(tessellation);
+        float maxError = compareSpheres(sphere, reference);
+        printf("  Tessellation %4d: %8zu vertices, %2s-bit indices, %8.3f ms (%8.3f ms single thread), reference %8.3f ms. Max difference %g%s%s\n",
+            tessellation, sphere.vertexData.size(), sphere.indices32Bit() ? "32" : "16", sec * 1000, singleSec * 1000, referenceSec * 1000, maxError,
+            (maxError > 1e-5f) ? " TOO LARGE" : "", (countsOk && expected32Bit == sphere.indices32Bit()) ? "" : ", WRONG COUNTS OR INDEX FORMAT");
+    }
+}
+
+void benchmarkTangentGenerator()
+{
+    // The generator weights the corners as the reference does and adds the handedness, so the tangents must be close and it does a little more
+    // work per triangle. The batches must make up for it on a single thread, at every size. Where there are enough hardware threads, the
+    // large spheres must also be faster on all of them than on one
+    const uint32_t kSpeedupThreads = 8;
+    const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+    uint32_t failures = 0;
+    printf("Tangent generator on spheres, %u hardware threads. The reference is the scalar, single-threaded calculateTangentSpace() it replaced\n", hardwareThreads);
+    const int kTessellations[] = { 128, 512, 2048 };
+    for (int tessellation : kTessellations)
+    {
+        Shape sphere = createSphere(2, tessellation);
+        const uint32_t vertexCount = (uint32_t)sphere.vertexData.size();
+        const uint32_t triangleCount = sphere.getIndexCount() / 3;
+        std::vector<glm::vec4> tangents(vertexCount);
+        std::vector<glm::vec4> threadedTangents(vertexCount);
+        std::vector<glm::vec3> reference;
+
+        auto generate = [&](std::vector<glm::vec4>& output, uint32_t threadCount)
+        {
+            generateTangents(sphere.vertexData.data(), vertexCount, sphere.getIndices(), sphere.getIndexCount(), sphere.indices32Bit(), output.data(), threadCount);
+        };
+        double sec = bestTime([&]() { generate(threadedTangents, 0); }, 0.2);
+        double singleSec = bestTime([&]() { generate(tangents, 1); }, 0.2);
+        double referenceSec = bestTime([&]() { reference = calculateTangentsReference(sphere); }, 0.2);
+
+        // Four threads must give the same tangents as one, up to the order of the additions. Every output is written, whatever was there
+        std::fill(threadedTangents.begin(), threadedTangents.end(), glm::vec4(1000.0f));
+        generate(threadedTangents, 4);
+        float threadError = 0;
+        for (uint32_t i = 0; i < vertexCount; i++) threadError = std::max(threadError, glm::length(threadedTangents[i] - tangents[i]));
+
+        float handedness;
+        float maxAngle = checkTangents(sphere, tangents, reference, handedness);
+        const bool slower = singleSec > referenceSec;
+        const bool checkThreads = tessellation >= 512 && hardwareThreads >= kSpeedupThreads;
+        const bool threadsSlower = checkThreads && sec >= singleSec;
+        const bool ok = maxAngle <= 0.1f && threadError <= 1e-5f && slower == false && threadsSlower == false;
+        if (ok == false) failures++;
+        printf("  Tessellation %4d: %8u triangles, %2s-bit indices, %8.3f ms (%8.3f ms single thread, %6.1f M triangles/s), reference %8.3f ms, single thread %.2fx. Max angle to the reference %.3f degrees%s%s%s%s\n",
+            tessellation, triangleCount, sphere.indices32Bit() ? "32" : "16", sec * 1000, singleSec * 1000, triangleCount / singleSec * 1e-6, referenceSec * 1000, referenceSec / singleSec, maxAngle,
+            (maxAngle > 0.1f) ? " TOO LARGE" : "", (threadError > 1e-5f) ? ", THREADS DIFFER" : "", slower ? ", SLOWER THAN THE REFERENCE" : "", threadsSlower ? ", THREADS DON'T HELP" : "");
+    }
+    if (hardwareThreads < kSpeedupThreads) printf("  Speedup of the threads not checked, it needs %u hardware threads\n", kSpeedupThreads);
+
+    // Shuffled triangles reference vertices all over the mesh, so the threads share most of them and reduce them at the end
+    {
+        Shape sphere = createSphere(2, 256);
+        const uint32_t vertexCount = (uint32_t)sphere.vertexData.size();
+        std::vector<uint32_t> triangles(sphere.getIndexCount() / 3);
+        for (uint32_t i = 0; i < (uint32_t)triangles.size(); i++) triangles[i] = i;
+        std::shuffle(triangles.begin(), triangles.end(), std::mt19937(7));
+        std::vector<uint32_t> shuffled;
+        for (uint32_t t : triangles)
+        {
+            for (uint32_t c = 0; c < 3; c++) shuffled.push_back(sphere.getIndex(t * 3 + c));
+        }
+        std::vector<glm::vec4> tangents(vertexCount), threadedTangents(vertexCount, glm::vec4(1000.0f));
+        generateTangents(sphere.vertexData.data(), vertexCount, sphere.getIndices(), sphere.getIndexCount(), sphere.indices32Bit(), tangents.data(), 1);
+        generateTangents(sphere.vertexData.data(), vertexCount, shuffled.data(), (uint32_t)shuffled.size(), true, threadedTangents.data(), 4);
+        float threadError = 0;
+        for (uint32_t i = 0; i < vertexCount; i++) threadError = std::max(threadError, glm::length(threadedTangents[i] - tangents[i]));
+        if (threadError > 1e-5f) failures++;
+        printf("  Shuffled triangles on 4 threads: %s\n", (threadError > 1e-5f) ? "THREADS DIFFER" : "same tangents");
+    }
+
+    // The same mesh with 16-bit and 32-bit indices gives the same tangents, and mirroring the texture flips the handedness
+    Shape sphere = createSphere(2, 64);
+    Shape mirrored = createSphere(2, 64, true);
+    const uint32_t vertexCount = (uint32_t)sphere.vertexData.size();
+    std::vector<uint32_t> indices32(sphere.indexData.begin(), sphere.indexData.end());
+    std::vector<glm::vec4> tangents16(vertexCount), tangents32(vertexCount), mirroredTangents(vertexCount);
+    generateTangents(sphere.vertexData.data(), vertexCount, sphere.indexData.data(), (uint32_t)sphere.indexData.size(), false, tangents16.data(), 1);
+    generateTangents(sphere.vertexData.data(), vertexCount, indices32.data(), (uint32_t)indices32.size(), true, tangents32.data(), 1);
+    generateTangents(mirrored.vertexData.data(), vertexCount, mirrored.getIndices(), mirrored.getIndexCount(), mirrored.indices32Bit(), mirroredTangents.data(), 1);
+    float handedness = 0;
+    float mirroredHandedness = 0;
+    bool indexFormatsMatch = memcmp(tangents16.data(), tangents32.data(), vertexCount * sizeof(glm::vec4)) == 0;
+    bool valid = checkTangents(sphere, tangents16, calculateTangentsReference(sphere), handedness) != FLT_MAX;
+    valid = valid && checkTangents(mirrored, mirroredTangents, calculateTangentsReference(mirrored), mirroredHandedness) != FLT_MAX;
+    valid = valid && handedness != 0 && handedness == -mirroredHandedness;
+    if (indexFormatsMatch == false || valid == false) failures++;
+    printf("  16-bit and 32-bit indices: %s. Handedness %g, mirrored %g: %s\n", indexFormatsMatch ? "same tangents" : "DIFFERENT TANGENTS",
+        handedness, mirroredHandedness, valid ? "ok" : "WRONG");
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkMeshOptimizer()
+{
+    printf("Mesh optimizer, %u-entry FIFO vertex cache, %u KB fetch cache\n", kVertexCacheSize, kFetchCacheSize / 1024);
+    uint32_t failures = 0;
+    auto report = [&](const char* name, const Shape& original, const Shape& optimized, const MeshStats& before, const MeshStats& after, double sec, bool checkTriangles)
+    {
+        // The optimizer must not lose, add or flip triangles, and must improve the vertex cache. It must not fetch more than the input either,
+        // even when the input already streams through its vertices like a small sphere or a triangle list, and stay close to one read per byte.
+        // The welded vertices can end in a partial cache line, so reading each of their lines once is the least it can fetch
+        const double bytes = double(after.vertexCount) * sizeof(VertexPositionNormalTangentTexture);
+        const float leastOverfetch = float(ceil(bytes / kFetchCacheLineSize) * kFetchCacheLineSize / bytes);
+        bool ok = after.triangleCount == before.triangleCount && after.vertexCount == before.uniqueVertexCount && after.uniqueVertexRatio == 1.0f &&
+            after.acmr < before.acmr && after.overfetch <= std::max(before.overfetch, leastOverfetch) && after.overfetch < 1.5f &&
+            optimized.indices32Bit() == (optimized.vertexData.size() > 0x10000);
+        if (checkTriangles) ok = ok && canonicalTriangles(original) == canonicalTriangles(optimized);
+        if (ok == false) failures++;
+        printf("  %-22s %8u triangles, %.2f ms (%.1f M triangles/s)%s\n", name, before.triangleCount, sec * 1000, before.triangleCount / sec * 1e-6, ok ? "" : " FAILED");
+        printf("    before %8u vertices, unique ratio %.3f, ACMR %.3f, ATVR %.3f, overfetch %.2f\n", before.vertexCount, before.uniqueVertexRatio, before.acmr, before.atvr, before.overfetch);
+        printf("    after  %8u vertices, unique ratio %.3f, ACMR %.3f, ATVR %.3f, overfetch %.2f\n", after.vertexCount, after.uniqueVertexRatio, after.acmr, after.atvr, after.overfetch);
+    };
+
+    // createSphere() emits the rings in order, a ring of a tessellation-512 sphere is larger than the fetch cache
+    for (int tessellation : { 64, 512 })
+    {
+        const Shape sphere = createSphere(2, tessellation);
+        Shape optimized;
+        MeshStats before, after;
+        double sec = bestTime([&]() { optimized = sphere; optimizeMesh(optimized); }, 0.2);
+        before = analyzeMesh(sphere);
+        after = analyzeMesh(optimized);
+        char name[64];
+        snprintf(name, sizeof(name), "Sphere %d", tessellation);
+        report(name, sphere, optimized, before, after, sec, tessellation <= 64);
+    }
+
+    // The same triangles in random order, and without indices so welding has to find the shared vertices
+    {
+        Shape sphere = createSphere(2, 64);
+        std::vector<uint32_t> triangles(sphere.getIndexCount() / 3);
+        for (uint32_t i = 0; i < (uint32_t)triangles.size(); i++) triangles[i] = i;
+        std::shuffle(triangles.begin(), triangles.end(), std::mt19937(5));
+        Shape shuffled;
+        Shape soup;
+        for (uint32_t t : triangles)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                shuffled.indexData.push_back((unsigned short)sphere.getIndex(t * 3 + c));
+                soup.vertexData.push_back(sphere.vertexData[sphere.getIndex(t * 3 + c)]);
+            }
+        }
+        shuffled.vertexData = sphere.vertexData;
+
+        Shape optimized;
+        double sec = bestTime([&]() { optimized = shuffled; optimizeMesh(optimized); }, 0.2);
+        report("Shuffled sphere 64", shuffled, optimized, analyzeMesh(shuffled), analyzeMesh(optimized), sec, true);
+        sec = bestTime([&]() { optimized = soup; optimizeMesh(optimized); }, 0.2);
+        // analyzeMesh() sees the soup as a triangle list, so it starts with 3 misses per triangle
+        report("Unindexed sphere 64", soup, optimized, analyzeMesh(soup), analyzeMesh(optimized), sec, true);
+        if (optimized.vertexData.size() != sphere.vertexData.size())
+        {
+            printf("  Welding kept %zu vertices instead of %zu: FAILED\n", optimized.vertexData.size(), sphere.vertexData.size());
+            failures++;
+        }
+    }
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkSceneGeometry()
+{
+    printf("Indexed scene geometry\n");
+    uint32_t failures = 0;
+    auto expect = [&](const char* name, const Scene& scene, const SceneGeometryViews& views, bool expected)
+    {
+        std::string error;
+        const bool valid = validateSceneGeometry(scene, views, error);
+        const bool ok = (valid == expected);
+        if (ok == false) failures++;
+        printf("    %-44s %-8s %s%s%s\n", name, valid ? "valid" : "rejected", ok ? "ok" : "WRONG", valid ? "" : ", ", valid ? "" : error.c_str());
+    };
+    auto load = [](Scene& scene, const std::vector<uint8_t>& data)
+    {
+        std::string error;
+        return scene.loadFromMemory(data, error);
+    };
+
+    Scene tutorial;
+    load(tutorial, createTutorialScene());
+    expect("Tutorial scene", tutorial, getSceneGeometryViews(tutorial), true);
+
+    // A 16-bit sphere, a 32-bit one and an unindexed triangle in one scene, the way the hit shaders see it
+    const Shape small = createSphere(2, 64);
+    const Shape large = createSphere(2, 256);
+    SceneWriter writer;
+    writer.addMesh(getTriangleVertices(), kTriangleVertexCount);
+    writer.addMesh(small.vertexData.data(), (uint32_t)small.vertexData.size(), small.getIndices(), small.getIndexCount(), SceneIndexFormat::Uint16);
+    writer.addMesh(large.vertexData.data(), (uint32_t)large.vertexData.size(), large.getIndices(), large.getIndexCount(), SceneIndexFormat::Uint32);
+    writer.addBlas(0, 3);
+    Scene spheres;
+    load(spheres, writer.serialize());
+    const SceneGeometryViews views = getSceneGeometryViews(spheres);
+    expect("Spheres, views over the whole blobs", spheres, views, true);
+
+    // The SRVs the tutorial used to create, with 3 elements
+    SceneGeometryViews short3;
+    short3.vertexElements = 3;
+    short3.indexElements = 3;
+    expect("Spheres, 3-element views", spheres, short3, false);
+    SceneGeometryViews shortIndices = views;
+    shortIndices.indexElements--;
+    expect("Spheres, index view a word short", spheres, shortIndices, false);
+
+    // An index past the vertices of its own mesh, but still inside the vertex buffer
+    std::vector<uint16_t> badIndices(small.indexData.begin(), small.indexData.end());
+    badIndices[badIndices.size() / 2] = (uint16_t)small.vertexData.size();
+    SceneWriter badWriter;
+    badWriter.addMesh(small.vertexData.data(), (uint32_t)small.vertexData.size(), badIndices.data(), (uint32_t)badIndices.size(), SceneIndexFormat::Uint16);
+    badWriter.addMesh(getTriangleVertices(), kTriangleVertexCount);
+    badWriter.addBlas(0, 2);
+    Scene bad;
+    load(bad, badWriter.serialize());
+    expect("Index past the vertices of its mesh", bad, getSceneGeometryViews(bad), false);
+
+    // What indexing saves against expanding every triangle to its own three vertices
+    printf("  Vertex and index memory, expanded vs indexed:\n");
+    for (const Shape* pShape : { &small, &large })
+    {
+        const uint64_t expanded = uint64_t(pShape->getIndexCount()) * sizeof(VertexPositionNormalTangentTexture);
+        const uint64_t vertexBytes = pShape->vertexData.size() * sizeof(VertexPositionNormalTangentTexture);
+        const uint64_t indexBytes = uint64_t(pShape->getIndexCount()) * (pShape->indices32Bit() ? 4 : 2);
+        printf("    %8u triangles: %8.2f MB expanded, %6.2f MB vertices + %5.2f MB %s indices, %.1fx less vertex memory, %.1fx less in total\n",
+            pShape->getIndexCount() / 3, expanded / 1048576.0, vertexBytes / 1048576.0, indexBytes / 1048576.0, pShape->indices32Bit() ? "32-bit" : "16-bit",
+            double(expanded) / vertexBytes, double(expanded) / (vertexBytes + indexBytes));
+    }
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkPackedVertices()
+{
+    printf("Packed vertices, %zu bytes instead of %zu\n", sizeof(PackedVertex), sizeof(VertexPositionNormalTangentTexture));
+    uint32_t failures = 0;
+
+    // Random directions, plus the axes and the diagonals where the octahedral folds and the basis switch
+    std::vector<glm::vec3> normals;
+    for (int x = -1; x <= 1; x++)
+    {
+        for (int y = -1; y <= 1; y++)
+        {
+            for (int z = -1; z <= 1; z++)
+            {
+                if (x || y || z) normals.push_back(glm::normalize(glm::vec3(float(x), float(y), float(z))));
+            }
+        }
+    }
+    std::mt19937 rng(7);
+    std::normal_distribution<float> gaussian;
+    while (normals.size() < 1000000) normals.push_back(glm::normalize(glm::vec3(gaussian(rng), gaussian(rng), gaussian(rng))));
+
+    float maxNormalError = 0;
+    float maxTangentError = 0;
+    uint32_t handednessErrors = 0;
+    for (size_t i = 0; i < normals.size(); i++)
+    {
+        const glm::vec3 n = normals[i];
+        glm::vec3 t = glm::vec3(gaussian(rng), gaussian(rng), gaussian(rng));
+        t = glm::normalize(t - n * glm::dot(n, t));
+        const float handedness = (i & 1) ? 1.0f : -1.0f;
+        glm::vec3 decodedNormal;
+        glm::vec4 decodedTangent;
+        decodeNormalTangent(encodeNormalTangent(n, t, handedness), decodedNormal, decodedTangent);
+        maxNormalError = std::max(maxNormalError, angleDegrees(n, decodedNormal));
+        maxTangentError = std::max(maxTangentError, angleDegrees(t, glm::vec3(decodedTangent)));
+        if (decodedTangent.w != handedness) handednessErrors++;
+    }
+    bool ok = maxNormalError < 0.1f && maxTangentError < 0.5f && handednessErrors == 0;
+    if (ok == false) failures++;
+    printf("  %zu random frames: max normal error %.4f degrees, max tangent error %.4f degrees, %u wrong handedness: %s\n",
+        normals.size(), maxNormalError, maxTangentError, handednessErrors, ok ? "ok" : "FAILED");
+
+    // Every half survives the round trip through float, and floats round to the nearest half
+    uint32_t halfErrors = 0;
+    for (uint32_t h = 0; h < 0x10000; h++)
+    {
+        const bool nan = ((h & 0x7c00) == 0x7c00) && (h & 0x3ff);
+        if (nan == false && floatToHalf(halfToFloat(uint16_t(h))) != h) halfErrors++;
+    }
+    std::uniform_real_distribution<float> unit(-4, 4);
+    float maxTexCoordError = 0;
+    for (uint32_t i = 0; i < 1000000; i++)
+    {
+        const float value = unit(rng);
+        const float rounded = halfToFloat(floatToHalf(value));
+        // The spacing of the halves around value is 2^(exponent - 10), so the rounding error is at most half of it
+        int exponent;
+        frexpf(value, &exponent);
+        if (fabsf(rounded - value) > ldexpf(1.0f, exponent - 12)) halfErrors++;
+        maxTexCoordError = std::max(maxTexCoordError, fabsf(rounded - value));
+    }
+    if (halfErrors) failures++;
+    printf("  Half floats: %u wrong conversions, max error %g in [-4, 4]: %s\n", halfErrors, maxTexCoordError, halfErrors ? "FAILED" : "ok");
+
+    // A sphere with generated handedness, through packVertices() and unpackVertex()
+    Shape sphere = createSphere(2, 512);
+    const uint32_t vertexCount = (uint32_t)sphere.vertexData.size();
+    std::vector<glm::vec4> tangents(vertexCount);
+    generateTangents(sphere.vertexData.data(), vertexCount, sphere.getIndices(), sphere.getIndexCount(), sphere.indices32Bit(), tangents.data());
+    std::vector<PackedVertex> packed(vertexCount);
+    double packSec = bestTime([&]() { packVertices(sphere.vertexData.data(), vertexCount, packed.data(), tangents.data()); }, 0.2);
+    float maxPositionError = 0;
+    maxNormalError = 0;
+    maxTangentError = 0;
+    maxTexCoordError = 0;
+    handednessErrors = 0;
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        const VertexPositionNormalTangentTexture& vertex = sphere.vertexData[i];
+        float handedness;
+        VertexPositionNormalTangentTexture unpacked = unpackVertex(packed[i], &handedness);
+        maxPositionError = std::max(maxPositionError, glm::length(unpacked.position - vertex.position));
+        maxNormalError = std::max(maxNormalError, angleDegrees(vertex.normal, unpacked.normal));
+        maxTangentError = std::max(maxTangentError, angleDegrees(glm::vec3(tangents[i]), unpacked.tangent));
+        maxTexCoordError = std::max(maxTexCoordError, std::max(fabsf(unpacked.texCoord.x - vertex.texCoord.x), fabsf(unpacked.texCoord.y - vertex.texCoord.y)));
+        if (handedness != tangents[i].w) handednessErrors++;
+    }
+    ok = maxPositionError == 0 && maxNormalError < 0.1f && maxTangentError < 0.5f && maxTexCoordError <= 1.0f / 4096 && handednessErrors == 0;
+    if (ok == false) failures++;
+    printf("  Sphere, %u vertices: packed in %.3f ms (%.1f M vertices/s). Max normal error %.4f degrees, tangent %.4f degrees, texture coordinate %g, %u wrong handedness: %s\n",
+        vertexCount, packSec * 1000, vertexCount / packSec * 1e-6, maxNormalError, maxTangentError, maxTexCoordError, handednessErrors, ok ? "ok" : "FAILED");
+
+    // What a hit costs. The tutorial's hit shaders read the normals of the three vertices, a shader that shades with a normal map and a
+    // texture reads the whole vertex. Memory moves in 32-byte sectors
+    struct Format
+    {
+        const char* name;
+        uint32_t stride;
+        uint32_t normalOffset;
+        uint32_t normalSize;
+    };
+    const Format kFormats[] =
+    {
+        { "VertexPositionNormalTangentTexture", (uint32_t)sizeof(VertexPositionNormalTangentTexture), 12, 12 },
+        { "PackedVertex", (uint32_t)sizeof(PackedVertex), 12, 4 },
+    };
+    for (const Format& format : kFormats)
+    {
+        const uint32_t attributeSize = format.stride - 12;
+        printf("  %-34s %7.2f MB. Normals: %2u bytes/hit, %.2f sectors/hit. Normal, tangent and texture coordinate: %2u bytes/hit, %.2f sectors/hit\n",
+            format.name, double(format.stride) * vertexCount / (1024 * 1024), 3 * format.normalSize, averageSectorsPerHit(sphere, format.stride, format.normalOffset, format.normalSize),
+            3 * attributeSize, averageSectorsPerHit(sphere, format.stride, 12, attributeSize));
+    }
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkUploadRing()
+{
+    printf("Ring allocator, %u frames in flight, 1000 allocations per frame\n", kFramesInFlight);
+    const uint64_t kMaxSizes[] = { 256, 4096, 65536 };
+    for (uint64_t maxSize : kMaxSizes)
+    {
+        // Room for the frames in flight with some headroom
+        const uint32_t kAllocationsPerFrame = 1000;
+        const uint64_t capacity = maxSize * kAllocationsPerFrame * (kFramesInFlight + 2);
+        std::vector<UploadRequest> requests = generateUploadRequests(1 << 16, maxSize, 1234);
+
+        const uint32_t kFrameCount = 10000;
+        UploadStats stats;
+        double sec = bestTime([&]()
+        {
+            RingAllocator ring(capacity);
+            stats = runUploadFrames(ring, requests, kFrameCount, kAllocationsPerFrame, false);
+        });
+
+        // Validate with the roomy ring and with one that is too small, which wraps around all the time and runs out of space
+        RingAllocator roomyRing(capacity);
+        RingAllocator smallRing(capacity / 3);
+        UploadStats roomy = runUploadFrames(roomyRing, requests, 1000, kAllocationsPerFrame, true);
+        UploadStats small = runUploadFrames(smallRing, requests, 1000, kAllocationsPerFrame, true);
+
+        printf("  Sizes up to %5llu bytes: %7.2f M allocations/s, peak usage %5.1f%% of %llu KB, %u out of space. Validation: %u invalid, %u out of space with a third of the ring\n",
+            (unsigned long long)maxSize, double(kFrameCount) * kAllocationsPerFrame / sec / 1e6, 100.0 * double(stats.peakUsage) / double(capacity), (unsigned long long)(capacity / 1024),
+            stats.outOfSpace + roomy.outOfSpace, roomy.invalid + small.invalid, small.outOfSpace);
+    }
+}
+
+void benchmarkDescriptorAllocator()
+{
+    printf("Descriptor allocator, %u frames in flight, a tenth of the meshes replaced every frame, 16 transient ranges per frame\n", kFramesInFlight);
+    const uint32_t kMeshCounts[] = { 100, 1000, 10000 };
+    for (uint32_t meshCount : kMeshCounts)
+    {
+        // Persistent ranges of up to 8 descriptors, with room for the frames in flight and some headroom for fragmentation
+        const uint32_t kMaxRangeSize = 8;
+        const uint32_t persistentCount = meshCount * kMaxRangeSize;
+        const uint32_t transientCount = 16 * 8 * (kFramesInFlight + 1);
+
+        const uint32_t kFrameCount = 1000;
+        DescriptorStats stats;
+        double sec = bestTime([&]()
+        {
+            DescriptorAllocator allocator(persistentCount, transientCount);
+            stats = runDescriptorFrames(allocator, meshCount, kMaxRangeSize, kFrameCount, 1234, false);
+        }, 0.2);
+
+        DescriptorAllocator validationAllocator(persistentCount, transientCount);
+        DescriptorStats validation = runDescriptorFrames(validationAllocator, meshCount, kMaxRangeSize, 200, 1234, true);
+
+        printf("  %5u meshes: %7.2f M allocations/s, peak %5u free ranges, %u out of space. Validation: %u invalid, %s\n", meshCount,
+            double(stats.allocations) / sec / 1e6, stats.peakFreeRanges, stats.outOfSpace + validation.outOfSpace, validation.invalid,
+            (stats.drained && validation.drained) ? "drained to a single free range" : "the free list didn't drain");
+    }
+}
+
+void benchmarkFramePacing()
+{
+    printf("Frame timeline, simulated CPU and GPU times with 20%% jitter, frame times in ms\n");
+    printf("   CPU    GPU   1 frame in flight  %u frames in flight  max(CPU, GPU)\n", kFramesInFlight);
+    const double kTimes[][2] = { { 4, 12 }, { 12, 4 }, { 8, 8 }, { 2, 16 }, { 16, 2 } };
+    for (const double* times : kTimes)
+    {
+        TimelineStats serial = simulateFrameTimeline(1, times[0], times[1], 10000, 42);
+        TimelineStats pipelined = simulateFrameTimeline(kFramesInFlight, times[0], times[1], 10000, 42);
+        printf("  %5.1f  %5.1f  %17.2f  %19.2f  %13.1f", times[0], times[1], serial.frameTime, pipelined.frameTime, std::max(times[0], times[1]));
+        uint32_t errors = serial.violations + serial.staleBuffers + pipelined.violations + pipelined.staleBuffers;
+        if (errors) printf("  %u fence violations, %u stale instance buffers", serial.violations + pipelined.violations, serial.staleBuffers + pipelined.staleBuffers);
+        printf("\n");
+    }
+}
+
+void benchmarkTlasBuildMode()
+{
+    printf("TLAS build mode of InstanceTable, 256 instances on a grid\n");
+    uint32_t failures = 0;
+    const char* kModeNames[] = { "none", "refit", "build" };
+    const uint32_t kGridSize = 16;
+    const uint32_t kInstanceCount = kGridSize * kGridSize;
+    auto gridPosition = [&](uint32_t i) { return glm::vec3(float(i % kGridSize) * 4, 0, float(i / kGridSize) * 4); };
+
+    InstanceTable table;
+    table.setBlas(0, 0x1000, glm::vec3(-1), glm::vec3(1));
+    for (uint32_t i = 0; i < kInstanceCount; i++) table.addInstance(0, translation(gridPosition(i)), i, 0);
+    std::vector<RaytracingInstanceDesc> buffer(kInstanceCount + 1);
+    uint64_t bufferVersion = 0;
+
+    // A frame decides on the mode, then writes the instance buffer, which clears the dirty records
+    auto runFrame = [&]()
+    {
+        TlasBuildMode mode = table.chooseBuildMode();
+        table.flush(buffer.data(), bufferVersion);
+        return mode;
+    };
+    auto getWorldBounds = [&]()
+    {
+        std::vector<InstanceBounds> bounds(table.getInstanceCount());
+        for (uint32_t i = 0; i < table.getInstanceCount(); i++) bounds[i] = table.getWorldBounds(i);
+        return bounds;
+    };
+    auto check = [&](const char* name, TlasBuildMode mode, TlasBuildMode expected, float degradation)
+    {
+        const bool ok = mode == expected;
+        if (ok == false) failures++;
+        printf("  %-52s", name);
+        if (degradation > 0) printf(" degradation %5.2f,", degradation);
+        printf(" %s%s\n", kModeNames[(int)mode], ok ? "" : " WRONG");
+    };
+
+    check("First frame", runFrame(), TlasBuildMode::Build, 0);
+    check("Nothing changed", runFrame(), TlasBuildMode::None, 0);
+    for (uint32_t i = 0; i < kInstanceCount; i++) table.setTransform(i, translation(gridPosition(i)));
+    check("Every transform set to the one it had", runFrame(), TlasBuildMode::None, 0);
+
+    // The SAH degradation is measured on a model of our own built from the same bounds, since the table rebuilds its own when it goes over
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> jitter(-0.2f, 0.2f);
+    TlasModel model;
+    model.build(getWorldBounds());
+    for (uint32_t frame = 0; frame < 4; frame++)
+    {
+        for (uint32_t i = 0; i < kInstanceCount; i++) table.setTransform(i, translation(gridPosition(i) + glm::vec3(jitter(rng), jitter(rng), jitter(rng))));
+        model.refit(getWorldBounds());
+        const float degradation = model.getDegradation();
+        if (degradation > InstanceTable::kDefaultRebuildThreshold) failures++;
+        check("Every instance moves by up to 0.2", runFrame(), TlasBuildMode::Refit, degradation);
+    }
+
+    // Scattering the instances over the whole grid lets the boxes of the old topology overlap
+    std::uniform_int_distribution<uint32_t> anywhere(0, kInstanceCount - 1);
+    for (uint32_t i = 0; i < kInstanceCount; i++) table.setTransform(i, translation(gridPosition(anywhere(rng))));
+    model.refit(getWorldBounds());
+    const float scatteredDegradation = model.getDegradation();
+    if (scatteredDegradation <= InstanceTable::kDefaultRebuildThreshold) failures++;
+    check("Every instance moves to a random grid cell", runFrame(), TlasBuildMode::Build, scatteredDegradation);
+    check("Nothing changed after the rebuild", runFrame(), TlasBuildMode::None, 0);
+
+    table.addInstance(0, translation(glm::vec3(-8, 0, 0)), kInstanceCount, 0);
+    check("An instance is added", runFrame(), TlasBuildMode::Build, 0);
+    table.setBlas(0, 0x2000, glm::vec3(-1), glm::vec3(1));
+    check("The BLAS is replaced", runFrame(), TlasBuildMode::Build, 0);
+    check("Nothing changed", runFrame(), TlasBuildMode::None, 0);
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkAsyncCompute()
+{
+    printf("Async compute, simulated TLAS updates and traces with 20%% jitter, frame times in ms\n");
+    printf("   CPU   TLAS  trace  direct queue  async compute  overlapped  max(CPU, TLAS, trace)\n");
+    const double kTimes[][3] = { { 2, 3, 10 }, { 2, 6, 6 }, { 4, 1, 12 }, { 12, 3, 6 }, { 1, 8, 4 } };
+    const uint32_t kFrames = 10000;
+    uint32_t failures = 0;
+    uint32_t unsynchronizedTraces = 0;
+    for (const double* times : kTimes)
+    {
+        AsyncComputeStats serial = simulateAsyncCompute(AsQueueMode::Direct, times[0], times[1], times[2], kFrames, 42);
+        AsyncComputeStats async = simulateAsyncCompute(AsQueueMode::AsyncCompute, times[0], times[1], times[2], kFrames, 42);
+        AsyncComputeStats noWait = simulateAsyncCompute(AsQueueMode::NoWait, times[0], times[1], times[2], kFrames, 42);
+        printf("  %5.1f  %5.1f  %5.1f  %12.2f  %13.2f  %9.0f%%  %21.1f", times[0], times[1], times[2], serial.frameTime, async.frameTime,
+            100.0 * async.overlaps / kFrames, std::max(times[0], std::max(times[1], times[2])));
+        const uint32_t errors = serial.earlyTraces + serial.slotViolations + async.earlyTraces + async.slotViolations;
+        if (errors || serial.stalled || async.stalled)
+        {
+            printf("  %u traces before their TLAS, %u TLAS updates of a slot in use%s", serial.earlyTraces + async.earlyTraces,
+                serial.slotViolations + async.slotViolations, (serial.stalled || async.stalled) ? ", stalled" : "");
+            failures++;
+        }
+        printf("\n");
+        unsynchronizedTraces += noWait.earlyTraces;
+    }
+    // Without the queue wait traces run ahead of their TLAS when the update is slow. If the model doesn't see it, it doesn't check anything
+    const bool caught = unsynchronizedTraces > 0;
+    printf("  Without the queue wait %u traces started before their TLAS update: %s\n", unsynchronizedTraces, caught ? "ok" : "FAILED");
+    if (caught == false) failures++;
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkShaderCache()
+{
+    printf("Shader cache, stub compiler\n");
+    const std::string kSource = "shader-cache-bench.hlsl";
+    const std::string kInclude = "shader-cache-bench.hlsli";
+    writeTextFile(kSource, "#include \"" + kInclude + "\"\n[shader(\"raygeneration\")] void rayGen() {}\n");
+    writeTextFile(kInclude, "static const float kValue = 1;\n");
+
+    StubShaderCompiler compiler;
+    std::vector<uint8_t> dxil;
+    std::string error;
+    std::vector<std::string> defines;
+    uint32_t failures = 0;
+
+    // Every step is a new launch, and says whether it should compile (a miss) or not (a hit)
+    auto expect = [&](const char* step, const std::string& target, bool compiles)
+    {
+        uint32_t before = compiler.compileCount;
+        std::vector<uint8_t> compiled;
+        ShaderCache cache(compiler, "ShaderCache");
+        bool ok = cache.getLibrary(kSource, target, defines, dxil, error);
+        bool compiledNow = compiler.compileCount != before;
+        // Whatever came from the cache has to be what the compiler produces for the current source
+        StubShaderCompiler reference;
+        reference.dxilSize = compiler.dxilSize;
+        std::string source;
+        std::ifstream file(kSource, std::ios::binary);
+        source.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        reference.compile(kSource, source, target, defines, compiled, error);
+        bool pass = ok && compiledNow == compiles && dxil == compiled;
+        if (pass == false) failures++;
+        printf("    %-40s %-8s %s\n", step, compiledNow ? "compiled" : "cached", pass ? "ok" : "FAILED");
+    };
+
+    expect("First use", "lib_6_3", true);
+    expect("Second use", "lib_6_3", false);
+    writeTextFile(kInclude, "static const float kValue = 2;\n");
+    expect("Included file changed", "lib_6_3", true);
+    expect("Second use", "lib_6_3", false);
+    expect("Another target", "lib_6_5", true);
+    expect("First target again", "lib_6_3", false);
+    defines = { "PACKED_VERTICES" };
+    expect("Define added", "lib_6_3", true);
+    expect("Second use", "lib_6_3", false);
+    defines.clear();
+    expect("Define removed", "lib_6_3", false);
+    compiler.version = "stub 2.0";
+    expect("Compiler version changed", "lib_6_3", true);
+
+    // Flip a byte of the DXIL in the cache file
+    const std::string entry = ShaderCache(compiler, "ShaderCache").getEntryPath(kSource, "lib_6_3", defines);
+    {
+        std::fstream file(entry, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(100);
+        file.put('~');
+    }
+    expect("Damaged cache file", "lib_6_3", true);
+
+    // Hit and miss cost for a few library sizes. The miss includes the stub compilation, which is only a copy
+    const size_t kSizes[] = { 64 * 1024, 1024 * 1024, 8 * 1024 * 1024 };
+    for (size_t size : kSizes)
+    {
+        compiler.dxilSize = size;
+        compiler.version = "stub " + std::to_string(size);
+        double missSec = bestTime([&]()
+        {
+            ShaderCache missCache(compiler, "ShaderCache");
+            remove(entry.c_str());
+            missCache.getLibrary(kSource, "lib_6_3", defines, dxil, error);
+        }, 0.2);
+        double hitSec = bestTime([&]()
+        {
+            ShaderCache hitCache(compiler, "ShaderCache");
+            hitCache.getLibrary(kSource, "lib_6_3", defines, dxil, error);
+        }, 0.2);
+        printf("  %5zu KB library: miss and store %7.3f ms, hit %7.3f ms\n", size / 1024, missSec * 1000, hitSec * 1000);
+    }
+    printf("  %u failed checks\n", failures);
+
+    remove(entry.c_str());
+    remove(ShaderCache(compiler, "ShaderCache").getEntryPath(kSource, "lib_6_5", defines).c_str());
+    remove(ShaderCache(compiler, "ShaderCache").getEntryPath(kSource, "lib_6_3", { "PACKED_VERTICES" }).c_str());
+    remove(kSource.c_str());
+    remove(kInclude.c_str());
+}
+
+void benchmarkShaderTable()
+{
+    printf("Shader table builder, the tutorial records with a triangle and a plane per instance\n");
+    const uint32_t kInstanceCounts[] = { 4, 1000, 100000 };
+    for (uint32_t instanceCount : kInstanceCounts)
+    {
+        ShaderTableBuilder builder;
+        std::vector<uint32_t> contributions;
+        std::vector<uint8_t> table;
+        uint8_t* pTable = nullptr;
+        double sec = bestTime([&]()
+        {
+            builder = ShaderTableBuilder();
+            buildTutorialTable(builder, instanceCount, contributions);
+            table.resize((size_t)builder.getSize() + ShaderTableBuilder::kTableAlignment);
+            pTable = table.data() + (ShaderTableBuilder::kTableAlignment - (uintptr_t)table.data() % ShaderTableBuilder::kTableAlignment) % ShaderTableBuilder::kTableAlignment;
+            builder.write(pTable);
+        }, 0.2);
+        uint32_t errors = verifyTutorialTable(builder, pTable, contributions);
+
+        // Every record at the stride of the largest one, which is what createShaderTable() used to do
+        uint64_t singleStrideSize = builder.getLayout(ShaderTableBuilder::Region::HitGroup).stride * (3 + builder.getRecordCount(ShaderTableBuilder::Region::HitGroup));
+        printf("  %6u instances: %9llu bytes (%9llu with a single stride), built and written in %8.3f ms, %u bad records\n", instanceCount,
+            (unsigned long long)builder.getSize(), (unsigned long long)singleStrideSize, sec * 1000, errors);
+    }
+}
+
+void benchmarkProfiler()
+{
+    printf("Profiler\n");
+    uint32_t failures = 0;
+
+    // The cost of a scope, including collecting it
+    {
+        Profiler profiler;
+        profiler.setTraceCapacity(0);
+        const uint32_t kFrames = 1000;
+        const uint32_t kScopesPerFrame = 1000;
+        Clock::time_point start = Clock::now();
+        for (uint32_t f = 0; f < kFrames; f++)
+        {
+            for (uint32_t e = 0; e < kScopesPerFrame; e++) Profiler::Scope scope(profiler, "Scope");
+            profiler.endFrame();
+        }
+        printf("  %.1f ns per scope, single thread\n", secondsSince(start) * 1e9 / (double(kFrames) * kScopesPerFrame));
+    }
+
+    // Worker threads record while the main thread collects. Every event has to show up in the trace or be counted as dropped, and the events
+    // of a thread have to stay in order
+    {
+        const uint32_t kThreads = 4;
+        const uint32_t kEventsPerThread = 200000;
+        Profiler profiler;
+        profiler.setTraceCapacity(kThreads * kEventsPerThread);
+        std::atomic<uint32_t> running(kThreads);
+        std::vector<std::thread> threads;
+        Clock::time_point start = Clock::now();
+        for (uint32_t t = 0; t < kThreads; t++)
+        {
+            threads.push_back(std::thread([&]()
+            {
+                for (uint32_t e = 0; e < kEventsPerThread; e++) Profiler::Scope scope(profiler, "Worker");
+                running--;
+            }));
+        }
+        uint32_t frames = 0;
+        while (running > 0)
+        {
+            profiler.endFrame();
+            frames++;
+        }
+        for (std::thread& thread : threads) thread.join();
+        profiler.endFrame();
+        double sec = secondsSince(start);
+
+        const std::string kTraceFile = "profiler-bench.json";
+        uint64_t traceEvents = 0;
+        if (profiler.writeChromeTrace(kTraceFile))
+        {
+            std::ifstream file(kTraceFile);
+            std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            for (size_t pos = content.find("\"ph\":\"X\""); pos != std::string::npos; pos = content.find("\"ph\":\"X\"", pos + 1)) traceEvents++;
+        }
+        remove(kTraceFile.c_str());
+
+        uint64_t collected = profiler.getTraceEventCount();
+        bool complete = collected + profiler.getDroppedEventCount() == uint64_t(kThreads) * kEventsPerThread;
+        bool written = traceEvents == collected;
+        if (complete == false || written == false) failures++;
+        printf("  %u threads, %u events each: %.1f M events/s, collected in %u frames, %llu dropped, %s, %s\n", kThreads, kEventsPerThread,
+            double(kThreads) * kEventsPerThread / sec / 1e6, frames, (unsigned long long)profiler.getDroppedEventCount(),
+            complete ? "no events lost" : "EVENTS LOST", written ? "trace complete" : "TRACE INCOMPLETE");
+    }
+
+    // Frames of 1 to 300 ms. The stats only keep the last kStatsWindow frames, and events with the same name in a frame are summed
+    {
+        Profiler profiler;
+        const uint32_t kFrames = 300;
+        for (uint64_t f = 1; f <= kFrames; f++)
+        {
+            uint64_t start = f * 1000000000ull;
+            profiler.addGpuEvent("Half", start, start + f * 500000);
+            profiler.addGpuEvent("Half", start, start + f * 500000);
+            profiler.endFrame();
+        }
+        std::vector<Profiler::Stats> stats = profiler.getStats();
+        const uint32_t expectedCount = std::min(kFrames, Profiler::kStatsWindow);
+        const double first = double(kFrames - expectedCount + 1);
+        bool ok = stats.size() == 1 && stats[0].gpu && stats[0].count == expectedCount && fabs(stats[0].averageMs - (first + kFrames) / 2) < 1e-6 &&
+            fabs(stats[0].p50Ms - (first + expectedCount / 2)) < 1e-6 && fabs(stats[0].p99Ms - (first + uint32_t(expectedCount * 0.99))) < 1e-6;
+        if (ok == false) failures++;
+        printf("  Rolling stats: %s\n", ok ? "ok" : "FAILED");
+    }
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkBlasCompaction()
+{
+    printf("BLAS compaction against a mock device\n");
+    uint32_t failures = 0;
+    const BlasManager::BuildMode concurrent = BlasManager::BuildMode::Concurrent;
+    failures += runBlasCompaction(8, 1, BlasManager::kDefaultScratchPoolSize, concurrent, true).failures;
+    failures += runBlasCompaction(1000, 1, BlasManager::kDefaultScratchPoolSize, concurrent, false).failures;
+    // A budget smaller than the largest scratch still builds, with a pool of that size
+    failures += runBlasCompaction(1000, 1, 1024 * 1024, concurrent, false).failures;
+    failures += runBlasCompaction(1000, 1, BlasManager::kDefaultScratchPoolSize, BlasManager::BuildMode::Serial, false).failures;
+    failures += runBlasCompaction(1000, 4, BlasManager::kDefaultScratchPoolSize, concurrent, false).failures;
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkTaskGraph()
+{
+    printf("Task graph\n");
+    uint32_t failures = 0;
+
+    // The stages of Tutorial01::onLoad() with their dependencies, sleeping for the time they take on a cold start with a cache miss
+    {
+        struct Stage
+        {
+            const char* name;
+            uint32_t ms;
+            std::vector<TaskGraph::TaskId> dependencies;
+            TaskGraph::Affinity affinity;
+        };
+        const TaskGraph::Affinity any = TaskGraph::Affinity::AnyThread;
+        const Stage kStages[] =
+        {
+            { "initDXR", 40, {}, TaskGraph::Affinity::MainThread },
+            { "prepareScene", 30, {}, any },
+            { "compileShaders", 60, {}, any },
+            { "createAccelerationStructures", 50, { 0, 1 }, any },
+            { "createRtPipelineState", 30, { 0, 2 }, any },
+            { "createShaderResources", 5, { 3 }, any },
+            { "createConstantBuffer", 2, { 3 }, any },
+            { "createShaderTable", 3, { 4, 5, 6 }, any },
+        };
+        const uint32_t stageCount = sizeof(kStages) / sizeof(kStages[0]);
+        // The stages mostly wait, so they overlap with more threads than cores
+        const uint32_t kThreadCounts[] = { 1, 4 };
+        uint64_t runTime[2] = {};
+        for (uint32_t t = 0; t < 2; t++)
+        {
+            const uint32_t threads = kThreadCounts[t];
+            JobSystem jobs(threads);
+            TaskGraph graph;
+            TaskGraphCheck check(stageCount);
+            for (const Stage& stage : kStages)
+            {
+                const uint32_t ms = stage.ms;
+                check.addCheckedTask(graph, stage.name, [ms]() { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }, stage.dependencies, stage.affinity);
+            }
+            uint32_t errors = check.run(graph, jobs);
+            runTime[t] = graph.getRunTime();
+            // The graph is as fast as its critical path, give or take the sleep resolution
+            bool ok = errors == 0 && (threads == 1 || graph.getRunTime() < graph.getCriticalPathTime() + 20000000ull);
+            if (ok == false) failures++;
+            if (threads > 1) graph.printTimings();
+            printf("  onLoad stages, %u thread%s: %8.3f ms, %s\n", threads, threads > 1 ? "s" : " ", graph.getRunTime() * 1e-6, ok ? "ok" : "FAILED");
+        }
+        printf("  %.2fx faster on %u threads\n", double(runTime[0]) / double(runTime[1]), kThreadCounts[1]);
+    }
+
+    // Random graphs of small tasks, a few of them on the main thread. Measures the scheduling cost of a task
+    const uint32_t kTaskCount = 20000;
+    std::mt19937 rng(7);
+    TaskGraph graph;
+    TaskGraphCheck check(kTaskCount);
+    std::atomic<uint64_t> sum(0);
+    for (uint32_t i = 0; i < kTaskCount; i++)
+    {
+        std::vector<TaskGraph::TaskId> dependencies;
+        const uint32_t dependencyCount = i ? rng() % 4 : 0;
+        for (uint32_t d = 0; d < dependencyCount; d++) dependencies.push_back(i - 1 - rng() % std::min(i, 64u));
+        const TaskGraph::Affinity affinity = (rng() % 16 == 0) ? TaskGraph::Affinity::MainThread : TaskGraph::Affinity::AnyThread;
+        check.addCheckedTask(graph, "Task", [&sum, i]() { sum += i; }, dependencies, affinity);
+    }
+    const uint32_t kRandomThreadCounts[] = { 1, 4, 0 };
+    for (uint32_t threads : kRandomThreadCounts)
+    {
+        sum = 0;
+        JobSystem jobs(threads);
+        uint32_t errors = check.run(graph, jobs);
+        bool ok = errors == 0 && sum == uint64_t(kTaskCount) * (kTaskCount - 1) / 2;
+        if (ok == false) failures++;
+        printf("  %u random tasks, %2u threads: %6.3f us per task, %s\n", kTaskCount, jobs.getThreadCount(), graph.getRunTime() * 1e-3 / kTaskCount, ok ? "ok" : "FAILED");
+    }
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkJobSystem()
+{
+    printf("Job system\n");
+    uint32_t failures = 0;
+
+    // Every element of a parallelFor once, and fork/join jobs that wait inside jobs
+    {
+        JobSystem jobs(8);
+        const uint32_t kCount = 1000003;
+        std::vector<uint32_t> visits(kCount, 0);
+        jobs.parallelFor(kCount, 1000, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; i++) visits[i]++;
+        });
+        bool ok = std::count(visits.begin(), visits.end(), 1u) == kCount;
+        printf("  parallelFor covers every element once: %s\n", ok ? "ok" : "FAILED");
+        if (ok == false) failures++;
+
+        uint64_t fib = forkJoinFibonacci(jobs, 32);
+        ok = fib == 2178309;
+        printf("  Fork/join Fibonacci(32): %s\n", ok ? "ok" : "FAILED");
+        if (ok == false) failures++;
+
+        // This thread is worker 0 of both systems while a second one is alive, and still of the first one after it's gone
+        {
+            JobSystem other(2);
+            ok = jobs.getWorkerIndex() == 0 && other.getWorkerIndex() == 0;
+            other.parallelFor(kCount, 1000, [&](uint32_t begin, uint32_t end)
+            {
+                for (uint32_t i = begin; i < end; i++) visits[i]++;
+            });
+        }
+        jobs.parallelFor(kCount, 1000, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; i++) visits[i]++;
+        });
+        ok = ok && jobs.getWorkerIndex() == 0 && std::count(visits.begin(), visits.end(), 3u) == kCount;
+        printf("  Two systems created by the same thread: %s\n", ok ? "ok" : "FAILED");
+        if (ok == false) failures++;
+    }
+
+    // Scalability. The same work at every thread count, compared with a plain loop
+    const uint32_t kCount = 1 << 20;
+    const uint32_t coreCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<float> reference(kCount);
+    double serial = bestTime([&]() { for (uint32_t i = 0; i < kCount; i++) reference[i] = jobWork(i); }, 0.2);
+    printf("  %u elements, plain loop %.2f ms, %u cores\n", kCount, serial * 1000, coreCount);
+    const uint32_t kThreadCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    for (uint32_t threads : kThreadCounts)
+    {
+        JobSystem jobs(threads);
+        std::vector<float> result(kCount);
+        double sec = bestTime([&]()
+        {
+            jobs.parallelFor(kCount, 1024, [&](uint32_t begin, uint32_t end)
+            {
+                for (uint32_t i = begin; i < end; i++) result[i] = jobWork(i);
+            });
+        }, 0.2);
+        bool ok = memcmp(result.data(), reference.data(), kCount * sizeof(float)) == 0;
+        if (ok == false) failures++;
+        // The efficiency is per core the threads can use
+        printf("  %2u threads: %8.2f ms, %5.2fx, %3.0f%% efficiency, %s\n", threads, sec * 1000, serial / sec, 100 * serial / sec / std::min(threads, coreCount),
+            ok ? "ok" : "FAILED");
+    }
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkCommandListPool()
+{
+    printf("Command list pool\n");
+    uint32_t failures = 0;
+    const uint32_t kFrameSlots = 3;
+    const uint32_t kFrames = 1000;
+    JobSystem jobs(4);
+    MockCommandListBackend backend;
+    CommandListPool pool(backend, kFrameSlots);
+    std::mt19937 rng(22);
+    uint32_t maxLists = 0;
+    uint32_t submitCount = 0;
+    for (uint32_t frame = 0; frame < kFrames; frame++)
+    {
+        const uint32_t slot = frame % kFrameSlots;
+        backend.retire(slot);
+        pool.beginFrame(slot);
+
+        // Sometimes a batch in the middle of the frame, like flushCommandList() does while loading. Its lists are in flight for the rest of it
+        uint32_t frameLists = 0;
+        if (frame % 7 == 0)
+        {
+            uint32_t list = pool.acquire(5);
+            backend.record(list, 5);
+            if (pool.submit() != 1) failures++;
+            submitCount++;
+            frameLists++;
+        }
+
+        // Lists recorded in parallel, acquired in about the reverse of their order, and a last one on this thread like the present barrier
+        const uint32_t listCount = 1 + rng() % 24;
+        jobs.parallelFor(listCount, 1, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                const uint32_t order = listCount - i;
+                const uint32_t list = pool.acquire(order);
+                for (uint32_t command = 0; command < 4; command++) backend.record(list, order);
+            }
+        });
+        const uint32_t last = pool.acquire(listCount + 1);
+        backend.record(last, listCount + 1);
+        if (pool.submit() != listCount + 1) failures++;
+        submitCount++;
+        frameLists += listCount + 1;
+        maxLists = std::max(maxLists, frameLists);
+    }
+
+    const CommandListPool::Stats& stats = pool.getStats();
+    const bool ordered = backend.errors == 0 && backend.executedCount == stats.acquireCount && stats.batchCount == submitCount;
+    printf("  Lists reset only after their frame retired, executed closed and in order: %s\n", ordered ? "ok" : "FAILED");
+    if (ordered == false) failures++;
+    // A slot keeps the lists of its busiest frame, no more
+    const bool reused = stats.listCount <= kFrameSlots * maxLists;
+    printf("  %u frames, %u lists on %u threads, %u allocators and lists created (%u per frame at most): %s\n", kFrames, stats.acquireCount,
+        jobs.getThreadCount(), stats.listCount, maxLists, reused ? "ok" : "FAILED");
+    if (reused == false) failures++;
+
+    // The cost of the pool itself, acquiring and submitting lists from one thread
+    const uint32_t kListCount = 64;
+    uint32_t slot = 0;
+    double sec = bestTime([&]()
+    {
+        slot = (slot + 1) % kFrameSlots;
+        backend.retire(slot);
+        pool.beginFrame(slot);
+        for (uint32_t i = 0; i < kListCount; i++) backend.record(pool.acquire(i), i);
+        pool.submit();
+    }, 0.2);
+    printf("  Acquire and submit: %.3f us per list\n", sec * 1e6 / kListCount);
+    if (backend.errors) failures++;
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkResourceStates()
+{
+    printf("Resource states\n");
+    uint32_t failures = 0;
+
+    // The barriers of a few small cases
+    {
+        const uint64_t kBuffer = 0x100;
+        const uint64_t kTexture = 0x200;
+        const uint32_t kCopySource = 0x800;
+        const uint32_t kCopyDest = 0x400;
+        const uint32_t kNonPixelShader = 0x40;
+        const uint32_t kPixelShader = 0x80;
+        ResourceStateTracker tracker;
+        tracker.addResource(kBuffer, 1, kCopySource);
+        tracker.addResource(kTexture, 4, kCopySource);
+        std::vector<ResourceBarrier> barriers;
+        uint32_t errors = 0;
+        auto expect = [&](size_t count)
+        {
+            if (barriers.size() != count) errors++;
+            barriers.clear();
+        };
+
+        CommandListStates list(tracker);
+        list.require(kBuffer, ResourceStateTracker::kStateUnorderedAccess);
+        list.flush(barriers);
+        expect(0);                                                      // The first use is resolved at submission
+        tracker.resolve(list, barriers);
+        if (barriers.size() != 1 || barriers[0].stateBefore != kCopySource || barriers[0].subresource != ResourceStateTracker::kAllSubresources) errors++;
+        barriers.clear();
+
+        list.require(kBuffer, ResourceStateTracker::kStateUnorderedAccess);
+        list.require(kBuffer, ResourceStateTracker::kStateUnorderedAccess);
+        list.flush(barriers);
+        expect(1);                                                      // A UAV barrier against the previous batch
+        list.require(kBuffer, kCopyDest);
+        list.require(kBuffer, ResourceStateTracker::kStateUnorderedAccess);
+        list.flush(barriers);
+        expect(1);                                                      // Back where it was, the UAV barrier is still needed
+        list.require(kBuffer, kNonPixelShader);
+        list.flush(barriers);
+        expect(1);
+        list.require(kBuffer, kPixelShader);
+        list.flush(barriers);
+        if (barriers.size() != 1 || barriers[0].stateAfter != (kNonPixelShader | kPixelShader)) errors++;
+        barriers.clear();
+        list.require(kBuffer, kNonPixelShader);
+        list.flush(barriers);
+        expect(0);                                                      // Already in a read state that includes it
+
+        list.require(kTexture, kCopyDest);
+        list.require(kTexture, kPixelShader);
+        list.flush(barriers);
+        expect(1);                                                      // From the state the list expects it in
+        list.require(kTexture, kCopySource);
+        list.flush(barriers);
+        if (barriers.size() != 1 || barriers[0].subresource != ResourceStateTracker::kAllSubresources) errors++;
+        barriers.clear();
+        list.require(kTexture, kCopyDest, 2);
+        list.require(kTexture, kCopyDest, 3);
+        list.flush(barriers);
+        expect(2);
+        list.uavBarrier(kBuffer);
+        list.uavBarrier();
+        list.uavBarrier(kTexture);
+        list.flush(barriers);
+        expect(1);                                                      // One barrier for every resource
+
+        // A list that knows the state a resource starts in has the barrier, the state is checked when it's submitted
+        const uint64_t kOutput = 0x300;
+        tracker.addResource(kOutput, 1, kCopySource);
+        CommandListStates known(tracker);
+        known.expect(kOutput, kCopySource);
+        known.require(kOutput, ResourceStateTracker::kStateUnorderedAccess);
+        known.flush(barriers);
+        expect(1);
+        tracker.resolve(known, barriers);
+        expect(0);
+        CommandListStates wrong(tracker);
+        wrong.expect(kOutput, kCopySource);
+        wrong.require(kOutput, kCopySource);
+        wrong.flush(barriers);
+        expect(0);
+        tracker.resolve(wrong, barriers);
+        expect(1);                                                      // It was a UAV
+        CommandListStates write(tracker);
+        write.require(kOutput, ResourceStateTracker::kStateUnorderedAccess);
+        tracker.resolve(write, barriers);
+        expect(1);                                                      // No UAV barrier, the transition orders the accesses
+        CommandListStates read(tracker);
+        read.require(kOutput, ResourceStateTracker::kStateUnorderedAccess);
+        tracker.resolve(read, barriers);
+        expect(1);                                                      // The UAV barrier against the list before
+
+        bool ok = errors == 0;
+        printf("  Redundant transitions and UAV barriers elided, transitions merged: %s\n", ok ? "ok" : "FAILED");
+        if (ok == false) failures++;
+    }
+
+    // Lists recorded in parallel and resolved in order, replayed on the "GPU"
+    JobSystem jobs(4);
+    uint32_t requireCount = 0;
+    StateCheck check;
+    double sec = bestTime([&]() { check = runResourceStates(jobs, 2000, 24, requireCount); }, 0.2);
+    const bool ok = check.violations == 0;
+    printf("  %u require() calls: %u barriers in %u ResourceBarrier() calls, every command in its state: %s\n", requireCount, check.barriers,
+        check.barrierCalls, ok ? "ok" : "FAILED");
+    printf("  %.3f us per require(), including the resolve\n", sec * 1e6 / requireCount);
+    if (ok == false) failures++;
+    printf("  %u failed checks\n", failures);
+}
+
+void benchmarkRenderGraph()
+{
+    printf("Render graph\n");
+    uint32_t failures = 0;
+
+    // The frame with the passes we're adding. The trace writes the color and the normals, AO reads the normals, the denoiser the color
+    // and the AO, the tonemap writes the image the copy puts in the back-buffer. Nothing needs the debug view of the AO
+    {
+        const uint64_t kTexture = 1920 * 1080 * 8;
+        const uint64_t kAlignment = 64 * 1024;
+        const uint32_t kUav = ResourceStateTracker::kStateUnorderedAccess;
+        const uint32_t kShaderResource = 0x40;
+        RenderGraph graph;
+        RenderGraph::ResourceId color = graph.addTransient("Color", kTexture, kAlignment);
+        RenderGraph::ResourceId normals = graph.addTransient("Normals", kTexture, kAlignment);
+        RenderGraph::ResourceId ao = graph.addTransient("AO", kTexture / 4, kAlignment);
+        RenderGraph::ResourceId denoised = graph.addTransient("Denoised", kTexture, kAlignment);
+        RenderGraph::ResourceId ldr = graph.addTransient("LDR", kTexture / 2, kAlignment);
+        RenderGraph::ResourceId debugView = graph.addTransient("AO debug view", kTexture / 2, kAlignment);
+        RenderGraph::ResourceId backBuffer = graph.addImported("Back-buffer");
+        graph.markOutput(backBuffer);
+        RenderGraph::PassId trace = graph.addPass("DispatchRays");
+        graph.write(trace, color, kUav);
+        graph.write(trace, normals, kUav);
+        RenderGraph::PassId aoPass = graph.addPass("AO");
+        graph.read(aoPass, normals, kShaderResource);
+        graph.write(aoPass, ao, kUav);
+        RenderGraph::PassId debug = graph.addPass("AO debug view");
+        graph.read(debug, ao, kShaderResource);
+        graph.write(debug, debugView, kUav);
+        RenderGraph::PassId denoise = graph.addPass("Denoise");
+        graph.read(denoise, color, kShaderResource);
+        graph.read(denoise, ao, kShaderResource);
+        graph.write(denoise, denoised, kUav);
+        RenderGraph::PassId tonemap = graph.addPass("Tonemap");
+        graph.read(tonemap, denoised, kShaderResource);
+        graph.write(tonemap, ldr, kUav);
+        RenderGraph::PassId copy = graph.addPass("Copy to back-buffer");
+        graph.read(copy, ldr, 0x800);
+        graph.write(copy, backBuffer, 0x400);
+        graph.compile();
+
+        GraphCheck check = checkRenderGraph(graph, 8, 3);
+        const bool ok = check.violations == 0 && check.firstListBarriers == 0 && graph.isCulled(debug) && graph.getPassOrder().size() == 5 && graph.isUsed(debugView) == false &&
+            graph.getPlacement(ldr).offset == graph.getPlacement(color).offset;     // The color is denoised before the LDR image is written
+        printf("  AO, denoise and tonemap: %u passes culled, %.1f MB of transients in %.1f MB, %u barriers in %u calls over 8 frames: %s\n",
+            check.culledCount, graph.getUnaliasedSize() / 1048576.0, graph.getHeapSize(0) / 1048576.0, check.states.barriers, check.states.barrierCalls,
+            ok ? "ok" : "FAILED");
+        if (ok == false) failures++;
+    }
+
+    // Random graphs
+    uint32_t violations = 0;
+    uint32_t culled = 0;
+    uint32_t firstListBarriers = 0;
+    uint64_t unaliased = 0;
+    uint64_t heaps = 0;
+    for (uint32_t seed = 0; seed < 200; seed++)
+    {
+        RenderGraph graph;
+        buildRandomGraph(graph, 4 + seed % 40, 2 + seed % 24, seed);
+        graph.compile();
+        GraphCheck check = checkRenderGraph(graph, 4, 2);
+        violations += check.violations;
+        culled += check.culledCount;
+        firstListBarriers += check.firstListBarriers;
+        unaliased += graph.getUnaliasedSize();
+        for (uint32_t heap = 0; heap < graph.getHeapCount(); heap++) heaps += graph.getHeapSize(heap);
+    }
+    const bool ok = violations == 0;
+    printf("  200 random graphs, %u passes culled, %.0f MB of transients in %.0f MB of heaps, %u barriers before the first passes: %s\n",
+        culled, unaliased / 1048576.0, heaps / 1048576.0, firstListBarriers, ok ? "ok" : "FAILED");
+    if (ok == false) failures++;
+
+    RenderGraph large;
+    buildRandomGraph(large, 500, 200, 1);
+    double sec = bestTime([&]() { large.compile(); }, 0.2);
+    printf("  compile() of 500 passes and 200 transients: %.3f ms\n", sec * 1e3);
+    printf("  %u failed checks\n", failures);
+}
+
+int runBenchmarks()
+{
+    benchmarkBvhTraversal();
+    benchmarkCpuReference();
+    benchmarkSphereGenerator();
+    benchmarkTangentGenerator();
+    benchmarkMeshOptimizer();
+    benchmarkSceneGeometry();
+    benchmarkPackedVertices();
+    benchmarkUploadRing();
+    benchmarkDescriptorAllocator();
+    benchmarkFramePacing();
+    benchmarkTlasBuildMode();
+    benchmarkAsyncCompute();
+    benchmarkShaderCache();
+    benchmarkShaderTable();
+    benchmarkProfiler();
+    benchmarkBlasCompaction();
+    benchmarkTaskGraph();
+    benchmarkJobSystem();
+    benchmarkCommandListPool();
+    benchmarkResourceStates();
+    benchmarkRenderGraph();
+    return 0;
+}
@@ -0,0 +1,123 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+
+// Micro-benchmarks for the CPU code. "01-CreateWindow.exe -bench" runs them all and prints the results
+int runBenchmarks();
+
+// Traces primary and shadow rays against a tessellated sphere with the SSE and AVX2 BVH8 traversals, and with Kernel::Auto, which picks one by
+// the BVH size for the shadow rays
+void benchmarkBvhTraversal();
+
+// Renders the tutorial scene with CpuRaytracer on one thread and on several, with the SSE, the AVX2 and the Auto traversal, and checks that every
+// frame hashes to the same value as the golden one. A different hash means the shading or the traversal changed, or FMAs got contracted
+void benchmarkCpuReference();
+
+// Generates spheres at tessellation 32 to 2048 with createSphere() and with the old push_back() generator. Checks that the topology is
+// identical, the vertices match and the index format is 16-bit exactly when the vertices fit
+void benchmarkSphereGenerator();
+
+// Generates the tangents of spheres with up to 16M triangles on all the cores, on one, and with the scalar generator it replaced. Checks that
+// they are unit length, orthogonal to the normal, within 0.1 degrees of the old ones, independent of the thread count, the triangle order and
+// the index format, and that mirroring the texture mapping flips the handedness. A single thread must beat the old generator at every size,
+// and with 8 hardware threads all of them must beat one on the large spheres
+void benchmarkTangentGenerator();
+
+// Runs optimizeMesh() on spheres as createSphere() emits them, on one with its triangles shuffled and on one without indices. Checks that the
+// triangles and their winding are kept, that welding finds every shared vertex, that the vertex cache improves and the overfetch doesn't get
+// worse, and prints the MeshStats
+void benchmarkMeshOptimizer();
+
+// Runs validateSceneGeometry() on the tutorial scene and on scenes with 16-bit, 32-bit and unindexed meshes, with views that cover them, the
+// 3-element views the tutorial used to create, and an index past its mesh. Reports the memory indexing saves over expanded triangles
+void benchmarkSceneGeometry();
+
+// Round-trips a million random normal, tangent and handedness triples and every half float through the PackedVertex encoding, and a sphere
+// through packVertices(). Checks the angular and texture-coordinate errors, then reports the bytes and 32-byte sectors a hit reads with
+// each vertex format
+void benchmarkPackedVertices();
+
+// Drives RingAllocator through the frame loop without a device. Validates every allocation once, then measures the allocation rate
+void benchmarkUploadRing();
+
+// Allocates and frees persistent descriptor ranges for a changing set of meshes and transient ranges every frame, without a device. Checks
+// that no range overlaps a live one or reuses a descriptor before its frame retired, and that the free list merges back into a single range
+void benchmarkDescriptorAllocator();
+
+// Simulates the CPU and GPU timeline of the frame loop with one and with kDefaultSwapChainBuffers frames in flight. Checks that no
+// per-frame slot is reused before its fence completed, and that the per-frame instance buffers stay in sync with the InstanceTable
+void benchmarkFramePacing();
+
+// Moves the instances of an InstanceTable and checks the mode chooseBuildMode() picks: nothing when nothing changed, a refit for small moves,
+// a full build once scattered instances degrade the SAH cost of the refit TlasModel past kDefaultRebuildThreshold, and when an instance is
+// added or its BLAS replaced
+void benchmarkTlasBuildMode();
+
+// Plays the frame loop on a model of the direct and the compute queue, with the TLAS update on the direct queue and on the compute queue.
+// Checks that no trace starts before the update of its frame and no update writes a TLAS a queued trace still reads, and reports how much
+// of the update cost the compute queue hides
+void benchmarkAsyncCompute();
+
+// Runs the shader cache against a stub compiler. Checks that edits to the source and its includes, a new target, a new define, a new compiler,
+// and a damaged cache file all cause a recompile and nothing else does, then measures the cost of a hit and a miss
+void benchmarkShaderCache();
+
+// Builds and writes shader tables with the record mix of the tutorial and checks every record byte for byte, including the padding and
+// the InstanceContributionToHitGroupIndex values. Compares the size with a table that uses a single stride for all the records
+void benchmarkShaderTable();
+
+// Measures the cost of a profiler scope and records from several threads while the main thread collects. Checks that every event is either
+// in the trace or counted as dropped, that the Chrome trace has all of them, and the rolling p50/p99 stats
+void benchmarkProfiler();
+
+// Builds and compacts BLASes of random sizes with BlasManager against a mock device, in one and in several rounds, serially and with a scratch
+// budget that forces the pool to be reused. Checks that the builds that can overlap get disjoint scratch, that the results and the copies don't
+// overlap, that only finished builds are copied and only the compacted buffers are left. Reports the memory before and after compaction, and
+// the buffers and barriers against building the BLASes one by one
+void benchmarkBlasCompaction();
+
+// Runs the stages of Tutorial01::onLoad() as timed stand-ins on one thread and on four, then random graphs of small tasks. Checks
+// that every task ran once, after its dependencies and on the calling thread when it has to, and prints the per-task timings of onLoad()
+void benchmarkTaskGraph();
+
+// Checks that a parallelFor() covers every element once, that jobs forked from jobs join and that a thread can create two systems, then
+// runs the same parallelFor() on 1 to 64 threads and reports the speedup over a plain loop
+void benchmarkJobSystem();
+
+// Acquires command lists on several threads for a few hundred frames with CommandListPool against a mock device. Checks that a list is only
+// reset once its frame retired, that every batch has the closed lists in order, and that the pool reuses them, then measures its overhead
+void benchmarkCommandListPool();
+
+// Checks the barriers of ResourceStateTracker for a few small cases, then records random passes into lists on several threads, resolves
+// them in order and replays the barriers. Checks that every barrier starts from the state the resource is in and every command runs in the
+// state it needs, with a UAV barrier after earlier UAV writes
+void benchmarkResourceStates();
+
+// Compiles a frame graph with AO, denoise and tonemap passes and random graphs. Checks the culled passes against the passes the outputs
+// need, that transients in use at the same time don't share memory, and replays the barriers of a few frames with the aliasing barriers
+void benchmarkRenderGraph();
@@ -0,0 +1,175 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "BlasManager.h"
+#include <algorithm>
+
+namespace
+{
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+BlasManager::~BlasManager()
+{
+    for (uint64_t address : mBuildBuffers) mBackend.releaseBuffer(address);
+    for (uint64_t address : mCompactedBuffers) mBackend.releaseBuffer(address);
+    if (mScratchPool) mBackend.releaseBuffer(mScratchPool);
+}
+
+uint32_t BlasManager::addBlas(uint64_t buildSize, uint64_t scratchSize)
+{
+    BlasInfo blas;
+    blas.buildSize = alignUp(buildSize, kAlignment);
+    blas.scratchSize = alignUp(scratchSize, kAlignment);
+    mBlas.push_back(blas);
+    return (uint32_t)mBlas.size() - 1;
+}
+
+void BlasManager::suballocate(const std::vector<uint64_t>& sizes, std::vector<uint64_t>& buffers, std::vector<uint64_t>& addresses)
+{
+    addresses.resize(sizes.size());
+    size_t first = 0;
+    while (first < sizes.size())
+    {
+        // As many as fit kMaxBufferSize, and at least one
+        uint64_t bufferSize = alignUp(sizes[first], kAlignment);
+        size_t end = first + 1;
+        for (; end < sizes.size() && bufferSize + alignUp(sizes[end], kAlignment) <= kMaxBufferSize; end++) bufferSize += alignUp(sizes[end], kAlignment);
+
+        const uint64_t buffer = mBackend.createBuffer(bufferSize, false);
+        buffers.push_back(buffer);
+        mStats.bufferCount++;
+        uint64_t offset = 0;
+        for (size_t i = first; i < end; i++)
+        {
+            addresses[i] = buffer + offset;
+            offset += alignUp(sizes[i], kAlignment);
+        }
+        first = end;
+    }
+}
+
+void BlasBackend::recordBuilds(const BuildCommand* pBuilds, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (pBuilds[i].barrierBefore) uavBarrier();
+        build(pBuilds[i].blasIndex, pBuilds[i].resultAddress, pBuilds[i].scratchAddress);
+    }
+}
+
+void BlasManager::build()
+{
+    if (mBuiltCount == mBlas.size()) return;
+
+    // In concurrent mode the pool only needs to hold all the builds at once if they fit the budget. It has to hold the largest one
+    uint64_t totalScratch = 0;
+    uint64_t maxScratch = 0;
+    std::vector<uint64_t> resultSizes;
+    for (uint32_t i = mBuiltCount; i < (uint32_t)mBlas.size(); i++)
+    {
+        totalScratch += mBlas[i].scratchSize;
+        maxScratch = std::max(maxScratch, mBlas[i].scratchSize);
+        resultSizes.push_back(mBlas[i].buildSize);
+        mStats.buildBytes += mBlas[i].buildSize;
+    }
+    const uint64_t poolSize = (mMode == BuildMode::Serial) ? maxScratch : std::max(std::min(totalScratch, mScratchPoolSize), maxScratch);
+    if (mScratchPool == 0 || poolSize > mScratchPoolCapacity)
+    {
+        if (mScratchPool) mBackend.releaseBuffer(mScratchPool);
+        mScratchPool = mBackend.createBuffer(poolSize, true);
+        mScratchPoolCapacity = poolSize;
+        mStats.scratchPoolBytes = std::max(mStats.scratchPoolBytes, poolSize);
+        mStats.bufferCount++;
+    }
+
+    // The results share as few buffers as possible
+    std::vector<uint64_t> resultAddresses;
+    suballocate(resultSizes, mBuildBuffers, resultAddresses);
+
+    std::vector<BlasBackend::BuildCommand> builds;
+    uint64_t scratchOffset = 0;
+    for (uint32_t i = 0; mBuiltCount < (uint32_t)mBlas.size(); mBuiltCount++, i++)
+    {
+        BlasInfo& blas = mBlas[mBuiltCount];
+        bool barrier = false;
+        if (scratchOffset + blas.scratchSize > mScratchPoolCapacity)
+        {
+            // The pool is full. The builds so far have to finish before their scratch is reused
+            barrier = true;
+            mStats.scratchReuseCount++;
+            scratchOffset = 0;
+        }
+        blas.address = resultAddresses[i];
+        builds.push_back({ mBuiltCount, blas.address, mScratchPool + scratchOffset, barrier });
+        scratchOffset += blas.scratchSize;
+    }
+    mBackend.recordBuilds(builds.data(), (uint32_t)builds.size());
+    // The copies in compact() and anything else that reads the BLASes come after the builds
+    mBackend.endBuilds();
+}
+
+void BlasManager::compact()
+{
+    if (mCompactedCount == mBuiltCount) return;
+
+    std::vector<uint64_t> sizes;
+    mBackend.readCompactedSizes(sizes);
+
+    // Packed tightly, every BLAS at an aligned offset
+    std::vector<uint64_t> compactedSizes;
+    for (uint32_t i = mCompactedCount; i < mBuiltCount; i++)
+    {
+        mBlas[i].compactedSize = sizes[i];
+        compactedSizes.push_back(sizes[i]);
+        mStats.compactedBytes += alignUp(sizes[i], kAlignment);
+    }
+    std::vector<uint64_t> addresses;
+    suballocate(compactedSizes, mCompactedBuffers, addresses);
+
+    for (uint32_t i = 0; mCompactedCount < mBuiltCount; mCompactedCount++, i++)
+    {
+        BlasInfo& blas = mBlas[mCompactedCount];
+        mBackend.copyCompacted(addresses[i], blas.address);
+        blas.address = addresses[i];
+    }
+    mBackend.uavBarrier();
+}
+
+void BlasManager::releaseBuildBuffers()
+{
+    for (uint64_t address : mBuildBuffers) mBackend.releaseBuffer(address);
+    mBuildBuffers.clear();
+
+    // Nothing is left to build. The next build() creates a pool again
+    if (mScratchPool) mBackend.releaseBuffer(mScratchPool);
+    mScratchPool = 0;
+    mScratchPoolCapacity = 0;
+}
@@ -0,0 +1,137 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+// The GPU side of BlasManager. Tutorial01 implements it with D3D12, the benchmarks with a mock that checks what the manager asks for
+class BlasBackend
+{
+public:
+    virtual ~BlasBackend() = default;
+
+    // A build of BlasManager::build(). barrierBefore is set when it reuses the scratch of an earlier build
+    struct BuildCommand
+    {
+        uint32_t blasIndex;
+        uint64_t resultAddress;
+        uint64_t scratchAddress;
+        bool barrierBefore;
+    };
+
+    // A default-heap buffer. Scratch buffers start in the UAV state, the others in the acceleration-structure state. Returns its GPU address
+    virtual uint64_t createBuffer(uint64_t size, bool scratch) = 0;
+    // The GPU is done with the buffer
+    virtual void releaseBuffer(uint64_t address) = 0;
+    // Records the build of BLAS blasIndex with ALLOW_COMPACTION, and the write of its compacted size where readCompactedSizes() finds it
+    virtual void build(uint32_t blasIndex, uint64_t resultAddress, uint64_t scratchAddress) = 0;
+    // Records the builds in order, with a uavBarrier() before the ones that need it. The default calls build() and uavBarrier(), a backend
+    // can split them into several command lists and record those on several threads, as long as they execute in order
+    virtual void recordBuilds(const BuildCommand* pBuilds, uint32_t count);
+    // Records a COMPACT copy
+    virtual void copyCompacted(uint64_t destAddress, uint64_t sourceAddress) = 0;
+    // Records a UAV barrier on every buffer, so the builds and copies recorded after it see the results of those before it
+    virtual void uavBarrier() = 0;
+    // Records a UAV barrier after the last build, and whatever readCompactedSizes() needs to see the sizes they wrote
+    virtual void endBuilds() = 0;
+    // The compacted sizes of the BLASes built, once the GPU finished the builds. The vector is indexed by blasIndex
+    virtual void readCompactedSizes(std::vector<uint64_t>& sizes) = 0;
+};
+
+/** Builds the bottom-level acceleration structures and compacts them.
+    build() records the builds of every BLAS added since the last call back to back. Their results share a few large buffers, at the maximum
+    size, and their scratch comes from a pooled buffer. In BuildMode::Concurrent builds get disjoint parts of the pool so they can overlap on
+    the GPU, and when the pool is full the manager waits for them with a UAV barrier and starts over. In BuildMode::Serial the pool only holds
+    the largest build and every build waits for the previous one. Once the caller ran the builds, compact() reads the compacted sizes, packs the
+    BLASes tightly into as few buffers as it can and records the copies. Once the copies ran, releaseBuildBuffers() frees the build-size results
+    and the scratch pool. Only the compacted buffers are left.
+*/
+class BlasManager
+{
+public:
+    static const uint64_t kAlignment = 256;                         // D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT
+    static const uint64_t kDefaultScratchPoolSize = 32 * 1024 * 1024;
+    static const uint64_t kMaxBufferSize = 128 * 1024 * 1024;       // The smallest maximum resource size D3D12 guarantees. Larger BLASes get their own buffer
+
+    enum class BuildMode
+    {
+        Concurrent,     // The pool holds as many builds as fit the budget, sized to the sum of their scratch
+        Serial,         // The pool is sized to the largest scratch, with a UAV barrier between builds
+    };
+
+    struct BlasInfo
+    {
+        uint64_t address = 0;           // The BLAS to put in the instance descs. It changes in compact()
+        uint64_t buildSize = 0;         // ResultDataMaxSizeInBytes
+        uint64_t scratchSize = 0;       // ScratchDataSizeInBytes
+        uint64_t compactedSize = 0;     // 0 until compact()
+    };
+
+    struct MemoryStats
+    {
+        uint64_t buildBytes = 0;        // Every BLAS built, at its build size
+        uint64_t compactedBytes = 0;    // The compacted buffers, with the alignment padding
+        uint64_t scratchPoolBytes = 0;  // The largest pool
+        uint32_t scratchReuseCount = 0; // The UAV barriers build() inserted to reuse the pool
+        uint32_t bufferCount = 0;       // The buffers created, results, scratch pools and compacted buffers
+    };
+
+    // The pool is larger if a single BLAS needs more scratch
+    explicit BlasManager(BlasBackend& backend, uint64_t scratchPoolSize = kDefaultScratchPoolSize, BuildMode mode = BuildMode::Concurrent) :
+        mBackend(backend), mScratchPoolSize(scratchPoolSize), mMode(mode) {}
+    // Releases every buffer, the GPU must be done with them
+    ~BlasManager();
+
+    // The sizes from GetRaytracingAccelerationStructurePrebuildInfo(). Returns the blasIndex the backend builds
+    uint32_t addBlas(uint64_t buildSize, uint64_t scratchSize);
+    // Each step handles the BLASes the previous one did since it was last called. The GPU must have finished the commands of the previous step.
+    // The BLAS addresses are valid from build() on, and move to the compacted buffer in compact()
+    void build();
+    void compact();
+    void releaseBuildBuffers();
+
+    uint32_t getBlasCount() const { return (uint32_t)mBlas.size(); }
+    const BlasInfo& getBlas(uint32_t blasIndex) const { return mBlas[blasIndex]; }
+    const MemoryStats& getMemoryStats() const { return mStats; }
+
+private:
+    // Places the sizes at aligned offsets in as few buffers of up to kMaxBufferSize as it can, and adds the buffers it creates to buffers
+    void suballocate(const std::vector<uint64_t>& sizes, std::vector<uint64_t>& buffers, std::vector<uint64_t>& addresses);
+
+    BlasBackend& mBackend;
+    std::vector<BlasInfo> mBlas;
+    std::vector<uint64_t> mBuildBuffers;        // Released by releaseBuildBuffers()
+    std::vector<uint64_t> mCompactedBuffers;
+    uint64_t mScratchPoolSize;
+    BuildMode mMode;
+    uint64_t mScratchPool = 0;
+    uint64_t mScratchPoolCapacity = 0;
+    uint32_t mBuiltCount = 0;
+    uint32_t mCompactedCount = 0;
+    MemoryStats mStats;
+};
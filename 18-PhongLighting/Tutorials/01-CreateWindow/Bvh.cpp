@@ -0,0 +1,308 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Bvh.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <float.h>
+#include <thread>
+
+namespace
+{
+    // Subtrees with fewer triangles than this are built on the current thread
+    const uint32_t kParallelThreshold = 4096;
+
+    struct Aabb
+    {
+        glm::vec3 min = glm::vec3(FLT_MAX);
+        glm::vec3 max = glm::vec3(-FLT_MAX);
+
+        void grow(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+        void grow(const Aabb& b) { min = glm::min(min, b.min); max = glm::max(max, b.max); }
+        bool valid() const { return min.x <= max.x; }
+        float area() const
+        {
+            if (valid() == false) return 0;
+            glm::vec3 e = max - min;
+            return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+    };
+
+    struct Bin
+    {
+        Aabb bounds;
+        uint32_t count = 0;
+    };
+
+    float surfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 e = boundsMax - boundsMin;
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    uint32_t binIndex(float c, float cmin, float scale, uint32_t binCount)
+    {
+        int32_t b = int32_t((c - cmin) * scale);
+        return uint32_t(std::min(std::max(b, 0), int32_t(binCount - 1)));
+    }
+
+}
+
+// A triangle reference. The build partitions these in-place, so they carry their own bounds to keep the memory accesses sequential
+struct PrimRef
+{
+    glm::vec3 boundsMin;
+    uint32_t triangleIndex;
+    glm::vec3 boundsMax;
+    uint32_t padding;
+    glm::vec3 centroid() const { return (boundsMin + boundsMax) * 0.5f; }
+};
+
+struct Bvh::BuildContext
+{
+    std::vector<PrimRef> refs;
+    std::atomic<uint32_t> nodeCount;
+    std::atomic<uint32_t> leafCount;
+    std::atomic<uint32_t> maxDepth;
+    std::atomic<uint32_t> activeThreads;
+    uint32_t maxThreads = 1;
+};
+
+void Bvh::build(const VertexPositionNormalTangentTexture* pVB[], const uint32_t vertexCount[], uint32_t geometryCount, uint32_t threadCount)
+{
+    std::vector<BvhGeometryDesc> geometries(geometryCount);
+    for (uint32_t i = 0; i < geometryCount; i++)
+    {
+        geometries[i].pVertices = pVB[i];
+        geometries[i].vertexCount = vertexCount[i];
+    }
+    build(geometries.data(), geometryCount, threadCount);
+}
+
+void Bvh::build(const BvhGeometryDesc* pGeometries, uint32_t geometryCount, uint32_t threadCount)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Gather the triangles
+    std::vector<Triangle> triangles;
+    for (uint32_t g = 0; g < geometryCount; g++)
+    {
+        const BvhGeometryDesc& geom = pGeometries[g];
+        uint32_t primCount = (geom.pIndices ? geom.indexCount : geom.vertexCount) / 3;
+        for (uint32_t p = 0; p < primCount; p++)
+        {
+            uint32_t idx[3];
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t i = p * 3 + k;
+                if (geom.pIndices == nullptr) idx[k] = i;
+                else idx[k] = geom.indices32Bit ? ((const uint32_t*)geom.pIndices)[i] : ((const uint16_t*)geom.pIndices)[i];
+            }
+            Triangle tri;
+            tri.v0 = geom.pVertices[idx[0]].position;
+            tri.v1 = geom.pVertices[idx[1]].position;
+            tri.v2 = geom.pVertices[idx[2]].position;
+            tri.geometryIndex = g;
+            tri.primitiveIndex = p;
+            triangles.push_back(tri);
+        }
+    }
+
+    const uint32_t triangleCount = (uint32_t)triangles.size();
+    BuildContext ctx;
+    ctx.refs.resize(triangleCount);
+    for (uint32_t i = 0; i < triangleCount; i++)
+    {
+        ctx.refs[i].boundsMin = glm::min(triangles[i].v0, glm::min(triangles[i].v1, triangles[i].v2));
+        ctx.refs[i].boundsMax = glm::max(triangles[i].v0, glm::max(triangles[i].v1, triangles[i].v2));
+        ctx.refs[i].triangleIndex = i;
+    }
+    ctx.nodeCount = 1;
+    ctx.leafCount = 0;
+    ctx.maxDepth = 0;
+    ctx.activeThreads = 1;
+    ctx.maxThreads = threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+
+    // A binary BVH has at most 2N-1 nodes
+    mNodes.assign(std::max(1u, 2 * triangleCount), Node());
+    if (triangleCount) buildRecursive(ctx, 0, 0, triangleCount, 0);
+    mNodes.resize(ctx.nodeCount);
+
+    // Store the triangles in leaf order
+    mTriangles.resize(triangleCount);
+    for (uint32_t i = 0; i < triangleCount; i++) mTriangles[i] = triangles[ctx.refs[i].triangleIndex];
+
+    // SAH cost of the final tree
+    mStats = BuildStats();
+    if (triangleCount)
+    {
+        float rootArea = surfaceArea(mNodes[0].boundsMin, mNodes[0].boundsMax);
+        double cost = 0;
+        for (const Node& node : mNodes)
+        {
+            double relativeArea = (rootArea > 0) ? surfaceArea(node.boundsMin, node.boundsMax) / rootArea : 1;
+            cost += relativeArea * (node.isLeaf() ? node.triangleCount : 1);
+        }
+        mStats.sahCost = cost;
+    }
+    mStats.triangleCount = triangleCount;
+    mStats.nodeCount = (uint32_t)mNodes.size();
+    mStats.leafCount = ctx.leafCount;
+    mStats.maxDepth = ctx.maxDepth;
+    mStats.buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void Bvh::buildRecursive(BuildContext& ctx, uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth)
+{
+    Node& node = mNodes[nodeIndex];
+    const uint32_t count = end - begin;
+
+    Aabb bounds, centroidBounds;
+    for (uint32_t i = begin; i < end; i++)
+    {
+        const PrimRef& ref = ctx.refs[i];
+        bounds.min = glm::min(bounds.min, ref.boundsMin);
+        bounds.max = glm::max(bounds.max, ref.boundsMax);
+        centroidBounds.grow(ref.centroid());
+    }
+    node.boundsMin = bounds.min;
+    node.boundsMax = bounds.max;
+
+    uint32_t d = ctx.maxDepth;
+    while (depth > d && ctx.maxDepth.compare_exchange_weak(d, depth) == false) {}
+
+    auto makeLeaf = [&]()
+    {
+        node.leftOrFirst = begin;
+        node.triangleCount = count;
+        ctx.leafCount++;
+    };
+
+    if (count == 1)
+    {
+        makeLeaf();
+        return;
+    }
+
+    // Bin the centroids along all 3 axes in a single pass. Small nodes don't need all the bins
+    const uint32_t binCount = std::min(uint32_t(kBinCount), std::max(4u, count));
+    glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+    glm::vec3 scale;
+    for (uint32_t axis = 0; axis < 3; axis++) scale[axis] = (extent[axis] > 0) ? binCount / extent[axis] : 0;
+
+    Bin bins[3][kBinCount];
+    for (uint32_t i = begin; i < end; i++)
+    {
+        const PrimRef& ref = ctx.refs[i];
+        glm::vec3 c = ref.centroid();
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            Bin& bin = bins[axis][binIndex(c[axis], centroidBounds.min[axis], scale[axis], binCount)];
+            bin.bounds.min = glm::min(bin.bounds.min, ref.boundsMin);
+            bin.bounds.max = glm::max(bin.bounds.max, ref.boundsMax);
+            bin.count++;
+        }
+    }
+
+    // Find the best split plane. Sweep from the right to get the area/count of every right side, then from the left to evaluate each plane
+    float bestCost = FLT_MAX;
+    uint32_t bestAxis = 0;
+    uint32_t bestSplit = 0;
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        if (extent[axis] <= 0) continue;
+        float rightArea[kBinCount];
+        uint32_t rightCount[kBinCount];
+        Aabb right;
+        uint32_t rightSum = 0;
+        for (uint32_t b = binCount - 1; b > 0; b--)
+        {
+            right.grow(bins[axis][b].bounds);
+            rightSum += bins[axis][b].count;
+            rightArea[b] = right.area();
+            rightCount[b] = rightSum;
+        }
+
+        Aabb left;
+        uint32_t leftSum = 0;
+        for (uint32_t b = 1; b < binCount; b++)
+        {
+            left.grow(bins[axis][b - 1].bounds);
+            leftSum += bins[axis][b - 1].count;
+            if (leftSum == 0 || rightCount[b] == 0) continue;
+            float cost = left.area() * leftSum + rightArea[b] * rightCount[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    // Traversal cost is 1, intersection cost is 1
+    float parentArea = bounds.area();
+    float splitCost = (parentArea > 0) ? 1.0f + bestCost / parentArea : FLT_MAX;
+    if (count <= kMaxLeafSize && splitCost >= float(count))
+    {
+        makeLeaf();
+        return;
+    }
+
+    PrimRef* pMid = ctx.refs.data() + begin + count / 2;
+    if (bestCost < FLT_MAX)
+    {
+        float axisScale = scale[bestAxis];
+        float cmin = centroidBounds.min[bestAxis];
+        pMid = std::partition(ctx.refs.data() + begin, ctx.refs.data() + end, [&](const PrimRef& ref)
+        {
+            return binIndex(ref.centroid()[bestAxis], cmin, axisScale, binCount) < bestSplit;
+        });
+    }
+    uint32_t mid = uint32_t(pMid - ctx.refs.data());
+    if (mid == begin || mid == end) mid = begin + count / 2; // All the centroids are in the same spot. Split in the middle
+
+    uint32_t leftChild = ctx.nodeCount.fetch_add(2);
+    node.leftOrFirst = leftChild;
+    node.triangleCount = 0;
+
+    // Build the left subtree on another thread if it's large enough and there's a free core
+    if (count >= kParallelThreshold && ctx.activeThreads.fetch_add(1) < ctx.maxThreads)
+    {
+        std::thread worker([&ctx, this, leftChild, begin, mid, depth]() { buildRecursive(ctx, leftChild, begin, mid, depth + 1); });
+        buildRecursive(ctx, leftChild + 1, mid, end, depth + 1);
+        worker.join();
+        ctx.activeThreads--;
+    }
+    else
+    {
+        if (count >= kParallelThreshold) ctx.activeThreads--;
+        buildRecursive(ctx, leftChild, begin, mid, depth + 1);
+        buildRecursive(ctx, leftChild + 1, mid, end, depth + 1);
+    }
+}
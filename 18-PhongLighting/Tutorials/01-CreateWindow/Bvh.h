@@ -0,0 +1,101 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "Geometry.h"
+
+// Same semantics as the HLSL RayDesc. A hit is accepted when TMin <= t <= TMax
+struct RayDesc
+{
+    glm::vec3 origin;
+    float tMin = 0;
+    glm::vec3 direction;
+    float tMax = 0;
+};
+
+// One D3D12_RAYTRACING_GEOMETRY_DESC. If there's no index buffer, every 3 vertices make a triangle
+struct BvhGeometryDesc
+{
+    const VertexPositionNormalTangentTexture* pVertices = nullptr;
+    uint32_t vertexCount = 0;
+    const void* pIndices = nullptr;
+    uint32_t indexCount = 0;
+    bool indices32Bit = false;
+};
+
+// A BVH built on the CPU with a binned SAH. This is what the CPU path uses instead of the driver-built BLAS from createBlasGeometryDescs()
+class Bvh
+{
+public:
+    // 32 bytes. An inner node stores the index of its first child (the second child follows it), a leaf stores a range in the triangle array
+    struct Node
+    {
+        glm::vec3 boundsMin;
+        uint32_t leftOrFirst = 0;
+        glm::vec3 boundsMax;
+        uint32_t triangleCount = 0;     // 0 for inner nodes
+        bool isLeaf() const { return triangleCount != 0; }
+    };
+
+    // The triangles are stored in leaf order, so a leaf is a contiguous range
+    struct Triangle
+    {
+        glm::vec3 v0, v1, v2;
+        uint32_t geometryIndex = 0;
+        uint32_t primitiveIndex = 0;    // PrimitiveIndex(), relative to the geometry
+    };
+
+    struct BuildStats
+    {
+        uint32_t triangleCount = 0;
+        uint32_t nodeCount = 0;
+        uint32_t leafCount = 0;
+        uint32_t maxDepth = 0;
+        double sahCost = 0;             // Expected cost of a random ray, with traversal and intersection costs of 1
+        double buildTimeMs = 0;
+    };
+
+    static const uint32_t kBinCount = 16;
+    static const uint32_t kMaxLeafSize = 4;
+
+    // The same inputs as createBlasGeometryDescs(). If threadCount is 0 we use all the cores
+    void build(const VertexPositionNormalTangentTexture* pVB[], const uint32_t vertexCount[], uint32_t geometryCount, uint32_t threadCount = 0);
+    void build(const BvhGeometryDesc* pGeometries, uint32_t geometryCount, uint32_t threadCount = 0);
+
+    const BuildStats& getStats() const { return mStats; }
+    const std::vector<Node>& getNodes() const { return mNodes; }
+    const std::vector<Triangle>& getTriangles() const { return mTriangles; }
+
+private:
+    struct BuildContext;
+    void buildRecursive(BuildContext& ctx, uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth);
+
+    std::vector<Node> mNodes;
+    std::vector<Triangle> mTriangles;
+    BuildStats mStats;
+};
+
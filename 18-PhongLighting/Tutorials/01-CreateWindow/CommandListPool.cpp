@@ -0,0 +1,77 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "CommandListPool.h"
+#include <algorithm>
+
+void CommandListPool::beginFrame(uint32_t frameIndex)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFrameIndex = frameIndex;
+    mFrames[frameIndex].usedCount = 0;
+}
+
+uint32_t CommandListPool::acquire(uint32_t order)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Frame& frame = mFrames[mFrameIndex];
+    uint32_t list;
+    if (frame.usedCount < frame.lists.size())
+    {
+        list = frame.lists[frame.usedCount];
+        mBackend.resetList(list);
+    }
+    else
+    {
+        list = mBackend.createList();
+        frame.lists.push_back(list);
+        mStats.listCount++;
+    }
+    frame.usedCount++;
+    mPending.push_back({ order, mSequence++, list });
+    mStats.acquireCount++;
+    return list;
+}
+
+uint32_t CommandListPool::submit()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mPending.empty()) return 0;
+
+    std::sort(mPending.begin(), mPending.end(), [](const Pending& a, const Pending& b)
+    {
+        return (a.order != b.order) ? a.order < b.order : a.sequence < b.sequence;
+    });
+    std::vector<uint32_t> lists;
+    for (const Pending& pending : mPending) lists.push_back(pending.list);
+    mBackend.prepareLists(lists.data(), (uint32_t)lists.size());
+    for (uint32_t list : lists) mBackend.closeList(list);
+    mBackend.executeLists(lists.data(), (uint32_t)lists.size());
+    mStats.batchCount++;
+    mPending.clear();
+    return (uint32_t)lists.size();
+}
@@ -0,0 +1,103 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+// The D3D12 side of CommandListPool. Tutorial01 implements it with D3D12, the benchmarks with a mock that checks what the pool asks for
+class CommandListBackend
+{
+public:
+    virtual ~CommandListBackend() = default;
+
+    // A command allocator and a direct command list that records into it, open for recording. Returns the list
+    virtual uint32_t createList() = 0;
+    // Resets the allocator of the list and the list, which is open for recording again. The GPU is done with what it recorded before
+    virtual void resetList(uint32_t list) = 0;
+    // The lists of a submit(), in execution order, before they're closed. The backend can still record to the end of a list what the next
+    // one needs
+    virtual void prepareLists(const uint32_t*, uint32_t) {}
+    virtual void closeList(uint32_t list) = 0;
+    // A single ExecuteCommandLists() with the closed lists, in that order
+    virtual void executeLists(const uint32_t* pLists, uint32_t count) = 0;
+};
+
+/** Command lists for recording on several threads.
+    Every list has an allocator of its own, so every thread that records gets a list and an allocator nobody else touches. The lists belong to
+    the frame slot they were acquired in and are reused once the GPU is done with that slot, so a slot ends up with as many lists as its
+    busiest frame needed. submit() closes the lists acquired since the last submit() and executes them in one batch, sorted by the order
+    they were acquired with, so the threads can record in any order.
+*/
+class CommandListPool
+{
+public:
+    struct Stats
+    {
+        uint32_t listCount = 0;         // Created, each with its allocator
+        uint32_t acquireCount = 0;
+        uint32_t batchCount = 0;        // ExecuteCommandLists() calls
+    };
+
+    CommandListPool(CommandListBackend& backend, uint32_t frameCount) : mBackend(backend), mFrames(frameCount) {}
+
+    // The GPU is done with everything submitted the last time frameIndex was the current slot. Lists must not be pending
+    void beginFrame(uint32_t frameIndex);
+
+    // Thread-safe. A list of its own, open for recording, until submit(). submit() executes the lists with lower orders first. Lists with the
+    // same order go in the order they were acquired, so lists that depend on each other need different orders
+    uint32_t acquire(uint32_t order);
+
+    // Closes the lists acquired since the last submit() and executes them. Returns the number of lists. Call from one thread, once the
+    // recording is done
+    uint32_t submit();
+
+    const Stats& getStats() const { return mStats; }
+
+private:
+    struct Pending
+    {
+        uint32_t order;
+        uint32_t sequence;
+        uint32_t list;
+    };
+
+    struct Frame
+    {
+        std::vector<uint32_t> lists;
+        uint32_t usedCount = 0;     // lists[0, usedCount) were acquired since beginFrame()
+    };
+
+    CommandListBackend& mBackend;
+    std::mutex mMutex;
+    std::vector<Frame> mFrames;
+    uint32_t mFrameIndex = 0;
+    std::vector<Pending> mPending;
+    uint32_t mSequence = 0;
+    Stats mStats;
+};
@@ -0,0 +1,431 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "CpuRaytracer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+namespace
+{
+    // The constants from 04-Shaders.hlsl
+    const glm::vec4 kLightDiffuseColor(0.2f, 0.2f, 0.2f, 1.0f);
+    const float kDiffuseCoef = 0.9f;
+    const glm::vec3 kLightPosition(2.0f, 2.0f, -2.0f);
+    const glm::vec4 kLightSpecularColor(1, 1, 1, 1);
+    const float kSpecularCoef = 0.7f;
+    const uint32_t kSpecularPower = 50;
+    const glm::vec4 kLightAmbientColor(0.2f, 0.2f, 0.2f, 1.0f);
+    const glm::vec4 kAlbedo(1.0f, 0.0f, 0.0f, 1.0f);
+    const glm::vec3 kMissColor(0.4f, 0.6f, 0.2f);
+
+    // pow() by squaring. Unlike powf() it's plain IEEE math, so it doesn't depend on the C runtime
+    float powUint(float x, uint32_t n)
+    {
+        float result = 1;
+        for (; n; n >>= 1, x *= x)
+        {
+            if (n & 1) result *= x;
+        }
+        return result;
+    }
+
+    // HLSL saturate() returns 0 for NaN
+    float saturate(float x)
+    {
+        return x > 0 ? (x < 1 ? x : 1) : 0;
+    }
+
+    glm::vec3 reflect(const glm::vec3& i, const glm::vec3& n)
+    {
+        return i - 2.0f * glm::dot(n, i) * n;
+    }
+
+    glm::vec3 linearToSrgb(const glm::vec3& c)
+    {
+        // Based on http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
+        glm::vec3 sq1 = glm::sqrt(c);
+        glm::vec3 sq2 = glm::sqrt(sq1);
+        glm::vec3 sq3 = glm::sqrt(sq2);
+        glm::vec3 srgb = 0.662002687f * sq1 + 0.684122060f * sq2 - 0.323583601f * sq3 - 0.0225411470f * c;
+        return srgb;
+    }
+
+    // FLOAT -> UNORM conversion, as done when writing to a DXGI_FORMAT_R8G8B8A8_UNORM UAV
+    uint32_t floatToUnorm8(float f)
+    {
+        return uint32_t(saturate(f) * 255.0f + 0.5f);
+    }
+
+    glm::vec3 hitAttribute(const glm::vec3 vertexAttribute[3], const glm::vec2& barycentrics)
+    {
+        return vertexAttribute[0] +
+            barycentrics.x * (vertexAttribute[1] - vertexAttribute[0]) +
+            barycentrics.y * (vertexAttribute[2] - vertexAttribute[0]);
+    }
+
+    // The Phong terms shared by chs() and planeChs()
+    glm::vec4 phong(const glm::vec3& hitPosition, const glm::vec3& worldRayDirection, const glm::vec3& hitNormal)
+    {
+        glm::vec3 incidentLightRay = glm::normalize(hitPosition - kLightPosition);
+
+        // Diffuse component.
+        float Kd = saturate(glm::dot(-incidentLightRay, hitNormal));
+        glm::vec4 diffuseColor = kDiffuseCoef * Kd * kLightDiffuseColor;
+
+        // Specular component.
+        glm::vec3 reflectedLightRay = glm::normalize(reflect(incidentLightRay, hitNormal));
+        float Ks = powUint(saturate(glm::dot(reflectedLightRay, glm::normalize(-worldRayDirection))), kSpecularPower);
+        glm::vec4 specularColor = kSpecularCoef * Ks * kLightSpecularColor;
+
+        // Ambient component.
+        glm::vec4 ambientColorMin = kLightAmbientColor - 0.15f;
+        glm::vec4 ambientColorMax = kLightAmbientColor;
+        float fNDotL = saturate(glm::dot(-incidentLightRay, hitNormal));
+        glm::vec4 ambientColor = kAlbedo * (ambientColorMin + fNDotL * (ambientColorMax - ambientColorMin));
+
+        return ambientColor + diffuseColor + specularColor;
+    }
+}
+
+CpuRaytracer::CpuRaytracer(const Scene& scene) : mScene(scene)
+{
+    // createAccelerationStructures()
+    mBlas.resize(scene.getBlasCount());
+    for (uint32_t i = 0; i < scene.getBlasCount(); i++)
+    {
+        const SceneBlas& blas = scene.getBlas(i);
+        std::vector<BvhGeometryDesc> geometries(blas.meshCount);
+        for (uint32_t g = 0; g < blas.meshCount; g++)
+        {
+            const SceneMesh& mesh = scene.getMesh(blas.firstMesh + g);
+            geometries[g].pVertices = scene.getVertices() + mesh.firstVertex;
+            geometries[g].vertexCount = mesh.vertexCount;
+            if (mesh.indexFormat != SceneIndexFormat::None)
+            {
+                geometries[g].pIndices = scene.getIndexData() + mesh.indexOffset;
+                geometries[g].indexCount = mesh.indexCount;
+                geometries[g].indices32Bit = (mesh.indexFormat == SceneIndexFormat::Uint32);
+            }
+        }
+        mBlas[i].build(geometries.data(), blas.meshCount);
+    }
+    mWideBlas.resize(mBlas.size());
+    for (size_t i = 0; i < mBlas.size(); i++) mWideBlas[i].build(mBlas[i]);
+
+    // createShaderTable(). The hit-table has a primary and a shadow entry for each geometry of each instance
+    mHitGroups.resize(scene.getHitGroupCount());
+    for (uint32_t i = 0; i < scene.getInstanceCount(); i++)
+    {
+        const SceneInstance& instance = scene.getInstance(i);
+        uint32_t hitGroup = scene.getInstanceContributionToHitGroupIndex(i);
+        for (uint32_t g = 0; g < scene.getBlas(instance.blasIndex).meshCount; g++)
+        {
+            const SceneMaterial& material = scene.getMaterial(instance.firstMaterial + g);
+            mHitGroups[hitGroup + g * 2] = (material.hitProgram == SceneHitProgram::Plane) ? HitProgram::Plane : HitProgram::Triangle;
+            mHitGroups[hitGroup + g * 2 + 1] = HitProgram::Shadow;
+        }
+    }
+
+    // createShaderResources()
+    mGeometryViews = getSceneGeometryViews(scene);
+
+    setRotation(0);
+}
+
+void CpuRaytracer::setRotation(float rotation)
+{
+    // buildTopLevelAS()
+    mInstances.resize(mScene.getInstanceCount());
+    for (uint32_t i = 0; i < mScene.getInstanceCount(); i++)
+    {
+        mInstances[i].objectToWorld = mScene.getInstanceTransform(i, rotation);
+        mInstances[i].worldToObject = glm::inverse(mInstances[i].objectToWorld);
+        mInstances[i].instanceID = i;
+        mInstances[i].instanceContributionToHitGroupIndex = mScene.getInstanceContributionToHitGroupIndex(i);
+        mInstances[i].blasIndex = mScene.getInstance(i).blasIndex;
+    }
+}
+
+bool CpuRaytracer::traceRay(const RayDesc& ray, bool acceptFirstHit, HitInfo& hit) const
+{
+    bool found = false;
+    float tMax = ray.tMax;
+
+    for (uint32_t i = 0; i < (uint32_t)mInstances.size(); i++)
+    {
+        const InstanceDesc& instance = mInstances[i];
+        // Transform the ray into object space. We don't normalize the direction, so t is the same in both spaces
+        RayDesc objectRay = ray;
+        objectRay.origin = glm::vec3(instance.worldToObject * glm::vec4(ray.origin, 1));
+        objectRay.direction = glm::vec3(instance.worldToObject * glm::vec4(ray.direction, 0));
+        objectRay.tMax = tMax;
+
+        WideBvh::Hit blasHit;
+        // On a tie keep the first instance
+        if (mWideBlas[instance.blasIndex].intersect(objectRay, acceptFirstHit, blasHit) && (found == false || blasHit.t < tMax))
+        {
+            found = true;
+            tMax = blasHit.t;
+            hit.t = blasHit.t;
+            hit.barycentrics = blasHit.barycentrics;
+            hit.instanceIndex = i;
+            hit.geometryIndex = blasHit.geometryIndex;
+            hit.primitiveIndex = blasHit.primitiveIndex;
+            if (acceptFirstHit) return true;
+        }
+    }
+    return found;
+}
+
+glm::vec3 CpuRaytracer::fetchNormal(uint32_t vertexIndex) const
+{
+    // The SRV starts at the beginning of the vertex buffer. Out-of-bounds reads from a structured buffer return 0
+    return (vertexIndex < mGeometryViews.vertexElements && vertexIndex < mScene.getVertexCount()) ? mScene.getVertices()[vertexIndex].normal : glm::vec3(0);
+}
+
+uint32_t CpuRaytracer::fetchIndexWord(uint32_t byteOffset) const
+{
+    // ByteAddressBuffer.Load(). The buffer is zero-padded to a whole word, and reads past the view return 0
+    uint32_t word = 0;
+    if (byteOffset / 4 < mGeometryViews.indexElements && byteOffset < mScene.getIndexDataSize())
+    {
+        memcpy(&word, mScene.getIndexData() + byteOffset, (size_t)std::min<uint64_t>(4, mScene.getIndexDataSize() - byteOffset));
+    }
+    return word;
+}
+
+void CpuRaytracer::getTriangleVertices(const HitInfo& hit, uint32_t vertices[3]) const
+{
+    // getTriangleVertices() in the shader, with the SceneGeometryConstants of the hit record
+    const SceneBlas& blas = mScene.getBlas(mInstances[hit.instanceIndex].blasIndex);
+    const SceneGeometryConstants geometry = getGeometryConstants(mScene.getMesh(blas.firstMesh + hit.geometryIndex));
+    if (geometry.indexFormat == SceneIndexFormat::Uint16)
+    {
+        const uint32_t offset = geometry.indexOffset + hit.primitiveIndex * 6;
+        const uint32_t word0 = fetchIndexWord(offset & ~3u);
+        const uint32_t word1 = fetchIndexWord((offset & ~3u) + 4);
+        vertices[0] = (offset & 2) ? (word0 >> 16) : (word0 & 0xffff);
+        vertices[1] = (offset & 2) ? (word1 & 0xffff) : (word0 >> 16);
+        vertices[2] = (offset & 2) ? (word1 >> 16) : (word1 & 0xffff);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            vertices[i] = (geometry.indexFormat == SceneIndexFormat::Uint32) ? fetchIndexWord(geometry.indexOffset + hit.primitiveIndex * 12 + i * 4) : hit.primitiveIndex * 3 + i;
+        }
+    }
+    for (uint32_t i = 0; i < 3; i++) vertices[i] += geometry.firstVertex;
+}
+
+glm::vec3 CpuRaytracer::chs(const RayDesc& ray, const HitInfo& hit) const
+{
+    glm::vec3 hitPosition = ray.origin + hit.t * ray.direction;
+
+    // Retrieve corresponding vertex normals for the triangle vertices.
+    uint32_t triangleVertices[3];
+    getTriangleVertices(hit, triangleVertices);
+    glm::vec3 vertexNormals[3] = {
+        fetchNormal(triangleVertices[0]),
+        fetchNormal(triangleVertices[1]),
+        fetchNormal(triangleVertices[2]),
+    };
+
+    glm::vec3 hitNormal = hitAttribute(vertexNormals, hit.barycentrics);
+    return glm::vec3(phong(hitPosition, ray.direction, hitNormal));
+}
+
+glm::vec3 CpuRaytracer::planeChs(const RayDesc& ray, const HitInfo& hit, Stats& stats) const
+{
+    glm::vec3 posW = ray.origin + hit.t * ray.direction;
+
+    // Fire a shadow ray. shadowChs() only sets a flag, so any hit will do
+    RayDesc shadowRay;
+    shadowRay.origin = posW;
+    shadowRay.direction = glm::normalize(glm::vec3(0.5f, 0.5f, -0.5f));
+    shadowRay.tMin = 0.01f;
+    shadowRay.tMax = 100000;
+    HitInfo shadowHit;
+    bool shadowed = traceRay(shadowRay, true, shadowHit);
+    stats.shadowRays++;
+    float factor = shadowed ? 0.1f : 1.0f;
+
+    // Retrieve corresponding vertex normals for the triangle vertices.
+    uint32_t triangleVertices[3];
+    getTriangleVertices(hit, triangleVertices);
+    glm::vec3 vertexNormals[3] = {
+        fetchNormal(triangleVertices[0]),
+        fetchNormal(triangleVertices[1]),
+        fetchNormal(triangleVertices[2]),
+    };
+
+    glm::vec3 hitNormal = hitAttribute(vertexNormals, hit.barycentrics);
+    return glm::vec3(phong(posW, ray.direction, hitNormal) + glm::vec4(0.7f, 0.7f, 0.7f, 1.0f) * factor);
+}
+
+glm::vec3 CpuRaytracer::rayGen(uint32_t x, uint32_t y, uint32_t width, uint32_t height, Stats& stats) const
+{
+    glm::vec2 crd = glm::vec2(float(x), float(y));
+    glm::vec2 dims = glm::vec2(float(width), float(height));
+
+    glm::vec2 d = ((crd / dims) * 2.f - 1.f);
+    float aspectRatio = dims.x / dims.y;
+
+    RayDesc ray;
+    ray.origin = glm::vec3(0, 0, -2);
+    ray.direction = glm::normalize(glm::vec3(d.x * aspectRatio, -d.y, 1));
+    ray.tMin = 0;
+    ray.tMax = 100000;
+
+    HitInfo hit;
+    stats.primaryRays++;
+    if (traceRay(ray, false, hit) == false) return kMissColor;
+
+    // The primary ray uses RayContributionToHitGroupIndex = 0 and MultiplierForGeometryContributionToShaderIndex = 2
+    const InstanceDesc& instance = mInstances[hit.instanceIndex];
+    uint32_t hitGroup = instance.instanceContributionToHitGroupIndex + 2 * hit.geometryIndex;
+    switch (mHitGroups[hitGroup])
+    {
+    case HitProgram::Triangle:
+        return chs(ray, hit);
+    case HitProgram::Plane:
+        return planeChs(ray, hit, stats);
+    default:
+        return glm::vec3(0);
+    }
+}
+
+void CpuRaytracer::setKernel(WideBvh::Kernel kernel)
+{
+    for (WideBvh& blas : mWideBlas) blas.setKernel(kernel);
+}
+
+CpuRaytracer::Stats CpuRaytracer::render(uint32_t width, uint32_t height, uint32_t threadCount)
+{
+    mWidth = width;
+    mHeight = height;
+    mFrame.resize(size_t(width) * height);
+
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // Threads grab rows until the image is done
+    std::atomic<uint32_t> nextRow(0);
+    std::vector<Stats> threadStats(threadCount);
+    auto worker = [&](uint32_t threadIndex)
+    {
+        Stats& stats = threadStats[threadIndex];
+        for (uint32_t y = nextRow++; y < height; y = nextRow++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                glm::vec3 col = linearToSrgb(rayGen(x, y, width, height, stats));
+                mFrame[size_t(y) * width + x] = floatToUnorm8(col.r) | (floatToUnorm8(col.g) << 8) | (floatToUnorm8(col.b) << 16) | (255u << 24);
+            }
+        }
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < threadCount; i++) threads.emplace_back(worker, i);
+    worker(0);
+    for (auto& t : threads) t.join();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    Stats total;
+    for (const Stats& s : threadStats)
+    {
+        total.primaryRays += s.primaryRays;
+        total.shadowRays += s.shadowRays;
+    }
+    total.seconds = std::chrono::duration<double>(end - start).count();
+    return total;
+}
+
+uint64_t CpuRaytracer::getFrameHash() const
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t pixel : mFrame)
+    {
+        for (uint32_t i = 0; i < 4; i++) hash = (hash ^ ((pixel >> (i * 8)) & 0xFF)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+bool CpuRaytracer::writeFrame(const std::string& filename) const
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (file.good() == false) return false;
+
+    file << "P6\n" << mWidth << " " << mHeight << "\n255\n";
+    std::vector<uint8_t> row(size_t(mWidth) * 3);
+    for (uint32_t y = 0; y < mHeight; y++)
+    {
+        for (uint32_t x = 0; x < mWidth; x++)
+        {
+            uint32_t c = mFrame[size_t(y) * mWidth + x];
+            row[x * 3 + 0] = uint8_t(c & 0xFF);
+            row[x * 3 + 1] = uint8_t((c >> 8) & 0xFF);
+            row[x * 3 + 2] = uint8_t((c >> 16) & 0xFF);
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+    return file.good();
+}
+
+int renderCpuReference(const std::string& sceneFile, const std::string& filename, uint32_t width, uint32_t height)
+{
+    Scene scene;
+    std::string error;
+    if (loadScene(scene, sceneFile, error) == false || validateSceneGeometry(scene, getSceneGeometryViews(scene), error) == false)
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    CpuRaytracer raytracer(scene);
+    raytracer.setRotation(0.005f); // The rotation the first onFrameRender() uses
+    CpuRaytracer::Stats stats = raytracer.render(width, height);
+    if (raytracer.writeFrame(filename) == false)
+    {
+        fprintf(stderr, "Can't write %s\n", filename.c_str());
+        return 1;
+    }
+    for (size_t i = 0; i < raytracer.getBlas().size(); i++)
+    {
+        const Bvh::BuildStats& blas = raytracer.getBlas()[i].getStats();
+        printf("BLAS %zu: %u triangles, %u nodes, %u leaves, depth %u, SAH cost %.2f, %.3f ms\n", i, blas.triangleCount, blas.nodeCount, blas.leafCount, blas.maxDepth, blas.sahCost, blas.buildTimeMs);
+    }
+    printf("%s: %ux%u, hash %016llx, %llu primary rays, %llu shadow rays, %.3f sec, %.2f Mrays/s\n", filename.c_str(), width, height, (unsigned long long)raytracer.getFrameHash(),
+        (unsigned long long)stats.primaryRays, (unsigned long long)stats.shadowRays, stats.seconds, stats.raysPerSecond() / 1e6);
+    return 0;
+}
@@ -0,0 +1,128 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "WideBvh.h"
+#include "Scene.h"
+#include <string>
+
+/** CPU reference implementation of Data/04-Shaders.hlsl.
+    It traces the scene built by Tutorial01::createAccelerationStructures() using the same shader-table layout, the same camera, the same Phong terms
+    and the same shadow ray, so it can run on machines without a GPU and produce an image to compare the DXR output against.
+    Every pixel is computed independently with plain IEEE float math and no C runtime functions, so the result doesn't depend on the thread count and is
+    reproducible across runs and platforms, as long as the compiler doesn't contract multiply-adds into FMAs. That's the default with MSVC, GCC and Clang
+    need -ffp-contract=off. See PortableMain.cpp.
+*/
+class CpuRaytracer
+{
+public:
+    struct Stats
+    {
+        uint64_t primaryRays = 0;
+        uint64_t shadowRays = 0;
+        double seconds = 0;
+        double raysPerSecond() const { return seconds > 0 ? double(primaryRays + shadowRays) / seconds : 0; }
+    };
+
+    // Builds the BVHs, instances and hit-groups from the scene, the same way Tutorial01 builds the acceleration structures and the shader-table
+    explicit CpuRaytracer(const Scene& scene);
+
+    // Update the instance transforms. This is the same value onFrameRender() uses
+    void setRotation(float rotation);
+
+    // Traverse the BLASes with this kernel. Kernel::Auto is the default, every kernel falls back to SSE on CPUs without AVX2
+    void setKernel(WideBvh::Kernel kernel);
+
+    // Run rayGen() for every pixel. If threadCount is 0 we use all the cores
+    Stats render(uint32_t width, uint32_t height, uint32_t threadCount = 0);
+
+    // The output in R8G8B8A8_UNORM, matching the content of gOutput
+    const std::vector<uint32_t>& getFrame() const { return mFrame; }
+    uint32_t getWidth() const { return mWidth; }
+    uint32_t getHeight() const { return mHeight; }
+
+    // A hash of getFrame(), to compare reference images without storing them
+    uint64_t getFrameHash() const;
+
+    // Write the frame as a binary PPM
+    bool writeFrame(const std::string& filename) const;
+
+    // The BVHs standing in for the bottom-level acceleration structures
+    const std::vector<Bvh>& getBlas() const { return mBlas; }
+
+private:
+    // The programs stored in the shader-table. See Tutorial01::createShaderTable()
+    enum class HitProgram
+    {
+        Triangle,   // chs
+        Plane,      // planeChs
+        Shadow,     // shadowChs
+    };
+
+    // A D3D12_RAYTRACING_INSTANCE_DESC
+    struct InstanceDesc
+    {
+        glm::mat4 objectToWorld;
+        glm::mat4 worldToObject;
+        uint32_t instanceID = 0;
+        uint32_t instanceContributionToHitGroupIndex = 0;
+        uint32_t blasIndex = 0;
+    };
+
+    // The system values the hit shaders read
+    struct HitInfo
+    {
+        float t = 0;                // RayTCurrent()
+        glm::vec2 barycentrics;     // BuiltInTriangleIntersectionAttributes
+        uint32_t instanceIndex = 0;
+        uint32_t geometryIndex = 0;
+        uint32_t primitiveIndex = 0; // PrimitiveIndex()
+    };
+
+    bool traceRay(const RayDesc& ray, bool acceptFirstHit, HitInfo& hit) const;
+    glm::vec3 rayGen(uint32_t x, uint32_t y, uint32_t width, uint32_t height, Stats& stats) const;
+    glm::vec3 chs(const RayDesc& ray, const HitInfo& hit) const;
+    glm::vec3 planeChs(const RayDesc& ray, const HitInfo& hit, Stats& stats) const;
+    glm::vec3 fetchNormal(uint32_t vertexIndex) const;
+    uint32_t fetchIndexWord(uint32_t byteOffset) const;
+    void getTriangleVertices(const HitInfo& hit, uint32_t vertices[3]) const;
+
+    const Scene& mScene;
+    std::vector<Bvh> mBlas;
+    std::vector<WideBvh> mWideBlas;     // mBlas collapsed for traversal
+    std::vector<InstanceDesc> mInstances;
+    std::vector<HitProgram> mHitGroups;
+    SceneGeometryViews mGeometryViews;
+
+    std::vector<uint32_t> mFrame;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+};
+
+// Render the first frame of the scene on the CPU and write it to disk, the tutorial scene if sceneFile is empty. Used as a reference image on
+// machines without a DXR capable GPU. Returns the exit code
+int renderCpuReference(const std::string& sceneFile, const std::string& filename, uint32_t width, uint32_t height);
@@ -40,9 +40,74 @@ struct STriVertex
     float3 tangent;
     float2 texCoord;
 };
+
+#ifdef PACKED_VERTICES
+// PackedVertex in PackedVertex.h, 20 bytes instead of 44. The application compiles with PACKED_VERTICES when it runs with -packed-vertices
+struct SPackedVertex
+{
+    float3 vertex;
+    uint normalTangent;     // Bits 0-10 and 11-21 the octahedral normal, 22-30 the tangent angle, 31 set for a handedness of -1
+    uint texCoord;          // Half-precision u in bits 0-15, v in bits 16-31
+};
+StructuredBuffer<SPackedVertex> BTriVertex : register(t1);
+
+// decodeOctahedral() in PackedVertex.cpp does the same on the CPU. The shaders only read the normal, the tangent and the texture
+// coordinates are there for the materials that will need them
+float3 decodeOctahedral(uint packed)
+{
+    float2 p = float2(packed & 0x7ff, (packed >> 11) & 0x7ff) * (2.0 / 2047.0) - 1.0;
+    float3 n = float3(p.x, p.y, 1 - abs(p.x) - abs(p.y));
+    float t = max(-n.z, 0);
+    n.x += (n.x >= 0) ? -t : t;
+    n.y += (n.y >= 0) ? -t : t;
+    return normalize(n);
+}
+
+float3 getVertexNormal(uint index)
+{
+    return decodeOctahedral(BTriVertex[index].normalTangent);
+}
+#else
 StructuredBuffer<STriVertex> BTriVertex : register(t1);
-// 17.4.a
-StructuredBuffer<uint> indices: register(t2);
+
+float3 getVertexNormal(uint index)
+{
+    return BTriVertex[index].normal;
+}
+#endif
+// 17.4.a The whole scene index blob. It holds 16-bit and 32-bit indices, so it's read as raw bytes
+ByteAddressBuffer indices : register(t2);
+
+// SceneGeometryConstants in Scene.h, the root constants of the hit record of every geometry
+cbuffer GeometryConstants : register(b1)
+{
+    uint firstVertex;
+    uint indexOffset;   // In bytes
+    uint indexFormat;   // SceneIndexFormat: 0 none, 1 16-bit, 2 32-bit
+}
+
+// The vertex buffer elements of a triangle. D3D12 reads the indices relative to the first vertex of the geometry, and so do we
+uint3 getTriangleVertices(uint primitiveIndex)
+{
+    uint3 triangleIndices;
+    if (indexFormat == 1)
+    {
+        // Three 16-bit indices span two words, and start either at the low or at the high half of the first one
+        uint offset = indexOffset + primitiveIndex * 6;
+        uint2 words = indices.Load2(offset & ~3);
+        if (offset & 2) triangleIndices = uint3(words.x >> 16, words.y & 0xffff, words.y >> 16);
+        else triangleIndices = uint3(words.x & 0xffff, words.x >> 16, words.y & 0xffff);
+    }
+    else if (indexFormat == 2)
+    {
+        triangleIndices = indices.Load3(indexOffset + primitiveIndex * 12);
+    }
+    else
+    {
+        triangleIndices = primitiveIndex * 3 + uint3(0, 1, 2);
+    }
+    return firstVertex + triangleIndices;
+}
 
 // 10.1.a
 cbuffer PerFrame : register(b0)
@@ -156,10 +221,11 @@ void chs(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attr
     float3 incidentLightRay = normalize(hitPosition - lightPosition);
 
     // Retrieve corresponding vertex normals for the triangle vertices.
+    uint3 triangleVertices = getTriangleVertices(PrimitiveIndex());
     float3 vertexNormals[3] = {
-        BTriVertex[instance + indices[0]].normal,
-        BTriVertex[instance + indices[1]].normal,
-        BTriVertex[instance + indices[2]].normal,
+        getVertexNormal(triangleVertices.x),
+        getVertexNormal(triangleVertices.y),
+        getVertexNormal(triangleVertices.z),
     };
 
     float3 hitNormal = HitAttribute(vertexNormals, attribs);
@@ -221,11 +287,11 @@ void planeChs(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes
     float3 incidentLightRay = normalize(hitPosition - lightPosition);
 
     // Retrieve corresponding vertex normals for the triangle vertices.
-    uint vertId = PrimitiveIndex();
+    uint3 triangleVertices = getTriangleVertices(PrimitiveIndex());
     float3 vertexNormals[3] = {
-        BTriVertex[vertId + 0].normal,
-        BTriVertex[vertId + 1].normal,
-        BTriVertex[vertId + 2].normal,
+        getVertexNormal(triangleVertices.x),
+        getVertexNormal(triangleVertices.y),
+        getVertexNormal(triangleVertices.z),
     };
 
     float3 hitNormal = HitAttribute(vertexNormals, attribs);
@@ -0,0 +1,135 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "DescriptorAllocator.h"
+#include <assert.h>
+
+void DescriptorAllocator::reset(uint32_t persistentCount, uint32_t transientCount)
+{
+    mPersistentCount = persistentCount;
+    mFreePersistentCount = persistentCount;
+    mFreeByIndex.clear();
+    mFreeBySize.clear();
+    mCurrentFrees.clear();
+    mPendingFrees.clear();
+    mTransient = RingAllocator(transientCount);
+    if (persistentCount) addFreeRange(0, persistentCount);
+}
+
+uint32_t DescriptorAllocator::allocatePersistent(uint32_t count)
+{
+    // Best fit keeps the large ranges around for the allocations that need them
+    std::multimap<uint32_t, uint32_t>::iterator it = mFreeBySize.lower_bound(count);
+    if (count == 0 || it == mFreeBySize.end()) return kInvalidIndex;
+
+    uint32_t index = it->second;
+    uint32_t rangeCount = it->first;
+    removeFreeRange(mFreeByIndex.find(index));
+    if (rangeCount > count) addFreeRange(index + count, rangeCount - count);
+    mFreePersistentCount -= count;
+    return index;
+}
+
+void DescriptorAllocator::freePersistent(uint32_t index, uint32_t count)
+{
+    assert(index + count <= mPersistentCount);
+    if (count == 0) return;
+    Range range = { index, count };
+    mCurrentFrees.push_back(range);
+}
+
+uint32_t DescriptorAllocator::allocateTransient(uint32_t count)
+{
+    uint64_t offset = mTransient.allocate(count, 1);
+    return (offset == RingAllocator::kInvalidOffset) ? kInvalidIndex : mPersistentCount + (uint32_t)offset;
+}
+
+void DescriptorAllocator::endFrame(uint64_t fenceValue)
+{
+    mTransient.endFrame(fenceValue);
+    if (mCurrentFrees.empty() == false)
+    {
+        PendingFrees pending;
+        pending.fenceValue = fenceValue;
+        pending.ranges.swap(mCurrentFrees);
+        mPendingFrees.push_back(std::move(pending));
+    }
+}
+
+void DescriptorAllocator::retire(uint64_t completedFenceValue)
+{
+    mTransient.retire(completedFenceValue);
+    while (mPendingFrees.empty() == false && mPendingFrees.front().fenceValue <= completedFenceValue)
+    {
+        for (const Range& range : mPendingFrees.front().ranges)
+        {
+            addFreeRange(range.index, range.count);
+            mFreePersistentCount += range.count;
+        }
+        mPendingFrees.pop_front();
+    }
+}
+
+void DescriptorAllocator::addFreeRange(uint32_t index, uint32_t count)
+{
+    // Merge with the free ranges right before and right after it
+    std::map<uint32_t, uint32_t>::iterator next = mFreeByIndex.lower_bound(index);
+    assert(next == mFreeByIndex.end() || next->first >= index + count);
+    if (next != mFreeByIndex.end() && next->first == index + count)
+    {
+        count += next->second;
+        removeFreeRange(next);
+        next = mFreeByIndex.lower_bound(index);
+    }
+    if (next != mFreeByIndex.begin())
+    {
+        std::map<uint32_t, uint32_t>::iterator prev = std::prev(next);
+        assert(prev->first + prev->second <= index);
+        if (prev->first + prev->second == index)
+        {
+            index = prev->first;
+            count += prev->second;
+            removeFreeRange(prev);
+        }
+    }
+    mFreeByIndex[index] = count;
+    mFreeBySize.insert(std::make_pair(count, index));
+}
+
+void DescriptorAllocator::removeFreeRange(std::map<uint32_t, uint32_t>::iterator it)
+{
+    std::pair<std::multimap<uint32_t, uint32_t>::iterator, std::multimap<uint32_t, uint32_t>::iterator> sizeRange = mFreeBySize.equal_range(it->second);
+    for (std::multimap<uint32_t, uint32_t>::iterator s = sizeRange.first; s != sizeRange.second; ++s)
+    {
+        if (s->second == it->first)
+        {
+            mFreeBySize.erase(s);
+            break;
+        }
+    }
+    mFreeByIndex.erase(it);
+}
@@ -0,0 +1,89 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "RingAllocator.h"
+#include <deque>
+#include <map>
+#include <vector>
+
+/** Index management for a descriptor heap. The heap is split into two regions:
+    - Persistent - ranges that live until freePersistent(). Freed ranges go back to a free list and are merged with their neighbours, so a
+      scene can create and destroy the descriptors of thousands of meshes without running out of contiguous space. A range can still be
+      referenced by the frames in flight, so it only becomes free once the frame that freed it retires.
+    - Transient - a linear region for descriptors that are only valid for one frame. Every frame allocates from it and the space is recycled
+      when the fence of the frame completes.
+    Transient indices start after the persistent region. Like RingAllocator, it doesn't know about D3D12, so it can run in the benchmarks.
+*/
+class DescriptorAllocator
+{
+public:
+    static const uint32_t kInvalidIndex = ~0u;
+
+    DescriptorAllocator() = default;
+    DescriptorAllocator(uint32_t persistentCount, uint32_t transientCount) { reset(persistentCount, transientCount); }
+    void reset(uint32_t persistentCount, uint32_t transientCount);
+
+    // Returns the first index of a contiguous range, or kInvalidIndex if there is no free range large enough
+    uint32_t allocatePersistent(uint32_t count);
+    void freePersistent(uint32_t index, uint32_t count);
+    uint32_t allocateTransient(uint32_t count);
+
+    // Everything freed or allocated from the transient region since the last endFrame() can be used by the GPU until it reaches fenceValue
+    void endFrame(uint64_t fenceValue);
+    void retire(uint64_t completedFenceValue);
+
+    uint32_t getPersistentCount() const { return mPersistentCount; }
+    uint32_t getTransientCount() const { return (uint32_t)mTransient.getCapacity(); }
+    uint32_t getFreePersistentCount() const { return mFreePersistentCount; }
+    uint32_t getFreeRangeCount() const { return (uint32_t)mFreeByIndex.size(); }
+    uint32_t getUsedTransientCount() const { return (uint32_t)mTransient.getUsedSize(); }
+
+private:
+    struct Range
+    {
+        uint32_t index;
+        uint32_t count;
+    };
+
+    struct PendingFrees
+    {
+        uint64_t fenceValue;
+        std::vector<Range> ranges;
+    };
+
+    void addFreeRange(uint32_t index, uint32_t count);
+    void removeFreeRange(std::map<uint32_t, uint32_t>::iterator it);
+
+    uint32_t mPersistentCount = 0;
+    uint32_t mFreePersistentCount = 0;
+    std::map<uint32_t, uint32_t> mFreeByIndex;          // First index -> count. Used to merge a freed range with its neighbours
+    std::multimap<uint32_t, uint32_t> mFreeBySize;      // Count -> first index. Used to find the smallest range that fits
+    std::vector<Range> mCurrentFrees;
+    std::deque<PendingFrees> mPendingFrees;
+    RingAllocator mTransient;
+};
@@ -0,0 +1,104 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "DescriptorHeap.h"
+#include <assert.h>
+
+void DescriptorHeap::init(ID3D12Device5Ptr pDevice, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t descriptorCount, bool shaderVisible)
+{
+    D3D12_DESCRIPTOR_HEAP_DESC desc = {};
+    desc.NumDescriptors = descriptorCount;
+    desc.Type = type;
+    desc.Flags = shaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    d3d_call(pDevice->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&mpHeap)));
+
+    mpDevice = pDevice;
+    mType = type;
+    mDescriptorSize = pDevice->GetDescriptorHandleIncrementSize(type);
+    mShaderVisible = shaderVisible;
+    mAllocator.reset(descriptorCount, 0);
+}
+
+void DescriptorHeap::release()
+{
+    mpHeap = nullptr;
+    mpDevice = nullptr;
+    mAllocator.reset(0, 0);
+    mCopyDst.clear();
+    mCopySrc.clear();
+    mCopySizes.clear();
+}
+
+DescriptorRange DescriptorHeap::allocatePersistent(uint32_t count)
+{
+    uint32_t index = mAllocator.allocatePersistent(count);
+    if (index == DescriptorAllocator::kInvalidIndex)
+    {
+        msgBox("The descriptor heap is out of persistent descriptors");
+        return DescriptorRange();
+    }
+    return getRange(index, count);
+}
+
+void DescriptorHeap::free(const DescriptorRange& range)
+{
+    mAllocator.freePersistent(range.index, range.count);
+}
+
+void DescriptorHeap::copy(const DescriptorRange& dst, uint32_t dstOffset, const DescriptorRange& src)
+{
+    assert(dstOffset + src.count <= dst.count);
+    mCopyDst.push_back(dst.getCpuHandle(dstOffset));
+    mCopySrc.push_back(src.cpuHandle);
+    mCopySizes.push_back(src.count);
+}
+
+void DescriptorHeap::flushCopies()
+{
+    if (mCopySizes.empty()) return;
+    // Every copy is a range of the same size in the source and in the destination, so both sides use the same size array
+    mpDevice->CopyDescriptors((UINT)mCopySizes.size(), mCopyDst.data(), mCopySizes.data(), (UINT)mCopySizes.size(), mCopySrc.data(), mCopySizes.data(), mType);
+    mCopyDst.clear();
+    mCopySrc.clear();
+    mCopySizes.clear();
+}
+
+DescriptorRange DescriptorHeap::getRange(uint32_t index, uint32_t count) const
+{
+    DescriptorRange range;
+    range.index = index;
+    range.count = count;
+    range.descriptorSize = mDescriptorSize;
+    range.cpuHandle = mpHeap->GetCPUDescriptorHandleForHeapStart();
+    range.cpuHandle.ptr += (SIZE_T)index * mDescriptorSize;
+    if (mShaderVisible)
+    {
+        range.gpuHandle = mpHeap->GetGPUDescriptorHandleForHeapStart();
+        range.gpuHandle.ptr += (UINT64)index * mDescriptorSize;
+    }
+    return range;
+}
@@ -0,0 +1,84 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "Framework.h"
+#include "DescriptorAllocator.h"
+
+// A contiguous range of a descriptor heap. gpuHandle is only valid for shader-visible heaps
+struct DescriptorRange
+{
+    uint32_t index = DescriptorAllocator::kInvalidIndex;
+    uint32_t count = 0;
+    uint32_t descriptorSize = 0;
+    D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = {};
+    D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle = {};
+
+    D3D12_CPU_DESCRIPTOR_HANDLE getCpuHandle(uint32_t offset) const { D3D12_CPU_DESCRIPTOR_HANDLE h = cpuHandle; h.ptr += (SIZE_T)offset * descriptorSize; return h; }
+    D3D12_GPU_DESCRIPTOR_HANDLE getGpuHandle(uint32_t offset) const { D3D12_GPU_DESCRIPTOR_HANDLE h = gpuHandle; h.ptr += (UINT64)offset * descriptorSize; return h; }
+};
+
+/** A descriptor heap managed by a DescriptorAllocator.
+    Views are usually created in a heap that isn't shader-visible (the staging heap) and copied to the shader-visible heap. Shader-visible
+    heaps can live in write-combined memory, so it's better not to create views there directly. copy() only records the copy, flushCopies()
+    submits all of them with a single CopyDescriptors() call.
+    Only the persistent ranges of the allocator are used. The shader tables hold the GPU handles of the per-frame tables, so those tables
+    stay where they are instead of moving to a transient range every frame.
+*/
+class DescriptorHeap
+{
+public:
+    void init(ID3D12Device5Ptr pDevice, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t descriptorCount, bool shaderVisible);
+    void release();
+
+    DescriptorRange allocatePersistent(uint32_t count);
+    void free(const DescriptorRange& range);
+
+    // Copy src.count descriptors from a staging heap into this heap, starting dstOffset descriptors into dst
+    void copy(const DescriptorRange& dst, uint32_t dstOffset, const DescriptorRange& src);
+    void flushCopies();
+
+    // Call after the frame's command list was submitted and fenceValue was signaled. The ranges freed during the frame are reused once it retires
+    void endFrame(uint64_t fenceValue) { mAllocator.endFrame(fenceValue); }
+    void retire(uint64_t completedFenceValue) { mAllocator.retire(completedFenceValue); }
+
+    ID3D12DescriptorHeap* getHeap() const { return mpHeap; }
+    const DescriptorAllocator& getAllocator() const { return mAllocator; }
+private:
+    DescriptorRange getRange(uint32_t index, uint32_t count) const;
+
+    ID3D12Device5Ptr mpDevice;
+    ID3D12DescriptorHeapPtr mpHeap;
+    D3D12_DESCRIPTOR_HEAP_TYPE mType = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    uint32_t mDescriptorSize = 0;
+    bool mShaderVisible = false;
+    DescriptorAllocator mAllocator;
+
+    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> mCopyDst;
+    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> mCopySrc;
+    std::vector<UINT> mCopySizes;
+};
@@ -0,0 +1,56 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+/** Fence bookkeeping for N frames in flight.
+    Every frame slot remembers the fence value signaled by the last frame that used it. Before the CPU records into a slot it waits for that value,
+    at which point the command allocator and the per-frame resources of the slot are no longer used by the GPU. With one submission per frame
+    the value is mFenceValue - framesInFlight + 1, so at most framesInFlight - 1 frames are queued while the CPU records the next one.
+*/
+class FramePacer
+{
+public:
+    explicit FramePacer(uint32_t framesInFlight = 1) { reset(framesInFlight); }
+    void reset(uint32_t framesInFlight);
+
+    // The slot the CPU is recording into. Index the per-frame resources with it
+    uint32_t getFrameIndex() const { return mFrameIndex; }
+    uint32_t getFramesInFlight() const { return (uint32_t)mSlotFenceValues.size(); }
+
+    // The slot used by the previous frame, which has the newest copy of the per-frame data
+    uint32_t getPreviousFrameIndex() const { return (mFrameIndex + getFramesInFlight() - 1) % getFramesInFlight(); }
+
+    // Call after the frame was submitted and signaledFenceValue was signaled. Moves to the next slot and returns the fence value the GPU has to reach before the CPU can record into it
+    uint64_t endFrame(uint64_t signaledFenceValue);
+
+private:
+    std::vector<uint64_t> mSlotFenceValues;
+    uint32_t mFrameIndex = 0;
+};
@@ -0,0 +1,713 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <float.h>
+#include <stddef.h>
+#include "Geometry.h"
+#include "GeometryKernels.h"
+#define GLM_ENABLE_EXPERIMENTAL
+#include "Externals/GLM/glm/gtx/transform.hpp"
+#include "Externals/GLM/glm/gtx/euler_angles.hpp"
+#include <emmintrin.h>
+#include <algorithm>
+#include <thread>
+
+// 18.1
+static const VertexPositionNormalTangentTexture kTriangleVertices[kTriangleVertexCount] =
+{
+    VertexPositionNormalTangentTexture(glm::vec3(0,          1,  0), glm::vec3(0, 0, -1), glm::vec3(), glm::vec2()),
+    VertexPositionNormalTangentTexture(glm::vec3(0.866f,  -0.5f, 0), glm::vec3(0, 0, -1), glm::vec3(), glm::vec2()),
+    VertexPositionNormalTangentTexture(glm::vec3(-0.866f, -0.5f, 0), glm::vec3(0, 0, -1), glm::vec3(), glm::vec2()),
+
+    // Note: 16 also increase vertex count passed to const uint32_t vertexCount[] = { 6, 6 }
+    VertexPositionNormalTangentTexture(glm::vec3(0,          1,  0), glm::vec3(1, 0, 0), glm::vec3(), glm::vec2()),
+    VertexPositionNormalTangentTexture(glm::vec3(0,  -0.5f, 0.866f), glm::vec3(1, 0, 0), glm::vec3(), glm::vec2()),
+    VertexPositionNormalTangentTexture(glm::vec3(0, -0.5f, -0.866f), glm::vec3(1, 0, 0), glm::vec3(), glm::vec2()),
+};
+
+// 18.1.b The two triangles of the plane share their diagonal
+static const VertexPositionNormalTangentTexture kPlaneVertices[kPlaneVertexCount] =
+{
+    VertexPositionNormalTangentTexture(glm::vec3(-100, -1,  -2), glm::vec3(0, 1, 0), glm::vec3(), glm::vec2()),
+    VertexPositionNormalTangentTexture(glm::vec3(100, -1,  100), glm::vec3(0, 1, 0), glm::vec3(), glm::vec2()),
+    VertexPositionNormalTangentTexture(glm::vec3(-100, -1,  100), glm::vec3(0, 1, 0), glm::vec3(), glm::vec2()),
+    VertexPositionNormalTangentTexture(glm::vec3(100, -1,  -2), glm::vec3(0, 1, 0), glm::vec3(), glm::vec2()),
+};
+
+static const uint16_t kPlaneIndices[kPlaneIndexCount] =
+{
+    0, 1, 2,
+    0, 3, 1,
+};
+
+const VertexPositionNormalTangentTexture* getTriangleVertices()
+{
+    return kTriangleVertices;
+}
+
+const VertexPositionNormalTangentTexture* getPlaneVertices()
+{
+    return kPlaneVertices;
+}
+
+const uint16_t* getPlaneIndices()
+{
+    return kPlaneIndices;
+}
+
+void computeBounds(const VertexPositionNormalTangentTexture* pVertices, uint32_t vertexCount, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+    boundsMin = glm::vec3(FLT_MAX);
+    boundsMax = glm::vec3(-FLT_MAX);
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        boundsMin = glm::min(boundsMin, pVertices[i].position);
+        boundsMax = glm::max(boundsMax, pVertices[i].position);
+    }
+}
+
+void getInstanceTransforms(float rotation, glm::mat4 transformation[kInstanceCount])
+{
+    // 8.0.c
+    transformation[0] = glm::mat4(); // Identity
+    // 14.1.d
+    glm::mat4 rotationMat = glm::eulerAngleY(rotation);
+    transformation[1] = glm::translate(glm::mat4(), glm::vec3(-2, 0, 0)) * rotationMat;
+    transformation[2] = glm::translate(glm::mat4(), glm::vec3(2, 0, 0)) * rotationMat;
+}
+
+namespace
+{
+    // Below this many vertices, createSphere() is faster on a single thread
+    const uint32_t kSphereVerticesPerThread = 32768;
+
+    // sin and cos of 4 angles with the single-precision Cephes polynomials. The error is a few ulps for |x| < 8192
+    void sinCos4(__m128 x, __m128& sinX, __m128& cosX)
+    {
+        const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+        __m128 sinSign = _mm_and_ps(x, signMask);
+        x = _mm_andnot_ps(signMask, x);
+
+        // The octant j, rounded up to an even number, so x - j * pi/4 is in [-pi/4, pi/4]
+        __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+        j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+        __m128 y = _mm_cvtepi32_ps(j);
+
+        // Octants 2 and 6 use the sin polynomial for cos and the other way around. 4 to 7 flip the sign of sin, 2 to 5 the sign of cos
+        __m128 swapPolynomials = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+        sinSign = _mm_xor_ps(sinSign, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29)));
+        __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+
+        // Subtract j * pi/4 in three parts, to keep the precision
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+        __m128 z = _mm_mul_ps(x, x);
+
+        __m128 c = _mm_set1_ps(2.443315711809948e-5f);
+        c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(-1.388731625493765e-3f));
+        c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(4.166664568298827e-2f));
+        c = _mm_mul_ps(_mm_mul_ps(c, z), z);
+        c = _mm_add_ps(_mm_sub_ps(c, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+        __m128 s = _mm_set1_ps(-1.9515295891e-4f);
+        s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(8.3321608736e-3f));
+        s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(-1.6666654611e-1f));
+        s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+
+        __m128 sinResult = _mm_or_ps(_mm_and_ps(swapPolynomials, s), _mm_andnot_ps(swapPolynomials, c));
+        __m128 cosResult = _mm_or_ps(_mm_and_ps(swapPolynomials, c), _mm_andnot_ps(swapPolynomials, s));
+        sinX = _mm_xor_ps(sinResult, sinSign);
+        cosX = _mm_xor_ps(cosResult, cosSign);
+    }
+
+    // Angles are padded to a multiple of 4
+    void sinCosTable(std::vector<float>& angles, std::vector<float>& sinTable, std::vector<float>& cosTable)
+    {
+        size_t count = angles.size();
+        angles.resize((count + 3) & ~size_t(3), 0.0f);
+        sinTable.resize(angles.size());
+        cosTable.resize(angles.size());
+        for (size_t i = 0; i < angles.size(); i += 4)
+        {
+            __m128 s, c;
+            sinCos4(_mm_loadu_ps(&angles[i]), s, c);
+            _mm_storeu_ps(&sinTable[i], s);
+            _mm_storeu_ps(&cosTable[i], c);
+        }
+    }
+
+    struct SphereLayout
+    {
+        uint32_t verticalSegments;
+        uint32_t horizontalSegments;
+        float radius;
+        float uStart;
+        float uIncrement;
+        float vStart;
+        float vIncrement;
+        std::vector<float> sinLongitude;
+        std::vector<float> cosLongitude;
+        std::vector<float> sinLatitude;
+        std::vector<float> cosLatitude;
+    };
+
+    /** The vertices are:
+            horizontalSegments copies of the bottom vertex, one per u coordinate
+            verticalSegments - 1 rings of horizontalSegments + 1 vertices. The first and the last vertex of a ring are at the same position, with u = 1 and 0
+            horizontalSegments copies of the top vertex
+        The indices are a fan from the bottom vertex to the first ring, 2 triangles per segment between consecutive rings, and a fan from the last
+        ring to the top vertex. Row 0 is the bottom fan, row r is ring r - 1 with the triangles to the next ring, the last row is the top fan
+    */
+    template<typename Index>
+    void writeSphereRow(const SphereLayout& layout, uint32_t row, VertexPositionNormalTangentTexture* pVertices, Index* pIndices)
+    {
+        const uint32_t h = layout.horizontalSegments;
+        const uint32_t ringSize = h + 1;
+        const uint32_t ringCount = layout.verticalSegments - 1;
+        const uint32_t vertexCount = 2 * h + ringCount * ringSize;
+
+        if (row == 0)
+        {
+            for (uint32_t i = 0; i < h; i++)
+            {
+                float u = layout.uStart + float(i + 1) * layout.uIncrement;
+                pVertices[i] = VertexPositionNormalTangentTexture(glm::vec3(0, -layout.radius, 0), glm::vec3(0, -1, 0), glm::vec3(0), glm::vec2(u, layout.vStart));
+                Index* pTriangle = pIndices + i * 3;
+                pTriangle[0] = Index(i);
+                pTriangle[1] = Index(1 + i + h);
+                pTriangle[2] = Index(i + h);
+            }
+        }
+        else if (row <= ringCount)
+        {
+            const uint32_t ring = row - 1;
+            const float v = layout.vStart + float(ring + 1) * layout.vIncrement;
+            const float dy = layout.sinLatitude[ring];
+            const float dxz = layout.cosLatitude[ring];
+            VertexPositionNormalTangentTexture* pRing = pVertices + h + ring * ringSize;
+            for (uint32_t j = 0; j <= h; j++)
+            {
+                const glm::vec3 normal(layout.cosLongitude[j] * dxz, dy, layout.sinLongitude[j] * dxz);
+                const glm::vec2 texCoord(layout.uStart + float(j) * layout.uIncrement, v);
+                pRing[j] = VertexPositionNormalTangentTexture(normal * layout.radius, normal, glm::vec3(0), texCoord);
+            }
+
+            if (ring + 1 < ringCount)
+            {
+                Index* pQuad = pIndices + 3 * h + ring * 6 * h;
+                const uint32_t first = h + ring * ringSize;
+                for (uint32_t j = 0; j < h; j++, pQuad += 6)
+                {
+                    const uint32_t i1 = first + j;
+                    const uint32_t i2 = i1 + 1;
+                    const uint32_t i3 = i1 + ringSize;
+                    const uint32_t i4 = i3 + 1;
+                    pQuad[0] = Index(i1);
+                    pQuad[1] = Index(i2);
+                    pQuad[2] = Index(i3);
+                    pQuad[3] = Index(i2);
+                    pQuad[4] = Index(i4);
+                    pQuad[5] = Index(i3);
+                }
+            }
+        }
+        else
+        {
+            VertexPositionNormalTangentTexture* pTop = pVertices + vertexCount - h;
+            Index* pFan = pIndices + 3 * h + (ringCount - 1) * 6 * h;
+            const float vTop = 1.0f - layout.vStart;
+            for (uint32_t i = 0; i < h; i++)
+            {
+                float u = layout.uStart + float(i + 1) * layout.uIncrement;
+                pTop[i] = VertexPositionNormalTangentTexture(glm::vec3(0, layout.radius, 0), glm::vec3(0, 1, 0), glm::vec3(0), glm::vec2(u, vTop));
+                Index* pTriangle = pFan + i * 3;
+                pTriangle[0] = Index(vertexCount - 1 - i);
+                pTriangle[1] = Index(vertexCount - h - 2 - i);
+                pTriangle[2] = Index(vertexCount - h - 1 - i);
+            }
+        }
+    }
+
+    template<typename Index>
+    void writeSphere(const SphereLayout& layout, VertexPositionNormalTangentTexture* pVertices, Index* pIndices, uint32_t threadCount)
+    {
+        // Rows are independent. Every thread writes a contiguous block of them
+        const uint32_t rowCount = layout.verticalSegments + 1;
+        threadCount = std::min(threadCount, rowCount);
+        auto worker = [&](uint32_t threadIndex)
+        {
+            uint32_t begin = rowCount * threadIndex / threadCount;
+            uint32_t end = rowCount * (threadIndex + 1) / threadCount;
+            for (uint32_t row = begin; row < end; row++) writeSphereRow(layout, row, pVertices, pIndices);
+        };
+
+        std::vector<std::thread> threads;
+        for (uint32_t i = 1; i < threadCount; i++) threads.emplace_back(worker, i);
+        worker(0);
+        for (auto& t : threads) t.join();
+    }
+}
+
+void sinCos(float x, float& sinX, float& cosX)
+{
+    // fmodf() is exact, so the range reduction doesn't depend on the C runtime either
+    __m128 s, c;
+    sinCos4(_mm_set1_ps(fmodf(x, 2 * static_cast<float>(M_PI))), s, c);
+    sinX = _mm_cvtss_f32(s);
+    cosX = _mm_cvtss_f32(c);
+}
+
+uint32_t getSphereVertexCount(int tessellation)
+{
+    const uint32_t verticalSegments = (uint32_t)std::max(tessellation, 2);
+    const uint32_t horizontalSegments = verticalSegments * 2;
+    return 2 * horizontalSegments + (verticalSegments - 1) * (horizontalSegments + 1);
+}
+
+uint32_t getSphereIndexCount(int tessellation)
+{
+    const uint32_t verticalSegments = (uint32_t)std::max(tessellation, 2);
+    const uint32_t horizontalSegments = verticalSegments * 2;
+    return 6 * horizontalSegments * (verticalSegments - 1);
+}
+
+// 18.0.d
+Shape createSphere(float diameter, int tessellation, bool uvHorizontalFlip, bool uvVerticalFlip, uint32_t threadCount)
+{
+    Shape returnSphereInfo;
+
+    SphereLayout layout;
+    layout.verticalSegments = (uint32_t)std::max(tessellation, 2);
+    layout.horizontalSegments = layout.verticalSegments * 2;
+    layout.radius = diameter / 2;
+    layout.uIncrement = (uvHorizontalFlip ? 1.f : -1.f) / layout.horizontalSegments;
+    layout.vIncrement = (uvVerticalFlip ? 1.f : -1.f) / layout.verticalSegments;
+    layout.uStart = uvHorizontalFlip ? 0.f : 1.f;
+    layout.vStart = uvVerticalFlip ? 0.f : 1.f;
+
+    // The longitudes are the same for every ring and the latitudes for every vertex of a ring, so sin and cos are only computed once per angle
+    std::vector<float> longitudes(layout.horizontalSegments + 1);
+    for (uint32_t j = 0; j <= layout.horizontalSegments; j++) longitudes[j] = j * static_cast<float>(M_PI) * 2 / layout.horizontalSegments;
+    sinCosTable(longitudes, layout.sinLongitude, layout.cosLongitude);
+    std::vector<float> latitudes(layout.verticalSegments - 1);
+    for (uint32_t i = 0; i < layout.verticalSegments - 1; i++) latitudes[i] = (((i + 1) * static_cast<float>(M_PI)) / layout.verticalSegments) - static_cast<float>(M_PI) / 2;
+    sinCosTable(latitudes, layout.sinLatitude, layout.cosLatitude);
+
+    // A thread per core for large spheres. Small ones are done before a thread would start
+    const uint32_t vertexCount = getSphereVertexCount(tessellation);
+    const uint32_t indexCount = getSphereIndexCount(tessellation);
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    if (vertexCount < kSphereVerticesPerThread * 2) threadCount = 1;
+
+    returnSphereInfo.vertexData.resize(vertexCount);
+    if (vertexCount <= 0x10000)
+    {
+        returnSphereInfo.indexData.resize(indexCount);
+        writeSphere(layout, returnSphereInfo.vertexData.data(), returnSphereInfo.indexData.data(), threadCount);
+    }
+    else
+    {
+        returnSphereInfo.indexData32.resize(indexCount);
+        writeSphere(layout, returnSphereInfo.vertexData.data(), returnSphereInfo.indexData32.data(), threadCount);
+    }
+
+    calculateTangentSpace(returnSphereInfo, threadCount);
+
+    return returnSphereInfo;
+}
+
+namespace
+{
+    // Below this many triangles, generateTangents() is faster on a single thread
+    const uint32_t kTangentTrianglesPerThread = 32768;
+
+    // Four 3D vectors, one per SSE lane
+    struct Vec3x4
+    {
+        __m128 x, y, z;
+    };
+
+    inline Vec3x4 sub(const Vec3x4& a, const Vec3x4& b) { return { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) }; }
+    inline Vec3x4 scale(const Vec3x4& a, __m128 s) { return { _mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s) }; }
+    inline __m128 dot(const Vec3x4& a, const Vec3x4& b)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+    }
+
+    inline Vec3x4 cross(const Vec3x4& a, const Vec3x4& b)
+    {
+        return { _mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y)), _mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z)), _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x)) };
+    }
+
+    // Loads the 16 bytes at member of the four vertices pIndex[0], pIndex[stride], pIndex[stride * 2] and pIndex[stride * 3] and transposes them
+    // to one component per register. The loads read past position and normal into the next member, never past the vertex
+    template<typename Index>
+    inline Vec3x4 loadVec3x4(const VertexPositionNormalTangentTexture* pVertices, const Index* pIndex, uint32_t stride, glm::vec3 VertexPositionNormalTangentTexture::* member)
+    {
+        __m128 r0 = _mm_loadu_ps(&(pVertices[pIndex[0]].*member).x);
+        __m128 r1 = _mm_loadu_ps(&(pVertices[pIndex[stride]].*member).x);
+        __m128 r2 = _mm_loadu_ps(&(pVertices[pIndex[stride * 2]].*member).x);
+        __m128 r3 = _mm_loadu_ps(&(pVertices[pIndex[stride * 3]].*member).x);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        return { r0, r1, r2 };
+    }
+
+    template<typename Index>
+    inline void loadTexCoords(const VertexPositionNormalTangentTexture* pVertices, const Index* pIndex, uint32_t stride, __m128& u, __m128& v)
+    {
+        __m128 uv01 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&pVertices[pIndex[0]].texCoord.x), (const __m64*)&pVertices[pIndex[stride]].texCoord.x);
+        __m128 uv23 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&pVertices[pIndex[stride * 2]].texCoord.x), (const __m64*)&pVertices[pIndex[stride * 3]].texCoord.x);
+        u = _mm_shuffle_ps(uv01, uv23, _MM_SHUFFLE(2, 0, 2, 0));
+        v = _mm_shuffle_ps(uv01, uv23, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+
+    // Where a block of triangles sums its tangents. xyz is the weighted tangent and w the weighted orientation, positive where the
+    // bitangent is cross(normal, tangent). The vertices [privateBegin, privateEnd) no other block references are summed straight into the
+    // output. The others the block references, [firstVertex, lastVertex] without the private ones, go to dense sums of its own
+    struct TangentBlock
+    {
+        uint32_t firstVertex = 1;
+        uint32_t lastVertex = 0;
+        uint32_t privateBegin = 0;
+        uint32_t privateEnd = 0;
+        std::vector<glm::vec4> shared;
+
+        glm::vec4& sum(glm::vec4* pTangents, uint32_t vertex)
+        {
+            if (vertex - privateBegin < privateEnd - privateBegin) return pTangents[vertex];
+            return shared[vertex - firstVertex - ((vertex >= privateEnd) ? privateEnd - privateBegin : 0)];
+        }
+    };
+
+    // Adds the tangents of the four triangles at pTriangles to the sums. Every corner gets the direction of increasing u over the texture-space
+    // area, as in the scalar generator this replaced, and the orientation of the triangle. Lanes not in laneMask add zero. Without shared
+    // sums, as on a single thread, every vertex is private
+    template<typename Index>
+    inline void computeBatch(const VertexPositionNormalTangentTexture* pVertices, const Index* pTriangles, __m128 laneMask, __m128 lanes[4])
+    {
+        const Vec3x4 p0 = loadVec3x4(pVertices, pTriangles, 3, &VertexPositionNormalTangentTexture::position);
+        const Vec3x4 p1 = loadVec3x4(pVertices, pTriangles + 1, 3, &VertexPositionNormalTangentTexture::position);
+        const Vec3x4 p2 = loadVec3x4(pVertices, pTriangles + 2, 3, &VertexPositionNormalTangentTexture::position);
+        __m128 u0, v0, u1, v1, u2, v2;
+        loadTexCoords(pVertices, pTriangles, 3, u0, v0);
+        loadTexCoords(pVertices, pTriangles + 1, 3, u1, v1);
+        loadTexCoords(pVertices, pTriangles + 2, 3, u2, v2);
+        const __m128 s1 = _mm_sub_ps(u1, u0);
+        const __m128 t1 = _mm_sub_ps(v1, v0);
+        const __m128 s2 = _mm_sub_ps(u2, u0);
+        const __m128 t2 = _mm_sub_ps(v2, v0);
+        const Vec3x4 e1 = sub(p1, p0);
+        const Vec3x4 e2 = sub(p2, p0);
+
+        // Triangles without a texture-space area have no tangent and are skipped. The others divide by it, which is what weights them
+        const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+        const __m128 area = _mm_sub_ps(_mm_mul_ps(s1, t2), _mm_mul_ps(s2, t1));
+        const __m128 valid = _mm_and_ps(_mm_cmpgt_ps(_mm_andnot_ps(signMask, area), _mm_set1_ps(FLT_MIN)), laneMask);
+        const __m128 r = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), area), valid);
+
+        // +1 where the bitangent is on the side of cross(normal, tangent), -1 where the texture is mirrored. cross(tangent, bitangent) is
+        // area * cross(e1, e2), which does not depend on the winding, so the normal of the first corner is enough
+        const Vec3x4 normal = loadVec3x4(pVertices, pTriangles, 3, &VertexPositionNormalTangentTexture::normal);
+        const __m128 orientation = _mm_and_ps(_mm_or_ps(_mm_and_ps(_mm_xor_ps(dot(normal, cross(e1, e2)), area), signMask), _mm_set1_ps(1.0f)), valid);
+
+        // Back to one tangent and orientation per lane, the same for the three corners. Lanes can share a vertex, so they are added one after
+        // the other. The vector stores may alias anything, so what block.sum() reads is copied to locals the compiler need not reload
+        __m128 x = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1.x, t2), _mm_mul_ps(e2.x, t1)), r);
+        __m128 y = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1.y, t2), _mm_mul_ps(e2.y, t1)), r);
+        __m128 z = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1.z, t2), _mm_mul_ps(e2.z, t1)), r);
+        __m128 o = orientation;
+        _MM_TRANSPOSE4_PS(x, y, z, o);
+        lanes[0] = x; lanes[1] = y; lanes[2] = z; lanes[3] = o;
+    }
+
+    template<bool kShared, typename Index>
+    inline void scatterBatch(const Index* pTriangles, const __m128 lanes[4], TangentBlock& block, glm::vec4* pTangents)
+    {
+        const __m128 x = lanes[0], y = lanes[1], z = lanes[2], o = lanes[3];
+        const uint32_t firstVertex = block.firstVertex;
+        const uint32_t privateBegin = block.privateBegin;
+        const uint32_t privateCount = block.privateEnd - block.privateBegin;
+        glm::vec4* const pShared = block.shared.data();
+        auto add = [&](uint32_t vertex, __m128 tangent)
+        {
+            float* pSum = &pTangents[vertex].x;
+            if (kShared && vertex - privateBegin >= privateCount) pSum = &pShared[vertex - firstVertex - ((vertex >= privateBegin) ? privateCount : 0)].x;
+            _mm_storeu_ps(pSum, _mm_add_ps(_mm_loadu_ps(pSum), tangent));
+        };
+        add(pTriangles[0], x);
+        add(pTriangles[1], x);
+        add(pTriangles[2], x);
+        add(pTriangles[3], y);
+        add(pTriangles[4], y);
+        add(pTriangles[5], y);
+        add(pTriangles[6], z);
+        add(pTriangles[7], z);
+        add(pTriangles[8], z);
+        add(pTriangles[9], o);
+        add(pTriangles[10], o);
+        add(pTriangles[11], o);
+    }
+
+    // Adds the tangents of triangles [beginTriangle, endTriangle) to the sums of the block, four triangles at a time, eight with AVX2. The
+    // projection into the plane of the normal is left to resolveTangents()
+    template<bool kShared, typename Index>
+    void accumulateTangents(const VertexPositionNormalTangentTexture* pVertices, const Index* pIndices, uint32_t beginTriangle, uint32_t endTriangle, TangentBlock& block, glm::vec4* pTangents)
+    {
+        // With AVX2, eight triangles at a time up to the last few
+        static_assert(sizeof(TangentVertex) == sizeof(VertexPositionNormalTangentTexture) && offsetof(TangentVertex, normal) == offsetof(VertexPositionNormalTangentTexture, normal) &&
+            offsetof(TangentVertex, texCoord) == offsetof(VertexPositionNormalTangentTexture, texCoord), "TangentVertex doesn't match VertexPositionNormalTangentTexture");
+        static const bool sAvx2 = cpuSupportsAvx2();
+        if (sAvx2)
+        {
+            const TangentSums sums = { &pTangents[0].x, kShared ? &block.shared[0].x : nullptr, block.firstVertex, block.privateBegin, block.privateEnd - block.privateBegin };
+            beginTriangle = accumulateTangentsAvx2((const TangentVertex*)pVertices, pIndices, beginTriangle, endTriangle, sums);
+        }
+
+        // The last batch repeats its last triangle in the unused lanes, which add zero
+        const __m128 allLanes = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        Index lastTriangles[12];
+        __m128 previous[4] = {};
+        const Index* pPrevious = nullptr;
+        for (uint32_t first = beginTriangle; first < endTriangle; first += 4)
+        {
+            const Index* pTriangles = pIndices + first * 3;
+            __m128 laneMask = allLanes;
+            if (endTriangle - first < 4)
+            {
+                const uint32_t laneCount = endTriangle - first;
+                for (uint32_t i = 0; i < 12; i++) lastTriangles[i] = pTriangles[std::min(i / 3, laneCount - 1) * 3 + i % 3];
+                pTriangles = lastTriangles;
+                laneMask = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_set_epi32(3, 2, 1, 0), _mm_set1_epi32((int)laneCount)));
+            }
+            __m128 lanes[4];
+            computeBatch(pVertices, pTriangles, laneMask, lanes);
+            if (pPrevious) scatterBatch<kShared>(pPrevious, previous, block, pTangents);
+            pPrevious = pTriangles;
+            for (int i = 0; i < 4; i++) previous[i] = lanes[i];
+        }
+        if (pPrevious) scatterBatch<kShared>(pPrevious, previous, block, pTangents);
+    }
+
+    // The tangent of a vertex from its normal and its sum, the same as four at a time in resolveTangents()
+    glm::vec4 resolveTangent(const glm::vec3& n, const glm::vec4& sum)
+    {
+        // Gram-Schmidt orthogonalize
+        glm::vec3 t(sum);
+        t -= n * glm::dot(n, t);
+        float lengthSquared = glm::dot(t, t);
+        if (lengthSquared < 1e-20f)
+        {
+            // No triangle with a usable texture mapping touches this vertex. Any tangent is as good as another
+            t = (fabsf(n.x) < 0.9f) ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+            t -= n * glm::dot(n, t);
+            lengthSquared = glm::dot(t, t);
+        }
+        t *= 1.0f / sqrtf(lengthSquared);
+
+        // The bitangent is w * cross(normal, tangent)
+        return glm::vec4(t, (sum.w < 0.0f) ? -1.0f : 1.0f);
+    }
+
+    // Adds the shared sums of the blocks to the private ones in pTangents for vertices [beginVertex, endVertex), and turns them into the final
+    // tangents. The vertices between the private ranges, sorted by their begin, start from zero
+    void resolveTangents(const VertexPositionNormalTangentTexture* pVertices, std::vector<TangentBlock>& blocks, const std::vector<uint32_t>& privateOrder, uint32_t beginVertex, uint32_t endVertex, glm::vec4* pTangents)
+    {
+        uint32_t gapBegin = beginVertex;
+        for (uint32_t b : privateOrder)
+        {
+            const TangentBlock& block = blocks[b];
+            if (block.privateBegin > gapBegin) std::fill(pTangents + gapBegin, pTangents + std::min(block.privateBegin, endVertex), glm::vec4(0));
+            gapBegin = std::max(gapBegin, block.privateEnd);
+            if (gapBegin >= endVertex) break;
+        }
+        if (gapBegin < endVertex) std::fill(pTangents + gapBegin, pTangents + endVertex, glm::vec4(0));
+
+        for (TangentBlock& block : blocks)
+        {
+            if (block.shared.empty()) continue;
+            const uint32_t begin = std::max(beginVertex, block.firstVertex);
+            const uint32_t end = std::min(endVertex, block.lastVertex + 1);
+            for (uint32_t i = begin; i < end; i++)
+            {
+                if (i - block.privateBegin >= block.privateEnd - block.privateBegin) pTangents[i] += block.sum(pTangents, i);
+            }
+        }
+
+        // Four vertices at a time. A batch with a vertex no usable triangle touches takes the scalar path, like the last vertices
+        uint32_t i = beginVertex;
+        for (; i + 4 <= endVertex; i += 4)
+        {
+            const uint32_t index[4] = { i, i + 1, i + 2, i + 3 };
+            const Vec3x4 n = loadVec3x4(pVertices, index, 1, &VertexPositionNormalTangentTexture::normal);
+            __m128 x = _mm_loadu_ps(&pTangents[i].x);
+            __m128 y = _mm_loadu_ps(&pTangents[i + 1].x);
+            __m128 z = _mm_loadu_ps(&pTangents[i + 2].x);
+            __m128 w = _mm_loadu_ps(&pTangents[i + 3].x);
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+
+            // Gram-Schmidt orthogonalize
+            Vec3x4 t = { x, y, z };
+            t = sub(t, scale(n, dot(n, t)));
+            const __m128 lengthSquared = dot(t, t);
+            if (_mm_movemask_ps(_mm_cmplt_ps(lengthSquared, _mm_set1_ps(1e-20f))) != 0)
+            {
+                for (uint32_t j = i; j < i + 4; j++) pTangents[j] = resolveTangent(pVertices[j].normal, pTangents[j]);
+                continue;
+            }
+            t = scale(t, _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared)));
+
+            x = t.x;
+            y = t.y;
+            z = t.z;
+            w = _mm_or_ps(_mm_and_ps(w, _mm_castsi128_ps(_mm_set1_epi32(0x80000000))), _mm_set1_ps(1.0f));
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            _mm_storeu_ps(&pTangents[i].x, x);
+            _mm_storeu_ps(&pTangents[i + 1].x, y);
+            _mm_storeu_ps(&pTangents[i + 2].x, z);
+            _mm_storeu_ps(&pTangents[i + 3].x, w);
+        }
+        for (; i < endVertex; i++) pTangents[i] = resolveTangent(pVertices[i].normal, pTangents[i]);
+    }
+
+    // Runs func(threadIndex) on threadCount threads, the calling thread included
+    template<typename Func>
+    void runOnThreads(uint32_t threadCount, const Func& func)
+    {
+        std::vector<std::thread> threads;
+        for (uint32_t i = 1; i < threadCount; i++) threads.emplace_back(func, i);
+        func(0);
+        for (auto& t : threads) t.join();
+    }
+
+    template<typename Index>
+    void generateTangents(const VertexPositionNormalTangentTexture* pVertices, uint32_t vertexCount, const Index* pIndices, uint32_t triangleCount, glm::vec4* pTangents, uint32_t threadCount)
+    {
+        // Every thread accumulates a contiguous block of triangles. Meshes mostly reference their vertices in order, so most of the vertices of
+        // a block are private to it and summed into pTangents with no reduction. The shared ones, the vertices on the border of two blocks or
+        // all of them in a shuffled mesh, are reduced by every thread for a block of vertices. A single thread owns every vertex
+        std::vector<TangentBlock> blocks(threadCount);
+        auto getTriangles = [&](uint32_t threadIndex, uint32_t& begin, uint32_t& end)
+        {
+            begin = (uint32_t)((uint64_t)triangleCount * threadIndex / threadCount);
+            end = (uint32_t)((uint64_t)triangleCount * (threadIndex + 1) / threadCount);
+        };
+        if (threadCount == 1)
+        {
+            blocks[0].firstVertex = 0;
+            blocks[0].lastVertex = vertexCount - 1;
+        }
+        else
+        {
+            runOnThreads(threadCount, [&](uint32_t threadIndex)
+            {
+                uint32_t begin, end;
+                getTriangles(threadIndex, begin, end);
+                TangentBlock& block = blocks[threadIndex];
+                block.firstVertex = UINT32_MAX;
+                for (uint32_t i = begin * 3; i < end * 3; i++)
+                {
+                    block.firstVertex = std::min(block.firstVertex, (uint32_t)pIndices[i]);
+                    block.lastVertex = std::max(block.lastVertex, (uint32_t)pIndices[i]);
+                }
+            });
+        }
+
+        // The private vertices of a block are the range it references without the ranges of the other blocks. A block inside the range
+        // leaves the larger side. Every cut makes the range smaller, so the ranges cut earlier stay outside
+        for (uint32_t b = 0; b < threadCount; b++)
+        {
+            TangentBlock& block = blocks[b];
+            if (block.firstVertex > block.lastVertex) continue;
+            uint64_t begin = block.firstVertex;
+            uint64_t end = (uint64_t)block.lastVertex + 1;
+            for (uint32_t other = 0; other < threadCount && begin < end; other++)
+            {
+                const TangentBlock& o = blocks[other];
+                if (other == b || o.firstVertex > o.lastVertex || o.lastVertex < begin || o.firstVertex >= end) continue;
+                if (o.firstVertex <= begin) begin = (uint64_t)o.lastVertex + 1;
+                else if (o.lastVertex + 1 >= end) end = o.firstVertex;
+                else if (o.firstVertex - begin >= end - o.lastVertex - 1) end = o.firstVertex;
+                else begin = (uint64_t)o.lastVertex + 1;
+            }
+            block.privateBegin = (uint32_t)std::min(begin, end);
+            block.privateEnd = (uint32_t)std::min(begin, end) + (uint32_t)((end > begin) ? end - begin : 0);
+        }
+        std::vector<uint32_t> privateOrder;
+        for (uint32_t b = 0; b < threadCount; b++)
+        {
+            if (blocks[b].privateBegin < blocks[b].privateEnd) privateOrder.push_back(b);
+        }
+        std::sort(privateOrder.begin(), privateOrder.end(), [&](uint32_t a, uint32_t b) { return blocks[a].privateBegin < blocks[b].privateBegin; });
+
+        runOnThreads(threadCount, [&](uint32_t threadIndex)
+        {
+            TangentBlock& block = blocks[threadIndex];
+            if (block.firstVertex > block.lastVertex) return;
+            uint32_t begin, end;
+            getTriangles(threadIndex, begin, end);
+            std::fill(pTangents + block.privateBegin, pTangents + block.privateEnd, glm::vec4(0));
+            block.shared.assign((block.lastVertex - block.firstVertex + 1) - (block.privateEnd - block.privateBegin), glm::vec4(0));
+            if (block.shared.empty()) accumulateTangents<false>(pVertices, pIndices, begin, end, block, pTangents);
+            else accumulateTangents<true>(pVertices, pIndices, begin, end, block, pTangents);
+        });
+        runOnThreads(threadCount, [&](uint32_t threadIndex)
+        {
+            uint32_t begin = (uint32_t)((uint64_t)vertexCount * threadIndex / threadCount);
+            uint32_t end = (uint32_t)((uint64_t)vertexCount * (threadIndex + 1) / threadCount);
+            resolveTangents(pVertices, blocks, privateOrder, begin, end, pTangents);
+        });
+    }
+}
+
+void generateTangents(const VertexPositionNormalTangentTexture* pVertices, uint32_t vertexCount, const void* pIndices, uint32_t indexCount, bool indices32Bit, glm::vec4* pTangents, uint32_t threadCount)
+{
+    const uint32_t triangleCount = indexCount / 3;
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::max(1u, std::min(threadCount, triangleCount / kTangentTrianglesPerThread));
+
+    if (indices32Bit)
+    {
+        generateTangents(pVertices, vertexCount, (const uint32_t*)pIndices, triangleCount, pTangents, threadCount);
+    }
+    else
+    {
+        generateTangents(pVertices, vertexCount, (const uint16_t*)pIndices, triangleCount, pTangents, threadCount);
+    }
+}
+
+// 18.0.f
+void calculateTangentSpace(Shape& shape, uint32_t threadCount)
+{
+    std::vector<glm::vec4> tangents(shape.vertexData.size());
+    generateTangents(shape.vertexData.data(), (uint32_t)shape.vertexData.size(), shape.getIndices(), shape.getIndexCount(), shape.indices32Bit(), tangents.data(), threadCount);
+
+    // The vertex only has room for the direction, so the handedness is dropped. Code that needs it calls generateTangents()
+    for (size_t i = 0; i < tangents.size(); i++) shape.vertexData[i].tangent = glm::vec3(tangents[i]);
+}
@@ -0,0 +1,94 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#define GLM_FORCE_CTOR_INIT
+#include "Externals/GLM/glm/glm.hpp"
+#include <stdint.h>
+#include <vector>
+
+// Geometry shared by the DXR path and the CPU reference path. Nothing in here depends on D3D12 or Win32, so it can be compiled on any platform.
+
+// 18.0.a
+struct VertexPositionNormalTangentTexture
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 tangent;
+    glm::vec2 texCoord;
+
+    VertexPositionNormalTangentTexture(const glm::vec3 pos, const glm::vec3 norm,
+        const glm::vec3 tan, const glm::vec2 texCor)
+    {
+        position = pos;
+        normal = norm;
+        tangent = tan;
+        texCoord = texCor;
+    }
+
+    VertexPositionNormalTangentTexture() = default;
+};
+
+// 18.0.b The indices are 16-bit if every vertex can be addressed with them, 32-bit otherwise. Only one of the index vectors is used
+struct Shape
+{
+    std::vector<VertexPositionNormalTangentTexture> vertexData;
+    std::vector<unsigned short> indexData;
+    std::vector<uint32_t> indexData32;
+
+    bool indices32Bit() const { return indexData32.empty() == false; }
+    uint32_t getIndexCount() const { return (uint32_t)(indices32Bit() ? indexData32.size() : indexData.size()); }
+    uint32_t getIndex(uint32_t i) const { return indices32Bit() ? indexData32[i] : indexData[i]; }
+    const void* getIndices() const { return indices32Bit() ? (const void*)indexData32.data() : (const void*)indexData.data(); }
+};
+
+// 18.0.e Per-vertex tangents, processed eight triangles at a time with AVX2, four without, and split across threadCount threads (0 uses all
+// the cores). pIndices holds indexCount 16-bit or 32-bit indices. xyz is the unit tangent, orthogonal to the normal, and w is the handedness:
+// the bitangent is w * cross(normal, tangent). Corners are weighted as in the scalar generator this replaced. This is not MikkTSpace: the
+// weights differ and vertices are not split where the frames disagree, so normal maps baked with MikkTSpace can show seams
+void generateTangents(const VertexPositionNormalTangentTexture* pVertices, uint32_t vertexCount, const void* pIndices, uint32_t indexCount, bool indices32Bit, glm::vec4* pTangents, uint32_t threadCount = 0);
+void calculateTangentSpace(Shape& shape, uint32_t threadCount = 0);
+
+// 18.0.c tessellation is the number of latitude bands, it's at least 2. If threadCount is 0 we use all the cores
+Shape createSphere(float diameter, int tessellation, bool uvHorizontalFlip = false, bool uvVerticalFlip = false, uint32_t threadCount = 0);
+uint32_t getSphereVertexCount(int tessellation);
+uint32_t getSphereIndexCount(int tessellation);
+
+// The tutorial scene. createTutorialScene() writes these into the built-in scene, the triangle as a plain triangle list and the plane indexed
+static const uint32_t kTriangleVertexCount = 6;
+static const uint32_t kPlaneVertexCount = 4;
+static const uint32_t kPlaneIndexCount = 6;
+static const uint32_t kInstanceCount = 3;
+const VertexPositionNormalTangentTexture* getTriangleVertices();
+const VertexPositionNormalTangentTexture* getPlaneVertices();
+const uint16_t* getPlaneIndices();
+// Object-space bounds of a vertex buffer
+void computeBounds(const VertexPositionNormalTangentTexture* pVertices, uint32_t vertexCount, glm::vec3& boundsMin, glm::vec3& boundsMax);
+// sin and cos with the same bits on every platform and C runtime, for the transforms the CPU reference has to reproduce exactly
+void sinCos(float x, float& sinX, float& cosX);
+// Instance 0 is the triangle+plane BLAS, instances 1 and 2 are the rotating triangles. The matrices are column-major (GLM)
+void getInstanceTransforms(float rotation, glm::mat4 transformation[kInstanceCount]);
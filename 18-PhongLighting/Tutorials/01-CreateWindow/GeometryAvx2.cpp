@@ -0,0 +1,201 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+// This file is compiled with /arch:AVX2. It must not include anything with inline functions that other files also use, see GeometryKernels.h
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC target("avx2")
+#endif
+#include <immintrin.h>
+#include <float.h>
+#include <stddef.h>
+#include "GeometryKernels.h"
+
+namespace
+{
+    // Eight 3D vectors, one per AVX lane
+    struct Vec3x8
+    {
+        __m256 x, y, z;
+    };
+
+    inline Vec3x8 sub(const Vec3x8& a, const Vec3x8& b) { return { _mm256_sub_ps(a.x, b.x), _mm256_sub_ps(a.y, b.y), _mm256_sub_ps(a.z, b.z) }; }
+    inline __m256 dot(const Vec3x8& a, const Vec3x8& b)
+    {
+        return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a.x, b.x), _mm256_mul_ps(a.y, b.y)), _mm256_mul_ps(a.z, b.z));
+    }
+
+    inline Vec3x8 cross(const Vec3x8& a, const Vec3x8& b)
+    {
+        return { _mm256_sub_ps(_mm256_mul_ps(a.y, b.z), _mm256_mul_ps(a.z, b.y)), _mm256_sub_ps(_mm256_mul_ps(a.z, b.x), _mm256_mul_ps(a.x, b.z)), _mm256_sub_ps(_mm256_mul_ps(a.x, b.y), _mm256_mul_ps(a.y, b.x)) };
+    }
+
+    // The 16 bytes at offset of vertex pIndex[lane * 3] in the low half and of pIndex[highLane * 3] in the high half
+    template<typename Index>
+    inline __m256 loadPair(const TangentVertex* pVertices, const Index* pIndex, size_t offset, uint32_t lane, uint32_t highLane)
+    {
+        const __m128 low = _mm_loadu_ps((const float*)((const uint8_t*)&pVertices[pIndex[lane * 3]] + offset));
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(low), _mm_loadu_ps((const float*)((const uint8_t*)&pVertices[pIndex[highLane * 3]] + offset)), 1);
+    }
+
+    // Loads the 16 bytes at offset of the vertices pIndex[0], pIndex[3], ... pIndex[21] and transposes them to one component per register.
+    // Triangles 0-3 go to the low half and 4-7 to the high half, so the transpose stays within the halves, as the AVX shuffles do. The loads
+    // read past position and normal into the next member, never past the vertex
+    template<typename Index>
+    inline Vec3x8 loadVec3x8(const TangentVertex* pVertices, const Index* pIndex, size_t offset)
+    {
+        const __m256 r0 = loadPair(pVertices, pIndex, offset, 0, 4);
+        const __m256 r1 = loadPair(pVertices, pIndex, offset, 1, 5);
+        const __m256 r2 = loadPair(pVertices, pIndex, offset, 2, 6);
+        const __m256 r3 = loadPair(pVertices, pIndex, offset, 3, 7);
+        const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+        const __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+        const __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+        const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+        return { _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2)), _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0)) };
+    }
+
+    // The same with the 16 bytes that end with the texture coordinate, of which only the last two floats are kept
+    template<typename Index>
+    inline void loadTexCoords(const TangentVertex* pVertices, const Index* pIndex, __m256& u, __m256& v)
+    {
+        const size_t offset = offsetof(TangentVertex, texCoord) - 8;
+        const __m256 t0 = _mm256_unpackhi_ps(loadPair(pVertices, pIndex, offset, 0, 4), loadPair(pVertices, pIndex, offset, 1, 5));
+        const __m256 t1 = _mm256_unpackhi_ps(loadPair(pVertices, pIndex, offset, 2, 6), loadPair(pVertices, pIndex, offset, 3, 7));
+        u = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+        v = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+
+    // The tangents and orientations of the eight triangles at pTriangles, one per lane, like computeBatch() in Geometry.cpp
+    template<typename Index>
+    inline void computeBatch(const TangentVertex* pVertices, const Index* pTriangles, __m128 lanes[8])
+    {
+        const Vec3x8 p0 = loadVec3x8(pVertices, pTriangles, offsetof(TangentVertex, position));
+        const Vec3x8 p1 = loadVec3x8(pVertices, pTriangles + 1, offsetof(TangentVertex, position));
+        const Vec3x8 p2 = loadVec3x8(pVertices, pTriangles + 2, offsetof(TangentVertex, position));
+        __m256 u0, v0, u1, v1, u2, v2;
+        loadTexCoords(pVertices, pTriangles, u0, v0);
+        loadTexCoords(pVertices, pTriangles + 1, u1, v1);
+        loadTexCoords(pVertices, pTriangles + 2, u2, v2);
+        const __m256 s1 = _mm256_sub_ps(u1, u0);
+        const __m256 t1 = _mm256_sub_ps(v1, v0);
+        const __m256 s2 = _mm256_sub_ps(u2, u0);
+        const __m256 t2 = _mm256_sub_ps(v2, v0);
+        const Vec3x8 e1 = sub(p1, p0);
+        const Vec3x8 e2 = sub(p2, p0);
+
+        const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+        const __m256 area = _mm256_sub_ps(_mm256_mul_ps(s1, t2), _mm256_mul_ps(s2, t1));
+        const __m256 valid = _mm256_cmp_ps(_mm256_andnot_ps(signMask, area), _mm256_set1_ps(FLT_MIN), _CMP_GT_OQ);
+        const __m256 r = _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.0f), area), valid);
+
+        const Vec3x8 normal = loadVec3x8(pVertices, pTriangles, offsetof(TangentVertex, normal));
+        const __m256 orientation = _mm256_and_ps(_mm256_or_ps(_mm256_and_ps(_mm256_xor_ps(dot(normal, cross(e1, e2)), area), signMask), _mm256_set1_ps(1.0f)), valid);
+
+        const __m256 x = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(e1.x, t2), _mm256_mul_ps(e2.x, t1)), r);
+        const __m256 y = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(e1.y, t2), _mm256_mul_ps(e2.y, t1)), r);
+        const __m256 z = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(e1.z, t2), _mm256_mul_ps(e2.z, t1)), r);
+        const __m256 xy0 = _mm256_unpacklo_ps(x, y);
+        const __m256 zo0 = _mm256_unpacklo_ps(z, orientation);
+        const __m256 xy1 = _mm256_unpackhi_ps(x, y);
+        const __m256 zo1 = _mm256_unpackhi_ps(z, orientation);
+        const __m256 l0 = _mm256_shuffle_ps(xy0, zo0, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 l1 = _mm256_shuffle_ps(xy0, zo0, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 l2 = _mm256_shuffle_ps(xy1, zo1, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 l3 = _mm256_shuffle_ps(xy1, zo1, _MM_SHUFFLE(3, 2, 3, 2));
+        lanes[0] = _mm256_castps256_ps128(l0);
+        lanes[1] = _mm256_castps256_ps128(l1);
+        lanes[2] = _mm256_castps256_ps128(l2);
+        lanes[3] = _mm256_castps256_ps128(l3);
+        lanes[4] = _mm256_extractf128_ps(l0, 1);
+        lanes[5] = _mm256_extractf128_ps(l1, 1);
+        lanes[6] = _mm256_extractf128_ps(l2, 1);
+        lanes[7] = _mm256_extractf128_ps(l3, 1);
+    }
+
+    // Adds the lanes to the sums of the three corners of their triangles, in the order of the triangles
+    template<bool kShared, typename Index>
+    inline void scatterBatch(const Index* pTriangles, const __m128 lanes[8], const TangentSums& sums)
+    {
+        float* const pTangents = sums.pTangents;
+        float* const pShared = sums.pShared;
+        const uint32_t firstVertex = sums.firstVertex;
+        const uint32_t privateBegin = sums.privateBegin;
+        const uint32_t privateCount = sums.privateCount;
+        auto add = [&](uint32_t vertex, __m128 tangent)
+        {
+            float* pSum = pTangents + (size_t)vertex * 4;
+            if (kShared && vertex - privateBegin >= privateCount) pSum = pShared + (size_t)(vertex - firstVertex - ((vertex >= privateBegin) ? privateCount : 0)) * 4;
+            _mm_storeu_ps(pSum, _mm_add_ps(_mm_loadu_ps(pSum), tangent));
+        };
+        auto addTriangle = [&](const Index* pTriangle, __m128 tangent)
+        {
+            add(pTriangle[0], tangent);
+            add(pTriangle[1], tangent);
+            add(pTriangle[2], tangent);
+        };
+        addTriangle(pTriangles, lanes[0]);
+        addTriangle(pTriangles + 3, lanes[1]);
+        addTriangle(pTriangles + 6, lanes[2]);
+        addTriangle(pTriangles + 9, lanes[3]);
+        addTriangle(pTriangles + 12, lanes[4]);
+        addTriangle(pTriangles + 15, lanes[5]);
+        addTriangle(pTriangles + 18, lanes[6]);
+        addTriangle(pTriangles + 21, lanes[7]);
+    }
+
+    // Computes a batch while the previous one is added, as in Geometry.cpp
+    template<bool kShared, typename Index>
+    uint32_t accumulateTangents(const TangentVertex* pVertices, const Index* pIndices, uint32_t beginTriangle, uint32_t endTriangle, const TangentSums& sums)
+    {
+        __m128 previous[8];
+        const Index* pPrevious = nullptr;
+        uint32_t first = beginTriangle;
+        for (; endTriangle - first >= 8; first += 8)
+        {
+            const Index* pTriangles = pIndices + (size_t)first * 3;
+            __m128 lanes[8];
+            computeBatch(pVertices, pTriangles, lanes);
+            if (pPrevious) scatterBatch<kShared>(pPrevious, previous, sums);
+            pPrevious = pTriangles;
+            for (int i = 0; i < 8; i++) previous[i] = lanes[i];
+        }
+        if (pPrevious) scatterBatch<kShared>(pPrevious, previous, sums);
+        return first;
+    }
+}
+
+uint32_t accumulateTangentsAvx2(const TangentVertex* pVertices, const uint16_t* pIndices, uint32_t beginTriangle, uint32_t endTriangle, const TangentSums& sums)
+{
+    if (sums.pShared) return accumulateTangents<true>(pVertices, pIndices, beginTriangle, endTriangle, sums);
+    return accumulateTangents<false>(pVertices, pIndices, beginTriangle, endTriangle, sums);
+}
+
+uint32_t accumulateTangentsAvx2(const TangentVertex* pVertices, const uint32_t* pIndices, uint32_t beginTriangle, uint32_t endTriangle, const TangentSums& sums)
+{
+    if (sums.pShared) return accumulateTangents<true>(pVertices, pIndices, beginTriangle, endTriangle, sums);
+    return accumulateTangents<false>(pVertices, pIndices, beginTriangle, endTriangle, sums);
+}
@@ -0,0 +1,63 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+
+/** The tangent kernels used by generateTangents().
+    This header doesn't include GLM, for the same reason as WideBvhKernels.h: the AVX2 kernel lives in its own translation unit which is
+    compiled with AVX2 enabled.
+*/
+
+// VertexPositionNormalTangentTexture without GLM. Geometry.cpp checks that the layouts match
+struct TangentVertex
+{
+    float position[3];
+    float normal[3];
+    float tangent[3];
+    float texCoord[2];
+};
+
+// Where the kernels add the tangents, 4 floats per vertex: the weighted tangent and the weighted orientation. The private vertices
+// [privateBegin, privateBegin + privateCount) are summed in pTangents, indexed by the vertex. The others go to pShared, which starts at
+// firstVertex and skips the private ones. pShared is null when every vertex is private
+struct TangentSums
+{
+    float* pTangents;
+    float* pShared;
+    uint32_t firstVertex;
+    uint32_t privateBegin;
+    uint32_t privateCount;
+};
+
+// Adds the tangents of triangles [beginTriangle, endTriangle) eight at a time, with the same math and in the same order as the SSE code in
+// Geometry.cpp. Returns the first triangle it left out, less than 8 from the end
+uint32_t accumulateTangentsAvx2(const TangentVertex* pVertices, const uint16_t* pIndices, uint32_t beginTriangle, uint32_t endTriangle, const TangentSums& sums);
+uint32_t accumulateTangentsAvx2(const TangentVertex* pVertices, const uint32_t* pIndices, uint32_t beginTriangle, uint32_t endTriangle, const TangentSums& sums);
+
+// Defined in WideBvh.cpp, see WideBvhKernels.h
+bool cpuSupportsAvx2();
@@ -0,0 +1,150 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "GpuProfiler.h"
+#include <algorithm>
+#include <assert.h>
+
+void GpuProfiler::init(ID3D12Device5Ptr pDevice, ID3D12CommandQueuePtr pQueue, Profiler* pProfiler)
+{
+    mpProfiler = pProfiler;
+
+    // Two timestamps per event
+    const uint32_t queryCount = kMaxEventsPerFrame * 2 * kDefaultSwapChainBuffers;
+    D3D12_QUERY_HEAP_DESC heapDesc = {};
+    heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    heapDesc.Count = queryCount;
+    d3d_call(pDevice->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&mpQueryHeap)));
+
+    D3D12_HEAP_PROPERTIES heapProps = {};
+    heapProps.Type = D3D12_HEAP_TYPE_READBACK;
+    D3D12_RESOURCE_DESC bufDesc = {};
+    bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    bufDesc.Width = queryCount * sizeof(uint64_t);
+    bufDesc.Height = 1;
+    bufDesc.DepthOrArraySize = 1;
+    bufDesc.MipLevels = 1;
+    bufDesc.SampleDesc.Count = 1;
+    bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    d3d_call(pDevice->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&mpReadback)));
+
+    addQueue(pQueue);
+}
+
+uint32_t GpuProfiler::addQueue(ID3D12CommandQueuePtr pQueue)
+{
+    Queue queue;
+    queue.pQueue = pQueue;
+    d3d_call(pQueue->GetTimestampFrequency(&queue.frequency));
+    calibrate(queue);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mQueues.push_back(queue);
+    return (uint32_t)mQueues.size() - 1;
+}
+
+void GpuProfiler::begin(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex, const char* name, uint32_t queue)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Frame& frame = mFrames[frameIndex];
+    if (frame.names.size() == kMaxEventsPerFrame) return;
+    uint32_t event = (uint32_t)frame.names.size();
+    frame.names.push_back(name);
+    frame.queues.push_back(queue);
+    frame.openEvents.push_back(std::make_pair(std::this_thread::get_id(), event));
+    pCmdList->EndQuery(mpQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, (frameIndex * kMaxEventsPerFrame + event) * 2);
+}
+
+void GpuProfiler::end(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex)
+{
+    // The matching begin() was dropped if the frame ran out of events. Events nest per thread, the threads record lists of their own
+    std::lock_guard<std::mutex> lock(mMutex);
+    Frame& frame = mFrames[frameIndex];
+    const std::thread::id thread = std::this_thread::get_id();
+    auto open = std::find_if(frame.openEvents.rbegin(), frame.openEvents.rend(), [&](const std::pair<std::thread::id, uint32_t>& e) { return e.first == thread; });
+    if (open == frame.openEvents.rend()) return;
+    uint32_t event = open->second;
+    frame.openEvents.erase(std::next(open).base());
+    pCmdList->EndQuery(mpQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, (frameIndex * kMaxEventsPerFrame + event) * 2 + 1);
+}
+
+void GpuProfiler::resolve(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex)
+{
+    Frame& frame = mFrames[frameIndex];
+    assert(frame.openEvents.empty());
+    if (frame.names.empty()) return;
+    uint32_t firstQuery = frameIndex * kMaxEventsPerFrame * 2;
+    pCmdList->ResolveQueryData(mpQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstQuery, (UINT)frame.names.size() * 2, mpReadback, firstQuery * sizeof(uint64_t));
+    frame.resolved = true;
+}
+
+void GpuProfiler::collect(uint32_t frameIndex)
+{
+    Frame& frame = mFrames[frameIndex];
+    if (frame.resolved)
+    {
+        for (Queue& queue : mQueues) calibrate(queue);
+        uint32_t firstQuery = frameIndex * kMaxEventsPerFrame * 2;
+        D3D12_RANGE readRange = { firstQuery * sizeof(uint64_t), (firstQuery + frame.names.size() * 2) * sizeof(uint64_t) };
+        uint64_t* pTimestamps = nullptr;
+        d3d_call(mpReadback->Map(0, &readRange, (void**)&pTimestamps));
+        for (uint32_t e = 0; e < (uint32_t)frame.names.size(); e++)
+        {
+            uint64_t begin = pTimestamps[firstQuery + e * 2];
+            uint64_t end = pTimestamps[firstQuery + e * 2 + 1];
+            const Queue& queue = mQueues[frame.queues[e]];
+            if (end >= begin) mpProfiler->addGpuEvent(frame.names[e], gpuToProfilerTime(queue, begin), gpuToProfilerTime(queue, end));
+        }
+        D3D12_RANGE writeRange = { 0, 0 };
+        mpReadback->Unmap(0, &writeRange);
+    }
+    frame.names.clear();
+    frame.queues.clear();
+    frame.openEvents.clear();
+    frame.resolved = false;
+}
+
+uint64_t GpuProfiler::gpuToProfilerTime(const Queue& queue, uint64_t gpuTimestamp) const
+{
+    // Timestamps from before the calibration are in the past of the profiler's clock
+    double seconds = (double(gpuTimestamp) - double(queue.calibrationGpuTime)) / double(queue.frequency);
+    double time = double(queue.calibrationProfilerTime) + seconds * 1e9;
+    return (time > 0) ? (uint64_t)time : 0;
+}
+
+void GpuProfiler::calibrate(Queue& queue)
+{
+    // The calibration gives the CPU time as a QPC value. Convert it to the profiler's clock through the current QPC value
+    LARGE_INTEGER qpcFrequency;
+    LARGE_INTEGER qpcNow;
+    QueryPerformanceFrequency(&qpcFrequency);
+    QueryPerformanceCounter(&qpcNow);
+    uint64_t profilerNow = mpProfiler->now();
+    uint64_t cpuTimestamp;
+    d3d_call(queue.pQueue->GetClockCalibration(&queue.calibrationGpuTime, &cpuTimestamp));
+    double offset = (double(cpuTimestamp) - double(qpcNow.QuadPart)) / double(qpcFrequency.QuadPart) * 1e9;
+    queue.calibrationProfilerTime = (uint64_t)std::max(0.0, double(profilerNow) + offset);
+}
@@ -0,0 +1,91 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "Framework.h"
+#include "Profiler.h"
+#include <mutex>
+#include <thread>
+
+MAKE_SMART_COM_PTR(ID3D12QueryHeap);
+
+/** GPU timestamps for the Profiler.
+    Every frame in flight has its own range of the query heap and of the readback buffer. begin() and end() write a timestamp into the
+    command list, resolve() copies the frame's timestamps to the readback buffer, and collect() reads them once the GPU is done with the
+    frame. Every queue has a timestamp frequency and a clock of its own, so every event remembers its queue, and its timestamps are mapped to
+    the profiler's clock with that queue's clock calibration, which is refreshed every collect().
+*/
+class GpuProfiler
+{
+public:
+    static const uint32_t kMaxEventsPerFrame = 64;
+
+    // pQueue is queue 0, the default of begin()
+    void init(ID3D12Device5Ptr pDevice, ID3D12CommandQueuePtr pQueue, Profiler* pProfiler);
+
+    // Returns the index that begin() takes for the lists executed on pQueue
+    uint32_t addQueue(ID3D12CommandQueuePtr pQueue);
+
+    // Events can be nested. name must outlive the profiler, use string literals. begin() and end() can be called from several threads, each
+    // with a list of its own. queue is the queue pCmdList is executed on
+    void begin(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex, const char* name, uint32_t queue = 0);
+    void end(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex);
+
+    // Call before the frame's last command list is closed, once the other threads are done recording. The other queues must be done with the
+    // frame's events before the list executes
+    void resolve(ID3D12GraphicsCommandList4Ptr pCmdList, uint32_t frameIndex);
+
+    // Call once the GPU finished the last frame that used frameIndex, before recording into it again. Adds the events to the Profiler
+    void collect(uint32_t frameIndex);
+
+private:
+    struct Frame
+    {
+        std::vector<const char*> names;
+        std::vector<uint32_t> queues;
+        std::vector<std::pair<std::thread::id, uint32_t>> openEvents;
+        bool resolved = false;
+    };
+
+    struct Queue
+    {
+        ID3D12CommandQueuePtr pQueue;
+        uint64_t frequency = 0;
+        uint64_t calibrationGpuTime = 0;
+        uint64_t calibrationProfilerTime = 0;
+    };
+
+    uint64_t gpuToProfilerTime(const Queue& queue, uint64_t gpuTimestamp) const;
+    void calibrate(Queue& queue);
+
+    std::mutex mMutex;
+    Profiler* mpProfiler = nullptr;
+    std::vector<Queue> mQueues;
+    ID3D12QueryHeapPtr mpQueryHeap;
+    ID3D12ResourcePtr mpReadback;
+    Frame mFrames[kDefaultSwapChainBuffers];
+};
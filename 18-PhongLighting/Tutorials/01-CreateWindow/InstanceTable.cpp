@@ -0,0 +1,182 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "InstanceTable.h"
+#include <string.h>
+
+const float InstanceTable::kDefaultRebuildThreshold = 1.5f;
+
+namespace
+{
+    // GLM is column major, the INSTANCE_DESC is row major
+    void writeTransform(RaytracingInstanceDesc& desc, const glm::mat4& transform)
+    {
+        for (uint32_t r = 0; r < 3; r++)
+        {
+            for (uint32_t c = 0; c < 4; c++) desc.transform[r][c] = transform[c][r];
+        }
+    }
+}
+
+void InstanceTable::setBlas(uint32_t blasIndex, uint64_t gpuAddress, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    if (blasIndex >= mBlas.size()) mBlas.resize(blasIndex + 1);
+    mBlas[blasIndex].gpuAddress = gpuAddress;
+    mBlas[blasIndex].bounds.boundsMin = boundsMin;
+    mBlas[blasIndex].bounds.boundsMax = boundsMax;
+
+    // The instances using it point to a new BLAS, so the TLAS needs a full build
+    for (uint32_t i = 0; i < getInstanceCount(); i++)
+    {
+        if (mBlasIndex[i] != blasIndex) continue;
+        mDescs[i].accelerationStructure = gpuAddress;
+        updateWorldBounds(i);
+        markDirty(i);
+    }
+    mStructureChanged = true;
+}
+
+uint32_t InstanceTable::addInstance(uint32_t blasIndex, const glm::mat4& transform, uint32_t instanceID, uint32_t instanceContributionToHitGroupIndex, uint32_t mask, uint32_t flags)
+{
+    uint32_t index = getInstanceCount();
+    RaytracingInstanceDesc desc = {};
+    desc.instanceID = instanceID;
+    desc.instanceMask = mask;
+    desc.instanceContributionToHitGroupIndex = instanceContributionToHitGroupIndex;
+    desc.flags = flags;
+    desc.accelerationStructure = mBlas[blasIndex].gpuAddress;
+    writeTransform(desc, transform);
+    mDescs.push_back(desc);
+    mTransforms.push_back(transform);
+    mBlasIndex.push_back(blasIndex);
+    mWorldBounds.emplace_back();
+    mDirty.push_back(0);
+
+    updateWorldBounds(index);
+    markDirty(index);
+    mStructureChanged = true;
+    return index;
+}
+
+void InstanceTable::setTransform(uint32_t instanceIndex, const glm::mat4& transform)
+{
+    if (memcmp(&mTransforms[instanceIndex], &transform, sizeof(transform)) == 0) return;
+
+    mTransforms[instanceIndex] = transform;
+    writeTransform(mDescs[instanceIndex], transform);
+    updateWorldBounds(instanceIndex);
+    markDirty(instanceIndex);
+}
+
+void InstanceTable::setInstanceContributionToHitGroupIndex(uint32_t instanceIndex, uint32_t instanceContributionToHitGroupIndex)
+{
+    if (mDescs[instanceIndex].instanceContributionToHitGroupIndex == instanceContributionToHitGroupIndex) return;
+    mDescs[instanceIndex].instanceContributionToHitGroupIndex = instanceContributionToHitGroupIndex;
+    markDirty(instanceIndex);
+    mStructureChanged = true;
+}
+
+void InstanceTable::markDirty(uint32_t instanceIndex)
+{
+    if (mDirty[instanceIndex]) return;
+    mDirty[instanceIndex] = 1;
+    mDirtyList.push_back(instanceIndex);
+}
+
+void InstanceTable::markAllDirty()
+{
+    for (uint32_t i = 0; i < getInstanceCount(); i++) markDirty(i);
+}
+
+void InstanceTable::updateWorldBounds(uint32_t instanceIndex)
+{
+    // Transform the box by projecting it on each of the world axes (Arvo, "Transforming Axis-Aligned Bounding Boxes")
+    const glm::mat4& m = mTransforms[instanceIndex];
+    const InstanceBounds& local = mBlas[mBlasIndex[instanceIndex]].bounds;
+    InstanceBounds& world = mWorldBounds[instanceIndex];
+    world.boundsMin = world.boundsMax = glm::vec3(m[3]);
+    for (int c = 0; c < 3; c++)
+    {
+        glm::vec3 a = glm::vec3(m[c]) * local.boundsMin[c];
+        glm::vec3 b = glm::vec3(m[c]) * local.boundsMax[c];
+        world.boundsMin += glm::min(a, b);
+        world.boundsMax += glm::max(a, b);
+    }
+}
+
+TlasBuildMode InstanceTable::chooseBuildMode()
+{
+    if (mStructureChanged || mModel.getInstanceCount() != getInstanceCount())
+    {
+        mModel.build(mWorldBounds);
+        mStructureChanged = false;
+        return TlasBuildMode::Build;
+    }
+
+    if (mDirtyList.empty()) return TlasBuildMode::None;
+
+    mModel.refit(mWorldBounds);
+    if (mModel.getDegradation() > mRebuildThreshold)
+    {
+        mModel.build(mWorldBounds);
+        return TlasBuildMode::Build;
+    }
+    return TlasBuildMode::Refit;
+}
+
+uint32_t InstanceTable::flush(RaytracingInstanceDesc* pMappedDescs, uint64_t& bufferVersion)
+{
+    // The dirty records become a new version
+    if (mDirtyList.empty() == false)
+    {
+        for (uint32_t i : mDirtyList) mDirty[i] = 0;
+        mHistory.push_back(std::move(mDirtyList));
+        mDirtyList.clear();
+        if (mHistory.size() > kMaxHistory) mHistory.pop_front();
+        mVersion++;
+    }
+
+    uint32_t written = 0;
+    const uint64_t missedVersions = mVersion - bufferVersion;
+    if (bufferVersion == 0 || missedVersions > mHistory.size())
+    {
+        // A new buffer, or one that missed versions we no longer remember
+        if (mDescs.empty() == false) memcpy(pMappedDescs, mDescs.data(), sizeof(RaytracingInstanceDesc) * mDescs.size());
+        written = getInstanceCount();
+    }
+    else
+    {
+        // A record that changed in several versions is written more than once, that's cheaper than merging the lists
+        for (size_t h = mHistory.size() - (size_t)missedVersions; h < mHistory.size(); h++)
+        {
+            for (uint32_t i : mHistory[h]) pMappedDescs[i] = mDescs[i];
+            written += (uint32_t)mHistory[h].size();
+        }
+    }
+    bufferVersion = mVersion;
+    return written;
+}
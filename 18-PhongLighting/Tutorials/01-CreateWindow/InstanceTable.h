@@ -0,0 +1,116 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "TlasModel.h"
+#include <deque>
+
+// Same layout as D3D12_RAYTRACING_INSTANCE_DESC, so the table doesn't need the D3D12 headers
+struct RaytracingInstanceDesc
+{
+    float transform[3][4];      // Row-major 3x4
+    uint32_t instanceID : 24;
+    uint32_t instanceMask : 8;
+    uint32_t instanceContributionToHitGroupIndex : 24;
+    uint32_t flags : 8;
+    uint64_t accelerationStructure;
+};
+static_assert(sizeof(RaytracingInstanceDesc) == 64, "RaytracingInstanceDesc must match D3D12_RAYTRACING_INSTANCE_DESC");
+
+enum class TlasBuildMode
+{
+    None,       // Nothing changed, the TLAS from the last frame is still valid
+    Refit,      // PERFORM_UPDATE
+    Build,      // Full rebuild
+};
+
+/** The instances of the top-level acceleration structure.
+    Every instance tracks whether it changed since the last flush(), so only the modified records get written to the instance buffer. Instance
+    buffers are expected to stay mapped. With one buffer per frame in flight, each buffer keeps the version it was last flushed at and gets the
+    changes of every version since. The table also keeps a TlasModel up to date and uses it to decide whether the TLAS can be refit or has degraded
+    enough that a full build is cheaper to trace.
+*/
+class InstanceTable
+{
+public:
+    // A refit is used as long as the SAH cost stays below this multiple of the cost right after the last build
+    static const float kDefaultRebuildThreshold;
+
+    // Register a BLAS. The bounds are in object space
+    void setBlas(uint32_t blasIndex, uint64_t gpuAddress, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    // Returns the instance index. Adding an instance forces a full build
+    uint32_t addInstance(uint32_t blasIndex, const glm::mat4& transform, uint32_t instanceID, uint32_t instanceContributionToHitGroupIndex, uint32_t mask = 0xFF, uint32_t flags = 0);
+
+    // The matrix is column-major (GLM). The instance is only marked dirty if the transform actually changed
+    void setTransform(uint32_t instanceIndex, const glm::mat4& transform);
+
+    // Forces a full build if the value changed
+    void setInstanceContributionToHitGroupIndex(uint32_t instanceIndex, uint32_t instanceContributionToHitGroupIndex);
+
+    // Mark every record dirty. New instance buffers don't need this, flush() writes every record into a buffer with version 0
+    void markAllDirty();
+
+    // Refit the TLAS model with the dirty instances and decide how to update the TLAS. Call this once per frame, before flush()
+    TlasBuildMode chooseBuildMode();
+
+    // Clear the dirty flags and write every record that changed since bufferVersion to the mapped instance buffer. Returns the number of records written
+    uint32_t flush(RaytracingInstanceDesc* pMappedDescs, uint64_t& bufferVersion);
+
+    void setRebuildThreshold(float threshold) { mRebuildThreshold = threshold; }
+    uint32_t getInstanceCount() const { return (uint32_t)mDescs.size(); }
+    uint32_t getDirtyCount() const { return (uint32_t)mDirtyList.size(); }
+    uint64_t getVersion() const { return mVersion; }
+    const RaytracingInstanceDesc& getDesc(uint32_t instanceIndex) const { return mDescs[instanceIndex]; }
+    const InstanceBounds& getWorldBounds(uint32_t instanceIndex) const { return mWorldBounds[instanceIndex]; }
+    const TlasModel& getModel() const { return mModel; }
+
+private:
+    struct Blas
+    {
+        uint64_t gpuAddress = 0;
+        InstanceBounds bounds;
+    };
+
+    void markDirty(uint32_t instanceIndex);
+    void updateWorldBounds(uint32_t instanceIndex);
+
+    std::vector<Blas> mBlas;
+    std::vector<RaytracingInstanceDesc> mDescs;
+    std::vector<glm::mat4> mTransforms;
+    std::vector<uint32_t> mBlasIndex;
+    std::vector<InstanceBounds> mWorldBounds;
+    std::vector<uint8_t> mDirty;
+    std::vector<uint32_t> mDirtyList;
+    // The dirty lists of the last versions, oldest first. A buffer older than that gets every record
+    static const uint32_t kMaxHistory = 8;
+    std::deque<std::vector<uint32_t>> mHistory;
+    uint64_t mVersion = 0;
+    TlasModel mModel;
+    bool mStructureChanged = true;
+    float mRebuildThreshold = kDefaultRebuildThreshold;
+};
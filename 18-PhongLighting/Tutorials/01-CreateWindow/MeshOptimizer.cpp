@@ -0,0 +1,331 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "MeshOptimizer.h"
+#include <string.h>
+
+namespace
+{
+    const uint32_t kNoVertex = ~0u;
+
+    // The indices as 32-bit. A shape without indices is a triangle list of its vertices
+    std::vector<uint32_t> readIndices(const Shape& shape)
+    {
+        std::vector<uint32_t> indices;
+        if (shape.getIndexCount())
+        {
+            if (shape.indices32Bit()) return shape.indexData32;
+            indices.assign(shape.indexData.begin(), shape.indexData.end());
+        }
+        else
+        {
+            indices.resize(shape.vertexData.size());
+            for (uint32_t i = 0; i < (uint32_t)indices.size(); i++) indices[i] = i;
+        }
+        return indices;
+    }
+
+    // 16-bit indices if they can address every vertex, like createSphere()
+    void writeIndices(Shape& shape, std::vector<uint32_t>& indices)
+    {
+        if (shape.vertexData.size() <= 0x10000)
+        {
+            shape.indexData.assign(indices.begin(), indices.end());
+            shape.indexData32.clear();
+        }
+        else
+        {
+            shape.indexData.clear();
+            shape.indexData32.swap(indices);
+        }
+    }
+
+    uint32_t hashVertex(const VertexPositionNormalTangentTexture& vertex)
+    {
+        uint32_t words[sizeof(vertex) / 4];
+        memcpy(words, &vertex, sizeof(words));
+        uint32_t hash = 0;
+        for (uint32_t word : words) hash = (hash ^ word) * 0x9e3779b1u;
+        return hash ^ (hash >> 15);
+    }
+
+    // remap[i] is the index of the first vertex bit-identical to vertex i, counted among the unique ones. Returns the unique vertex count
+    uint32_t buildWeldRemap(const std::vector<VertexPositionNormalTangentTexture>& vertices, std::vector<uint32_t>& remap)
+    {
+        static_assert(sizeof(VertexPositionNormalTangentTexture) == 11 * sizeof(float), "The vertices are compared with memcmp(), they can't have padding");
+        const uint32_t vertexCount = (uint32_t)vertices.size();
+        remap.resize(vertexCount);
+
+        // Open addressing with linear probing, at most half full. The table holds the first vertex of every unique value
+        uint32_t tableSize = 16;
+        while (tableSize < vertexCount * 2) tableSize *= 2;
+        std::vector<uint32_t> table(tableSize, kNoVertex);
+        uint32_t uniqueCount = 0;
+        for (uint32_t i = 0; i < vertexCount; i++)
+        {
+            uint32_t slot = hashVertex(vertices[i]) & (tableSize - 1);
+            while (table[slot] != kNoVertex && memcmp(&vertices[table[slot]], &vertices[i], sizeof(vertices[i])))
+            {
+                slot = (slot + 1) & (tableSize - 1);
+            }
+            if (table[slot] == kNoVertex)
+            {
+                table[slot] = i;
+                remap[i] = uniqueCount++;
+            }
+            else
+            {
+                remap[i] = remap[table[slot]];
+            }
+        }
+        return uniqueCount;
+    }
+
+    // MeshStats::overfetch. Every vertex read brings in the cache lines it spans
+    float computeOverfetch(const std::vector<uint32_t>& indices, uint32_t referencedCount)
+    {
+        const uint64_t stride = sizeof(VertexPositionNormalTangentTexture);
+        const uint32_t lineCount = kFetchCacheSize / kFetchCacheLineSize;
+        std::vector<uint64_t> tags(lineCount, ~0ull);
+        uint64_t fetchedLines = 0;
+        for (uint32_t index : indices)
+        {
+            const uint64_t first = index * stride / kFetchCacheLineSize;
+            const uint64_t last = (index * stride + stride - 1) / kFetchCacheLineSize;
+            for (uint64_t line = first; line <= last; line++)
+            {
+                uint64_t& tag = tags[line % lineCount];
+                if (tag != line)
+                {
+                    tag = line;
+                    fetchedLines++;
+                }
+            }
+        }
+        return float(double(fetchedLines * kFetchCacheLineSize) / double(referencedCount * stride));
+    }
+
+    // The same without the rest of analyzeMesh(), for optimizeMesh() to compare orders
+    float computeOverfetch(const Shape& shape)
+    {
+        const std::vector<uint32_t> indices = readIndices(shape);
+        std::vector<uint8_t> referenced(shape.vertexData.size(), 0);
+        uint32_t referencedCount = 0;
+        for (uint32_t index : indices)
+        {
+            if (referenced[index]) continue;
+            referenced[index] = 1;
+            referencedCount++;
+        }
+        return referencedCount ? computeOverfetch(indices, referencedCount) : 0;
+    }
+}
+
+MeshStats analyzeMesh(const Shape& shape, uint32_t cacheSize)
+{
+    MeshStats stats;
+    const std::vector<uint32_t> indices = readIndices(shape);
+    stats.vertexCount = (uint32_t)shape.vertexData.size();
+    stats.triangleCount = (uint32_t)indices.size() / 3;
+    if (stats.vertexCount == 0 || stats.triangleCount == 0) return stats;
+
+    std::vector<uint32_t> remap;
+    stats.uniqueVertexCount = buildWeldRemap(shape.vertexData, remap);
+    stats.uniqueVertexRatio = float(stats.uniqueVertexCount) / stats.vertexCount;
+
+    // FIFO cache. A vertex is in it while fewer than cacheSize vertices were added after it
+    std::vector<uint32_t> cacheTime(stats.vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    uint32_t misses = 0;
+    uint32_t referencedCount = 0;
+    for (uint32_t index : indices)
+    {
+        if (cacheTime[index] == 0) referencedCount++;
+        if (time - cacheTime[index] > cacheSize)
+        {
+            cacheTime[index] = time++;
+            misses++;
+        }
+    }
+    stats.acmr = float(misses) / stats.triangleCount;
+    stats.atvr = float(misses) / referencedCount;
+    stats.overfetch = computeOverfetch(indices, referencedCount);
+    return stats;
+}
+
+uint32_t weldVertices(Shape& shape)
+{
+    std::vector<uint32_t> indices = readIndices(shape);
+    std::vector<uint32_t> remap;
+    const uint32_t vertexCount = (uint32_t)shape.vertexData.size();
+    const uint32_t uniqueCount = buildWeldRemap(shape.vertexData, remap);
+
+    // The remap is increasing in the first occurrence, so the unique vertices can be compacted in place
+    for (uint32_t i = 0; i < vertexCount; i++) shape.vertexData[remap[i]] = shape.vertexData[i];
+    shape.vertexData.resize(uniqueCount);
+    for (uint32_t& index : indices) index = remap[index];
+    writeIndices(shape, indices);
+    return vertexCount - uniqueCount;
+}
+
+void optimizeVertexCache(Shape& shape, uint32_t cacheSize, uint32_t fetchWindow)
+{
+    const std::vector<uint32_t> indices = readIndices(shape);
+    const uint32_t vertexCount = (uint32_t)shape.vertexData.size();
+    const uint32_t triangleCount = (uint32_t)indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // The triangles of every vertex, and how many of them are still to be emitted
+    std::vector<uint32_t> liveCount(vertexCount, 0);
+    for (uint32_t index : indices) liveCount[index]++;
+    std::vector<uint32_t> firstAdjacency(vertexCount + 1, 0);
+    for (uint32_t v = 0; v < vertexCount; v++) firstAdjacency[v + 1] = firstAdjacency[v] + liveCount[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> cursor(firstAdjacency.begin(), firstAdjacency.end() - 1);
+        for (uint32_t i = 0; i < (uint32_t)indices.size(); i++) adjacency[cursor[indices[i]]++] = i / 3;
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    deadEnd.reserve(indices.size());
+    output.reserve(indices.size());
+    uint32_t time = cacheSize + 1;
+    uint32_t nextVertex = 0;
+
+    // The vertices in the order the output first uses them, which is the order optimizeVertexFetch() stores them in
+    std::vector<uint32_t> fetchOrder;
+    std::vector<uint8_t> fetched(vertexCount, 0);
+    fetchOrder.reserve(vertexCount);
+    size_t oldestLive = 0;
+
+    // Emit all the triangles around the fanning vertex, then continue from the vertex they used that stays longest in the cache
+    uint32_t fanning = 0;
+    while (fanning != kNoVertex)
+    {
+        candidates.clear();
+        for (uint32_t a = firstAdjacency[fanning]; a < firstAdjacency[fanning + 1]; a++)
+        {
+            const uint32_t triangle = adjacency[a];
+            if (emitted[triangle]) continue;
+            for (uint32_t corner = 0; corner < 3; corner++)
+            {
+                const uint32_t v = indices[triangle * 3 + corner];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveCount[v]--;
+                if (time - cacheTime[v] > cacheSize) cacheTime[v] = time++;
+                if (fetched[v] == 0)
+                {
+                    fetched[v] = 1;
+                    fetchOrder.push_back(v);
+                }
+            }
+            emitted[triangle] = 1;
+        }
+
+        // Prefer a vertex whose remaining triangles fit before it's evicted, and the oldest of those
+        fanning = kNoVertex;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates)
+        {
+            if (liveCount[v] == 0) continue;
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveCount[v] <= cacheSize) priority = time - cacheTime[v];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanning = v;
+            }
+        }
+
+        // Unless the oldest vertex with triangles left is about to leave the fetch window. Finish it while what it shares is still fetched
+        while (oldestLive < fetchOrder.size() && liveCount[fetchOrder[oldestLive]] == 0) oldestLive++;
+        if (fetchWindow && oldestLive < fetchOrder.size() && fetchOrder.size() - oldestLive > fetchWindow) fanning = fetchOrder[oldestLive];
+
+        // Dead end. The most recently used vertex with triangles left, or else the next one in the vertex buffer
+        while (fanning == kNoVertex && deadEnd.empty() == false)
+        {
+            const uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveCount[v]) fanning = v;
+        }
+        while (fanning == kNoVertex && nextVertex < vertexCount)
+        {
+            if (liveCount[nextVertex]) fanning = nextVertex;
+            else nextVertex++;
+        }
+    }
+
+    writeIndices(shape, output);
+}
+
+void optimizeVertexFetch(Shape& shape)
+{
+    std::vector<uint32_t> indices = readIndices(shape);
+    std::vector<uint32_t> remap(shape.vertexData.size(), kNoVertex);
+    uint32_t usedCount = 0;
+    for (uint32_t& index : indices)
+    {
+        if (remap[index] == kNoVertex) remap[index] = usedCount++;
+        index = remap[index];
+    }
+
+    std::vector<VertexPositionNormalTangentTexture> vertices(usedCount);
+    for (uint32_t i = 0; i < (uint32_t)remap.size(); i++)
+    {
+        if (remap[i] != kNoVertex) vertices[remap[i]] = shape.vertexData[i];
+    }
+    shape.vertexData.swap(vertices);
+    writeIndices(shape, indices);
+}
+
+void optimizeMesh(Shape& shape, MeshStats* pBefore, MeshStats* pAfter)
+{
+    if (pBefore) *pBefore = analyzeMesh(shape);
+    const float overfetch = computeOverfetch(shape);
+    weldVertices(shape);
+    const Shape welded = shape;
+    optimizeVertexCache(shape);
+    optimizeVertexFetch(shape);
+
+    // Tipsify sweeps bands of a few rows across the mesh. When a row is longer than the fetch cache holds, the next band reads the shared row
+    // again, which is worse than a mesh that already streams through its vertices. Trade some vertex cache hits for a bounded fetch window then
+    const float tipsifyOverfetch = computeOverfetch(shape);
+    if (tipsifyOverfetch > overfetch)
+    {
+        Shape windowed = welded;
+        optimizeVertexCache(windowed, kVertexCacheSize, kFetchWindow);
+        optimizeVertexFetch(windowed);
+        if (computeOverfetch(windowed) < tipsifyOverfetch) shape = std::move(windowed);
+    }
+    if (pAfter) *pAfter = analyzeMesh(shape);
+}
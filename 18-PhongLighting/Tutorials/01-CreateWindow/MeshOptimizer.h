@@ -0,0 +1,67 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "Geometry.h"
+
+// Reorders Shape index and vertex buffers for locality. Everything runs on the CPU, nothing in here depends on D3D12 or Win32.
+// The rasterizer and the any-hit/closest-hit shaders both fetch vertices through the index buffer, and the BLAS builder reads them the same
+// way, so triangles that share vertices should be close in the index buffer and vertices used together close in the vertex buffer
+
+// The post-transform cache the optimizer targets and analyzeMesh() simulates. 16 entries is a conservative size for current GPUs
+static const uint32_t kVertexCacheSize = 16;
+// The fetch cache analyzeMesh() simulates, direct-mapped
+static const uint32_t kFetchCacheLineSize = 64;
+static const uint32_t kFetchCacheSize = 16 * 1024;
+// The vertices optimizeVertexCache() keeps in reach when it bounds the fetch window. Less than the cache holds, direct-mapped lines conflict
+static const uint32_t kFetchWindow = kFetchCacheSize / sizeof(VertexPositionNormalTangentTexture) * 7 / 8;
+
+struct MeshStats
+{
+    uint32_t vertexCount = 0;
+    uint32_t triangleCount = 0;
+    uint32_t uniqueVertexCount = 0;     // Vertices that differ in at least one bit
+    float uniqueVertexRatio = 0;        // uniqueVertexCount / vertexCount, 1 when there is nothing to weld
+    float acmr = 0;                     // Average cache misses per triangle with a FIFO cache. 3 is the worst, around 0.5 the best for a closed mesh
+    float atvr = 0;                     // Average cache misses per referenced vertex, 1 is the best
+    float overfetch = 0;                // Bytes read into the fetch cache per byte of referenced vertex, 1 is the best
+};
+
+MeshStats analyzeMesh(const Shape& shape, uint32_t cacheSize = kVertexCacheSize);
+
+// Merges vertices that are bit-identical and rewrites the indices. A shape without indices gets them. Returns the number of vertices removed
+uint32_t weldVertices(Shape& shape);
+// Reorders the triangles with Tipsify (Sander, Nehab and Barczak 2007), which runs in linear time. The vertex buffer is untouched. With a
+// fetchWindow, a vertex that still has triangles once fetchWindow newer vertices were used is fanned next, so the vertices a triangle shares with
+// earlier ones stay in the fetch cache after optimizeVertexFetch(). It costs vertex cache hits, on a regular grid about 0.75 ACMR instead of 0.62
+void optimizeVertexCache(Shape& shape, uint32_t cacheSize = kVertexCacheSize, uint32_t fetchWindow = 0);
+// Reorders the vertices in the order the index buffer first uses them and drops the ones it doesn't use. Run it after optimizeVertexCache()
+void optimizeVertexFetch(Shape& shape);
+
+// weldVertices(), optimizeVertexCache() and optimizeVertexFetch(). When that fetches more than the input did, which happens to meshes that
+// already stream through their vertices, the vertex cache pass runs again with kFetchWindow. pBefore and pAfter are optional
+void optimizeMesh(Shape& shape, MeshStats* pBefore = nullptr, MeshStats* pAfter = nullptr);
@@ -0,0 +1,206 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include "PackedVertex.h"
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+    const uint32_t kOctahedralBits = 11;
+    const uint32_t kOctahedralMax = (1 << kOctahedralBits) - 1;
+    const uint32_t kTangentAngleBits = 9;
+    const uint32_t kTangentAngleSteps = 1 << kTangentAngleBits;
+    const uint32_t kHandednessBit = 1u << 31;
+
+    uint32_t packOctahedral(uint32_t x, uint32_t y)
+    {
+        return x | (y << kOctahedralBits);
+    }
+}
+
+uint32_t encodeOctahedral(const glm::vec3& normal)
+{
+    // Project on the octahedron, then fold the lower half over the upper one. A zero vector comes out as +z
+    const float l1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+    glm::vec2 p = (l1 > 0) ? glm::vec2(normal.x, normal.y) / l1 : glm::vec2(0);
+    if (normal.z < 0)
+    {
+        glm::vec2 folded = glm::vec2(1 - fabsf(p.y), 1 - fabsf(p.x));
+        p.x = (p.x >= 0) ? folded.x : -folded.x;
+        p.y = (p.y >= 0) ? folded.y : -folded.y;
+    }
+
+    // Rounding each axis to the nearest step isn't always the closest direction. Try the four neighbors and keep the best one
+    glm::vec2 scaled = (glm::clamp(p, -1.0f, 1.0f) * 0.5f + 0.5f) * float(kOctahedralMax);
+    uint32_t x0 = (uint32_t)floorf(scaled.x);
+    uint32_t y0 = (uint32_t)floorf(scaled.y);
+    uint32_t best = packOctahedral(x0, y0);
+    float bestDot = -2;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        uint32_t x = std::min(x0 + (i & 1), kOctahedralMax);
+        uint32_t y = std::min(y0 + (i >> 1), kOctahedralMax);
+        uint32_t candidate = packOctahedral(x, y);
+        float d = glm::dot(decodeOctahedral(candidate), normal);
+        if (d > bestDot)
+        {
+            bestDot = d;
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+glm::vec3 decodeOctahedral(uint32_t packed)
+{
+    glm::vec2 p = glm::vec2(float(packed & kOctahedralMax), float((packed >> kOctahedralBits) & kOctahedralMax)) * (2.0f / kOctahedralMax) - 1.0f;
+    glm::vec3 n(p.x, p.y, 1 - fabsf(p.x) - fabsf(p.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += (n.x >= 0) ? -t : t;
+    n.y += (n.y >= 0) ? -t : t;
+    return glm::normalize(n);
+}
+
+void orthonormalBasis(const glm::vec3& normal, glm::vec3& b1, glm::vec3& b2)
+{
+    // Duff et al., "Building an Orthonormal Basis, Revisited". The shader uses the same sign test, so -0 goes the same way on both sides
+    const float sign = (normal.z >= 0) ? 1.0f : -1.0f;
+    const float a = -1.0f / (sign + normal.z);
+    const float b = normal.x * normal.y * a;
+    b1 = glm::vec3(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+    b2 = glm::vec3(b, sign + normal.y * normal.y * a, -normal.y);
+}
+
+uint32_t encodeNormalTangent(const glm::vec3& normal, const glm::vec3& tangent, float handedness)
+{
+    // The angle is measured around the normal the shader will decode, not the exact one
+    uint32_t packed = encodeOctahedral(normal);
+    glm::vec3 b1, b2;
+    orthonormalBasis(decodeOctahedral(packed), b1, b2);
+    float angle = atan2f(glm::dot(tangent, b2), glm::dot(tangent, b1));
+    uint32_t step = (uint32_t)lroundf((angle + float(M_PI)) * (kTangentAngleSteps / (2 * float(M_PI)))) & (kTangentAngleSteps - 1);
+    packed |= step << (2 * kOctahedralBits);
+    if (handedness < 0) packed |= kHandednessBit;
+    return packed;
+}
+
+void decodeNormalTangent(uint32_t packed, glm::vec3& normal, glm::vec4& tangent)
+{
+    normal = decodeOctahedral(packed);
+    glm::vec3 b1, b2;
+    orthonormalBasis(normal, b1, b2);
+    float angle = float((packed >> (2 * kOctahedralBits)) & (kTangentAngleSteps - 1)) * (2 * float(M_PI) / kTangentAngleSteps) - float(M_PI);
+    tangent = glm::vec4(b1 * cosf(angle) + b2 * sinf(angle), (packed & kHandednessBit) ? -1.0f : 1.0f);
+}
+
+uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // Infinity and NaN. A NaN keeps a mantissa bit, so it doesn't turn into an infinity
+    if (exponent == 0xff) return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+    const int halfExponent = int(exponent) - 127 + 15;
+    if (halfExponent >= 0x1f) return uint16_t(sign | 0x7c00);
+    uint32_t shift;
+    uint32_t half;
+    if (halfExponent <= 0)
+    {
+        // A denormal half. Below half the smallest one, it rounds to zero
+        if (halfExponent < -10) return uint16_t(sign);
+        mantissa |= 0x800000;
+        shift = 14 - halfExponent;
+        half = mantissa >> shift;
+    }
+    else
+    {
+        shift = 13;
+        half = (uint32_t(halfExponent) << 10) | (mantissa >> shift);
+    }
+
+    // Round to nearest even. A carry out of the mantissa correctly bumps the exponent, up to infinity
+    const uint32_t rest = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) half++;
+    return uint16_t(sign | half);
+}
+
+float halfToFloat(uint16_t value)
+{
+    const uint32_t sign = uint32_t(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1f;
+    const uint32_t mantissa = value & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else if (exponent != 0)
+    {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    else
+    {
+        // Zero or a denormal, which is a normal float
+        float magnitude = float(mantissa) * (1.0f / (1 << 24));
+        memcpy(&bits, &magnitude, sizeof(bits));
+        bits |= sign;
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+void packVertices(const VertexPositionNormalTangentTexture* pVertices, uint32_t vertexCount, PackedVertex* pPacked, const glm::vec4* pTangents)
+{
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        const VertexPositionNormalTangentTexture& vertex = pVertices[i];
+        const glm::vec3 tangent = pTangents ? glm::vec3(pTangents[i]) : vertex.tangent;
+        const float handedness = pTangents ? pTangents[i].w : 1.0f;
+        pPacked[i].position = vertex.position;
+        pPacked[i].normalTangent = encodeNormalTangent(vertex.normal, tangent, handedness);
+        pPacked[i].texCoord = uint32_t(floatToHalf(vertex.texCoord.x)) | (uint32_t(floatToHalf(vertex.texCoord.y)) << 16);
+    }
+}
+
+VertexPositionNormalTangentTexture unpackVertex(const PackedVertex& packed, float* pHandedness)
+{
+    glm::vec3 normal;
+    glm::vec4 tangent;
+    decodeNormalTangent(packed.normalTangent, normal, tangent);
+    if (pHandedness) *pHandedness = tangent.w;
+    glm::vec2 texCoord(halfToFloat(uint16_t(packed.texCoord & 0xffff)), halfToFloat(uint16_t(packed.texCoord >> 16)));
+    return VertexPositionNormalTangentTexture(packed.position, normal, glm::vec3(tangent), texCoord);
+}
@@ -0,0 +1,66 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "Geometry.h"
+
+// The compact vertex format, and the CPU side of its encoding. Data/04-Shaders.hlsl has the matching decoder, compiled in with PACKED_VERTICES.
+// Nothing in here depends on D3D12 or Win32
+
+/** 20 bytes instead of the 44 of VertexPositionNormalTangentTexture.
+    The position stays float3 at offset 0, so the BLAS builds read it from the same buffer the hit shaders do.
+    The normal is octahedral-encoded with 11 bits per axis. The tangent is an angle in the plane of the decoded normal, measured from the
+    orthonormal basis orthonormalBasis() builds around it, with 9 bits, and the top bit is the handedness. Both normal and tangent are
+    within a fraction of a degree. The texture coordinates are half floats, so they keep 11 significant bits
+*/
+struct PackedVertex
+{
+    glm::vec3 position;
+    uint32_t normalTangent;     // Bits 0-10 and 11-21 the octahedral normal, 22-30 the tangent angle, 31 set for a handedness of -1
+    uint32_t texCoord;          // u in bits 0-15, v in bits 16-31
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must match SPackedVertex in 04-Shaders.hlsl");
+
+// tangent doesn't have to be orthogonal to normal, only the part in the plane of the normal is kept. A zero tangent decodes to the first
+// basis vector. handedness is the w of generateTangents(), only its sign is used
+uint32_t encodeNormalTangent(const glm::vec3& normal, const glm::vec3& tangent, float handedness);
+// The tangent is returned as in generateTangents(), with the handedness in w
+void decodeNormalTangent(uint32_t packed, glm::vec3& normal, glm::vec4& tangent);
+
+// Any unit vector to 11 bits per axis and back. The encoding picks the rounding that decodes closest to the input
+uint32_t encodeOctahedral(const glm::vec3& normal);
+glm::vec3 decodeOctahedral(uint32_t packed);
+// An orthonormal basis around a unit vector. It's continuous everywhere except where normal.z changes sign
+void orthonormalBasis(const glm::vec3& normal, glm::vec3& b1, glm::vec3& b2);
+
+// IEEE half precision, rounded to nearest even. Out-of-range values become infinities, like f32tof16() in HLSL
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
+
+// pTangents is optional. If it's there, its xyz replaces the tangent of the vertices and its w is the handedness, otherwise the handedness is +1
+void packVertices(const VertexPositionNormalTangentTexture* pVertices, uint32_t vertexCount, PackedVertex* pPacked, const glm::vec4* pTangents = nullptr);
+VertexPositionNormalTangentTexture unpackVertex(const PackedVertex& packed, float* pHandedness = nullptr);
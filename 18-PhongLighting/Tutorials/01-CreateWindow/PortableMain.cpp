@@ -0,0 +1,89 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+
+/** The entry point of the tools that don't need a GPU, on platforms without D3D12 like the Linux machines that render the CPU reference
+    images. Windows uses WinMain() in 01-CreateWindow.cpp, which takes the same options. Built from this directory with
+
+        g++ -std=c++14 -O2 -ffp-contract=off -mavx2 -mfma -I../../Framework -c WideBvhAvx2.cpp GeometryAvx2.cpp
+        g++ -std=c++14 -O2 -ffp-contract=off -pthread -I../../Framework -o CpuReference PortableMain.cpp Benchmarks.cpp BlasManager.cpp Bvh.cpp
+            CommandListPool.cpp CpuRaytracer.cpp DescriptorAllocator.cpp FramePacer.cpp Geometry.cpp InstanceTable.cpp MappedFile.cpp
+            MeshOptimizer.cpp PackedVertex.cpp Profiler.cpp QueueTimeline.cpp RenderGraph.cpp ResourceStateTracker.cpp RingAllocator.cpp
+            Scene.cpp ShaderCache.cpp ShaderTableBuilder.cpp TaskGraph.cpp TlasModel.cpp WideBvh.cpp ../../Framework/JobSystem.cpp WideBvhAvx2.o
+            GeometryAvx2.o
+
+    -ffp-contract=off keeps GCC and Clang from fusing multiply-adds, which MSVC doesn't do either, so the reference images are the same bits
+    as the ones of the Windows build. benchmarkCpuReference() checks it.
+*/
+#ifndef _WIN32
+#include "Benchmarks.h"
+#include "CpuRaytracer.h"
+#include "Scene.h"
+#include <fstream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    /** Command line:
+        -scene <file>           Load a scene file instead of the built-in tutorial scene
+        -cpuref [file]          Render the CPU reference image
+        -bench                  Run the CPU benchmarks
+        -writescene <file>      Write the built-in tutorial scene to a file, as a starting point for custom scenes
+    */
+    std::vector<std::string> args(argv + 1, argv + argc);
+    std::string sceneFile;
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "-scene" && i + 1 < args.size()) sceneFile = args[++i];
+    }
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "-cpuref")
+        {
+            std::string filename = (i + 1 < args.size() && args[i + 1][0] != '-') ? args[i + 1] : "CpuReference.ppm";
+            return renderCpuReference(sceneFile, filename, 1920, 1200);
+        }
+        if (args[i] == "-bench")
+        {
+            return runBenchmarks();
+        }
+        if (args[i] == "-writescene" && i + 1 < args.size())
+        {
+            std::vector<uint8_t> data = createTutorialScene();
+            std::ofstream file(args[i + 1], std::ios::binary);
+            file.write((const char*)data.data(), data.size());
+            return file.good() ? 0 : 1;
+        }
+    }
+
+    fprintf(stderr, "Usage: %s [-scene <file>] -cpuref [file] | -bench | -writescene <file>\n", argv[0]);
+    return 1;
+}
+#endif
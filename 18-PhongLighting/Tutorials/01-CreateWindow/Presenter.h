@@ -0,0 +1,66 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "Framework.h"
+
+/** The buffers the frames are presented from. SwapChainPresenter wraps the DXGI swap-chain of a window. OffscreenPresenter is used when
+    there is no window, its buffers are plain textures and present() only moves to the next one, so the frame loop is the same either way.
+    There are kDefaultSwapChainBuffers buffers, in the PRESENT state between frames.
+*/
+class Presenter
+{
+public:
+    virtual ~Presenter() {}
+    virtual ID3D12ResourcePtr getBuffer(uint32_t index) = 0;
+    virtual uint32_t getCurrentBufferIndex() = 0;
+    virtual void present() = 0;
+};
+
+class SwapChainPresenter : public Presenter
+{
+public:
+    SwapChainPresenter(IDXGIFactory4Ptr pFactory, HWND hwnd, uint32_t width, uint32_t height, DXGI_FORMAT format, ID3D12CommandQueuePtr pCommandQueue);
+    ID3D12ResourcePtr getBuffer(uint32_t index) override;
+    uint32_t getCurrentBufferIndex() override { return mpSwapChain->GetCurrentBackBufferIndex(); }
+    void present() override { mpSwapChain->Present(0, 0); }
+private:
+    IDXGISwapChain3Ptr mpSwapChain;
+};
+
+class OffscreenPresenter : public Presenter
+{
+public:
+    // The buffers are typeless, so they accept an sRGB RTV and a copy from a UNORM texture, the same as the swap-chain buffers
+    OffscreenPresenter(ID3D12Device5Ptr pDevice, uint32_t width, uint32_t height, DXGI_FORMAT typelessFormat);
+    ID3D12ResourcePtr getBuffer(uint32_t index) override { return mpBuffers[index]; }
+    uint32_t getCurrentBufferIndex() override { return mCurrentBuffer; }
+    void present() override { mCurrentBuffer = (mCurrentBuffer + 1) % kDefaultSwapChainBuffers; }
+private:
+    ID3D12ResourcePtr mpBuffers[kDefaultSwapChainBuffers];
+    uint32_t mCurrentBuffer = 0;
+};
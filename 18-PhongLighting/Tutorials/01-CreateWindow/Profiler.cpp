@@ -0,0 +1,205 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Profiler.h"
+#include <algorithm>
+#include <stdio.h>
+
+namespace
+{
+    std::atomic<uint32_t> gNextProfilerId(1);
+
+    // The buffer the thread used last. Ids are never reused, so a new profiler at the address of a deleted one doesn't pick up a stale buffer
+    struct ThreadBufferCache
+    {
+        uint32_t profilerId = 0;
+        void* pBuffer = nullptr;
+    };
+    thread_local ThreadBufferCache tCache;
+
+    double percentile(std::vector<double>& sorted, double p)
+    {
+        return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+    }
+
+    std::string escapeJson(const std::string& s)
+    {
+        std::string escaped;
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\') escaped += '\\';
+            if ((unsigned char)c >= 0x20) escaped += c;
+        }
+        return escaped;
+    }
+}
+
+Profiler::Profiler() : mEpoch(Clock::now()), mId(gNextProfilerId++)
+{
+}
+
+Profiler::ThreadBuffer* Profiler::getThreadBuffer()
+{
+    if (tCache.profilerId == mId) return (ThreadBuffer*)tCache.pBuffer;
+
+    // First event of this thread, or the thread used another profiler in between
+    std::lock_guard<std::mutex> lock(mThreadsMutex);
+    ThreadBuffer* pBuffer = nullptr;
+    for (const std::unique_ptr<ThreadBuffer>& pThread : mThreads)
+    {
+        if (pThread->owner == std::this_thread::get_id()) pBuffer = pThread.get();
+    }
+    if (pBuffer == nullptr)
+    {
+        mThreads.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer));
+        pBuffer = mThreads.back().get();
+        pBuffer->owner = std::this_thread::get_id();
+        pBuffer->threadId = (uint32_t)mThreads.size();
+    }
+    tCache.profilerId = mId;
+    tCache.pBuffer = pBuffer;
+    return pBuffer;
+}
+
+void Profiler::addCpuEvent(const char* name, uint64_t start, uint64_t end)
+{
+    ThreadBuffer* pBuffer = getThreadBuffer();
+    uint64_t write = pBuffer->writeIndex.load(std::memory_order_relaxed);
+    if (write - pBuffer->readIndex.load(std::memory_order_acquire) >= kThreadBufferSize)
+    {
+        pBuffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Event& event = pBuffer->events[write % kThreadBufferSize];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    // Publish the event to endFrame()
+    pBuffer->writeIndex.store(write + 1, std::memory_order_release);
+}
+
+void Profiler::addGpuEvent(const char* name, uint64_t start, uint64_t end)
+{
+    record(name, kGpuThreadId, true, start, end);
+}
+
+void Profiler::endFrame()
+{
+    std::lock_guard<std::mutex> lock(mThreadsMutex);
+    for (const std::unique_ptr<ThreadBuffer>& pThread : mThreads)
+    {
+        uint64_t read = pThread->readIndex.load(std::memory_order_relaxed);
+        uint64_t write = pThread->writeIndex.load(std::memory_order_acquire);
+        for (; read < write; read++)
+        {
+            const Event& event = pThread->events[read % kThreadBufferSize];
+            record(event.name, pThread->threadId, false, event.start, event.end);
+        }
+        // Hand the slots back to the thread
+        pThread->readIndex.store(write, std::memory_order_release);
+        mDroppedEvents += pThread->dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    for (std::pair<const std::string, History>& entry : mHistory)
+    {
+        History& history = entry.second;
+        if (history.inFrame == false) continue;
+        history.durations.push_back(history.frameTotal);
+        if (history.durations.size() > kStatsWindow) history.durations.pop_front();
+        history.frameTotal = 0;
+        history.inFrame = false;
+    }
+}
+
+void Profiler::record(const char* name, uint32_t threadId, bool gpu, uint64_t start, uint64_t end)
+{
+    History*& pHistory = mHistoryByName[name];
+    if (pHistory == nullptr) pHistory = &mHistory[name];
+    History& history = *pHistory;
+    history.gpu = gpu;
+    history.frameTotal += double(end - start) * 1e-6;
+    history.inFrame = true;
+
+    if (mTrace.size() < mTraceCapacity)
+    {
+        TraceEvent event = { name, threadId, start, end };
+        mTrace.push_back(event);
+    }
+}
+
+std::vector<Profiler::Stats> Profiler::getStats() const
+{
+    std::vector<Stats> stats;
+    for (const std::pair<const std::string, History>& entry : mHistory)
+    {
+        const History& history = entry.second;
+        if (history.durations.empty()) continue;
+        std::vector<double> sorted(history.durations.begin(), history.durations.end());
+        std::sort(sorted.begin(), sorted.end());
+
+        Stats s;
+        s.name = entry.first;
+        s.gpu = history.gpu;
+        s.count = (uint32_t)sorted.size();
+        for (double d : sorted) s.averageMs += d;
+        s.averageMs /= double(sorted.size());
+        s.p50Ms = percentile(sorted, 0.5);
+        s.p99Ms = percentile(sorted, 0.99);
+        stats.push_back(s);
+    }
+    return stats;
+}
+
+void Profiler::printStats() const
+{
+    printf("%-24s %4s %7s %10s %10s %10s\n", "Event", "", "Frames", "Avg ms", "p50 ms", "p99 ms");
+    for (const Stats& s : getStats())
+    {
+        printf("%-24s %4s %7u %10.3f %10.3f %10.3f\n", s.name.c_str(), s.gpu ? "GPU" : "CPU", s.count, s.averageMs, s.p50Ms, s.p99Ms);
+    }
+    if (mDroppedEvents) printf("%llu events were dropped, the thread buffers were full\n", (unsigned long long)mDroppedEvents);
+}
+
+bool Profiler::writeChromeTrace(const std::string& filename) const
+{
+    FILE* pFile = fopen(filename.c_str(), "w");
+    if (pFile == nullptr) return false;
+
+    // Complete events ("ph":"X") with the time in microseconds. The GPU gets a track of its own
+    fprintf(pFile, "{\"traceEvents\":[\n");
+    fprintf(pFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+    for (const TraceEvent& event : mTrace)
+    {
+        uint32_t tid = (event.threadId == kGpuThreadId) ? 0 : event.threadId;
+        fprintf(pFile, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", escapeJson(event.name).c_str(), tid,
+            double(event.start) * 1e-3, double(event.end - event.start) * 1e-3);
+    }
+    fprintf(pFile, "\n]}\n");
+    bool ok = ferror(pFile) == 0;
+    fclose(pFile);
+    return ok;
+}
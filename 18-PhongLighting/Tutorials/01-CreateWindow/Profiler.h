@@ -0,0 +1,150 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/** Frame-time instrumentation.
+    CPU events are recorded with Profiler::Scope. Every thread writes into a buffer of its own, which only that thread writes and only
+    endFrame() reads, so recording an event doesn't take a lock. A thread takes the lock once, the first time it records an event.
+    GPU events come from timestamp queries. They are added with addGpuEvent() once the frame they belong to completed.
+    endFrame() collects the events. Every event name keeps the durations of the last kStatsWindow frames for the p50/p99 stats, and the
+    events are kept for the Chrome trace (chrome://tracing or ui.perfetto.dev) until the trace capacity is reached.
+    It doesn't depend on D3D12, so it works the same in headless runs and in the benchmarks.
+*/
+class Profiler
+{
+public:
+    static const uint32_t kStatsWindow = 256;
+    static const uint32_t kThreadBufferSize = 4096;     // Events a thread can record between two endFrame() calls. More are dropped
+
+    // Times the scope. name must outlive the profiler, use string literals
+    class Scope
+    {
+    public:
+        Scope(Profiler& profiler, const char* name) : mProfiler(profiler), mName(name), mStart(profiler.now()) {}
+        ~Scope() { mProfiler.addCpuEvent(mName, mStart, mProfiler.now()); }
+    private:
+        Profiler& mProfiler;
+        const char* mName;
+        uint64_t mStart;
+    };
+
+    struct Stats
+    {
+        std::string name;
+        bool gpu = false;
+        uint32_t count = 0;     // The number of durations in the window
+        double averageMs = 0;
+        double p50Ms = 0;
+        double p99Ms = 0;
+    };
+
+    Profiler();
+
+    // Nanoseconds since the profiler was created
+    uint64_t now() const { return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - mEpoch).count(); }
+
+    void addCpuEvent(const char* name, uint64_t start, uint64_t end);
+    // start and end are on the CPU timeline, in nanoseconds since the profiler was created. Only call from the thread that calls endFrame()
+    void addGpuEvent(const char* name, uint64_t start, uint64_t end);
+
+    // Collect the events of all threads. An event that is recorded while endFrame() runs shows up in this frame or in the next one
+    void endFrame();
+
+    std::vector<Stats> getStats() const;
+    void printStats() const;
+
+    // The trace keeps the first capacity events, 0 disables it
+    void setTraceCapacity(size_t capacity) { mTraceCapacity = capacity; }
+    size_t getTraceEventCount() const { return mTrace.size(); }
+    uint64_t getDroppedEventCount() const { return mDroppedEvents; }
+    bool writeChromeTrace(const std::string& filename) const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Event
+    {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    // Single producer (the owning thread), single consumer (endFrame())
+    struct ThreadBuffer
+    {
+        std::thread::id owner;
+        uint32_t threadId = 0;     // Starts at 1, the trace uses 0 for the GPU
+        Event events[kThreadBufferSize];
+        std::atomic<uint64_t> writeIndex;
+        std::atomic<uint64_t> readIndex;
+        std::atomic<uint64_t> dropped;
+        ThreadBuffer() : writeIndex(0), readIndex(0), dropped(0) {}
+    };
+
+    struct TraceEvent
+    {
+        const char* name;
+        uint32_t threadId;      // kGpuThreadId for GPU events
+        uint64_t start;
+        uint64_t end;
+    };
+
+    struct History
+    {
+        bool gpu = false;
+        double frameTotal = 0;  // Events with the same name in one frame are summed
+        bool inFrame = false;
+        std::deque<double> durations;
+    };
+
+    static const uint32_t kGpuThreadId = ~0u;
+
+    ThreadBuffer* getThreadBuffer();
+    void record(const char* name, uint32_t threadId, bool gpu, uint64_t start, uint64_t end);
+
+    Clock::time_point mEpoch;
+    uint32_t mId;           // Tells the thread-local buffer cache which profiler a buffer belongs to
+    std::mutex mThreadsMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> mThreads;
+    std::map<std::string, History> mHistory;
+    std::unordered_map<const char*, History*> mHistoryByName;    // Saves a string compare per event. Equal names at different addresses share the History
+    std::vector<TraceEvent> mTrace;
+    size_t mTraceCapacity = 1 << 20;
+    uint64_t mDroppedEvents = 0;
+};
@@ -0,0 +1,129 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "QueueTimeline.h"
+#include <algorithm>
+#include <float.h>
+
+const double QueueTimeline::kNever = DBL_MAX;
+
+uint32_t QueueTimeline::addQueue()
+{
+    mQueues.push_back(Queue());
+    return (uint32_t)mQueues.size() - 1;
+}
+
+uint32_t QueueTimeline::addFence()
+{
+    mFences.push_back({ { 0, 0.0 } });
+    return (uint32_t)mFences.size() - 1;
+}
+
+uint32_t QueueTimeline::execute(uint32_t queue, double submitTime, double duration, uint32_t tag)
+{
+    mSpans.push_back({ queue, tag, duration, kNever, kNever });
+    mQueues[queue].commands.push_back({ CommandType::Execute, submitTime, (uint32_t)mSpans.size() - 1, 0 });
+    return (uint32_t)mSpans.size() - 1;
+}
+
+void QueueTimeline::signal(uint32_t queue, uint32_t fence, uint64_t value, double submitTime)
+{
+    mQueues[queue].commands.push_back({ CommandType::Signal, submitTime, fence, value });
+}
+
+void QueueTimeline::wait(uint32_t queue, uint32_t fence, uint64_t value, double submitTime)
+{
+    mQueues[queue].commands.push_back({ CommandType::Wait, submitTime, fence, value });
+}
+
+double QueueTimeline::findFenceTime(uint32_t fence, uint64_t value) const
+{
+    for (const Signal& signal : mFences[fence])
+    {
+        if (signal.value >= value) return signal.time;
+    }
+    return kNever;
+}
+
+void QueueTimeline::run()
+{
+    // Every pass runs each queue until it's done or waits for a fence another queue hasn't signaled yet
+    bool progress = true;
+    while (progress)
+    {
+        progress = false;
+        for (Queue& queue : mQueues)
+        {
+            for (; queue.next < queue.commands.size(); queue.next++)
+            {
+                const Command& command = queue.commands[queue.next];
+                double time = std::max(queue.time, command.submitTime);
+                if (command.type == CommandType::Execute)
+                {
+                    Span& span = mSpans[command.index];
+                    span.start = time;
+                    span.end = time + span.duration;
+                    time = span.end;
+                }
+                else if (command.type == CommandType::Signal)
+                {
+                    mFences[command.index].push_back({ command.value, time });
+                }
+                else
+                {
+                    const double fenceTime = findFenceTime(command.index, command.value);
+                    if (fenceTime == kNever) break;
+                    time = std::max(time, fenceTime);
+                }
+                queue.time = time;
+                progress = true;
+            }
+        }
+    }
+}
+
+double QueueTimeline::getFenceTime(uint32_t fence, uint64_t value)
+{
+    run();
+    return findFenceTime(fence, value);
+}
+
+const QueueTimeline::Span& QueueTimeline::getSpan(uint32_t span)
+{
+    run();
+    return mSpans[span];
+}
+
+bool QueueTimeline::isStalled()
+{
+    run();
+    for (const Queue& queue : mQueues)
+    {
+        if (queue.next < queue.commands.size()) return true;
+    }
+    return false;
+}
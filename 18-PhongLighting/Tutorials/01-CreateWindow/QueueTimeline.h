@@ -0,0 +1,103 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+/** A CPU model of GPU queues and the fences between them, to test how the work of several queues depends on each other.
+    Every queue runs its commands in the order they were submitted, like an ID3D12CommandQueue. execute() takes its duration once the queue
+    gets to it, signal() sets a fence and wait() stalls the queue until a fence reaches a value. Nothing starts before the CPU submitted it.
+    The queues run side by side at full speed, the model doesn't slow them down when they share the GPU. The queues are played lazily, the
+    getters run them as far as the commands submitted so far let them.
+*/
+class QueueTimeline
+{
+public:
+    static const double kNever;
+
+    struct Span
+    {
+        uint32_t queue;
+        uint32_t tag;
+        double duration;
+        double start;   // kNever until the queue got to it
+        double end;
+    };
+
+    uint32_t addQueue();
+    // The fence starts at 0. Signal values have to go up
+    uint32_t addFence();
+
+    // submitTime is the CPU time of the submission. execute() returns the span of the work
+    uint32_t execute(uint32_t queue, double submitTime, double duration, uint32_t tag);
+    void signal(uint32_t queue, uint32_t fence, uint64_t value, double submitTime);
+    void wait(uint32_t queue, uint32_t fence, uint64_t value, double submitTime);
+
+    // When the fence reached value, kNever if the commands submitted so far never get it there
+    double getFenceTime(uint32_t fence, uint64_t value);
+    const Span& getSpan(uint32_t span);
+    uint32_t getSpanCount() const { return (uint32_t)mSpans.size(); }
+    // A queue waits for a fence value nothing submitted signals
+    bool isStalled();
+
+private:
+    enum class CommandType
+    {
+        Execute,
+        Signal,
+        Wait,
+    };
+
+    struct Command
+    {
+        CommandType type;
+        double submitTime;
+        uint32_t index;         // The span of an Execute, the fence of a Signal or a Wait
+        uint64_t value;
+    };
+
+    struct Queue
+    {
+        std::vector<Command> commands;
+        uint32_t next = 0;
+        double time = 0;
+    };
+
+    struct Signal
+    {
+        uint64_t value;
+        double time;
+    };
+
+    void run();
+    double findFenceTime(uint32_t fence, uint64_t value) const;
+
+    std::vector<Queue> mQueues;
+    std::vector<std::vector<Signal>> mFences;      // The signals that ran, in order
+    std::vector<Span> mSpans;
+};
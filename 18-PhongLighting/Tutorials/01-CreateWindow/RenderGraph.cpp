@@ -0,0 +1,213 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "RenderGraph.h"
+#include <algorithm>
+
+const uint32_t RenderGraph::kInvalid;
+
+RenderGraph::ResourceId RenderGraph::addTransient(const char* name, uint64_t size, uint64_t alignment, uint32_t heap)
+{
+    Resource resource;
+    resource.name = name;
+    resource.transient = true;
+    resource.placement.heap = heap;
+    resource.placement.size = size;
+    resource.placement.alignment = std::max<uint64_t>(alignment, 1);
+    mResources.push_back(resource);
+    return (ResourceId)mResources.size() - 1;
+}
+
+RenderGraph::ResourceId RenderGraph::addImported(const char* name)
+{
+    Resource resource;
+    resource.name = name;
+    mResources.push_back(resource);
+    return (ResourceId)mResources.size() - 1;
+}
+
+RenderGraph::PassId RenderGraph::addPass(const char* name)
+{
+    Pass pass;
+    pass.name = name;
+    mPasses.push_back(pass);
+    return (PassId)mPasses.size() - 1;
+}
+
+void RenderGraph::read(PassId pass, ResourceId resource, uint32_t state)
+{
+    access(pass, resource, state, false);
+}
+
+void RenderGraph::write(PassId pass, ResourceId resource, uint32_t state)
+{
+    access(pass, resource, state, true);
+}
+
+void RenderGraph::access(PassId pass, ResourceId resource, uint32_t state, bool write)
+{
+    std::vector<Access>& accesses = mPasses[pass].accesses;
+    for (Access& a : accesses)
+    {
+        if (a.resource != resource) continue;
+        // The write decides the state. Two reads need both
+        if (write) a.state = state;
+        else if (a.write == false) a.state |= state;
+        a.read = a.read || (write == false);
+        a.write = a.write || write;
+        return;
+    }
+    accesses.push_back({ resource, state, write == false, write });
+}
+
+void RenderGraph::markOutput(ResourceId resource)
+{
+    mResources[resource].output = true;
+}
+
+void RenderGraph::compile()
+{
+    cull();
+
+    // 6.2.b The lifetimes, in positions of the passes that are left
+    for (Resource& resource : mResources)
+    {
+        resource.first = kInvalid;
+        resource.last = kInvalid;
+    }
+    for (uint32_t position = 0; position < (uint32_t)mOrder.size(); position++)
+    {
+        Pass& pass = mPasses[mOrder[position]];
+        pass.firstUses.clear();
+        for (const Access& a : pass.accesses)
+        {
+            Resource& resource = mResources[a.resource];
+            if (resource.first == kInvalid)
+            {
+                resource.first = position;
+                if (resource.transient) pass.firstUses.push_back(a.resource);
+            }
+            resource.last = position;
+            resource.finalState = a.state;
+        }
+    }
+
+    place();
+}
+
+void RenderGraph::cull()
+{
+    // 6.2.a From the last pass back. A pass is needed if it writes what a needed pass after it reads, or an output nothing writes after it.
+    // The pass overwrites what it writes, so the passes before it only need to write what it reads
+    std::vector<bool> needed(mResources.size());
+    for (uint32_t r = 0; r < (uint32_t)mResources.size(); r++) needed[r] = mResources[r].output;
+    std::vector<bool> live(mPasses.size());
+    for (uint32_t p = (uint32_t)mPasses.size(); p-- > 0;)
+    {
+        const Pass& pass = mPasses[p];
+        for (const Access& a : pass.accesses)
+        {
+            if (a.write && needed[a.resource]) live[p] = true;
+        }
+        if (live[p] == false) continue;
+        for (const Access& a : pass.accesses)
+        {
+            if (a.write) needed[a.resource] = false;
+            if (a.read) needed[a.resource] = true;
+        }
+    }
+
+    mOrder.clear();
+    for (uint32_t p = 0; p < (uint32_t)mPasses.size(); p++)
+    {
+        mPasses[p].position = live[p] ? (uint32_t)mOrder.size() : kInvalid;
+        if (live[p]) mOrder.push_back(p);
+    }
+}
+
+void RenderGraph::place()
+{
+    // 6.2.c Largest first, each at the lowest offset that doesn't overlap a transient in use at the same time. The heaps only hold the
+    // transients the passes that are left use
+    std::vector<ResourceId> transients;
+    uint32_t heapCount = 0;
+    mUnaliasedSize = 0;
+    for (ResourceId r = 0; r < (ResourceId)mResources.size(); r++)
+    {
+        Resource& resource = mResources[r];
+        resource.aliased = false;
+        if (resource.transient == false) continue;
+        heapCount = std::max(heapCount, resource.placement.heap + 1);
+        resource.placement.offset = 0;
+        if (resource.first == kInvalid) continue;
+        transients.push_back(r);
+        mUnaliasedSize += resource.placement.size;
+    }
+    std::stable_sort(transients.begin(), transients.end(), [this](ResourceId a, ResourceId b)
+    {
+        return mResources[a].placement.size > mResources[b].placement.size;
+    });
+
+    mHeapSizes.assign(heapCount, 0);
+    std::vector<ResourceId> placed;
+    for (ResourceId r : transients)
+    {
+        Resource& resource = mResources[r];
+        Placement& placement = resource.placement;
+        auto alignUp = [&](uint64_t offset) { return (offset + placement.alignment - 1) / placement.alignment * placement.alignment; };
+        auto conflicts = [&](ResourceId other, uint64_t offset)
+        {
+            const Resource& o = mResources[other];
+            const bool sameTime = o.first <= resource.last && resource.first <= o.last;
+            const bool sameMemory = o.placement.offset < offset + placement.size && offset < o.placement.offset + o.placement.size;
+            return o.placement.heap == placement.heap && sameTime && sameMemory;
+        };
+
+        // The candidates are the start of the heap and the ends of the transients placed so far
+        uint64_t best = UINT64_MAX;
+        for (size_t i = 0; i <= placed.size(); i++)
+        {
+            const uint64_t offset = alignUp((i == placed.size()) ? 0 : mResources[placed[i]].placement.offset + mResources[placed[i]].placement.size);
+            if (offset >= best) continue;
+            if (std::none_of(placed.begin(), placed.end(), [&](ResourceId other) { return conflicts(other, offset); })) best = offset;
+        }
+        placement.offset = best;
+        placed.push_back(r);
+        mHeapSizes[placement.heap] = std::max(mHeapSizes[placement.heap], placement.offset + placement.size);
+    }
+
+    // The memory of a transient held another one earlier in the frame, or later in the previous frame that used the heap
+    for (ResourceId a : placed)
+    {
+        for (ResourceId b : placed)
+        {
+            const Placement& pa = mResources[a].placement;
+            const Placement& pb = mResources[b].placement;
+            if (a != b && pa.heap == pb.heap && pa.offset < pb.offset + pb.size && pb.offset < pa.offset + pa.size) mResources[a].aliased = true;
+        }
+    }
+}
@@ -0,0 +1,133 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+/** The passes of a frame and the resources they read and write, compiled once and recorded every frame.
+    A pass can only access resources that were added before it and passes run in the order they were added, so a pass reads what the passes
+    before it wrote. compile() culls the passes nothing needs, finds when every transient resource is in use and places the transients in
+    heaps, the ones that are never in use at the same time in the same memory. Every pass lists the states its accesses need, the barriers
+    come from a ResourceStateTracker, and the transients it starts using, which need an aliasing barrier if they share their memory.
+    It doesn't depend on D3D12, so the benchmarks compile graphs without a device. States are D3D12_RESOURCE_STATES values.
+*/
+class RenderGraph
+{
+public:
+    typedef uint32_t PassId;
+    typedef uint32_t ResourceId;
+    static const uint32_t kInvalid = 0xffffffff;
+
+    struct Access
+    {
+        ResourceId resource;
+        uint32_t state;
+        bool read;
+        bool write;
+    };
+
+    struct Placement
+    {
+        uint32_t heap = 0;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint64_t alignment = 0;
+    };
+
+    // Memory the graph places, size and alignment as GetResourceAllocationInfo() returns them. The transients of a heap alias each other.
+    // name must outlive the graph, use string literals
+    ResourceId addTransient(const char* name, uint64_t size, uint64_t alignment, uint32_t heap = 0);
+    // A resource that lives outside the graph, like the back-buffer
+    ResourceId addImported(const char* name);
+    PassId addPass(const char* name);
+    // One access per resource and pass. A pass that reads and writes a resource needs it in the state of the write
+    void read(PassId pass, ResourceId resource, uint32_t state);
+    void write(PassId pass, ResourceId resource, uint32_t state);
+    // The writes to it are kept, and the passes they need
+    void markOutput(ResourceId resource);
+
+    void compile();
+
+    // After compile()
+    const std::vector<PassId>& getPassOrder() const { return mOrder; }
+    bool isCulled(PassId pass) const { return mPasses[pass].position == kInvalid; }
+    const std::vector<Access>& getAccesses(PassId pass) const { return mPasses[pass].accesses; }
+    // The transients whose lifetime starts with the pass
+    const std::vector<ResourceId>& getFirstUses(PassId pass) const { return mPasses[pass].firstUses; }
+    bool isTransient(ResourceId resource) const { return mResources[resource].transient; }
+    // Used by a pass that isn't culled
+    bool isUsed(ResourceId resource) const { return mResources[resource].first != kInvalid; }
+    // Shares memory with another transient, so its first pass needs an aliasing barrier
+    bool isAliased(ResourceId resource) const { return mResources[resource].aliased; }
+    // The state the last pass leaves it in. A transient starts every frame in it
+    uint32_t getFinalState(ResourceId resource) const { return mResources[resource].finalState; }
+    // Positions in getPassOrder()
+    uint32_t getFirstPosition(ResourceId resource) const { return mResources[resource].first; }
+    uint32_t getLastPosition(ResourceId resource) const { return mResources[resource].last; }
+    const Placement& getPlacement(ResourceId resource) const { return mResources[resource].placement; }
+    uint32_t getHeapCount() const { return (uint32_t)mHeapSizes.size(); }
+    uint64_t getHeapSize(uint32_t heap) const { return mHeapSizes[heap]; }
+    // The memory the used transients would need without aliasing
+    uint64_t getUnaliasedSize() const { return mUnaliasedSize; }
+
+    uint32_t getPassCount() const { return (uint32_t)mPasses.size(); }
+    uint32_t getResourceCount() const { return (uint32_t)mResources.size(); }
+    const char* getPassName(PassId pass) const { return mPasses[pass].name; }
+    const char* getResourceName(ResourceId resource) const { return mResources[resource].name; }
+
+private:
+    struct Pass
+    {
+        const char* name;
+        std::vector<Access> accesses;
+        std::vector<ResourceId> firstUses;
+        uint32_t position = kInvalid;
+    };
+
+    struct Resource
+    {
+        const char* name;
+        bool transient = false;
+        bool output = false;
+        bool aliased = false;
+        uint32_t first = kInvalid;
+        uint32_t last = kInvalid;
+        uint32_t finalState = 0;
+        Placement placement;
+    };
+
+    void access(PassId pass, ResourceId resource, uint32_t state, bool write);
+    void cull();
+    void place();
+
+    std::vector<Pass> mPasses;
+    std::vector<Resource> mResources;
+    std::vector<PassId> mOrder;
+    std::vector<uint64_t> mHeapSizes;
+    uint64_t mUnaliasedSize = 0;
+};
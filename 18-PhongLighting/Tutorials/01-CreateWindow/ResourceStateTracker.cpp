@@ -0,0 +1,294 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "ResourceStateTracker.h"
+#include <algorithm>
+
+namespace
+{
+    // Replaces the transitions of a resource by one for all its subresources when they all go from the same state to the same state
+    void mergeSubresources(std::vector<ResourceBarrier>& barriers, size_t first, uint64_t resource, uint32_t subresourceCount)
+    {
+        uint32_t count = 0;
+        const ResourceBarrier* pFirst = nullptr;
+        for (size_t i = first; i < barriers.size(); i++)
+        {
+            const ResourceBarrier& b = barriers[i];
+            if (b.type != ResourceBarrier::Type::Transition || b.resource != resource) continue;
+            if (pFirst && (b.stateBefore != pFirst->stateBefore || b.stateAfter != pFirst->stateAfter)) return;
+            if (pFirst == nullptr) pFirst = &b;
+            count++;
+        }
+        if (count != subresourceCount) return;
+
+        ResourceBarrier merged = *pFirst;
+        merged.subresource = ResourceStateTracker::kAllSubresources;
+        barriers.erase(std::remove_if(barriers.begin() + first, barriers.end(), [&](const ResourceBarrier& b)
+        {
+            return b.type == ResourceBarrier::Type::Transition && b.resource == resource;
+        }), barriers.end());
+        barriers.push_back(merged);
+    }
+
+    void addUav(std::vector<ResourceBarrier>& barriers, size_t first, uint64_t resource)
+    {
+        for (size_t i = first; i < barriers.size(); i++)
+        {
+            const ResourceBarrier& b = barriers[i];
+            if (b.type == ResourceBarrier::Type::Uav && (b.resource == 0 || b.resource == resource)) return;
+        }
+        if (resource == 0)
+        {
+            // Covers the UAV barriers of the single resources
+            barriers.erase(std::remove_if(barriers.begin() + first, barriers.end(), [](const ResourceBarrier& b)
+            {
+                return b.type == ResourceBarrier::Type::Uav;
+            }), barriers.end());
+        }
+        barriers.push_back({ ResourceBarrier::Type::Uav, resource, 0, 0, 0 });
+    }
+}
+
+const uint32_t ResourceStateTracker::kAllSubresources;
+const uint32_t ResourceStateTracker::kStateCommon;
+const uint32_t ResourceStateTracker::kStateUnorderedAccess;
+const uint32_t ResourceStateTracker::kReadStates;
+const uint32_t CommandListStates::kUnknown;
+
+void ResourceStateTracker::addResource(uint64_t resource, uint32_t subresourceCount, uint32_t state)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Resource& r = mResources[resource];
+    r.states.assign(subresourceCount ? subresourceCount : 1, state);
+    r.uavPending = false;
+}
+
+void ResourceStateTracker::removeResource(uint64_t resource)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mResources.erase(resource);
+}
+
+uint32_t ResourceStateTracker::getSubresourceCount(uint64_t resource) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mResources.find(resource);
+    return (it == mResources.end()) ? 1 : (uint32_t)it->second.states.size();
+}
+
+uint32_t ResourceStateTracker::getState(uint64_t resource, uint32_t subresource) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mResources.find(resource);
+    return (it == mResources.end() || subresource >= it->second.states.size()) ? kStateCommon : it->second.states[subresource];
+}
+
+void ResourceStateTracker::resolve(const CommandListStates& list, std::vector<ResourceBarrier>& barriers)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    const size_t first = barriers.size();
+    for (const auto& it : list.mResources)
+    {
+        auto global = mResources.find(it.first);
+        if (global == mResources.end()) continue;
+        std::vector<uint32_t>& states = global->second.states;
+        const CommandListStates::Resource& resource = it.second;
+        const uint32_t count = std::min((uint32_t)states.size(), (uint32_t)resource.states.size());
+        bool transitions = false;
+        for (uint32_t s = 0; s < count; s++)
+        {
+            const uint32_t expected = resource.expected[s];
+            if (expected == CommandListStates::kUnknown) continue;
+            // The barriers the list recorded start from exactly the expected state, a read state that includes it doesn't do
+            if (states[s] != expected)
+            {
+                barriers.push_back({ ResourceBarrier::Type::Transition, it.first, s, states[s], expected });
+                transitions = true;
+            }
+            else if (expected == kStateUnorderedAccess && global->second.uavPending)
+            {
+                addUav(barriers, first, it.first);
+            }
+            states[s] = resource.states[s];
+        }
+        if (transitions) mergeSubresources(barriers, first, it.first, (uint32_t)states.size());
+
+        // The writes of the lists before are done after a barrier for the whole resource, the ones of this list after its last UAV barrier
+        bool covered = resource.covered;
+        for (size_t i = first; i < barriers.size(); i++)
+        {
+            const ResourceBarrier& b = barriers[i];
+            const bool whole = b.type == ResourceBarrier::Type::Uav || b.subresource == kAllSubresources || states.size() == 1;
+            if ((b.resource == 0 || b.resource == it.first) && whole) covered = true;
+        }
+        global->second.uavPending = (resource.uavFlush != CommandListStates::kUnknown) || (global->second.uavPending && covered == false);
+    }
+}
+
+CommandListStates::Resource& CommandListStates::getResource(uint64_t resource)
+{
+    auto it = mResources.find(resource);
+    if (it == mResources.end())
+    {
+        const uint32_t count = mTracker.getSubresourceCount(resource);
+        it = mResources.insert(std::make_pair(resource, Resource())).first;
+        it->second.expected.assign(count, kUnknown);
+        it->second.states.assign(count, kUnknown);
+    }
+    return it->second;
+}
+
+void CommandListStates::expect(uint64_t resource, uint32_t state, uint32_t subresource)
+{
+    Resource& r = getResource(resource);
+    const uint32_t count = (uint32_t)r.states.size();
+    const uint32_t first = (subresource == ResourceStateTracker::kAllSubresources) ? 0 : std::min(subresource, count - 1);
+    const uint32_t last = (subresource == ResourceStateTracker::kAllSubresources) ? count : first + 1;
+    for (uint32_t s = first; s < last; s++)
+    {
+        if (r.states[s] != kUnknown) continue;
+        r.expected[s] = state;
+        r.states[s] = state;
+    }
+}
+
+void CommandListStates::require(uint64_t resource, uint32_t state, uint32_t subresource)
+{
+    Resource& r = getResource(resource);
+    const uint32_t count = (uint32_t)r.states.size();
+    const uint32_t first = (subresource == ResourceStateTracker::kAllSubresources) ? 0 : std::min(subresource, count - 1);
+    const uint32_t last = (subresource == ResourceStateTracker::kAllSubresources) ? count : first + 1;
+
+    bool transitions = false;
+    for (uint32_t s = first; s < last; s++)
+    {
+        const uint32_t current = r.states[s];
+        if (current == kUnknown)
+        {
+            // The first use. ResourceStateTracker::resolve() gets the subresource into the state before the list starts
+            r.expected[s] = state;
+            r.states[s] = state;
+        }
+        else if (current == state)
+        {
+            continue;
+        }
+        else if (ResourceStateTracker::isReadState(current) && ResourceStateTracker::isReadState(state))
+        {
+            if ((current & state) != state)
+            {
+                addTransition(resource, s, current, current | state);
+                r.states[s] = current | state;
+                transitions = true;
+            }
+        }
+        else
+        {
+            addTransition(resource, s, current, state);
+            r.states[s] = state;
+            transitions = true;
+        }
+    }
+    if (transitions && count > 1) mergeSubresources(mBatch, 0, resource, count);
+
+    if (state == ResourceStateTracker::kStateUnorderedAccess)
+    {
+        // Used as a UAV before an earlier flush with no barrier since. A transition orders the accesses, including one that went back to UAV
+        // and was elided, so only look at the transitions left
+        if (r.uavFlush != kUnknown && r.uavFlush != mFlushCount)
+        {
+            const bool transition = std::any_of(mBatch.begin(), mBatch.end(), [&](const ResourceBarrier& b)
+            {
+                const bool covers = b.subresource == ResourceStateTracker::kAllSubresources || count == 1 || (last == first + 1 && b.subresource == first);
+                return b.type == ResourceBarrier::Type::Transition && b.resource == resource && covers;
+            });
+            if (transition == false) addUav(mBatch, 0, resource);
+        }
+        r.uavFlush = mFlushCount;
+    }
+}
+
+void CommandListStates::addTransition(uint64_t resource, uint32_t subresource, uint32_t before, uint32_t after)
+{
+    // A subresource that changes state twice between two flushes gets a single transition, none if it's back where it was
+    for (size_t i = 0; i < mBatch.size(); i++)
+    {
+        ResourceBarrier& b = mBatch[i];
+        if (b.type != ResourceBarrier::Type::Transition || b.resource != resource) continue;
+        if (b.subresource == ResourceStateTracker::kAllSubresources)
+        {
+            // Split it, only this subresource changes again
+            const uint32_t count = (uint32_t)mResources[resource].states.size();
+            const ResourceBarrier all = b;
+            mBatch.erase(mBatch.begin() + i);
+            for (uint32_t s = 0; s < count; s++) mBatch.push_back({ all.type, resource, s, all.stateBefore, all.stateAfter });
+            addTransition(resource, subresource, before, after);
+            return;
+        }
+        if (b.subresource != subresource) continue;
+        b.stateAfter = after;
+        if (b.stateBefore == b.stateAfter) mBatch.erase(mBatch.begin() + i);
+        return;
+    }
+    mBatch.push_back({ ResourceBarrier::Type::Transition, resource, subresource, before, after });
+}
+
+void CommandListStates::uavBarrier(uint64_t resource)
+{
+    addUav(mBatch, 0, resource);
+}
+
+void CommandListStates::flush(std::vector<ResourceBarrier>& barriers)
+{
+    // Resources with a single subresource use kAllSubresources too
+    for (const ResourceBarrier& b : mBatch)
+    {
+        barriers.push_back(b);
+        if (b.type == ResourceBarrier::Type::Transition && mResources[b.resource].states.size() == 1) barriers.back().subresource = ResourceStateTracker::kAllSubresources;
+
+        // The UAV accesses before the barrier are done, if it covers every subresource. The ones of this batch come after it
+        for (auto& it : mResources)
+        {
+            Resource& r = it.second;
+            const bool covers = b.type == ResourceBarrier::Type::Uav || b.subresource == ResourceStateTracker::kAllSubresources || r.states.size() == 1;
+            if ((b.resource == 0 || b.resource == it.first) && covers)
+            {
+                r.covered = true;
+                if (r.uavFlush != mFlushCount) r.uavFlush = kUnknown;
+            }
+        }
+    }
+    mBatch.clear();
+    mFlushCount++;
+}
+
+void CommandListStates::reset()
+{
+    mResources.clear();
+    mBatch.clear();
+    mFlushCount = 0;
+}
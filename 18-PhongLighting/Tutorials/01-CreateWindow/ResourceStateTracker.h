@@ -0,0 +1,132 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// A barrier for D3D12_RESOURCE_BARRIER. The resource is the ID3D12Resource pointer, 0 in a UAV barrier covers every resource
+struct ResourceBarrier
+{
+    enum class Type
+    {
+        Transition,
+        Uav,
+        Aliasing,   // The resource starts using memory other placed resources used. The RenderGraph adds them, the tracker doesn't
+    };
+
+    Type type;
+    uint64_t resource;
+    uint32_t subresource;
+    uint32_t stateBefore;
+    uint32_t stateAfter;
+};
+
+class CommandListStates;
+
+/** The state of every subresource, as the command lists submitted so far leave it.
+    The states are D3D12_RESOURCE_STATES values. Command lists are recorded on several threads, so a list can't know the state a resource
+    will be in when it starts. Every list tracks the states it needs in a CommandListStates of its own, the first state it needs of a
+    subresource is the state the list expects it in. resolve() is called for the lists in submission order. It returns the barriers that bring
+    the resources from their current state to the one the list expects, and takes the states the list leaves them in. A list that expects a
+    UAV another list wrote gets a UAV barrier.
+*/
+class ResourceStateTracker
+{
+public:
+    static const uint32_t kAllSubresources = 0xffffffff;   // D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES
+    static const uint32_t kStateCommon = 0;                 // D3D12_RESOURCE_STATE_COMMON, also D3D12_RESOURCE_STATE_PRESENT
+    static const uint32_t kStateUnorderedAccess = 0x8;      // D3D12_RESOURCE_STATE_UNORDERED_ACCESS
+    // The read-only states, which can be combined. D3D12_RESOURCE_STATE_GENERIC_READ, DEPTH_READ and RESOLVE_SOURCE
+    static const uint32_t kReadStates = 0xac3 | 0x20 | 0x2000;
+
+    static bool isReadState(uint32_t state) { return state != kStateCommon && (state & ~kReadStates) == 0; }
+
+    // Thread-safe. A resource has to be added before a list uses it
+    void addResource(uint64_t resource, uint32_t subresourceCount, uint32_t state);
+    void removeResource(uint64_t resource);
+    uint32_t getSubresourceCount(uint64_t resource) const;
+    uint32_t getState(uint64_t resource, uint32_t subresource) const;
+
+    // Appends the barriers list needs before it starts and takes the states it leaves the resources in. Call in submission order
+    void resolve(const CommandListStates& list, std::vector<ResourceBarrier>& barriers);
+
+private:
+    struct Resource
+    {
+        std::vector<uint32_t> states;
+        bool uavPending = false;    // Used as a UAV by a list, with no barrier for every subresource since
+    };
+
+    mutable std::mutex mMutex;
+    std::map<uint64_t, Resource> mResources;
+};
+
+/** The resource states of one command list.
+    require() the states the next commands need, then flush() and record the barriers with a single ResourceBarrier() call before them.
+    Barriers are only added when a state changes. A subresource that changes state more than once between two flushes gets one transition,
+    none if it ends up where it was. A read state is added to the read states a subresource is in rather than replacing them. A subresource
+    that is required as a UAV again after a flush gets a UAV barrier, the commands before may have written it.
+*/
+class CommandListStates
+{
+public:
+    explicit CommandListStates(const ResourceStateTracker& tracker) : mTracker(tracker) {}
+
+    void require(uint64_t resource, uint32_t state, uint32_t subresource = ResourceStateTracker::kAllSubresources);
+    // For a list that knows the state a resource starts in, before it requires it. The barriers from that state are then in the list, and
+    // resolve() only adds the ones before it if the state was wrong
+    void expect(uint64_t resource, uint32_t state, uint32_t subresource = ResourceStateTracker::kAllSubresources);
+    // An explicit UAV barrier, for resources that don't change state like acceleration structures. 0 covers every resource
+    void uavBarrier(uint64_t resource = 0);
+    // Appends the barriers since the last flush()
+    void flush(std::vector<ResourceBarrier>& barriers);
+    // The list was reset
+    void reset();
+
+private:
+    friend class ResourceStateTracker;
+    static const uint32_t kUnknown = 0xffffffff;
+
+    struct Resource
+    {
+        std::vector<uint32_t> expected;     // The state the list expects when it starts, kUnknown if it doesn't use the subresource
+        std::vector<uint32_t> states;       // The state after the commands recorded so far
+        uint32_t uavFlush = kUnknown;       // The flush() the subresources were last required as UAVs in, kUnknown after a barrier
+        bool covered = false;               // A barrier for every subresource was flushed, the accesses of the lists before are done
+    };
+
+    Resource& getResource(uint64_t resource);
+    void addTransition(uint64_t resource, uint32_t subresource, uint32_t before, uint32_t after);
+
+    const ResourceStateTracker& mTracker;
+    std::map<uint64_t, Resource> mResources;
+    std::vector<ResourceBarrier> mBatch;
+    uint32_t mFlushCount = 0;
+};
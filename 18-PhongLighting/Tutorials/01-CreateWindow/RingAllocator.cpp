@@ -0,0 +1,91 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "RingAllocator.h"
+
+namespace
+{
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (alignment > 1) ? (value + alignment - 1) / alignment * alignment : value;
+    }
+}
+
+uint64_t RingAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+    if (size == 0 || size > mCapacity) return kInvalidOffset;
+
+    // Start over from the beginning whenever the ring is empty, so one frame can use the whole buffer
+    if (mUsed == 0) mHead = mTail = 0;
+
+    uint64_t offset = alignUp(mHead, alignment);
+    uint64_t end = offset + size;
+    if (mUsed == 0 || mHead > mTail)
+    {
+        // The used range is [tail, head). Allocate after it, or wrap around and allocate before the tail
+        if (end > mCapacity)
+        {
+            if (size > mTail) return kInvalidOffset;
+            // The space between the head and the end of the buffer is lost until the frame retires
+            uint64_t consumed = (mCapacity - mHead) + size;
+            mUsed += consumed;
+            mCurrentFrameSize += consumed;
+            mHead = size;
+            return 0;
+        }
+    }
+    else if (end > mTail)
+    {
+        // The used range wraps around, the free space is [head, tail)
+        return kInvalidOffset;
+    }
+
+    uint64_t consumed = end - mHead;
+    mUsed += consumed;
+    mCurrentFrameSize += consumed;
+    mHead = end;
+    return offset;
+}
+
+void RingAllocator::endFrame(uint64_t fenceValue)
+{
+    if (mCurrentFrameSize == 0) return;
+    Frame frame = { fenceValue, mCurrentFrameSize };
+    mFrames.push_back(frame);
+    mCurrentFrameSize = 0;
+}
+
+void RingAllocator::retire(uint64_t completedFenceValue)
+{
+    while (mFrames.empty() == false && mFrames.front().fenceValue <= completedFenceValue)
+    {
+        // Frames are contiguous in the ring, so the tail moves forward by exactly the size of the frame
+        mTail = (mTail + mFrames.front().size) % mCapacity;
+        mUsed -= mFrames.front().size;
+        mFrames.pop_front();
+    }
+}
@@ -0,0 +1,71 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <deque>
+
+/** Offset management for a ring buffer whose memory is released in frames.
+    Allocations are linear. endFrame() closes the current frame and tags it with the fence value the GPU signals when it's done with the frame.
+    retire() releases every frame whose fence value was reached, oldest first. If nothing is ever retired, this is a plain linear allocator.
+    It doesn't own any memory, so the same code manages the transient descriptors of DescriptorAllocator and runs in the benchmarks without a device.
+*/
+class RingAllocator
+{
+public:
+    static const uint64_t kInvalidOffset = ~0ull;
+
+    RingAllocator() = default;
+    explicit RingAllocator(uint64_t capacity) : mCapacity(capacity) {}
+
+    // The alignment doesn't have to be a power of 2, so a structured-buffer SRV can start at any element. Returns kInvalidOffset if the ring is full
+    uint64_t allocate(uint64_t size, uint64_t alignment);
+
+    // Everything allocated since the last endFrame() is in use until the GPU reaches fenceValue
+    void endFrame(uint64_t fenceValue);
+
+    // Release the frames whose fence value is <= completedFenceValue
+    void retire(uint64_t completedFenceValue);
+
+    uint64_t getCapacity() const { return mCapacity; }
+    uint64_t getUsedSize() const { return mUsed; }      // Including the alignment padding and the space skipped when wrapping around
+    uint32_t getPendingFrameCount() const { return (uint32_t)mFrames.size(); }
+
+private:
+    struct Frame
+    {
+        uint64_t fenceValue;
+        uint64_t size;      // The bytes the frame used, including the padding
+    };
+
+    uint64_t mCapacity = 0;
+    uint64_t mHead = 0;     // Where the next allocation goes
+    uint64_t mTail = 0;     // The start of the oldest allocation still in use
+    uint64_t mUsed = 0;
+    uint64_t mCurrentFrameSize = 0;
+    std::deque<Frame> mFrames;
+};
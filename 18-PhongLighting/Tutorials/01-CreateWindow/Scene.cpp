@@ -0,0 +1,414 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Scene.h"
+#include <algorithm>
+#include <fstream>
+#include <string.h>
+
+namespace
+{
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    uint32_t indexSize(SceneIndexFormat format)
+    {
+        switch (format)
+        {
+        case SceneIndexFormat::Uint16: return 2;
+        case SceneIndexFormat::Uint32: return 4;
+        default: return 0;
+        }
+    }
+
+    // Point pArray at a section, after checking it's inside the file, holds a whole number of elements and the count fits a Count. The struct
+    // arrays are indexed with 32-bit values, the index blob is counted in bytes and can be larger than 4 GB
+    template<typename T, typename Count>
+    bool mapSection(const uint8_t* pData, uint64_t fileSize, const SceneSection& section, const char* name, const T*& pArray, Count& count, std::string& error)
+    {
+        if ((section.offset % kSceneAlignment) != 0 || section.offset > fileSize || section.size > fileSize - section.offset || (section.size % sizeof(T)) != 0)
+        {
+            error = std::string("The ") + name + " section is corrupt";
+            return false;
+        }
+        if (section.size / sizeof(T) > uint64_t(Count(~Count(0))))
+        {
+            error = std::string("The ") + name + " section has " + std::to_string(section.size / sizeof(T)) + " elements, more than the " + std::to_string(uint64_t(Count(~Count(0)))) + " supported";
+            return false;
+        }
+        pArray = (const T*)(pData + section.offset);
+        count = Count(section.size / sizeof(T));
+        return true;
+    }
+
+    void writeRows(const glm::mat4& m, float transform[3][4])
+    {
+        // GLM is column major, the instance transform is row major
+        for (uint32_t r = 0; r < 3; r++)
+        {
+            for (uint32_t c = 0; c < 4; c++) transform[r][c] = m[c][r];
+        }
+    }
+}
+
+bool Scene::load(const std::string& filename, std::string& error)
+{
+    mMemory.clear();
+    if (mFile.open(filename) == false)
+    {
+        error = "Can't open " + filename;
+        return false;
+    }
+    return parse(mFile.getData(), mFile.getSize(), error);
+}
+
+bool Scene::loadFromMemory(std::vector<uint8_t> data, std::string& error)
+{
+    mFile.close();
+    mMemory = std::move(data);
+    return parse(mMemory.data(), mMemory.size(), error);
+}
+
+bool Scene::parse(const uint8_t* pData, uint64_t size, std::string& error)
+{
+    mHitGroupOffsets.clear();
+    if (size < sizeof(SceneFileHeader))
+    {
+        error = "The file is too small to be a scene";
+        return false;
+    }
+
+    const SceneFileHeader& header = *(const SceneFileHeader*)pData;
+    if (header.magic != kSceneMagic || header.version != kSceneVersion)
+    {
+        error = "Not a scene file, or the version is not supported";
+        return false;
+    }
+    if (header.vertexStride != sizeof(VertexPositionNormalTangentTexture))
+    {
+        error = "The scene vertex format doesn't match VertexPositionNormalTangentTexture";
+        return false;
+    }
+
+    if (mapSection(pData, size, header.meshes, "mesh", mpMeshes, mMeshCount, error) == false) return false;
+    if (mapSection(pData, size, header.blas, "BLAS", mpBlas, mBlasCount, error) == false) return false;
+    if (mapSection(pData, size, header.instances, "instance", mpInstances, mInstanceCount, error) == false) return false;
+    if (mapSection(pData, size, header.materials, "material", mpMaterials, mMaterialCount, error) == false) return false;
+    if (mapSection(pData, size, header.vertices, "vertex", mpVertices, mVertexCount, error) == false) return false;
+    if (mapSection(pData, size, header.indices, "index", mpIndexData, mIndexDataSize, error) == false) return false;
+
+    // Validate the references, so the builders can trust the scene
+    for (uint32_t i = 0; i < mMeshCount; i++)
+    {
+        const SceneMesh& mesh = mpMeshes[i];
+        uint32_t stride = indexSize(mesh.indexFormat);
+        bool valid = (uint64_t(mesh.firstVertex) + mesh.vertexCount <= mVertexCount);
+        if (mesh.indexFormat == SceneIndexFormat::None)
+        {
+            valid = valid && (mesh.indexCount == 0) && (mesh.vertexCount % 3 == 0);
+        }
+        else
+        {
+            valid = valid && (stride != 0) && (mesh.indexOffset % stride == 0) && (mesh.indexCount % 3 == 0) &&
+                (mesh.indexOffset <= mIndexDataSize) && (uint64_t(mesh.indexCount) * stride <= mIndexDataSize - mesh.indexOffset);
+        }
+        if (valid == false)
+        {
+            error = "Mesh " + std::to_string(i) + " is out of the vertex or index data";
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < mBlasCount; i++)
+    {
+        const SceneBlas& blas = mpBlas[i];
+        if (blas.meshCount == 0 || uint64_t(blas.firstMesh) + blas.meshCount > mMeshCount)
+        {
+            error = "BLAS " + std::to_string(i) + " references meshes that don't exist";
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < mMaterialCount; i++)
+    {
+        if (mpMaterials[i].hitProgram != SceneHitProgram::Triangle && mpMaterials[i].hitProgram != SceneHitProgram::Plane)
+        {
+            error = "Material " + std::to_string(i) + " has an unknown hit program";
+            return false;
+        }
+    }
+
+    uint32_t hitGroupOffset = 0;
+    mHitGroupOffsets.reserve(mInstanceCount + 1);
+    for (uint32_t i = 0; i < mInstanceCount; i++)
+    {
+        const SceneInstance& instance = mpInstances[i];
+        if (instance.blasIndex >= mBlasCount || uint64_t(instance.firstMaterial) + mpBlas[instance.blasIndex].meshCount > mMaterialCount)
+        {
+            error = "Instance " + std::to_string(i) + " references a BLAS or materials that don't exist";
+            return false;
+        }
+        mHitGroupOffsets.push_back(hitGroupOffset);
+        hitGroupOffset += 2 * mpBlas[instance.blasIndex].meshCount;
+    }
+    mHitGroupOffsets.push_back(hitGroupOffset);
+    return true;
+}
+
+glm::mat4 Scene::getInstanceTransform(uint32_t instanceIndex, float rotation) const
+{
+    const SceneInstance& instance = mpInstances[instanceIndex];
+    glm::mat4 m;
+    for (uint32_t r = 0; r < 3; r++)
+    {
+        for (uint32_t c = 0; c < 4; c++) m[c][r] = instance.transform[r][c];
+    }
+    if (instance.flags & kSceneInstanceRotateY)
+    {
+        // glm::eulerAngleY(), with a sin and cos that don't depend on the C runtime so the CPU reference is the same everywhere
+        float s, c;
+        sinCos(rotation, s, c);
+        glm::mat4 rotationY;
+        rotationY[0][0] = c;
+        rotationY[0][2] = -s;
+        rotationY[2][0] = s;
+        rotationY[2][2] = c;
+        m = m * rotationY;
+    }
+    return m;
+}
+
+uint32_t SceneWriter::addMesh(const VertexPositionNormalTangentTexture* pVertices, uint32_t vertexCount, const void* pIndices, uint32_t indexCount, SceneIndexFormat indexFormat)
+{
+    SceneMesh mesh = {};
+    mesh.firstVertex = (uint32_t)mVertices.size();
+    mesh.vertexCount = vertexCount;
+    mVertices.insert(mVertices.end(), pVertices, pVertices + vertexCount);
+
+    if (pIndices && indexCount && indexFormat != SceneIndexFormat::None)
+    {
+        // Keep every index range 4-byte aligned, so it can be bound as an index SRV
+        mIndices.resize((size_t)alignUp(mIndices.size(), 4));
+        mesh.indexOffset = mIndices.size();
+        mesh.indexCount = indexCount;
+        mesh.indexFormat = indexFormat;
+        const uint8_t* pBytes = (const uint8_t*)pIndices;
+        mIndices.insert(mIndices.end(), pBytes, pBytes + size_t(indexCount) * indexSize(indexFormat));
+    }
+    else
+    {
+        mesh.indexFormat = SceneIndexFormat::None;
+    }
+    mMeshes.push_back(mesh);
+    return (uint32_t)mMeshes.size() - 1;
+}
+
+uint32_t SceneWriter::addBlas(uint32_t firstMesh, uint32_t meshCount)
+{
+    SceneBlas blas = { firstMesh, meshCount };
+    mBlas.push_back(blas);
+    return (uint32_t)mBlas.size() - 1;
+}
+
+uint32_t SceneWriter::addMaterial(SceneHitProgram hitProgram, const glm::vec4 constants[3])
+{
+    SceneMaterial material = {};
+    material.hitProgram = hitProgram;
+    if (constants) memcpy(material.constants, constants, sizeof(material.constants));
+    mMaterials.push_back(material);
+    return (uint32_t)mMaterials.size() - 1;
+}
+
+uint32_t SceneWriter::addInstance(uint32_t blasIndex, const glm::mat4& transform, uint32_t firstMaterial, uint32_t flags)
+{
+    SceneInstance instance = {};
+    writeRows(transform, instance.transform);
+    instance.blasIndex = blasIndex;
+    instance.firstMaterial = firstMaterial;
+    instance.flags = flags;
+    mInstances.push_back(instance);
+    return (uint32_t)mInstances.size() - 1;
+}
+
+std::vector<uint8_t> SceneWriter::serialize() const
+{
+    SceneFileHeader header = {};
+    header.magic = kSceneMagic;
+    header.version = kSceneVersion;
+    header.vertexStride = sizeof(VertexPositionNormalTangentTexture);
+
+    struct Blob
+    {
+        SceneSection* pSection;
+        const void* pData;
+        uint64_t size;
+    };
+    const Blob blobs[] =
+    {
+        { &header.meshes, mMeshes.data(), mMeshes.size() * sizeof(SceneMesh) },
+        { &header.blas, mBlas.data(), mBlas.size() * sizeof(SceneBlas) },
+        { &header.instances, mInstances.data(), mInstances.size() * sizeof(SceneInstance) },
+        { &header.materials, mMaterials.data(), mMaterials.size() * sizeof(SceneMaterial) },
+        { &header.vertices, mVertices.data(), mVertices.size() * sizeof(VertexPositionNormalTangentTexture) },
+        { &header.indices, mIndices.data(), mIndices.size() },
+    };
+
+    uint64_t offset = alignUp(sizeof(SceneFileHeader), kSceneAlignment);
+    for (const Blob& blob : blobs)
+    {
+        blob.pSection->offset = offset;
+        blob.pSection->size = blob.size;
+        offset = alignUp(offset + blob.size, kSceneAlignment);
+    }
+
+    std::vector<uint8_t> data((size_t)offset, 0);
+    memcpy(data.data(), &header, sizeof(header));
+    for (const Blob& blob : blobs)
+    {
+        if (blob.size) memcpy(data.data() + blob.pSection->offset, blob.pData, (size_t)blob.size);
+    }
+    return data;
+}
+
+bool SceneWriter::write(const std::string& filename) const
+{
+    std::vector<uint8_t> data = serialize();
+    std::ofstream file(filename, std::ios::binary);
+    file.write((const char*)data.data(), data.size());
+    return file.good();
+}
+
+SceneGeometryConstants getGeometryConstants(const SceneMesh& mesh)
+{
+    SceneGeometryConstants constants = {};
+    constants.firstVertex = mesh.firstVertex;
+    constants.indexOffset = (uint32_t)mesh.indexOffset;
+    constants.indexFormat = mesh.indexFormat;
+    return constants;
+}
+
+SceneGeometryViews getSceneGeometryViews(const Scene& scene)
+{
+    SceneGeometryViews views;
+    views.vertexElements = scene.getVertexCount();
+    views.indexElements = (uint32_t)std::max<uint64_t>(alignUp(scene.getIndexDataSize(), 4) / 4, 1);
+    return views;
+}
+
+bool validateSceneGeometry(const Scene& scene, const SceneGeometryViews& views, std::string& error)
+{
+    for (uint32_t i = 0; i < scene.getMeshCount(); i++)
+    {
+        const SceneMesh& mesh = scene.getMesh(i);
+        const std::string name = "Mesh " + std::to_string(i);
+        if (uint64_t(mesh.firstVertex) + mesh.vertexCount > views.vertexElements)
+        {
+            error = name + " has vertices past the " + std::to_string(views.vertexElements) + " elements of the vertex SRV";
+            return false;
+        }
+        if (mesh.indexFormat == SceneIndexFormat::None)
+        {
+            if (mesh.vertexCount % 3)
+            {
+                error = name + " has no indices and " + std::to_string(mesh.vertexCount) + " vertices, which is not a whole number of triangles";
+                return false;
+            }
+            continue;
+        }
+
+        const uint32_t stride = indexSize(mesh.indexFormat);
+        const uint64_t indexEnd = mesh.indexOffset + uint64_t(mesh.indexCount) * stride;
+        if (stride == 0 || mesh.indexCount % 3 || mesh.indexOffset % stride || indexEnd > scene.getIndexDataSize())
+        {
+            error = name + " has an invalid index format, count or offset";
+            return false;
+        }
+        if (indexEnd > uint64_t(views.indexElements) * 4 || mesh.indexOffset > UINT32_MAX)
+        {
+            error = name + " has indices past the " + std::to_string(views.indexElements) + " words of the index SRV";
+            return false;
+        }
+
+        // D3D12 reads the indices relative to the first vertex of the geometry
+        const uint8_t* pIndices = scene.getIndexData() + mesh.indexOffset;
+        uint32_t maxIndex = 0;
+        if (mesh.indexFormat == SceneIndexFormat::Uint16)
+        {
+            for (uint32_t j = 0; j < mesh.indexCount; j++) maxIndex = std::max<uint32_t>(maxIndex, ((const uint16_t*)pIndices)[j]);
+        }
+        else
+        {
+            for (uint32_t j = 0; j < mesh.indexCount; j++) maxIndex = std::max(maxIndex, ((const uint32_t*)pIndices)[j]);
+        }
+        if (mesh.indexCount && maxIndex >= mesh.vertexCount)
+        {
+            error = name + " has index " + std::to_string(maxIndex) + " but only " + std::to_string(mesh.vertexCount) + " vertices";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool loadScene(Scene& scene, const std::string& filename, std::string& error)
+{
+    if (filename.empty()) return scene.loadFromMemory(createTutorialScene(), error);
+    return scene.load(filename, error);
+}
+
+std::vector<uint8_t> createTutorialScene()
+{
+    SceneWriter writer;
+
+    // 11.1 The triangle and the plane. The BLAS for the first instance has both, the BLAS for the other instances has the triangle only
+    uint32_t triangle = writer.addMesh(getTriangleVertices(), kTriangleVertexCount);
+    writer.addMesh(getPlaneVertices(), kPlaneVertexCount, getPlaneIndices(), kPlaneIndexCount, SceneIndexFormat::Uint16);
+    uint32_t triangleAndPlaneBlas = writer.addBlas(triangle, 2);
+    uint32_t triangleBlas = writer.addBlas(triangle, 1);
+
+    // 10.2 Each triangle instance has its own constant buffer
+    const glm::vec4 colors[3][3] =
+    {
+        { glm::vec4(1.0f, 0.0f, 0.0f, 1.0f), glm::vec4(0.0f, 1.0f, 0.0f, 1.0f), glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) },
+        { glm::vec4(1.0f, 1.0f, 0.0f, 1.0f), glm::vec4(0.0f, 1.0f, 1.0f, 1.0f), glm::vec4(1.0f, 0.0f, 1.0f, 1.0f) },
+        { glm::vec4(1.0f, 0.0f, 1.0f, 1.0f), glm::vec4(1.0f, 1.0f, 0.0f, 1.0f), glm::vec4(0.0f, 1.0f, 1.0f, 1.0f) },
+    };
+
+    // 11.3 The first instance keeps the identity transform, the others rotate
+    glm::mat4 transformation[kInstanceCount];
+    getInstanceTransforms(0, transformation);
+    uint32_t material = writer.addMaterial(SceneHitProgram::Triangle, colors[0]);
+    writer.addMaterial(SceneHitProgram::Plane);
+    writer.addInstance(triangleAndPlaneBlas, transformation[0], material);
+    for (uint32_t i = 1; i < kInstanceCount; i++)
+    {
+        material = writer.addMaterial(SceneHitProgram::Triangle, colors[i]);
+        writer.addInstance(triangleBlas, transformation[i], material, kSceneInstanceRotateY);
+    }
+    return writer.serialize();
+}
@@ -0,0 +1,213 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "Geometry.h"
+#include "MappedFile.h"
+#include <string>
+
+/** Binary scene format.
+    The file starts with a SceneFileHeader followed by the sections it points to. Every section is an array of one of the structs below, except
+    for the vertex and index blobs, which are stored exactly the way the GPU buffers expect them. All offsets are from the start of the file and
+    are 16-byte aligned, so the file can be memory-mapped and the structs and blobs used in place. There are no lights, the hit shaders and
+    CpuRaytracer share a fixed one.
+*/
+static const uint32_t kSceneMagic = 0x53525844;     // "DXRS"
+static const uint32_t kSceneVersion = 2;
+static const uint32_t kSceneAlignment = 16;
+
+enum class SceneIndexFormat : uint32_t
+{
+    None,       // Every 3 vertices make a triangle
+    Uint16,
+    Uint32,
+};
+
+// The closest-hit program of a geometry. The shadow-ray program is always shadowChs
+enum class SceneHitProgram : uint32_t
+{
+    Triangle,   // chs, with the material constants in the hit-group constant buffer
+    Plane,      // planeChs
+};
+
+// SceneInstance::flags
+static const uint32_t kSceneInstanceRotateY = 0x1;  // The instance spins around its Y axis, like the tutorial triangles
+
+struct SceneSection
+{
+    uint64_t offset;
+    uint64_t size;      // In bytes
+};
+
+struct SceneFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexStride;  // sizeof(VertexPositionNormalTangentTexture)
+    uint32_t reserved;
+    SceneSection meshes;
+    SceneSection blas;
+    SceneSection instances;
+    SceneSection materials;
+    SceneSection vertices;
+    SceneSection indices;
+};
+
+// One D3D12_RAYTRACING_GEOMETRY_DESC
+struct SceneMesh
+{
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint64_t indexOffset;   // In bytes, from the start of the index blob
+    uint32_t indexCount;
+    SceneIndexFormat indexFormat;
+};
+
+// A bottom-level AS made of a range of meshes. The mesh order is the geometry order, which selects the hit-group
+struct SceneBlas
+{
+    uint32_t firstMesh;
+    uint32_t meshCount;
+};
+
+struct SceneInstance
+{
+    float transform[3][4];  // Row-major 3x4, like D3D12_RAYTRACING_INSTANCE_DESC
+    uint32_t blasIndex;
+    uint32_t firstMaterial; // Geometry i of the BLAS uses material firstMaterial + i
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+struct SceneMaterial
+{
+    SceneHitProgram hitProgram;
+    uint32_t reserved[3];
+    float constants[3][4];  // The colors A, B and C of the chs constant buffer, padded to float4
+};
+
+/** A loaded scene.
+    load() maps the file and validates it. The getters return pointers into the mapping, so nothing is parsed or copied at load time.
+*/
+class Scene
+{
+public:
+    bool load(const std::string& filename, std::string& error);
+    bool loadFromMemory(std::vector<uint8_t> data, std::string& error);
+
+    uint32_t getMeshCount() const { return mMeshCount; }
+    uint32_t getBlasCount() const { return mBlasCount; }
+    uint32_t getInstanceCount() const { return mInstanceCount; }
+    uint32_t getMaterialCount() const { return mMaterialCount; }
+    const SceneMesh& getMesh(uint32_t index) const { return mpMeshes[index]; }
+    const SceneBlas& getBlas(uint32_t index) const { return mpBlas[index]; }
+    const SceneInstance& getInstance(uint32_t index) const { return mpInstances[index]; }
+    const SceneMaterial& getMaterial(uint32_t index) const { return mpMaterials[index]; }
+
+    // The blobs to upload as-is
+    const VertexPositionNormalTangentTexture* getVertices() const { return mpVertices; }
+    uint32_t getVertexCount() const { return mVertexCount; }
+    const uint8_t* getIndexData() const { return mpIndexData; }
+    uint64_t getIndexDataSize() const { return mIndexDataSize; }
+
+    // The column-major (GLM) object-to-world matrix of an instance, for the given animation time
+    glm::mat4 getInstanceTransform(uint32_t instanceIndex, float rotation) const;
+
+    // Each geometry has a primary and a shadow hit-group, and the instances follow each other in the hit-table
+    uint32_t getInstanceContributionToHitGroupIndex(uint32_t instanceIndex) const { return mHitGroupOffsets[instanceIndex]; }
+    uint32_t getHitGroupCount() const { return mHitGroupOffsets.empty() ? 0 : mHitGroupOffsets.back(); }
+
+private:
+    bool parse(const uint8_t* pData, uint64_t size, std::string& error);
+
+    MappedFile mFile;
+    std::vector<uint8_t> mMemory;
+    const SceneMesh* mpMeshes = nullptr;
+    const SceneBlas* mpBlas = nullptr;
+    const SceneInstance* mpInstances = nullptr;
+    const SceneMaterial* mpMaterials = nullptr;
+    const VertexPositionNormalTangentTexture* mpVertices = nullptr;
+    const uint8_t* mpIndexData = nullptr;
+    uint32_t mMeshCount = 0;
+    uint32_t mBlasCount = 0;
+    uint32_t mInstanceCount = 0;
+    uint32_t mMaterialCount = 0;
+    uint32_t mVertexCount = 0;
+    uint64_t mIndexDataSize = 0;
+    std::vector<uint32_t> mHitGroupOffsets;     // One per instance, plus the total
+};
+
+// Assembles a scene file
+class SceneWriter
+{
+public:
+    // Returns the mesh index. pIndices can be null
+    uint32_t addMesh(const VertexPositionNormalTangentTexture* pVertices, uint32_t vertexCount, const void* pIndices = nullptr, uint32_t indexCount = 0, SceneIndexFormat indexFormat = SceneIndexFormat::None);
+    uint32_t addBlas(uint32_t firstMesh, uint32_t meshCount);
+    uint32_t addMaterial(SceneHitProgram hitProgram, const glm::vec4 constants[3] = nullptr);
+    // The matrix is column-major (GLM)
+    uint32_t addInstance(uint32_t blasIndex, const glm::mat4& transform, uint32_t firstMaterial, uint32_t flags = 0);
+
+    std::vector<uint8_t> serialize() const;
+    bool write(const std::string& filename) const;
+
+private:
+    std::vector<SceneMesh> mMeshes;
+    std::vector<SceneBlas> mBlas;
+    std::vector<SceneInstance> mInstances;
+    std::vector<SceneMaterial> mMaterials;
+    std::vector<VertexPositionNormalTangentTexture> mVertices;
+    std::vector<uint8_t> mIndices;
+};
+
+// The root constants of every hit record, GeometryConstants in 04-Shaders.hlsl. The hit shaders find the vertices of PrimitiveIndex() with them
+struct SceneGeometryConstants
+{
+    uint32_t firstVertex;
+    uint32_t indexOffset;           // In bytes, from the start of the index blob
+    SceneIndexFormat indexFormat;
+};
+SceneGeometryConstants getGeometryConstants(const SceneMesh& mesh);
+
+// The NumElements of the views the hit shaders read the geometry through. The vertex SRV is structured with one element per vertex, the index
+// SRV is raw with one element per 32-bit word
+struct SceneGeometryViews
+{
+    uint32_t vertexElements = 0;
+    uint32_t indexElements = 0;
+};
+// Views covering the whole vertex and index blobs. The index view has at least one element, so it can be created for a scene without indices
+SceneGeometryViews getSceneGeometryViews(const Scene& scene);
+// Checks that the views cover the vertices and indices of every mesh, that every index addresses a vertex of its own mesh and that the
+// offsets fit the root constants. Out-of-bounds reads return 0 on the GPU, so these mistakes would show as black or wrongly lit triangles
+bool validateSceneGeometry(const Scene& scene, const SceneGeometryViews& views, std::string& error);
+
+// Load a scene file. An empty filename loads createTutorialScene()
+bool loadScene(Scene& scene, const std::string& filename, std::string& error);
+
+// The scene Tutorial01 used to hardcode: the triangle+plane instance and the two rotating triangles
+std::vector<uint8_t> createTutorialScene();
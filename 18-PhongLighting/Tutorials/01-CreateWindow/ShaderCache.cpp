@@ -0,0 +1,251 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "ShaderCache.h"
+#include "MappedFile.h"
+#include <errno.h>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    const char kCacheMagic[4] = { 'D', 'X', 'I', 'C' };
+    const uint32_t kCacheFormatVersion = 1;
+
+    struct CacheFileHeader
+    {
+        char magic[4];
+        uint32_t formatVersion;
+        uint64_t key;
+        uint64_t dxilSize;
+        uint64_t dxilHash;      // Catches a damaged file, the key only says which source it was compiled from
+    };
+
+    // FNV-1a
+    const uint64_t kHashSeed = 14695981039346656037ull;
+
+    uint64_t hashBytes(const void* pData, size_t size, uint64_t hash = kHashSeed)
+    {
+        const uint8_t* pBytes = (const uint8_t*)pData;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= pBytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // The terminating null separates the strings, so "ab" + "c" and "a" + "bc" hash differently
+    uint64_t hashString(const std::string& s, uint64_t hash)
+    {
+        return hashBytes(s.c_str(), s.size() + 1, hash);
+    }
+
+    bool readFile(const std::string& filename, std::string& contents)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (file.good() == false) return false;
+        std::stringstream stream;
+        stream << file.rdbuf();
+        contents = stream.str();
+        return true;
+    }
+
+    std::string getDirectory(const std::string& filename)
+    {
+        size_t slash = filename.find_last_of("/\\");
+        return (slash == std::string::npos) ? std::string() : filename.substr(0, slash + 1);
+    }
+
+    // Hash the files included by source, depth first in the order they appear. Includes that can't be found are hashed by name only, the compiler will report them
+    uint64_t hashIncludes(const std::string& source, const std::string& directory, std::set<std::string>& visited, uint64_t hash)
+    {
+        std::istringstream lines(source);
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            size_t pos = line.find_first_not_of(" \t");
+            if (pos == std::string::npos || line.compare(pos, 1, "#") != 0) continue;
+            pos = line.find_first_not_of(" \t", pos + 1);
+            if (pos == std::string::npos || line.compare(pos, 7, "include") != 0) continue;
+            size_t begin = line.find_first_of("\"<", pos + 7);
+            if (begin == std::string::npos) continue;
+            size_t end = line.find_first_of("\">", begin + 1);
+            if (end == std::string::npos) continue;
+
+            std::string path = directory + line.substr(begin + 1, end - begin - 1);
+            hash = hashString(path, hash);
+            if (visited.insert(path).second == false) continue;
+            std::string included;
+            if (readFile(path, included))
+            {
+                hash = hashString(included, hash);
+                hash = hashIncludes(included, getDirectory(path), visited, hash);
+            }
+        }
+        return hash;
+    }
+
+    bool createDirectory(const std::string& directory)
+    {
+#ifdef _WIN32
+        return CreateDirectoryA(directory.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+        return mkdir(directory.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+    }
+
+    // Replaces the destination in one step, readers never see a partially written file
+    bool replaceFile(const std::string& source, const std::string& destination)
+    {
+#ifdef _WIN32
+        return MoveFileExA(source.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+        return rename(source.c_str(), destination.c_str()) == 0;
+#endif
+    }
+}
+
+bool ShaderCache::computeKey(const std::string& filename, const std::string& target, const std::vector<std::string>& defines, std::string& source, uint64_t& key, std::string& error)
+{
+    if (readFile(filename, source) == false)
+    {
+        error = "Can't open file " + filename;
+        return false;
+    }
+
+    // Only ask for the version once, the compiler might have to be loaded for it
+    if (mHasCompilerVersion == false)
+    {
+        mCompilerVersion = mCompiler.getVersion();
+        mHasCompilerVersion = true;
+    }
+
+    key = hashBytes(&kCacheFormatVersion, sizeof(kCacheFormatVersion));
+    key = hashString(mCompilerVersion, key);
+    key = hashString(target, key);
+    for (const std::string& define : defines) key = hashString(define, key);
+    key = hashString(source, key);
+    std::set<std::string> visited;
+    key = hashIncludes(source, getDirectory(filename), visited, key);
+    return true;
+}
+
+bool ShaderCache::load(const std::string& path, uint64_t key, std::vector<uint8_t>& dxil) const
+{
+    MappedFile file;
+    if (file.open(path) == false || file.getSize() < sizeof(CacheFileHeader)) return false;
+
+    CacheFileHeader header;
+    memcpy(&header, file.getData(), sizeof(header));
+    if (memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header.formatVersion != kCacheFormatVersion || header.key != key) return false;
+    if (header.dxilSize == 0 || header.dxilSize != file.getSize() - sizeof(CacheFileHeader)) return false;
+
+    const uint8_t* pDxil = file.getData() + sizeof(CacheFileHeader);
+    if (hashBytes(pDxil, (size_t)header.dxilSize) != header.dxilHash) return false;
+    dxil.assign(pDxil, pDxil + header.dxilSize);
+    return true;
+}
+
+void ShaderCache::store(const std::string& path, uint64_t key, const std::vector<uint8_t>& dxil) const
+{
+    // A cache we can't write is not an error, the next launch compiles again
+    if (createDirectory(mDirectory) == false) return;
+
+    CacheFileHeader header = {};
+    memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.formatVersion = kCacheFormatVersion;
+    header.key = key;
+    header.dxilSize = dxil.size();
+    header.dxilHash = hashBytes(dxil.data(), dxil.size());
+
+    // The key makes the temporary name unique enough for two instances writing different entries at the same time
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%016llx.tmp", (unsigned long long)key);
+    std::string tempPath = path + suffix;
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)dxil.data(), dxil.size());
+        if (file.good() == false)
+        {
+            file.close();
+            remove(tempPath.c_str());
+            return;
+        }
+    }
+    if (replaceFile(tempPath, path) == false) remove(tempPath.c_str());
+}
+
+std::string ShaderCache::getEntryPath(const std::string& filename, const std::string& target, const std::vector<std::string>& defines) const
+{
+    std::string name = filename;
+    for (char& c : name)
+    {
+        if (c == '/' || c == '\\' || c == ':') c = '_';
+    }
+    std::string path = mDirectory + "/" + name + "." + target;
+    if (defines.empty() == false)
+    {
+        uint64_t definesHash = kHashSeed;
+        for (const std::string& define : defines) definesHash = hashString(define, definesHash);
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%08x", (uint32_t)(definesHash ^ (definesHash >> 32)));
+        path += suffix;
+    }
+    return path + ".dxilcache";
+}
+
+bool ShaderCache::getLibrary(const std::string& filename, const std::string& target, const std::vector<std::string>& defines, std::vector<uint8_t>& dxil, std::string& error)
+{
+    std::string source;
+    uint64_t key;
+    if (computeKey(filename, target, defines, source, key, error) == false) return false;
+
+    // A new key replaces the old entry
+    std::string path = getEntryPath(filename, target, defines);
+    if (load(path, key, dxil))
+    {
+        mHitCount++;
+        return true;
+    }
+
+    mMissCount++;
+    if (mCompiler.compile(filename, source, target, defines, dxil, error) == false) return false;
+    store(path, key, dxil);
+    return true;
+}
@@ -0,0 +1,77 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The compiler behind the cache. The tutorial uses dxcompiler, anything else (a stub on machines without it) can be plugged in
+class ShaderCompiler
+{
+public:
+    virtual ~ShaderCompiler() = default;
+
+    // Part of the cache key, a new compiler invalidates every entry
+    virtual std::string getVersion() = 0;
+
+    // Returns false and the compiler log in error if the compilation failed. Every define is "NAME" or "NAME=VALUE"
+    virtual bool compile(const std::string& filename, const std::string& source, const std::string& target, const std::vector<std::string>& defines, std::vector<uint8_t>& dxil, std::string& error) = 0;
+};
+
+/** On-disk cache of compiled shader libraries.
+    There is one file per source file, target and set of defines. It's keyed by a hash of the source, every file it includes (recursively,
+    relative to the including file), the target string, the defines, and the compiler version. A hit is a single mapping of the cache file. Entries are written to a
+    temporary file and renamed over the old one, so a reader sees either the old or the new entry, never a partial one. A stale or damaged
+    entry is a miss, and is replaced by the new compilation.
+*/
+class ShaderCache
+{
+public:
+    ShaderCache(ShaderCompiler& compiler, const std::string& directory) : mCompiler(compiler), mDirectory(directory) {}
+
+    // Returns false if the source can't be read or doesn't compile. The reason is in error
+    bool getLibrary(const std::string& filename, const std::string& target, const std::vector<std::string>& defines, std::vector<uint8_t>& dxil, std::string& error);
+
+    // The cache file of a source file, target and set of defines. Defines are part of the name, so variants don't evict each other
+    std::string getEntryPath(const std::string& filename, const std::string& target, const std::vector<std::string>& defines) const;
+
+    uint32_t getHitCount() const { return mHitCount; }
+    uint32_t getMissCount() const { return mMissCount; }
+
+private:
+    bool computeKey(const std::string& filename, const std::string& target, const std::vector<std::string>& defines, std::string& source, uint64_t& key, std::string& error);
+    bool load(const std::string& path, uint64_t key, std::vector<uint8_t>& dxil) const;
+    void store(const std::string& path, uint64_t key, const std::vector<uint8_t>& dxil) const;
+
+    ShaderCompiler& mCompiler;
+    std::string mDirectory;
+    std::string mCompilerVersion;
+    bool mHasCompilerVersion = false;
+    uint32_t mHitCount = 0;
+    uint32_t mMissCount = 0;
+};
@@ -0,0 +1,121 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "ShaderTableBuilder.h"
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+namespace
+{
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+ShaderTableBuilder::Record& ShaderTableBuilder::Record::addDescriptor(uint64_t value)
+{
+    // The record starts at a kRecordAlignment boundary and the identifier is 32 bytes, so aligning the argument offset aligns the address
+    mArguments.resize((size_t)alignUp(mArguments.size(), sizeof(uint64_t)));
+    size_t offset = mArguments.size();
+    mArguments.resize(offset + sizeof(uint64_t));
+    memcpy(mArguments.data() + offset, &value, sizeof(value));
+    return *this;
+}
+
+ShaderTableBuilder::Record& ShaderTableBuilder::Record::addConstants(const void* pData, uint32_t size)
+{
+    assert((size % sizeof(uint32_t)) == 0);
+    mArguments.resize((size_t)alignUp(mArguments.size(), sizeof(uint32_t)));
+    size_t offset = mArguments.size();
+    mArguments.resize(offset + size);
+    memcpy(mArguments.data() + offset, pData, size);
+    return *this;
+}
+
+ShaderTableBuilder::Record& ShaderTableBuilder::addRecord(Region region, const void* pIdentifier)
+{
+    mRecords[(uint32_t)region].emplace_back();
+    Record& record = mRecords[(uint32_t)region].back();
+    memcpy(record.mIdentifier, pIdentifier, kShaderIdentifierSize);
+    return record;
+}
+
+ShaderTableBuilder::Record& ShaderTableBuilder::addRayGen(const void* pIdentifier)
+{
+    return addRecord(Region::RayGen, pIdentifier);
+}
+
+ShaderTableBuilder::Record& ShaderTableBuilder::addMiss(const void* pIdentifier)
+{
+    return addRecord(Region::Miss, pIdentifier);
+}
+
+ShaderTableBuilder::Record& ShaderTableBuilder::addHitGroup(const void* pIdentifier)
+{
+    return addRecord(Region::HitGroup, pIdentifier);
+}
+
+ShaderTableBuilder::RegionLayout ShaderTableBuilder::getLayout(Region region) const
+{
+    RegionLayout layout;
+    for (uint32_t r = 0; r <= (uint32_t)region; r++)
+    {
+        layout.offset = alignUp(layout.offset + layout.size, kTableAlignment);
+        layout.stride = 0;
+        for (const Record& record : mRecords[r]) layout.stride = std::max(layout.stride, uint64_t(record.getSize()));
+        layout.stride = alignUp(layout.stride, kRecordAlignment);
+        assert(layout.stride <= kMaxRecordStride);
+        layout.recordCount = (uint32_t)mRecords[r].size();
+        layout.size = layout.stride * layout.recordCount;
+    }
+    return layout;
+}
+
+uint64_t ShaderTableBuilder::getSize() const
+{
+    RegionLayout last = getLayout(Region::HitGroup);
+    return last.offset + last.size;
+}
+
+void ShaderTableBuilder::write(uint8_t* pDst) const
+{
+    assert(((uintptr_t)pDst % kTableAlignment) == 0);
+    memset(pDst, 0, (size_t)getSize());
+    for (uint32_t r = 0; r < (uint32_t)Region::Count; r++)
+    {
+        RegionLayout layout = getLayout((Region)r);
+        uint8_t* pRecord = pDst + layout.offset;
+        for (const Record& record : mRecords[r])
+        {
+            memcpy(pRecord, record.mIdentifier, kShaderIdentifierSize);
+            if (record.mArguments.empty() == false) memcpy(pRecord + kShaderIdentifierSize, record.mArguments.data(), record.mArguments.size());
+            pRecord += layout.stride;
+        }
+    }
+}
@@ -0,0 +1,94 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+/** Builds a shader table on the CPU, without the D3D12 headers.
+    The records are grouped in the ray-gen, miss and hit-group regions. Each region has its own stride, which is the size of its largest
+    record aligned to kRecordAlignment, and starts at a kTableAlignment boundary. Root arguments are packed after the shader identifier with
+    their natural alignment, 8 bytes for descriptors and 4 bytes for 32-bit constants.
+    Hit records are added per instance. beginInstance() returns the InstanceContributionToHitGroupIndex of the records added after it.
+*/
+class ShaderTableBuilder
+{
+public:
+    static const uint32_t kShaderIdentifierSize = 32;   // D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES
+    static const uint32_t kRecordAlignment = 32;        // D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT
+    static const uint32_t kTableAlignment = 64;         // D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT
+    static const uint32_t kMaxRecordStride = 4096;      // D3D12_RAYTRACING_MAX_SHADER_RECORD_STRIDE
+
+    enum class Region
+    {
+        RayGen,
+        Miss,
+        HitGroup,
+        Count
+    };
+
+    struct RegionLayout
+    {
+        uint64_t offset = 0;        // From the start of the table
+        uint64_t stride = 0;
+        uint64_t size = 0;
+        uint32_t recordCount = 0;
+    };
+
+    class Record
+    {
+    public:
+        // A root descriptor (GPU virtual address) or a descriptor table (GPU descriptor handle)
+        Record& addDescriptor(uint64_t value);
+        // 32-bit root constants. size must be a multiple of 4
+        Record& addConstants(const void* pData, uint32_t size);
+        uint32_t getSize() const { return kShaderIdentifierSize + (uint32_t)mArguments.size(); }
+
+    private:
+        friend class ShaderTableBuilder;
+        uint8_t mIdentifier[kShaderIdentifierSize];
+        std::vector<uint8_t> mArguments;
+    };
+
+    // The identifiers are copied, pIdentifier is what ID3D12StateObjectProperties::GetShaderIdentifier() returns
+    Record& addRayGen(const void* pIdentifier);
+    Record& addMiss(const void* pIdentifier);
+    uint32_t beginInstance() const { return getRecordCount(Region::HitGroup); }
+    Record& addHitGroup(const void* pIdentifier);
+
+    uint32_t getRecordCount(Region region) const { return (uint32_t)mRecords[(uint32_t)region].size(); }
+    RegionLayout getLayout(Region region) const;
+    uint64_t getSize() const;
+
+    // pDst needs getSize() bytes and kTableAlignment alignment. The padding is zeroed, so the output is deterministic
+    void write(uint8_t* pDst) const;
+
+private:
+    Record& addRecord(Region region, const void* pIdentifier);
+    std::deque<Record> mRecords[(uint32_t)Region::Count];     // A deque, so the references we return stay valid
+};
@@ -0,0 +1,183 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "TaskGraph.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+
+// What run() shares with the tasks
+struct TaskGraph::RunState
+{
+    // A task as a job. The jobs must live until the counter is zero
+    struct TaskJob
+    {
+        TaskGraph* pGraph;
+        RunState* pState;
+        TaskId id;
+        void operator()() const { pGraph->runTask(id, *pState); }
+    };
+
+    explicit RunState(JobSystem& jobSystem, uint32_t taskCount) : jobs(jobSystem), taskJobs(taskCount), waitingFor(taskCount), finished(0) {}
+
+    JobSystem& jobs;
+    JobCounter counter;
+    std::vector<TaskJob> taskJobs;
+    std::vector<std::atomic<uint32_t>> waitingFor;
+    std::atomic<uint32_t> finished;
+    std::mutex mainMutex;
+    std::deque<TaskId> mainReady;
+    Clock::time_point start;
+};
+
+TaskGraph::TaskId TaskGraph::addTask(const char* name, std::function<void()> work, const std::vector<TaskId>& dependencies, Affinity affinity)
+{
+    const TaskId id = (TaskId)mTasks.size();
+    Task task;
+    task.name = name;
+    task.work = std::move(work);
+    task.affinity = affinity;
+    for (TaskId dependency : dependencies)
+    {
+        // Only earlier tasks, a dependency that repeats counts once
+        assert(dependency < id);
+        if (std::find(task.dependencies.begin(), task.dependencies.end(), dependency) != task.dependencies.end()) continue;
+        task.dependencies.push_back(dependency);
+        mTasks[dependency].dependents.push_back(id);
+    }
+    mTasks.push_back(std::move(task));
+    return id;
+}
+
+void TaskGraph::run(JobSystem& jobs)
+{
+    assert(jobs.getWorkerIndex() == 0);
+    const uint32_t taskCount = (uint32_t)mTasks.size();
+    RunState state(jobs, taskCount);
+    state.start = Clock::now();
+    for (TaskId i = 0; i < taskCount; i++)
+    {
+        RunState::TaskJob job = { this, &state, i };
+        state.taskJobs[i] = job;
+        state.waitingFor[i] = (uint32_t)mTasks[i].dependencies.size();
+    }
+    for (TaskId i = 0; i < taskCount; i++)
+    {
+        if (mTasks[i].dependencies.empty()) schedule(i, state);
+    }
+
+    // The main-thread tasks first, they are the only ones the other workers can't help with
+    while (state.finished.load(std::memory_order_acquire) < taskCount)
+    {
+        bool mainTask = false;
+        TaskId id = 0;
+        {
+            std::lock_guard<std::mutex> lock(state.mainMutex);
+            if (state.mainReady.empty() == false)
+            {
+                mainTask = true;
+                id = state.mainReady.front();
+                state.mainReady.pop_front();
+            }
+        }
+        if (mainTask) runTask(id, state);
+        else if (jobs.runPendingJob() == false) std::this_thread::yield();
+    }
+    // Every task finished, the jobs that ran them may still be returning
+    jobs.wait(state.counter);
+    mRunTime = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - state.start).count();
+}
+
+void TaskGraph::schedule(TaskId id, RunState& state)
+{
+    if (mTasks[id].affinity == Affinity::MainThread)
+    {
+        std::lock_guard<std::mutex> lock(state.mainMutex);
+        state.mainReady.push_back(id);
+    }
+    else
+    {
+        state.jobs.run(state.counter, state.taskJobs[id]);
+    }
+}
+
+void TaskGraph::runTask(TaskId id, RunState& state)
+{
+    Task& task = mTasks[id];
+    task.timing.thread = state.jobs.getWorkerIndex();
+    task.timing.start = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - state.start).count();
+    if (mpProfiler)
+    {
+        Profiler::Scope scope(*mpProfiler, task.name);
+        task.work();
+    }
+    else
+    {
+        task.work();
+    }
+    task.timing.end = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - state.start).count();
+
+    // The last dependency to finish schedules the task. acq_rel passes what every dependency wrote on to it
+    for (TaskId dependent : task.dependents)
+    {
+        if (state.waitingFor[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1) schedule(dependent, state);
+    }
+    state.finished.fetch_add(1, std::memory_order_release);
+}
+
+uint64_t TaskGraph::getCriticalPathTime() const
+{
+    // The tasks are in topological order, the dependencies of a task come before it
+    std::vector<uint64_t> pathEnd(mTasks.size());
+    uint64_t longest = 0;
+    for (TaskId i = 0; i < (TaskId)mTasks.size(); i++)
+    {
+        uint64_t pathStart = 0;
+        for (TaskId dependency : mTasks[i].dependencies) pathStart = std::max(pathStart, pathEnd[dependency]);
+        pathEnd[i] = pathStart + (mTasks[i].timing.end - mTasks[i].timing.start);
+        longest = std::max(longest, pathEnd[i]);
+    }
+    return longest;
+}
+
+void TaskGraph::printTimings() const
+{
+    printf("%-32s %6s %10s %10s\n", "Task", "Thread", "Start ms", "Time ms");
+    uint64_t taskTime = 0;
+    for (const Task& task : mTasks)
+    {
+        printf("%-32s %6u %10.3f %10.3f\n", task.name, task.timing.thread, task.timing.start * 1e-6, (task.timing.end - task.timing.start) * 1e-6);
+        taskTime += task.timing.end - task.timing.start;
+    }
+    printf("%.3f ms, %.3f ms of tasks, %.3f ms critical path\n", mRunTime * 1e-6, taskTime * 1e-6, getCriticalPathTime() * 1e-6);
+}
@@ -0,0 +1,101 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+class JobSystem;
+class Profiler;
+
+/** Runs a fixed set of tasks on a JobSystem, each one once the tasks it depends on finished.
+    A task can only depend on tasks added before it, so the graph can't have cycles. A task that is ready becomes a job, except for the
+    MainThread tasks. They only run on the thread that calls run(), for the work that has to stay on the thread that owns the window, and
+    that thread runs jobs while none of them is ready. run() records when every task ran and on which thread, and if
+    the graph has a profiler every task is also a Profiler::Scope on the thread that ran it, so it shows up in the Chrome trace.
+    It doesn't depend on D3D12, so the benchmarks run it with stand-in stages.
+*/
+class TaskGraph
+{
+public:
+    typedef uint32_t TaskId;
+
+    enum class Affinity
+    {
+        AnyThread,
+        MainThread,
+    };
+
+    struct Timing
+    {
+        uint64_t start = 0;     // Nanoseconds since run() started
+        uint64_t end = 0;
+        uint32_t thread = 0;    // The worker of the JobSystem, 0 is the thread that called run()
+    };
+
+    explicit TaskGraph(Profiler* pProfiler = nullptr) : mpProfiler(pProfiler) {}
+
+    // name must outlive the graph, use string literals. The dependencies must be tasks that were already added
+    TaskId addTask(const char* name, std::function<void()> work, const std::vector<TaskId>& dependencies = std::vector<TaskId>(), Affinity affinity = Affinity::AnyThread);
+
+    // Runs every task on jobs and returns once they all finished. Call it on the thread that created jobs, its worker 0. With a single
+    // worker every task runs on the calling thread
+    void run(JobSystem& jobs);
+
+    uint32_t getTaskCount() const { return (uint32_t)mTasks.size(); }
+    const char* getName(TaskId task) const { return mTasks[task].name; }
+    const std::vector<TaskId>& getDependencies(TaskId task) const { return mTasks[task].dependencies; }
+    const Timing& getTiming(TaskId task) const { return mTasks[task].timing; }
+    // The wall-clock time of the last run(), and the longest chain of dependent tasks in it. The difference is what the threads waited for
+    uint64_t getRunTime() const { return mRunTime; }
+    uint64_t getCriticalPathTime() const;
+
+    void printTimings() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Task
+    {
+        const char* name;
+        std::function<void()> work;
+        std::vector<TaskId> dependencies;
+        std::vector<TaskId> dependents;
+        Affinity affinity;
+        Timing timing;
+    };
+
+    struct RunState;
+    void schedule(TaskId id, RunState& state);
+    void runTask(TaskId id, RunState& state);
+
+    std::vector<Task> mTasks;
+    Profiler* mpProfiler;
+    uint64_t mRunTime = 0;
+};
@@ -0,0 +1,140 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "TlasModel.h"
+#include <algorithm>
+#include <float.h>
+
+namespace
+{
+    float surfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 e = glm::max(boundsMax - boundsMin, glm::vec3(0));
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+}
+
+void TlasModel::build(const std::vector<InstanceBounds>& instances)
+{
+    mInstanceCount = (uint32_t)instances.size();
+    mNodes.clear();
+    if (mInstanceCount == 0)
+    {
+        mSahCost = mBuildSahCost = 0;
+        return;
+    }
+
+    std::vector<uint32_t> order(mInstanceCount);
+    for (uint32_t i = 0; i < mInstanceCount; i++) order[i] = i;
+
+    // A binary tree with one instance per leaf has 2N-1 nodes
+    mNodes.reserve(size_t(mInstanceCount) * 2 - 1);
+    mNodes.emplace_back();
+    buildRecursive(instances, 0, order.data(), order.data() + order.size());
+    computeSahCost();
+    mBuildSahCost = mSahCost;
+}
+
+void TlasModel::buildRecursive(const std::vector<InstanceBounds>& instances, uint32_t nodeIndex, uint32_t* pBegin, uint32_t* pEnd)
+{
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    glm::vec3 centroidMin(FLT_MAX);
+    glm::vec3 centroidMax(-FLT_MAX);
+    for (uint32_t* p = pBegin; p < pEnd; p++)
+    {
+        const InstanceBounds& b = instances[*p];
+        boundsMin = glm::min(boundsMin, b.boundsMin);
+        boundsMax = glm::max(boundsMax, b.boundsMax);
+        glm::vec3 c = (b.boundsMin + b.boundsMax) * 0.5f;
+        centroidMin = glm::min(centroidMin, c);
+        centroidMax = glm::max(centroidMax, c);
+    }
+    mNodes[nodeIndex].boundsMin = boundsMin;
+    mNodes[nodeIndex].boundsMax = boundsMax;
+
+    if (pEnd - pBegin == 1)
+    {
+        mNodes[nodeIndex].leftOrInstance = *pBegin;
+        mNodes[nodeIndex].isLeaf = 1;
+        return;
+    }
+
+    glm::vec3 extent = centroidMax - centroidMin;
+    int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : ((extent.y >= extent.z) ? 1 : 2);
+    uint32_t* pMid = pBegin + (pEnd - pBegin) / 2;
+    std::nth_element(pBegin, pMid, pEnd, [&](uint32_t a, uint32_t b)
+    {
+        return (instances[a].boundsMin[axis] + instances[a].boundsMax[axis]) < (instances[b].boundsMin[axis] + instances[b].boundsMax[axis]);
+    });
+
+    uint32_t leftChild = (uint32_t)mNodes.size();
+    mNodes[nodeIndex].leftOrInstance = leftChild;
+    mNodes.emplace_back();
+    mNodes.emplace_back();
+    buildRecursive(instances, leftChild, pBegin, pMid);
+    buildRecursive(instances, leftChild + 1, pMid, pEnd);
+}
+
+void TlasModel::refit(const std::vector<InstanceBounds>& instances)
+{
+    if (instances.size() != mInstanceCount)
+    {
+        build(instances);
+        return;
+    }
+
+    for (size_t i = mNodes.size(); i-- > 0;)
+    {
+        Node& node = mNodes[i];
+        if (node.isLeaf)
+        {
+            node.boundsMin = instances[node.leftOrInstance].boundsMin;
+            node.boundsMax = instances[node.leftOrInstance].boundsMax;
+        }
+        else
+        {
+            const Node& left = mNodes[node.leftOrInstance];
+            const Node& right = mNodes[node.leftOrInstance + 1];
+            node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+            node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+        }
+    }
+    computeSahCost();
+}
+
+void TlasModel::computeSahCost()
+{
+    mSahCost = 0;
+    float rootArea = surfaceArea(mNodes[0].boundsMin, mNodes[0].boundsMax);
+    if (rootArea <= 0) return;
+
+    // Traversal cost is 1, intersection cost is 1
+    double cost = 0;
+    for (const Node& node : mNodes) cost += surfaceArea(node.boundsMin, node.boundsMax);
+    mSahCost = float(cost / rootArea);
+}
@@ -0,0 +1,76 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "Geometry.h"
+
+struct InstanceBounds
+{
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+/** A CPU model of the top-level acceleration structure.
+    The driver's TLAS is opaque, so we keep our own BVH over the instance bounds and refit it the same way PERFORM_UPDATE does: the topology stays
+    and the boxes grow to fit the moved instances. Comparing its SAH cost against the cost right after the last build tells us how much the refits
+    have degraded the tree, which is what InstanceTable uses to choose between a refit and a full rebuild.
+*/
+class TlasModel
+{
+public:
+    // Median split on the largest axis, one instance per leaf
+    void build(const std::vector<InstanceBounds>& instances);
+
+    // Keep the topology and recompute the node bounds. The instance count must match the last build()
+    void refit(const std::vector<InstanceBounds>& instances);
+
+    // The SAH cost with traversal and intersection costs of 1, relative to the root area so scaling the whole scene doesn't change it
+    float getSahCost() const { return mSahCost; }
+    float getBuildSahCost() const { return mBuildSahCost; }
+
+    // 1 right after build(). A refit that lets the boxes overlap more makes it grow
+    float getDegradation() const { return (mBuildSahCost > 0) ? mSahCost / mBuildSahCost : 1.0f; }
+
+    uint32_t getInstanceCount() const { return mInstanceCount; }
+
+private:
+    struct Node
+    {
+        glm::vec3 boundsMin;
+        uint32_t leftOrInstance = 0;    // The first child of an inner node (the second child follows it), or the instance index of a leaf
+        glm::vec3 boundsMax;
+        uint32_t isLeaf = 0;
+    };
+
+    void buildRecursive(const std::vector<InstanceBounds>& instances, uint32_t nodeIndex, uint32_t* pBegin, uint32_t* pEnd);
+    void computeSahCost();
+
+    std::vector<Node> mNodes;   // Children always come after their parent, so refit() can walk the array backwards
+    uint32_t mInstanceCount = 0;
+    float mSahCost = 0;
+    float mBuildSahCost = 0;
+};
@@ -0,0 +1,116 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "UploadHeap.h"
+#include <algorithm>
+
+void UploadHeap::init(ID3D12Device5Ptr pDevice, uint64_t pageSize)
+{
+    mpDevice = pDevice;
+    mPageSize = pageSize;
+}
+
+void UploadHeap::release()
+{
+    // The pages are released with the resource, no need to unmap them
+    mPages.clear();
+}
+
+UploadAllocation UploadHeap::allocatePersistent(uint64_t size, uint64_t alignment)
+{
+    // Blocks start at multiples of kBlockSize. Other alignments may need up to alignment - 1 bytes of padding
+    const uint64_t padding = (kBlockSize % alignment == 0) ? 0 : alignment - 1;
+    const uint32_t blockCount = (uint32_t)((size + padding + kBlockSize - 1) / kBlockSize);
+
+    UploadAllocation allocation;
+    allocation.firstBlock = DescriptorAllocator::kInvalidIndex;
+    for (uint32_t i = 0; i < (uint32_t)mPages.size(); i++)
+    {
+        allocation.firstBlock = mPages[i].blocks.allocatePersistent(blockCount);
+        if (allocation.firstBlock != DescriptorAllocator::kInvalidIndex)
+        {
+            allocation.page = i;
+            break;
+        }
+    }
+
+    if (allocation.firstBlock == DescriptorAllocator::kInvalidIndex)
+    {
+        // All the pages are full or their free blocks are still in use by the GPU. Add a new one
+        D3D12_HEAP_PROPERTIES heapProps = {};
+        heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+
+        D3D12_RESOURCE_DESC bufDesc = {};
+        bufDesc.DepthOrArraySize = 1;
+        bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+        bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+        bufDesc.Height = 1;
+        bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+        bufDesc.MipLevels = 1;
+        bufDesc.SampleDesc.Count = 1;
+        bufDesc.Width = std::max(mPageSize, align_to(uint64_t(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT), blockCount * kBlockSize));
+
+        Page page;
+        d3d_call(mpDevice->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&page.pBuffer)));
+        page.pBuffer->SetName(L"Upload Page");
+        d3d_call(page.pBuffer->Map(0, nullptr, (void**)&page.pData));
+        page.blocks.reset((uint32_t)(bufDesc.Width / kBlockSize), 0);
+        allocation.page = (uint32_t)mPages.size();
+        allocation.firstBlock = page.blocks.allocatePersistent(blockCount);
+        mPages.push_back(std::move(page));
+    }
+
+    const Page& page = mPages[allocation.page];
+    allocation.blockCount = blockCount;
+    allocation.pResource = page.pBuffer;
+    allocation.offset = align_to(alignment, allocation.firstBlock * kBlockSize);
+    allocation.pData = page.pData + allocation.offset;
+    allocation.gpuAddress = page.pBuffer->GetGPUVirtualAddress() + allocation.offset;
+    return allocation;
+}
+
+void UploadHeap::freePersistent(const UploadAllocation& allocation)
+{
+    if (allocation.pResource == nullptr) return;
+    mPages[allocation.page].blocks.freePersistent(allocation.firstBlock, allocation.blockCount);
+}
+
+void UploadHeap::endFrame(uint64_t fenceValue)
+{
+    for (Page& page : mPages)
+    {
+        page.blocks.endFrame(fenceValue);
+    }
+}
+
+void UploadHeap::retire(uint64_t completedFenceValue)
+{
+    for (Page& page : mPages)
+    {
+        page.blocks.retire(completedFenceValue);
+    }
+}
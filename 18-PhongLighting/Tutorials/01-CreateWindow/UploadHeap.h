@@ -0,0 +1,81 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "Framework.h"
+#include "DescriptorAllocator.h"
+
+// A range of an upload-heap page. The page stays mapped, so pData can be written at any time the GPU isn't reading the range
+struct UploadAllocation
+{
+    ID3D12Resource* pResource = nullptr;
+    uint64_t offset = 0;
+    uint8_t* pData = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS gpuAddress = 0;
+    uint32_t page = 0;          // The blocks freePersistent() returns
+    uint32_t firstBlock = 0;
+    uint32_t blockCount = 0;
+};
+
+/** Suballocates upload-heap memory from a few large buffers instead of creating a committed resource for every buffer.
+    The pages are split into kBlockSize blocks, managed by the persistent free list of a DescriptorAllocator with a block per index.
+    Allocations live until freePersistent(). The frames in flight can still read a freed range, so endFrame() tags the frees with the fence
+    value of the frame and retire() reuses the blocks once the fence completes. Requests larger than the page size get a page of their own.
+*/
+class UploadHeap
+{
+public:
+    static const uint64_t kDefaultPageSize = 4 * 1024 * 1024;
+    static const uint64_t kBlockSize = 256;
+    static const uint64_t kConstantBufferAlignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+    static const uint64_t kShaderTableAlignment = D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT;
+    static const uint64_t kInstanceDescAlignment = D3D12_RAYTRACING_INSTANCE_DESCS_BYTE_ALIGNMENT;
+
+    void init(ID3D12Device5Ptr pDevice, uint64_t pageSize = kDefaultPageSize);
+    void release();
+
+    // The alignment doesn't have to be a power of 2, so a structured-buffer SRV can start at any element
+    UploadAllocation allocatePersistent(uint64_t size, uint64_t alignment);
+    void freePersistent(const UploadAllocation& allocation);
+
+    // Call after the frame's command list was submitted and fenceValue was signaled
+    void endFrame(uint64_t fenceValue);
+    void retire(uint64_t completedFenceValue);
+
+    uint32_t getPageCount() const { return (uint32_t)mPages.size(); }
+private:
+    struct Page
+    {
+        ID3D12ResourcePtr pBuffer;
+        uint8_t* pData = nullptr;
+        DescriptorAllocator blocks;
+    };
+
+    ID3D12Device5Ptr mpDevice;
+    uint64_t mPageSize = kDefaultPageSize;
+    std::vector<Page> mPages;
+};
@@ -0,0 +1,262 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "WideBvh.h"
+#include <emmintrin.h>
+#include <limits>
+
+namespace
+{
+    // The BVH8 node counts Kernel::Auto traces any-hit queries with SSE for. Shadow rays against spheres of 48 to 2000 triangles ran 1% to 10%
+    // faster with SSE, depending on the CPU. AVX2 was faster below, where the whole BVH is a few box tests, and above
+    const size_t kSseAnyHitMinNodes = 8;
+    const size_t kSseAnyHitMaxNodes = 512;
+
+    // Tests the 8 children as two groups of 4
+    class BoxTestSse
+    {
+    public:
+        explicit BoxTestSse(const WideBvhRay& ray)
+        {
+            for (uint32_t axis = 0; axis < 3; axis++)
+            {
+                float invDir = 1.0f / ray.direction[axis];
+                mOrigin[axis] = _mm_set1_ps(ray.origin[axis]);
+                mInvDir[axis] = _mm_set1_ps(invDir);
+                // Pick the near and far planes from the ray direction, so no min/max is needed per axis. This also makes the empty slots miss, since their min is greater than their max
+                mNearIsMin[axis] = (invDir >= 0);
+            }
+            mTMin = _mm_set1_ps(ray.tMin);
+        }
+
+        uint32_t test(const WideBvhNode& node, float tMax, float dist[kWideBvhWidth]) const
+        {
+            const __m128 tMaxV = _mm_set1_ps(tMax);
+            uint32_t mask = 0;
+            for (uint32_t half = 0; half < kWideBvhWidth; half += 4)
+            {
+                __m128 tNear[3];
+                __m128 tFar[3];
+                for (uint32_t axis = 0; axis < 3; axis++)
+                {
+                    const float* pNear = mNearIsMin[axis] ? node.minBounds[axis] : node.maxBounds[axis];
+                    const float* pFar = mNearIsMin[axis] ? node.maxBounds[axis] : node.minBounds[axis];
+                    tNear[axis] = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pNear + half), mOrigin[axis]), mInvDir[axis]);
+                    tFar[axis] = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pFar + half), mOrigin[axis]), mInvDir[axis]);
+                }
+                __m128 entry = _mm_max_ps(_mm_max_ps(tNear[0], tNear[1]), _mm_max_ps(tNear[2], mTMin));
+                __m128 exit = _mm_min_ps(_mm_min_ps(tFar[0], tFar[1]), _mm_min_ps(tFar[2], tMaxV));
+                mask |= uint32_t(_mm_movemask_ps(_mm_cmple_ps(entry, exit))) << half;
+                _mm_storeu_ps(dist + half, entry);
+            }
+            return mask;
+        }
+
+    private:
+        __m128 mOrigin[3];
+        __m128 mInvDir[3];
+        __m128 mTMin;
+        bool mNearIsMin[3];
+    };
+}
+
+#include "WideBvhTraversal.inl"
+
+bool intersectWideBvhSse(const WideBvhNode* pNodes, const WideBvhTriangle* pTriangles, const WideBvhRay& ray, bool acceptFirstHit, WideBvhHit& hit)
+{
+    return traverseWideBvh<BoxTestSse>(pNodes, pTriangles, ray, acceptFirstHit, hit);
+}
+
+#if defined(_MSC_VER)
+bool cpuSupportsAvx2()
+{
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    // AVX and OSXSAVE, then check that the OS saves the YMM registers
+    __cpuid(info, 1);
+    const int kAvxAndOsxsave = (1 << 27) | (1 << 28);
+    if ((info[2] & kAvxAndOsxsave) != kAvxAndOsxsave) return false;
+    if ((_xgetbv(0) & 6) != 6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+#else
+bool cpuSupportsAvx2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+}
+#endif
+
+void WideBvh::build(const Bvh& bvh)
+{
+    mNodes.clear();
+    mTriangles.clear();
+
+    const std::vector<Bvh::Triangle>& triangles = bvh.getTriangles();
+    mTriangles.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        const Bvh::Triangle& src = triangles[i];
+        WideBvhTriangle& dst = mTriangles[i];
+        glm::vec3 e1 = src.v1 - src.v0;
+        glm::vec3 e2 = src.v2 - src.v0;
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            dst.v0[axis] = src.v0[axis];
+            dst.e1[axis] = e1[axis];
+            dst.e2[axis] = e2[axis];
+        }
+        dst.geometryIndex = src.geometryIndex;
+        dst.primitiveIndex = src.primitiveIndex;
+    }
+
+    if (mTriangles.empty() == false)
+    {
+        mNodes.reserve(bvh.getNodes().size() / 4 + 1);
+        collapse(bvh, 0);
+    }
+
+    setKernel(Kernel::Auto);
+}
+
+uint32_t WideBvh::collapse(const Bvh& bvh, uint32_t binaryNodeIndex)
+{
+    const std::vector<Bvh::Node>& nodes = bvh.getNodes();
+
+    // Open up the inner child with the largest surface area until there are 8 children. A leaf root becomes the only child
+    uint32_t children[kWideBvhWidth];
+    uint32_t childCount = 0;
+    const Bvh::Node& root = nodes[binaryNodeIndex];
+    if (root.isLeaf())
+    {
+        children[childCount++] = binaryNodeIndex;
+    }
+    else
+    {
+        children[childCount++] = root.leftOrFirst;
+        children[childCount++] = root.leftOrFirst + 1;
+    }
+
+    while (childCount < kWideBvhWidth)
+    {
+        int32_t best = -1;
+        float bestArea = -1;
+        for (uint32_t i = 0; i < childCount; i++)
+        {
+            const Bvh::Node& child = nodes[children[i]];
+            if (child.isLeaf()) continue;
+            glm::vec3 e = child.boundsMax - child.boundsMin;
+            float area = e.x * e.y + e.y * e.z + e.z * e.x;
+            if (area > bestArea)
+            {
+                best = int32_t(i);
+                bestArea = area;
+            }
+        }
+        if (best < 0) break;
+
+        uint32_t first = nodes[children[best]].leftOrFirst;
+        children[best] = first;
+        children[childCount++] = first + 1;
+    }
+
+    uint32_t wideIndex = (uint32_t)mNodes.size();
+    mNodes.emplace_back();
+    for (uint32_t slot = 0; slot < kWideBvhWidth; slot++)
+    {
+        // mNodes can grow while collapsing the children, so don't hold a reference to it
+        uint32_t child = 0;
+        uint32_t triangleCount = 0;
+        glm::vec3 boundsMin(std::numeric_limits<float>::infinity());
+        glm::vec3 boundsMax(-std::numeric_limits<float>::infinity());
+        if (slot < childCount)
+        {
+            const Bvh::Node& node = nodes[children[slot]];
+            boundsMin = node.boundsMin;
+            boundsMax = node.boundsMax;
+            if (node.isLeaf())
+            {
+                child = node.leftOrFirst;
+                triangleCount = node.triangleCount;
+            }
+            else
+            {
+                child = collapse(bvh, children[slot]);
+            }
+        }
+
+        WideBvhNode& wide = mNodes[wideIndex];
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            wide.minBounds[axis][slot] = boundsMin[axis];
+            wide.maxBounds[axis][slot] = boundsMax[axis];
+        }
+        wide.child[slot] = child;
+        wide.triangleCount[slot] = triangleCount;
+    }
+    return wideIndex;
+}
+
+void WideBvh::setKernel(Kernel kernel)
+{
+    static const bool sAvx2 = cpuSupportsAvx2();
+    mKernel = sAvx2 ? kernel : Kernel::Sse;
+    mClosestHitKernel = (mKernel == Kernel::Auto) ? Kernel::Avx2 : mKernel;
+    mAnyHitKernel = mClosestHitKernel;
+    if (mKernel == Kernel::Auto && mNodes.size() >= kSseAnyHitMinNodes && mNodes.size() < kSseAnyHitMaxNodes) mAnyHitKernel = Kernel::Sse;
+}
+
+bool WideBvh::intersect(const RayDesc& ray, bool acceptFirstHit, Hit& hit) const
+{
+    if (mNodes.empty()) return false;
+
+    WideBvhRay wideRay;
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        wideRay.origin[axis] = ray.origin[axis];
+        wideRay.direction[axis] = ray.direction[axis];
+    }
+    wideRay.tMin = ray.tMin;
+    wideRay.tMax = ray.tMax;
+
+    WideBvhHit wideHit;
+    const Kernel kernel = acceptFirstHit ? mAnyHitKernel : mClosestHitKernel;
+    bool found = (kernel == Kernel::Avx2) ?
+        intersectWideBvhAvx2(mNodes.data(), mTriangles.data(), wideRay, acceptFirstHit, wideHit) :
+        intersectWideBvhSse(mNodes.data(), mTriangles.data(), wideRay, acceptFirstHit, wideHit);
+    if (found == false) return false;
+
+    hit.t = wideHit.t;
+    hit.barycentrics = glm::vec2(wideHit.u, wideHit.v);
+    hit.geometryIndex = wideHit.geometryIndex;
+    hit.primitiveIndex = wideHit.primitiveIndex;
+    return true;
+}
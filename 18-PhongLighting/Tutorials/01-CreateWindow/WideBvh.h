@@ -0,0 +1,75 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "Bvh.h"
+#include "WideBvhKernels.h"
+
+/** An 8-wide BVH collapsed from a binary Bvh.
+    Each node stores the bounds of up to 8 children, so a ray tests all of them with a handful of AVX2 instructions instead of walking 3 levels of the binary tree.
+    The AVX2 kernel is picked at runtime. CPUs without AVX2 fall back to SSE, which tests a node as two halves of 4 children. Any-hit queries on
+    mid-sized BVHs also use SSE, they measured as fast or faster with it.
+*/
+class WideBvh
+{
+public:
+    enum class Kernel
+    {
+        Sse,
+        Avx2,
+        Auto,   // AVX2 for closest-hit queries. Any-hit queries use SSE on the BVH sizes where it measured faster, see setKernel()
+    };
+
+    struct Hit
+    {
+        float t = 0;
+        glm::vec2 barycentrics;
+        uint32_t geometryIndex = 0;
+        uint32_t primitiveIndex = 0;
+    };
+
+    // The triangles keep the order of the source BVH
+    void build(const Bvh& bvh);
+
+    // Find the closest hit. If acceptFirstHit is true, return as soon as anything is hit (RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH)
+    bool intersect(const RayDesc& ray, bool acceptFirstHit, Hit& hit) const;
+
+    // build() selects Kernel::Auto. On a CPU without AVX2 every kernel is SSE
+    void setKernel(Kernel kernel);
+    Kernel getKernel() const { return mKernel; }
+
+    const std::vector<WideBvhNode>& getNodes() const { return mNodes; }
+
+private:
+    uint32_t collapse(const Bvh& bvh, uint32_t binaryNodeIndex);
+
+    std::vector<WideBvhNode> mNodes;
+    std::vector<WideBvhTriangle> mTriangles;
+    Kernel mKernel = Kernel::Sse;
+    Kernel mClosestHitKernel = Kernel::Sse;
+    Kernel mAnyHitKernel = Kernel::Sse;
+};
@@ -0,0 +1,83 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+// This file is compiled with /arch:AVX2. It must not include anything with inline functions that other files also use, see WideBvhKernels.h
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC target("avx2")
+#endif
+#include <immintrin.h>
+#include "WideBvhKernels.h"
+
+namespace
+{
+    // Tests the 8 children at once. Same math as BoxTestSse
+    class BoxTestAvx2
+    {
+    public:
+        explicit BoxTestAvx2(const WideBvhRay& ray)
+        {
+            for (uint32_t axis = 0; axis < 3; axis++)
+            {
+                float invDir = 1.0f / ray.direction[axis];
+                mOrigin[axis] = _mm256_set1_ps(ray.origin[axis]);
+                mInvDir[axis] = _mm256_set1_ps(invDir);
+                mNearIsMin[axis] = (invDir >= 0);
+            }
+            mTMin = _mm256_set1_ps(ray.tMin);
+        }
+
+        uint32_t test(const WideBvhNode& node, float tMax, float dist[kWideBvhWidth]) const
+        {
+            __m256 tNear[3];
+            __m256 tFar[3];
+            for (uint32_t axis = 0; axis < 3; axis++)
+            {
+                const float* pNear = mNearIsMin[axis] ? node.minBounds[axis] : node.maxBounds[axis];
+                const float* pFar = mNearIsMin[axis] ? node.maxBounds[axis] : node.minBounds[axis];
+                tNear[axis] = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(pNear), mOrigin[axis]), mInvDir[axis]);
+                tFar[axis] = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(pFar), mOrigin[axis]), mInvDir[axis]);
+            }
+            __m256 entry = _mm256_max_ps(_mm256_max_ps(tNear[0], tNear[1]), _mm256_max_ps(tNear[2], mTMin));
+            __m256 exit = _mm256_min_ps(_mm256_min_ps(tFar[0], tFar[1]), _mm256_min_ps(tFar[2], _mm256_set1_ps(tMax)));
+            _mm256_storeu_ps(dist, entry);
+            return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ)));
+        }
+
+    private:
+        __m256 mOrigin[3];
+        __m256 mInvDir[3];
+        __m256 mTMin;
+        bool mNearIsMin[3];
+    };
+}
+
+#include "WideBvhTraversal.inl"
+
+bool intersectWideBvhAvx2(const WideBvhNode* pNodes, const WideBvhTriangle* pTriangles, const WideBvhRay& ray, bool acceptFirstHit, WideBvhHit& hit)
+{
+    return traverseWideBvh<BoxTestAvx2>(pNodes, pTriangles, ray, acceptFirstHit, hit);
+}
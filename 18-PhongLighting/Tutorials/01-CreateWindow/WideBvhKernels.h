@@ -0,0 +1,78 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <stdint.h>
+
+/** The BVH8 layout and the traversal kernels used by WideBvh.
+    This header doesn't include GLM. The AVX2 kernel lives in its own translation unit which is compiled with AVX2 enabled, and sharing inline
+    functions with the rest of the code would let the linker pick AVX2 copies of them for code that runs on CPUs without AVX2.
+*/
+static const uint32_t kWideBvhWidth = 8;
+
+// 256 bytes. The child bounds are stored SoA so all 8 boxes can be tested at once. Empty slots have min = +inf and max = -inf, so they never get hit
+struct WideBvhNode
+{
+    float minBounds[3][kWideBvhWidth];          // x, y, z
+    float maxBounds[3][kWideBvhWidth];
+    uint32_t child[kWideBvhWidth];              // The node index of an inner child, the first triangle of a leaf
+    uint32_t triangleCount[kWideBvhWidth];      // 0 for inner children and empty slots
+};
+
+// The edges are precomputed for the ray/triangle test
+struct WideBvhTriangle
+{
+    float v0[3];
+    float e1[3];    // v1 - v0
+    float e2[3];    // v2 - v0
+    uint32_t geometryIndex;
+    uint32_t primitiveIndex;
+};
+
+struct WideBvhRay
+{
+    float origin[3];
+    float direction[3];
+    float tMin;
+    float tMax;
+};
+
+struct WideBvhHit
+{
+    float t;
+    float u;        // Barycentric of v1
+    float v;        // Barycentric of v2
+    uint32_t geometryIndex;
+    uint32_t primitiveIndex;
+};
+
+// Node 0 is the root. If acceptFirstHit is true the traversal stops at the first hit, otherwise it returns the closest one
+bool intersectWideBvhSse(const WideBvhNode* pNodes, const WideBvhTriangle* pTriangles, const WideBvhRay& ray, bool acceptFirstHit, WideBvhHit& hit);
+bool intersectWideBvhAvx2(const WideBvhNode* pNodes, const WideBvhTriangle* pTriangles, const WideBvhRay& ray, bool acceptFirstHit, WideBvhHit& hit);
+
+// Checks both the CPU and the OS support for AVX2
+bool cpuSupportsAvx2();
@@ -0,0 +1,163 @@
+/***************************************************************************
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+
+// The traversal loop shared by the SSE and AVX2 kernels. Everything in here has internal linkage, see WideBvhKernels.h
+// Include it after defining the BoxTest class. The only difference between the kernels is how the 8 child boxes are tested
+#include "WideBvhKernels.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+    // Up to 7 entries get pushed per level
+    const uint32_t kWideBvhStackSize = 256;
+
+    struct StackEntry
+    {
+        uint32_t index;             // Node index, or the first triangle of a leaf
+        uint32_t triangleCount;     // 0 for nodes
+        float dist;                 // Entry distance of the box
+    };
+
+    inline uint32_t firstBitIndex(uint32_t mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return (uint32_t)__builtin_ctz(mask);
+#endif
+    }
+
+    // Not std::isfinite(), see WideBvhKernels.h. inf - inf and NaN - NaN are both NaN
+    inline bool isFinite(float x)
+    {
+        return (x - x) == 0;
+    }
+
+    inline float dot3(const float a[3], const float b[3])
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    inline void cross3(const float a[3], const float b[3], float out[3])
+    {
+        out[0] = a[1] * b[2] - b[1] * a[2];
+        out[1] = a[2] * b[0] - b[2] * a[0];
+        out[2] = a[0] * b[1] - b[0] * a[1];
+    }
+
+    // Double-sided Moller-Trumbore. u and v are the barycentrics of v1 and v2, matching BuiltInTriangleIntersectionAttributes
+    inline bool intersectWideTriangle(const WideBvhTriangle& tri, const WideBvhRay& ray, float tMax, float& t, float& u, float& v)
+    {
+        float p[3];
+        cross3(ray.direction, tri.e2, p);
+        float det = dot3(tri.e1, p);
+        if (det == 0) return false;
+        float invDet = 1.0f / det;
+
+        float s[3] = { ray.origin[0] - tri.v0[0], ray.origin[1] - tri.v0[1], ray.origin[2] - tri.v0[2] };
+        u = dot3(s, p) * invDet;
+        if (u < 0 || u > 1) return false;
+
+        float q[3];
+        cross3(s, tri.e1, q);
+        v = dot3(ray.direction, q) * invDet;
+        if (v < 0 || u + v > 1) return false;
+
+        t = dot3(tri.e2, q) * invDet;
+        return (t >= ray.tMin && t <= tMax);
+    }
+
+    template<typename BoxTest>
+    bool traverseWideBvh(const WideBvhNode* pNodes, const WideBvhTriangle* pTriangles, const WideBvhRay& ray, bool acceptFirstHit, WideBvhHit& hit)
+    {
+        // The empty slots only miss because their bounds are infinite. A ray with an infinite or NaN component could hit them, so it always misses
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            if (isFinite(ray.origin[axis]) == false || isFinite(ray.direction[axis]) == false) return false;
+        }
+
+        const BoxTest boxTest(ray);
+        float tMax = ray.tMax;
+        bool found = false;
+
+        StackEntry stack[kWideBvhStackSize];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = { 0, 0, ray.tMin };
+
+        while (stackSize)
+        {
+            const StackEntry entry = stack[--stackSize];
+            if (entry.dist > tMax) continue;    // A closer hit was found after this entry was pushed
+
+            if (entry.triangleCount)
+            {
+                for (uint32_t i = entry.index; i < entry.index + entry.triangleCount; i++)
+                {
+                    const WideBvhTriangle& tri = pTriangles[i];
+                    float t, u, v;
+                    if (intersectWideTriangle(tri, ray, tMax, t, u, v) == false) continue;
+                    // On a tie keep the lowest geometry/primitive, so the result doesn't depend on the traversal order
+                    if (found && t == tMax && (tri.geometryIndex > hit.geometryIndex || (tri.geometryIndex == hit.geometryIndex && tri.primitiveIndex > hit.primitiveIndex))) continue;
+
+                    found = true;
+                    tMax = t;
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.geometryIndex = tri.geometryIndex;
+                    hit.primitiveIndex = tri.primitiveIndex;
+                    if (acceptFirstHit) return true;
+                }
+                continue;
+            }
+
+            const WideBvhNode& node = pNodes[entry.index];
+            float dist[kWideBvhWidth];
+            uint32_t mask = boxTest.test(node, tMax, dist);
+
+            // Sort the children that were hit from far to near, so the nearest one is on top of the stack
+            StackEntry children[kWideBvhWidth];
+            uint32_t childCount = 0;
+            while (mask)
+            {
+                uint32_t slot = firstBitIndex(mask);
+                mask &= mask - 1;
+                StackEntry child = { node.child[slot], node.triangleCount[slot], dist[slot] };
+                uint32_t j = childCount++;
+                for (; j > 0 && children[j - 1].dist < child.dist; j--) children[j] = children[j - 1];
+                children[j] = child;
+            }
+            for (uint32_t i = 0; i < childCount; i++) stack[stackSize++] = children[i];
+        }
+        return found;
+    }
+}